@@ -24,10 +24,239 @@ import line_protocol_pb2
 # baudrate for UART
 BAUDRATE = 115200
 
+# baudrate of the controller link after a reset (src/link_speed.h) + rates without baud error
+LINK_BAUDRATE = 115200
+LINK_RATES = (115200, 250000, 500000, 1000000)
+# max. wait for the ping at the new baudrate (controller falls back after LINK_CONFIRM_MS = 1 s)
+LINK_CONFIRM_S = 0.5
+
+
+def unpack_value(data, signed=False):
+    """Unpacks a value sent in 7-bit groups (LSB first, msb used as flag).
+
+    Args:
+        data (bytes): packed bytes
+        signed (bool): interpret the value as 32-bit two's complement
+    """
+    value = 0
+    for i, byte in enumerate(data):
+        value |= (byte & 0b01111111) << (7 * i)
+    value &= 0xFFFFFFFF
+    if signed and value & 0x80000000:
+        value -= 1 << 32
+    return value
+
+
+def pack_value(value, num_bytes):
+    """Packs a value into 7-bit groups (LSB first, msb set => no null bytes).
+
+    Args:
+        value (int): value (negative: two's complement of the packed bits)
+        num_bytes (int): number of packed bytes
+    """
+    value &= (1 << (7 * num_bytes)) - 1
+    return bytes(0x80 | ((value >> (7 * i)) & 0b01111111) for i in range(num_bytes))
+
+
+# texts of the ErrorCodes of an ERROR response (detail: Response.error_detail)
+ERROR_MESSAGES = {
+    line_protocol_pb2.ERR_DECODE: "Decoding of the request failed",
+    line_protocol_pb2.ERR_REQUEST_TYPE: "Request type is incorrect",
+    line_protocol_pb2.ERR_NOT_REGISTERED: "Profile is not registered",
+    line_protocol_pb2.ERR_DRIVER_MISMATCH: "Action does not match the registered driver",
+    line_protocol_pb2.ERR_TABLE_FULL: "Table is full (profiles, rules, scheduler or macro storage)",
+    line_protocol_pb2.ERR_RESOURCE_CONFLICT: "Resources are used by another profile",
+    line_protocol_pb2.ERR_NO_DRIVER: "No driver functions defined for driver %i",
+    line_protocol_pb2.ERR_INIT_FAILED: "Initialization of the driver failed",
+    line_protocol_pb2.ERR_TIMEOUT: "Timeout after %i ms",
+    line_protocol_pb2.ERR_NO_MODE: "No mode of the action selected",
+    line_protocol_pb2.ERR_ACTION_FAILED: "Action failed",
+    line_protocol_pb2.ERR_OUT_OF_RANGE: "Value is out of range",
+    line_protocol_pb2.ERR_BUSY: "Busy (step motor moving or another macro running)",
+    line_protocol_pb2.ERR_NOT_FOUND: "Not found (channel, linked profile, macro or trace chunk)",
+    line_protocol_pb2.ERR_OVERFLOW: "Response is bigger than the buffer",
+    line_protocol_pb2.ERR_TOO_LATE: "Scheduled time has already passed",
+    line_protocol_pb2.ERR_CANCELLED: "Cancelled (macro step %i)",
+    line_protocol_pb2.ERR_INVALID_RULE: "Condition %i does not fit the trigger profile",
+    line_protocol_pb2.ERR_INVALID_MACRO: "Invalid macro instruction (offset/step %i)",
+    line_protocol_pb2.ERR_MACRO_FAILED: "Action of the macro failed (step %i)",
+    line_protocol_pb2.ERR_FAST_PATH: "Fast path disabled or invalid frame (opcode %i)",
+}
+
+
+def error_text(response):
+    """Text of the ErrorCode of an ERROR response (+ text sent by a firmware built with ERROR_STRINGS).
+
+    Args:
+        response (line_protocol_pb2.Response): ERROR response
+    """
+    # pylint: disable=no-member
+    message = ERROR_MESSAGES.get(response.error, "Unknown error %i" % response.error)
+    if "%i" in message:
+        message = message % response.error_detail
+    elif response.error_detail != 0:
+        message += " (%i)" % response.error_detail
+    if len(response.payload) != 0:
+        message += ": " + response.payload.decode("utf-8")
+    return message
+
+
+# binary fast path (src/fast_path.h): first byte of a frame + opcodes
+FAST_MARKER = 0xFF
+FAST_OP_DIGITAL_WRITE = 1
+FAST_OP_DIGITAL_READ = 2
+FAST_OP_STEP_STEPS = 3
+FAST_OP_STEP_SPEED = 4
+FAST_OP_SENSOR_READ = 5
+
 
 """" ---------- Classes for profiles ---------- """
 
 
+class DeviceClock:
+    """Maps the device timestamps of the responses to the host clock.
+
+    NTP-like: every TIME_SYNC round gives a sample (t0: request sent, t1: request received,
+    t2: response sent, t3: response received), the sample with the smallest round-trip
+    delay wins. Drift is not estimated => repeat sync_clock() periodically.
+    """
+
+    def __init__(self):
+        # device time - host time [s] (None: not synchronised)
+        self.offset = None
+        # max. error of the offset [s]
+        self.error = None
+        # last response to a request: (t0, t3, timestamp, duration)
+        self.last_sample = None
+
+    def clear(self):
+        """ Drops the offset (new synchronisation) """
+        self.offset = None
+        self.error = None
+
+    def add_sample(self, t0, t3, timestamp, duration):
+        """Adds a TIME_SYNC sample.
+
+        Args:
+            t0 (float): host time when the request was sent [s]
+            t3 (float): host time when the response was received [s]
+            timestamp (int): device time when the response was sent [us]
+            duration (int): device time since the request was received [us]
+        """
+        t2 = timestamp / 1e6
+        t1 = t2 - duration / 1e6
+        delay = (t3 - t0) - (t2 - t1)
+        if self.error is None or delay / 2 < self.error:
+            self.offset = ((t1 - t0) + (t2 - t3)) / 2
+            self.error = delay / 2
+
+    def to_host(self, timestamp):
+        """ Host time [s] of a device timestamp [us] (None: not synchronised) """
+        if self.offset is None:
+            return None
+        return timestamp / 1e6 - self.offset
+
+    def to_device(self, host_time):
+        """ Device timestamp [us] of a host time [s] (None: not synchronised) """
+        if self.offset is None:
+            return None
+        return int((host_time + self.offset) * 1e6)
+
+
+class PendingRequest:
+    """Request sent with a sequence id (Controller.submit()), completed by the DATA/ERROR
+    response with the same sequence id. An ACK only marks a non-blocking action as started.
+    """
+
+    def __init__(self, seq, profile_id, sent_length):
+        self.seq = seq
+        self.profile_id = profile_id
+        self.sent_at = time.time()
+        self.sent_length = sent_length
+        self.acked = False
+        # PROGRESS responses (macros)
+        self.progress = []
+        # DATA or ERROR response
+        self.response = None
+        self.done = threading.Event()
+
+    def wait(self, timeout=None):
+        """Waits for the completion.
+
+        Returns:
+            Response: DATA or ERROR response, None on timeout
+        """
+        self.done.wait(timeout)
+        return self.response
+
+
+class MacroCode:
+    """Assembler of the macro bytecode (see macro.h): actions, delays and jumps to labels.
+
+    Example: move the conveyor until the light barrier is HIGH
+        code = MacroCode()
+        code.label("loop")
+        code.action(move_request)
+        code.action(read_barrier_request)
+        code.jump_if("loop", 1, size=1)  # digital read: level + 1
+        controller.upload_macro(1, code)
+    """
+
+    END, ACTION, DELAY, JUMP, JUMP_IF, JUMP_ERR = range(6)
+    CMP_EQ, CMP_NE, CMP_LT, CMP_GE = range(4)
+    SIZE_RAW = 0x80
+
+    def __init__(self):
+        self.code = bytearray()
+        self.labels = {}
+        # offset of a target byte -> label
+        self.fixups = {}
+
+    def label(self, name):
+        """ Marks the offset of the next instruction """
+        self.labels[name] = len(self.code)
+
+    def action(self, request):
+        """ Executes the action of the request (waits for DATA/ERROR of an acknowledged action) """
+        # pylint: disable=no-member
+        encoded = request.action.SerializeToString()
+        if len(encoded) > 0xFF:
+            raise ValueError("action is too long for a macro")
+        self.code += bytes([self.ACTION, len(encoded)]) + encoded
+
+    def delay(self, seconds):
+        """ Waits (max. 65.535 s) """
+        self.code += bytes([self.DELAY]) + int(seconds * 1000).to_bytes(2, "little")
+
+    def jump(self, label):
+        self.code += bytes([self.JUMP, 0])
+        self.fixups[len(self.code) - 1] = label
+
+    def jump_if(self, label, value, cmp=CMP_EQ, offset=0, size=2):
+        """Jumps if the DATA payload of the last action compares true.
+
+        Args:
+            value (int): compared value (16 bits)
+            cmp (int): CMP_EQ, CMP_NE, CMP_LT (payload < value) or CMP_GE
+            offset (int): offset in the payload
+            size (int): number of bytes (7-bit groups, | SIZE_RAW for raw bytes)
+        """
+        self.code += bytes([self.JUMP_IF, cmp, offset, size]) + value.to_bytes(2, "little") + bytes([0])
+        self.fixups[len(self.code) - 1] = label
+
+    def jump_err(self, label):
+        """ Jumps if the last action failed (otherwise a failed action stops the macro) """
+        self.code += bytes([self.JUMP_ERR, 0])
+        self.fixups[len(self.code) - 1] = label
+
+    def assemble(self):
+        """ Returns the bytecode with the resolved labels (END is appended) """
+        code = self.code + bytes([self.END])
+        for position, label in self.fixups.items():
+            code[position] = self.labels[label]
+        return bytes(code)
+
+
 class ProfileState(Enum):
     """Enum to define possible profile states.
 
@@ -116,11 +345,15 @@ class DigitalGeneric(Profile):
 
     def write_digital(self, output):
         """ Write digital pin to HIGH/LOW """
-        req = line_protocol_pb2.Request()
-        # pylint: disable=no-member
-        req.action.profile_id = self.profile_id
-        req.action.a_digital_generic.output = output
-        controller.send(req.SerializeToString())
+        if controller.fast_path:
+            controller.send_fast(FAST_OP_DIGITAL_WRITE, self.profile_id,
+                                 pack_value(int(output == line_protocol_pb2.HIGH), 1))
+        else:
+            req = line_protocol_pb2.Request()
+            # pylint: disable=no-member
+            req.action.profile_id = self.profile_id
+            req.action.a_digital_generic.output = output
+            controller.send(req.SerializeToString())
         if output == line_protocol_pb2.HIGH:
             logging.info(
                 " Digital pin action: HIGH sent (Profile: %i)", self.profile_id
@@ -135,11 +368,14 @@ class DigitalGeneric(Profile):
 
     def read_digital(self):
         """ Read digital pin """
-        req = line_protocol_pb2.Request()
-        # pylint: disable=no-member
-        req.action.profile_id = self.profile_id
-        req.action.a_digital_generic.event_triggered = False
-        controller.send(req.SerializeToString())
+        if controller.fast_path:
+            controller.send_fast(FAST_OP_DIGITAL_READ, self.profile_id)
+        else:
+            req = line_protocol_pb2.Request()
+            # pylint: disable=no-member
+            req.action.profile_id = self.profile_id
+            req.action.a_digital_generic.event_triggered = False
+            controller.send(req.SerializeToString())
         logging.info(
             " Digital pin action: Read pin (Profile: %i)", self.profile_id)
         self.profile_state = ProfileState.BLOCKING
@@ -263,11 +499,14 @@ class ColorSensor(Profile):
 
     def action_profile(self):
         """ Action function for color_sensor profiles """
-        req = line_protocol_pb2.Request()
-        # pylint: disable=no-member
-        req.action.profile_id = self.profile_id
-        req.action.a_color_sensor.event_triggered = False  # currently not supported
-        controller.send(req.SerializeToString())
+        if controller.fast_path:
+            controller.send_fast(FAST_OP_SENSOR_READ, self.profile_id)
+        else:
+            req = line_protocol_pb2.Request()
+            # pylint: disable=no-member
+            req.action.profile_id = self.profile_id
+            req.action.a_color_sensor.event_triggered = False  # currently not supported
+            controller.send(req.SerializeToString())
         logging.info(
             " Read request for color sensor sent (Profile: %i)", self.profile_id
         )
@@ -332,11 +571,14 @@ class UltrasonicSensor(Profile):
 
     def action_profile(self):
         """ Action function for ultrasonic_sensor profiles """
-        req = line_protocol_pb2.Request()
-        # pylint: disable=no-member
-        req.action.profile_id = self.profile_id
-        req.action.a_ultrasonic_sensor.event_triggered = False  # not supported
-        controller.send(req.SerializeToString())
+        if controller.fast_path:
+            controller.send_fast(FAST_OP_SENSOR_READ, self.profile_id)
+        else:
+            req = line_protocol_pb2.Request()
+            # pylint: disable=no-member
+            req.action.profile_id = self.profile_id
+            req.action.a_ultrasonic_sensor.event_triggered = False  # not supported
+            controller.send(req.SerializeToString())
         logging.info(
             "Ultrasonic sensor: sent action (Profile: %i)", self.profile_id)
         self.profile_state = ProfileState.BLOCKING
@@ -369,6 +611,10 @@ class StepMotor(Profile):
         Args:
             profile_id ([uint8]): unique profile id
         """
+        self.position = 0
+        self.velocity = 0
+        self.ramp_state = 0
+        self.queue_depth = 0
         super().__init__(profile_id)
 
     def register_profile(self):
@@ -383,24 +629,46 @@ class StepMotor(Profile):
 
     def set_speed(self, direction, time_min_val, wait):
         """ Action function for step_motor profiles to set the motor speed """
-        req = line_protocol_pb2.Request()
-        # pylint: disable=no-member
-        req.action.profile_id = self.profile_id
-        req.action.a_step_motor.direction = direction
-        req.action.a_step_motor.time_min_val = time_min_val
-        req.action.a_step_motor.wait = wait
-        controller.send(req.SerializeToString())
+        if controller.fast_path and not wait:
+            controller.send_fast(FAST_OP_STEP_SPEED, self.profile_id,
+                                 pack_value(direction, 1) + pack_value(time_min_val, 3))
+        else:
+            req = line_protocol_pb2.Request()
+            # pylint: disable=no-member
+            req.action.profile_id = self.profile_id
+            req.action.a_step_motor.direction = direction
+            req.action.a_step_motor.time_min_val = time_min_val
+            req.action.a_step_motor.wait = wait
+            controller.send(req.SerializeToString())
         self.profile_state = ProfileState.BLOCKING
         super().action_wait()
 
     def set_steps(self, steps, time_min_val, wait):
         """ Action function for step_motor profiles to set the motor steps """
+        if controller.fast_path and not wait:
+            controller.send_fast(FAST_OP_STEP_STEPS, self.profile_id,
+                                 pack_value(steps, 5) + pack_value(time_min_val, 3))
+        else:
+            req = line_protocol_pb2.Request()
+            # pylint: disable=no-member
+            req.action.profile_id = self.profile_id
+            req.action.a_step_motor.steps = steps
+            req.action.a_step_motor.time_min_val = time_min_val
+            req.action.a_step_motor.wait = wait
+            controller.send(req.SerializeToString())
+        self.profile_state = ProfileState.BLOCKING
+        super().action_wait()
+
+    def subscribe_telemetry(self, interval):
+        """Start (interval > 0) or stop (interval = 0) the telemetry stream.
+
+        Args:
+            interval ([uint32]): time between two telemetry messages in ms
+        """
         req = line_protocol_pb2.Request()
         # pylint: disable=no-member
         req.action.profile_id = self.profile_id
-        req.action.a_step_motor.steps = steps
-        req.action.a_step_motor.time_min_val = time_min_val
-        req.action.a_step_motor.wait = wait
+        req.action.a_step_motor.telemetry_interval = interval
         controller.send(req.SerializeToString())
         self.profile_state = ProfileState.BLOCKING
         super().action_wait()
@@ -409,10 +677,22 @@ class StepMotor(Profile):
         """Handles incoming data from actions or events.
 
         Args:
-            data ([type]): TODO: has to be defined
+            data (byte[12]): telemetry: position (5), velocity (5), ramp state (1), queue depth (1)
         """
-        # TODO: implement data handling
-        pass
+        if len(data) != 12:
+            return
+        self.position = unpack_value(data[0:5], signed=True)
+        self.velocity = unpack_value(data[5:10], signed=True)
+        self.ramp_state = unpack_value(data[10:11])
+        self.queue_depth = unpack_value(data[11:12])
+        logging.info(
+            ">> Step motor telemetry: position: %i, velocity: %i steps/s, ramp: %i, queue: %i (Profile: %i)",
+            self.position,
+            self.velocity,
+            self.ramp_state,
+            self.queue_depth,
+            self.profile_id,
+        )
 
 
 class McuDriver(Profile):
@@ -425,6 +705,10 @@ class McuDriver(Profile):
             profile_id ([uint8]): unique profile id
         """
         super().__init__(profile_id)
+        # payloads of the TRACE_DUMP chunks
+        self.trace_chunks = []
+        # last decoded STATS snapshot
+        self.stats = None
 
     def register_profile(self):
         """ Register new profile on MCU """
@@ -458,13 +742,365 @@ class McuDriver(Profile):
         self.profile_state = ProfileState.BLOCKING
         super().action_wait()
 
+    def reset(self):
+        """ Action function to reset the MCU (watchdog), the cause is reported after the boot """
+        req = line_protocol_pb2.Request()
+        # pylint: disable=no-member
+        req.action.profile_id = self.profile_id
+        req.action.a_mcu_driver.mcu_action = line_protocol_pb2.RESET
+        self.curr_request = line_protocol_pb2.RESET
+        controller.send(req.SerializeToString())
+        self.profile_state = ProfileState.BLOCKING
+        super().action_wait()
+
+    def get_reset_cause(self):
+        """ Action function to get the cause of the last reset """
+        req = line_protocol_pb2.Request()
+        # pylint: disable=no-member
+        req.action.profile_id = self.profile_id
+        req.action.a_mcu_driver.mcu_action = line_protocol_pb2.RESET_CAUSE
+        self.curr_request = line_protocol_pb2.RESET_CAUSE
+        controller.send(req.SerializeToString())
+        self.profile_state = ProfileState.BLOCKING
+        super().action_wait()
+
+    def ping(self, count=20, pipelined=True):
+        """Sends VERSION requests and logs the request rate.
+
+        Args:
+            count (int): number of requests
+            pipelined (bool): send all requests before waiting (sequence ids), otherwise stop-and-wait
+        """
+        req = line_protocol_pb2.Request()
+        # pylint: disable=no-member
+        req.action.profile_id = self.profile_id
+        req.action.a_mcu_driver.mcu_action = line_protocol_pb2.VERSION
+        start = time.time()
+        if pipelined:
+            pending = [controller.submit(req) for _ in range(count)]
+        else:
+            pending = []
+            for _ in range(count):
+                pending.append(controller.submit(req))
+                pending[-1].wait(2)
+        lost = sum(1 for request in pending if request.wait(2) is None)
+        elapsed = time.time() - start
+        logging.info(">> MCU ping (%s): %i requests in %.1f ms (%.1f requests/s, %i lost)",
+                     "pipelined" if pipelined else "stop-and-wait", count, elapsed * 1000,
+                     count / elapsed, lost)
+
+    def sync_clock(self, rounds=8):
+        """Synchronises the host clock with the device clock (TIME_SYNC), turns the
+        timestamps of all responses on.
+
+        Args:
+            rounds (int): number of TIME_SYNC requests, the one with the smallest delay is used
+        """
+        device_clock.clear()
+        for _ in range(rounds):
+            req = line_protocol_pb2.Request()
+            # pylint: disable=no-member
+            req.action.profile_id = self.profile_id
+            req.action.a_mcu_driver.mcu_action = line_protocol_pb2.TIME_SYNC
+            self.curr_request = line_protocol_pb2.TIME_SYNC
+            controller.send(req.SerializeToString())
+            self.profile_state = ProfileState.BLOCKING
+            super().action_wait()
+            if device_clock.last_sample is not None:
+                device_clock.add_sample(*device_clock.last_sample)
+        if device_clock.offset is not None:
+            logging.info(">> MCU clock: offset %.6f s (+/- %.3f ms)",
+                         device_clock.offset, device_clock.error * 1000)
+
+    def cancel_scheduled(self):
+        """ Cancels all scheduled actions (each one is completed with an ERROR) """
+        req = line_protocol_pb2.Request()
+        # pylint: disable=no-member
+        req.action.profile_id = self.profile_id
+        req.action.a_mcu_driver.mcu_action = line_protocol_pb2.CANCEL_SCHEDULED
+        self.curr_request = line_protocol_pb2.CANCEL_SCHEDULED
+        controller.send(req.SerializeToString())
+        self.profile_state = ProfileState.BLOCKING
+        super().action_wait()
+
+    def run_macro(self, macro_id):
+        """Starts a stored macro (Controller.upload_macro()) without waiting.
+
+        Returns:
+            PendingRequest: one PROGRESS per action, completed by DATA (number of steps) or ERROR
+        """
+        req = line_protocol_pb2.Request()
+        # pylint: disable=no-member
+        req.action.profile_id = self.profile_id
+        req.action.a_mcu_driver.mcu_action = line_protocol_pb2.MACRO_RUN
+        req.action.a_mcu_driver.arg = macro_id
+        return controller.submit(req)
+
+    def stop_macro(self):
+        """ Stops the running macro (its request is completed with an ERROR) """
+        req = line_protocol_pb2.Request()
+        # pylint: disable=no-member
+        req.action.profile_id = self.profile_id
+        req.action.a_mcu_driver.mcu_action = line_protocol_pb2.MACRO_STOP
+        self.curr_request = line_protocol_pb2.MACRO_STOP
+        controller.send(req.SerializeToString())
+        self.profile_state = ProfileState.BLOCKING
+        super().action_wait()
+
+    def set_timestamps(self, enabled):
+        """Turns the timestamps of all responses on/off (default: off).
+
+        Args:
+            enabled (bool): responses carry timestamp + duration
+        """
+        req = line_protocol_pb2.Request()
+        # pylint: disable=no-member
+        req.action.profile_id = self.profile_id
+        req.action.a_mcu_driver.mcu_action = line_protocol_pb2.TIMESTAMPS
+        req.action.a_mcu_driver.arg = int(enabled)
+        self.curr_request = line_protocol_pb2.TIMESTAMPS
+        controller.send(req.SerializeToString())
+        self.profile_state = ProfileState.BLOCKING
+        super().action_wait()
+
+    def enable_fast_path(self):
+        """ Action function to turn on the binary fast path frames of the firmware """
+        req = line_protocol_pb2.Request()
+        # pylint: disable=no-member
+        req.action.profile_id = self.profile_id
+        req.action.a_mcu_driver.mcu_action = line_protocol_pb2.FAST_PATH
+        req.action.a_mcu_driver.arg = 1
+        self.curr_request = line_protocol_pb2.FAST_PATH
+        controller.send(req.SerializeToString())
+        self.profile_state = ProfileState.BLOCKING
+        super().action_wait()
+
+    def get_drivers(self):
+        """ Action function to get the drivers compiled into the firmware (stored in self.drivers) """
+        req = line_protocol_pb2.Request()
+        # pylint: disable=no-member
+        req.action.profile_id = self.profile_id
+        req.action.a_mcu_driver.mcu_action = line_protocol_pb2.DRIVERS
+        self.curr_request = line_protocol_pb2.DRIVERS
+        controller.send(req.SerializeToString())
+        self.profile_state = ProfileState.BLOCKING
+        super().action_wait()
+
+    def set_baudrate(self, baudrate, persist=False):
+        """Negotiates a new baudrate of the controller link (src/link_speed.h): the controller
+        answers at the current rate and switches, the gateway pings at the new rate and confirms
+        the switch once the ping was answered. Without the ping reply both sides fall back to the
+        current rate, a confirmation without reply is retried at the new rate.
+
+        Args:
+            baudrate (int): one of LINK_RATES
+            persist (bool): controller starts with the baudrate after a reset
+
+        Returns:
+            bool: True if the controller runs at the new baudrate
+        """
+        req = line_protocol_pb2.Request()
+        # pylint: disable=no-member
+        req.action.profile_id = self.profile_id
+        req.action.a_mcu_driver.mcu_action = line_protocol_pb2.BAUD
+        req.action.a_mcu_driver.arg = baudrate
+        response = controller.submit(req).wait(LINK_CONFIRM_S)
+        if response is None or response.code != line_protocol_pb2.DATA:
+            logging.warning(">> MCU baudrate %i rejected", baudrate)
+            return False
+
+        previous = controller.serial.baudrate
+        controller.serial.baudrate = baudrate
+        response = controller.submit(req).wait(LINK_CONFIRM_S)
+        if response is None or response.code != line_protocol_pb2.DATA:
+            controller.serial.baudrate = previous
+            logging.warning(">> MCU baudrate %i not confirmed, back to %i", baudrate, previous)
+            return False
+
+        # confirmation: the controller keeps its fallback until it is received
+        for _ in range(2):
+            response = controller.submit(req).wait(LINK_CONFIRM_S)
+            if response is not None and response.code == line_protocol_pb2.DATA:
+                break
+        else:
+            controller.serial.baudrate = previous
+            logging.warning(">> MCU baudrate %i: no answer to the confirmation, back to %i", baudrate, previous)
+            return False
+        logging.info(">> MCU baudrate: %i", baudrate)
+
+        if persist:
+            req.action.a_mcu_driver.mcu_action = line_protocol_pb2.BAUD_PERSIST
+            req.action.a_mcu_driver.arg = 1
+            response = controller.submit(req).wait(LINK_CONFIRM_S)
+            return response is not None and response.code == line_protocol_pb2.DATA
+        return True
+
+    def get_stats(self):
+        """ Action function to get the performance counters of the firmware """
+        req = line_protocol_pb2.Request()
+        # pylint: disable=no-member
+        req.action.profile_id = self.profile_id
+        req.action.a_mcu_driver.mcu_action = line_protocol_pb2.STATS
+        self.curr_request = line_protocol_pb2.STATS
+        controller.send(req.SerializeToString())
+        self.profile_state = ProfileState.BLOCKING
+        super().action_wait()
+
+    def measure_stack(self, run, *args):
+        """Max. stack of the firmware while run(*args) is executed, e.g. one request of a driver
+        (the counters are cleared => the free stack is painted again before).
+
+        Args:
+            run (callable): sends the requests to measure, e.g. profile.read_digital
+
+        Returns:
+            int: max. stack [B] (None: no snapshot received)
+        """
+        self.reset_stats()
+        run(*args)
+        self.stats = None
+        self.get_stats()
+        if self.stats is None:
+            return None
+        logging.info(">> MCU stack of %s: %i B", getattr(run, "__name__", "requests"), self.stats["stack_max"])
+        return self.stats["stack_max"]
+
+    def reset_stats(self):
+        """ Action function to clear the performance counters of the firmware """
+        req = line_protocol_pb2.Request()
+        # pylint: disable=no-member
+        req.action.profile_id = self.profile_id
+        req.action.a_mcu_driver.mcu_action = line_protocol_pb2.RESET_STATS
+        self.curr_request = line_protocol_pb2.RESET_STATS
+        controller.send(req.SerializeToString())
+        self.profile_state = ProfileState.BLOCKING
+        super().action_wait()
+
+    def dump_trace(self, path):
+        """Reads all chunks of the trace buffer (firmware built with TRACE_ENABLED)
+        and stores them in a file for tools/trace/trace_to_chrome.
+
+        Args:
+            path (str): dump file
+        """
+        self.trace_chunks = []
+        chunk = 0
+        num_chunks = 1
+        while chunk < num_chunks:
+            req = line_protocol_pb2.Request()
+            # pylint: disable=no-member
+            req.action.profile_id = self.profile_id
+            req.action.a_mcu_driver.mcu_action = line_protocol_pb2.TRACE_DUMP
+            req.action.a_mcu_driver.arg = chunk
+            self.curr_request = line_protocol_pb2.TRACE_DUMP
+            controller.send(req.SerializeToString())
+            self.profile_state = ProfileState.BLOCKING
+            super().action_wait()
+            # the state is updated before the data handler stores the chunk
+            while len(self.trace_chunks) <= chunk:
+                time.sleep(0.01)
+            # header: version (1 byte), chunk (3 bytes), number of chunks (3 bytes)
+            num_chunks = unpack_value(self.trace_chunks[chunk][4:7])
+            chunk += 1
+        with open(path, "wb") as dump:
+            dump.write(b"".join(self.trace_chunks))
+        logging.info(">> MCU trace: %i chunks stored in %s", num_chunks, path)
+
+    @staticmethod
+    def decode_stats(data):
+        """Decodes the snapshot of the performance counters (layout: src/perf_counters.h).
+
+        Args:
+            data (bytes): payload of the STATS response
+
+        Returns:
+            dict: counters, None if the layout version is unknown
+        """
+        pos = 0
+
+        def take(num_bytes):
+            nonlocal pos
+            value = unpack_value(data[pos:pos + num_bytes])
+            pos += num_bytes
+            return value
+
+        if take(1) != 1:
+            return None
+        stats = {"elapsed_ms": take(5), "loop_count": take(5),
+                 "loop_max_us": take(5), "loop_avg_us": take(5)}
+        stats["loop_histogram"] = [take(5) for _ in range(8)]
+        stats["requests_decoded"] = take(5)
+        stats["requests_failed"] = take(5)
+        stats["isr_count"] = take(5)
+        stats["isr_time_us"] = take(5)
+        stats["isr_max_us"] = take(5)
+        stats["rx_high_water"] = take(3)
+        stats["tx_high_water"] = take(3)
+        stats["stack_max"] = take(3)
+        stats["free_memory"] = take(3)
+        # drivers in the order of the oneof (= order of the driver table)
+        # pylint: disable=no-member
+        names = [field.name[2:] for field in
+                 line_protocol_pb2.Action.DESCRIPTOR.oneofs_by_name["driver"].fields]
+        stats["drivers"] = {}
+        for index in range(take(1)):
+            name = names[index] if index < len(names) else "driver%i" % index
+            stats["drivers"][name] = (take(5), take(5))
+        return stats
+
     def data_handler(self, data):
         """Handles incoming data from actions or events.
 
         Args:
             data ([type]): TODO: has to be defined
         """
-        if self.curr_request == line_protocol_pb2.VERSION:
+        if self.curr_request == line_protocol_pb2.STATS:
+            stats = self.decode_stats(data)
+            if stats is None:
+                logging.warning(">> MCU stats: unknown snapshot version")
+                return
+            self.stats = stats
+            elapsed_s = max(stats["elapsed_ms"], 1) / 1000
+            logging.info(">> MCU stats (%.1f s): %.1f loops/s, loop avg %i us, max %i us",
+                         elapsed_s, stats["loop_count"] / elapsed_s,
+                         stats["loop_avg_us"], stats["loop_max_us"])
+            logging.info(">> MCU stats: loop histogram (<128us * 4^i) %s", stats["loop_histogram"])
+            logging.info(">> MCU stats: requests %i decoded, %i failed",
+                         stats["requests_decoded"], stats["requests_failed"])
+            logging.info(">> MCU stats: ISR %i calls, %i us, max %i us",
+                         stats["isr_count"], stats["isr_time_us"], stats["isr_max_us"])
+            logging.info(">> MCU stats: serial high-water RX %i B, TX %i B, stack max %i B, free %i B",
+                         stats["rx_high_water"], stats["tx_high_water"],
+                         stats["stack_max"], stats["free_memory"])
+            for name, (actions, time_us) in stats["drivers"].items():
+                if actions > 0:
+                    logging.info(">> MCU stats: %s %i actions, avg %i us",
+                                 name, actions, time_us // actions)
+        elif self.curr_request == line_protocol_pb2.RESET_STATS:
+            logging.info(">> MCU stats cleared")
+        elif self.curr_request == line_protocol_pb2.TRACE_DUMP:
+            self.trace_chunks.append(bytes(data))
+        elif self.curr_request == line_protocol_pb2.RESET_CAUSE:
+            # MCUSR flags (src/watchdog.h)
+            flags = unpack_value(data)
+            causes = [name for bit, name in ((0x80, "requested"), (0x08, "watchdog"), (0x04, "brown-out"),
+                                             (0x02, "external"), (0x01, "power-on")) if flags & bit]
+            logging.info(">> MCU reset cause: %s (0x%02X)", ", ".join(causes) or "unknown", flags)
+        elif self.curr_request == line_protocol_pb2.FAST_PATH:
+            controller.fast_path = True
+            logging.info(">> MCU fast path enabled (version %i, %i opcodes)",
+                         unpack_value(data[0:1]), unpack_value(data[1:2]))
+        elif self.curr_request == line_protocol_pb2.DRIVERS:
+            # bit i: driver i of the oneof (= order of the driver table)
+            # pylint: disable=no-member
+            names = [field.name[2:] for field in
+                     line_protocol_pb2.Action.DESCRIPTOR.oneofs_by_name["driver"].fields]
+            count = unpack_value(data[0:1])
+            mask = unpack_value(data[1:])
+            self.drivers = [names[i] if i < len(names) else "driver%i" % i
+                            for i in range(count) if mask & (1 << i)]
+            logging.info(">> MCU drivers: %s", ", ".join(self.drivers))
+        elif self.curr_request == line_protocol_pb2.VERSION:
             logging.info(">> MCU firmware version: %s", data.decode("utf-8"))
         elif self.curr_request == line_protocol_pb2.RAM:
             # first bit is used as flag to avoid null bytes
@@ -476,6 +1112,290 @@ class McuDriver(Profile):
                          '='*int(round(percentage/10)),
                          ' '*(10-int(round(percentage/10))),
                          percentage, used_space, ram_space)
+
+
+class AnalogGeneric(Profile):
+    """ Profile for analog_generic driver (ADC channel sampled continuously by the firmware) """
+
+    def __init__(self, profile_id, channel, extra_bits=0):
+        """The constructor creates an instance of a analog_generic profile.
+
+        Args:
+            profile_id ([uint8]): unique profile id
+            channel ([int]): ADC channel (0 - 15 => A0 - A15)
+            extra_bits ([int]): oversampling: 4^extra_bits conversions per value => 10 + extra_bits bits (0 - 3)
+        """
+        self.channel = channel
+        self.extra_bits = extra_bits
+        self.value = 0
+        # stream: value period [us] (None: no stream), received values
+        self.period_us = None
+        self.samples = []
+        super().__init__(profile_id)
+
+    def register_profile(self):
+        """ Register new profile on MCU """
+        req = line_protocol_pb2.Request()
+        # pylint: disable=no-member
+        req.registration.profile_id = self.profile_id
+        req.registration.r_analog_generic.channel = self.channel
+        req.registration.r_analog_generic.extra_bits = self.extra_bits
+        controller.send(req.SerializeToString())
+        logging.info(" Registration sent for Profile: %i", self.profile_id)
+        super().register_wait()
+
+    def read(self):
+        """ Newest value of the channel """
+        req = line_protocol_pb2.Request()
+        # pylint: disable=no-member
+        req.action.profile_id = self.profile_id
+        req.action.a_analog_generic.read = True
+        controller.send(req.SerializeToString())
+        self.profile_state = ProfileState.BLOCKING
+        super().action_wait()
+        return self.value
+
+    def read_event_threshold(self, above=None, below=None):
+        """Start event listening: DATA once a value is above/below the threshold.
+
+        Args:
+            above ([int]): threshold for values rising above it
+            below ([int]): threshold for values falling below it
+        """
+        req = line_protocol_pb2.Request()
+        # pylint: disable=no-member
+        req.action.profile_id = self.profile_id
+        if above is not None:
+            req.action.a_analog_generic.above = above
+        else:
+            req.action.a_analog_generic.below = below
+        controller.send(req.SerializeToString())
+        self.profile_state = ProfileState.BLOCKING
+        super().action_wait()
+
+    def stream(self, block):
+        """Start (block > 0) or stop (block = 0) the stream of values.
+
+        Args:
+            block ([int]): values per DATA message (max. ANALOG_RING_SIZE = 32)
+        """
+        req = line_protocol_pb2.Request()
+        # pylint: disable=no-member
+        req.action.profile_id = self.profile_id
+        req.action.a_analog_generic.stream_block = block
+        self.period_us = None if block == 0 else 0
+        controller.send(req.SerializeToString())
+        self.profile_state = ProfileState.BLOCKING
+        super().action_wait()
+
+    def data_handler(self, data):
+        """Handles incoming data from actions or events.
+
+        Args:
+            data (bytes): value (2), stream start: value period [us] (4),
+                stream block: lost values (2) + values (2 each)
+        """
+        if self.period_us == 0:
+            self.period_us = unpack_value(data[0:4])
+            logging.info(">> Analog stream: one value every %i us (Profile: %i)",
+                         self.period_us, self.profile_id)
+        elif self.period_us is not None:
+            lost = unpack_value(data[0:2])
+            values = [unpack_value(data[i:i + 2]) for i in range(2, len(data), 2)]
+            self.samples.extend(values)
+            if lost != 0:
+                logging.warning(">> Analog stream: %i values lost (Profile: %i)", lost, self.profile_id)
+        else:
+            self.value = unpack_value(data[0:2])
+            logging.info(">> Analog DATA: %i (Profile: %i)", self.value, self.profile_id)
+
+
+class PwmGeneric(Profile):
+    """ Profile for pwm_generic driver (PWM/servo outputs of a 16-bit timer) """
+
+    def __init__(self, profile_id, timer, channels, frequency, resolution):
+        """The constructor creates an instance of a pwm_generic profile.
+
+        Args:
+            profile_id ([uint8]): unique profile id
+            timer ([int]): 16-bit timer (1, 3 or 5), used only by this profile
+            channels ([int]): used outputs (bit 0: A, bit 1: B, bit 2: C)
+            frequency ([int]): PWM frequency [Hz] (servos: 50)
+            resolution ([int]): bits of the duty cycle (1 - 16)
+        """
+        self.timer = timer
+        self.channels = channels
+        self.frequency = frequency
+        self.resolution = resolution
+        super().__init__(profile_id)
+
+    def register_profile(self):
+        """ Register new profile on MCU """
+        req = line_protocol_pb2.Request()
+        # pylint: disable=no-member
+        req.registration.profile_id = self.profile_id
+        req.registration.r_pwm_generic.timer = self.timer
+        req.registration.r_pwm_generic.channels = self.channels
+        req.registration.r_pwm_generic.frequency = self.frequency
+        req.registration.r_pwm_generic.resolution = self.resolution
+        controller.send(req.SerializeToString())
+        logging.info(" Registration sent for Profile: %i", self.profile_id)
+        super().register_wait()
+
+    def set_duty(self, channel, duty, ramp_ms=0):
+        """Set the duty cycle of a channel (ramp: ACK now, DATA at the end of the ramp).
+
+        Args:
+            channel ([int]): output compare channel (0: A, 1: B, 2: C)
+            duty ([int]): duty cycle (0 - 2^resolution - 1)
+            ramp_ms ([int]): ramp from the current duty cycle [ms] (0: immediately)
+        """
+        req = line_protocol_pb2.Request()
+        # pylint: disable=no-member
+        req.action.profile_id = self.profile_id
+        req.action.a_pwm_generic.channel = channel
+        req.action.a_pwm_generic.duty = duty
+        req.action.a_pwm_generic.ramp_ms = ramp_ms
+        controller.send(req.SerializeToString())
+        self.profile_state = ProfileState.BLOCKING
+        super().action_wait()
+
+    def set_pulse(self, channel, pulse_us, ramp_ms=0):
+        """Set the pulse width of a channel, e.g. servo position (ramp: ACK now, DATA at the end of the ramp).
+
+        Args:
+            channel ([int]): output compare channel (0: A, 1: B, 2: C)
+            pulse_us ([int]): pulse width [us] (servos: 1000 - 2000)
+            ramp_ms ([int]): ramp from the current pulse width [ms] (0: immediately)
+        """
+        req = line_protocol_pb2.Request()
+        # pylint: disable=no-member
+        req.action.profile_id = self.profile_id
+        req.action.a_pwm_generic.channel = channel
+        req.action.a_pwm_generic.pulse_us = pulse_us
+        req.action.a_pwm_generic.ramp_ms = ramp_ms
+        controller.send(req.SerializeToString())
+        self.profile_state = ProfileState.BLOCKING
+        super().action_wait()
+
+    def data_handler(self, data):
+        """Handles incoming data from actions or events.
+
+        Args:
+            data (bytes): channel (1) which reached its new value
+        """
+        logging.info(">> PWM channel %i set (Profile: %i)", unpack_value(data[0:1]), self.profile_id)
+
+
+class EncoderGeneric(Profile):
+    """ Profile for encoder_generic driver (quadrature encoder on external interrupt pins) """
+
+    def __init__(self, profile_id, pin_a, pin_b, step_profile_id=0, ratio_counts=0, ratio_steps=0):
+        """The constructor creates an instance of a encoder_generic profile.
+
+        Args:
+            profile_id ([uint8]): unique profile id
+            pin_a ([int]): input A, external interrupt pin (21, 20, 19, 18, 2, 3)
+            pin_b ([int]): input B, external interrupt pin (21, 20, 19, 18, 2, 3)
+            step_profile_id ([uint8]): linked step motor profile for the following error (0: none)
+            ratio_counts ([int]): encoder counts per ratio_steps motor steps
+            ratio_steps ([int]): motor steps per ratio_counts encoder counts
+        """
+        self.pin_a = pin_a
+        self.pin_b = pin_b
+        self.step_profile_id = step_profile_id
+        self.ratio_counts = ratio_counts
+        self.ratio_steps = ratio_steps
+        self.position = 0
+        self.velocity = 0
+        self.errors = 0
+        super().__init__(profile_id)
+
+    def register_profile(self):
+        """ Register new profile on MCU """
+        req = line_protocol_pb2.Request()
+        # pylint: disable=no-member
+        req.registration.profile_id = self.profile_id
+        req.registration.r_encoder_generic.pin_a = self.pin_a
+        req.registration.r_encoder_generic.pin_b = self.pin_b
+        req.registration.r_encoder_generic.step_profile_id = self.step_profile_id
+        req.registration.r_encoder_generic.ratio_counts = self.ratio_counts
+        req.registration.r_encoder_generic.ratio_steps = self.ratio_steps
+        controller.send(req.SerializeToString())
+        logging.info(" Registration sent for Profile: %i", self.profile_id)
+        super().register_wait()
+
+    def read(self):
+        """ Position [counts], velocity [counts/s] + missed edges of the encoder """
+        req = line_protocol_pb2.Request()
+        # pylint: disable=no-member
+        req.action.profile_id = self.profile_id
+        req.action.a_encoder_generic.read = True
+        controller.send(req.SerializeToString())
+        self.profile_state = ProfileState.BLOCKING
+        super().action_wait()
+        return self.position, self.velocity
+
+    def read_event_position(self, above=None, below=None):
+        """Start event listening: DATA once the position is above/below the threshold.
+
+        Args:
+            above ([int]): threshold for a position rising above it
+            below ([int]): threshold for a position falling below it
+        """
+        req = line_protocol_pb2.Request()
+        # pylint: disable=no-member
+        req.action.profile_id = self.profile_id
+        if above is not None:
+            req.action.a_encoder_generic.above = above
+        else:
+            req.action.a_encoder_generic.below = below
+        controller.send(req.SerializeToString())
+        self.profile_state = ProfileState.BLOCKING
+        super().action_wait()
+
+    def follow_error(self, max_error=None):
+        """Following error to the linked step motor [counts].
+
+        Args:
+            max_error ([int]): None: read the error now, else: DATA once |error| > max_error (belt slip)
+        """
+        req = line_protocol_pb2.Request()
+        # pylint: disable=no-member
+        req.action.profile_id = self.profile_id
+        if max_error is None:
+            req.action.a_encoder_generic.follow_error = True
+        else:
+            req.action.a_encoder_generic.max_error = max_error
+        controller.send(req.SerializeToString())
+        self.profile_state = ProfileState.BLOCKING
+        super().action_wait()
+
+    def reset(self):
+        """ Position + following error = 0 """
+        req = line_protocol_pb2.Request()
+        # pylint: disable=no-member
+        req.action.profile_id = self.profile_id
+        req.action.a_encoder_generic.reset = True
+        controller.send(req.SerializeToString())
+        self.profile_state = ProfileState.BLOCKING
+        super().action_wait()
+
+    def data_handler(self, data):
+        """Handles incoming data from actions or events.
+
+        Args:
+            data (bytes): read: position (5) + velocity (5) + missed edges (2),
+                events/following error: position or following error (5), reset: empty
+        """
+        if len(data) == 12:
+            self.position = unpack_value(data[0:5], signed=True)
+            self.velocity = unpack_value(data[5:10], signed=True)
+            self.errors = unpack_value(data[10:12])
+            logging.info(">> Encoder: position %i, velocity %i counts/s, %i missed edges (Profile: %i)",
+                         self.position, self.velocity, self.errors, self.profile_id)
+        elif len(data) == 5:
+            logging.info(">> Encoder DATA: %i (Profile: %i)", unpack_value(data, signed=True), self.profile_id)
 # ADI-PY-Profile: Label for automatic driver initialization (Do not move!)
 
 
@@ -486,20 +1406,61 @@ class ControllerPacketHandler(serial.threaded.Packetizer):
     """Callback for received packet"""
 
     def handle_packet(self, packet):
+        received_at = time.time()
         response = line_protocol_pb2.Response()
-        response.ParseFromString(packet)
         # pylint: disable=no-member
+        if packet[0] == FAST_MARKER:
+            # fast frame: marker, code, profile_id (2), payload
+            response.code = packet[1] & 0b01111111
+            response.profile_id = unpack_value(packet[2:4])
+            if response.code == line_protocol_pb2.ERROR:
+                response.error = unpack_value(packet[4:5])
+                response.error_detail = unpack_value(packet[5:10])
+            else:
+                response.payload = bytes(packet[4:])
+        else:
+            response.ParseFromString(packet)
+
+        # responses to requests with sequence id (Controller.submit())
+        if response.seq != 0:
+            pending = controller.in_flight.get(response.seq)
+            if pending is None:
+                logging.warning(">> Profile: %i response for unknown request %i (code %i)",
+                                response.profile_id, response.seq, response.code)
+                return
+            if response.timestamp != 0:
+                self.log_timing(response, len(packet), received_at, pending.sent_at, pending.sent_length)
+            if response.code == line_protocol_pb2.ACK:
+                pending.acked = True
+            elif response.code == line_protocol_pb2.PROGRESS:
+                pending.progress.append(response)
+                self.log_progress(response)
+            elif response.code in (line_protocol_pb2.DATA, line_protocol_pb2.ERROR):
+                if response.code == line_protocol_pb2.ERROR:
+                    logging.error(">> Profile: %i request %i %s", response.profile_id,
+                                  response.seq, error_text(response))
+                del controller.in_flight[response.seq]
+                pending.response = response
+                pending.done.set()
+            return
+
+        if response.timestamp != 0:
+            self.log_timing(response, len(packet), received_at,
+                            controller.sent_at, controller.sent_length)
 
         # print entire msg for debugging
         # print(response.__str__())
         if response.code == line_protocol_pb2.DEBUG:
             logging.debug(">> %s", response.payload.decode("utf-8"))
 
+        elif response.code == line_protocol_pb2.PROGRESS:
+            self.log_progress(response)
+
         elif response.code == line_protocol_pb2.ERROR:
             logging.error(
                 ">> Profile: %i %s",
                 response.profile_id,
-                response.payload.decode("utf-8")
+                error_text(response)
             )
         elif response.code == line_protocol_pb2.ACK:
             profile = profiles.get_profile(response.profile_id)
@@ -531,33 +1492,188 @@ class ControllerPacketHandler(serial.threaded.Packetizer):
                     logging.info(
                         ">> Empty event DATA for profile: %s received", response.profile_id
                     )
+            elif profile.profile_state == ProfileState.IDLE:
+                """ streamed DATA (e.g. step motor telemetry) """
+                if not len(response.payload) == 0:
+                    profile.data_handler(response.payload)
+
+    @staticmethod
+    def log_progress(response):
+        """ Logs the PROGRESS of a macro: macro_id, step, next instruction, response code of the action """
+        payload = response.payload
+        macro_id, step, pc = (unpack_value(payload[i:i + 2]) for i in (0, 2, 4))
+        logging.info(">> Macro %i step %i (%s), next instruction at %i", macro_id, step,
+                     line_protocol_pb2.ResponseCode.Name(unpack_value(payload[6:7])), pc)
+
+    @staticmethod
+    def log_timing(response, length, received_at, sent_at, sent_length):
+        """Logs the latency of a response to a request, or the host time of an event.
+
+        Latency: execution (duration on the device) + transmission (request + response
+        on the wire) + queueing (rest: host/USB buffers, loop() of the firmware)
+        """
+        if response.duration != 0:
+            device_clock.last_sample = (sent_at, received_at, response.timestamp, response.duration)
+            total = received_at - sent_at
+            execution = response.duration / 1e6
+            transmission = (sent_length + length + 1) * 10 / controller.serial.baudrate
+            logging.debug(">> Profile: %i latency %.2f ms (execution %.2f ms, transmission %.2f ms, queueing %.2f ms)",
+                          response.profile_id, total * 1000, execution * 1000, transmission * 1000,
+                          (total - execution - transmission) * 1000)
+        else:
+            host_time = device_clock.to_host(response.timestamp)
+            if host_time is not None:
+                logging.debug(">> Profile: %i event at %.6f (%.2f ms ago)", response.profile_id,
+                              host_time, (received_at - host_time) * 1000)
 
 
 class Controller(serial.threaded.ReaderThread):
     """"""
 
-    def __init__(self, serial_device, event_handler):
+    def __init__(self, serial_device, event_handler, baudrate=LINK_BAUDRATE):
         """
         The constructor creates a serial instance for given dev/url with a preset option
         :param serial_device: device or url for the serial interface
         :param event_handler: event handler of class ControllerHandler
+        :param baudrate: baudrate of the link (stored rate of the controller, see McuDriver.set_baudrate())
         """
         serial_instance = serial.serial_for_url(
-            serial_device, baudrate=115200, timeout=1
+            serial_device, baudrate=baudrate, timeout=1
         )
         super(Controller, self).__init__(serial_instance, event_handler)
+        # host time + length (incl. terminator) of the last request (latency of the responses)
+        self.sent_at = 0
+        self.sent_length = 0
+        # requests with sequence id waiting for DATA/ERROR: seq -> PendingRequest
+        self.in_flight = {}
+        self.next_seq = 1
+        # fast path frames enabled (McuDriver.enable_fast_path())
+        self.fast_path = False
 
     def send(self, protobuf):
         """ send the given protobuf message """
+        self.sent_at = time.time()
+        self.sent_length = len(protobuf) + 1
         self.serial.write(protobuf)
         self.serial.write(b"\0")
         return
 
+    def send_fast(self, opcode, profile_id, args=b""):
+        """Sends a fast path frame (src/fast_path.h), the response is a fast frame as well.
+
+        Args:
+            opcode (int): FAST_OP_*
+            profile_id (int): profile of the action
+            args (bytes): packed arguments of the opcode (pack_value())
+        """
+        self.send(bytes([FAST_MARKER, 0x80 | opcode]) + pack_value(profile_id, 2) + args)
+
+    def submit(self, request):
+        """Sends a request with a new sequence id without waiting (pipelining).
+
+        Args:
+            request (line_protocol_pb2.Request): request (seq is overwritten)
+
+        Returns:
+            PendingRequest: completed by the response with the same sequence id
+        """
+        request.seq = self.next_seq
+        # sequence ids are uint32, 0 is reserved for requests without sequence id
+        self.next_seq = self.next_seq % 0xFFFFFFFF + 1
+        protobuf = request.SerializeToString()
+        # pylint: disable=no-member
+        if request.HasField("action"):
+            profile_id = request.action.profile_id
+        elif request.HasField("rule"):
+            profile_id = request.rule.trigger_profile_id
+        elif request.HasField("macro"):
+            profile_id = request.macro.macro_id
+        else:
+            profile_id = request.registration.profile_id
+        pending = PendingRequest(request.seq, profile_id, len(protobuf) + 1)
+        self.in_flight[request.seq] = pending
+        self.send(protobuf)
+        return pending
+
+    def set_rule(self, rule_id, trigger_profile_id, action, notify=False, **condition):
+        """Stores a reflex rule in the firmware: the condition on the trigger profile
+        executes the action without a trip to the gateway.
+
+        Example: stop the conveyor (profile 7) when the light barrier (profile 3) goes HIGH
+            controller.set_rule(1, 3, stop_request, level=line_protocol_pb2.HIGH)
+
+        Args:
+            rule_id (int): unique id (a rule with the same id is replaced)
+            trigger_profile_id (int): profile of the condition
+            action (line_protocol_pb2.Request): request with the action (None deletes the rule)
+            notify (bool): the firmware sends the responses of the action to the gateway
+            condition: one of level, distance_below, dominant_channel, reply_prefix
+
+        Returns:
+            PendingRequest: completed by DATA (rule stored) or ERROR
+        """
+        req = line_protocol_pb2.Request()
+        # pylint: disable=no-member
+        req.rule.rule_id = rule_id
+        req.rule.trigger_profile_id = trigger_profile_id
+        for name, value in condition.items():
+            setattr(req.rule, name, value)
+        if action is not None:
+            req.rule.action.CopyFrom(action.action)
+        req.rule.notify = notify
+        return self.submit(req)
+
+    def upload_macro(self, macro_id, code, name="", persist=False):
+        """Stores a macro in the firmware (started with McuDriver.run_macro()).
+
+        Args:
+            macro_id (int): unique id < 256 (a macro with the same id is replaced)
+            code (MacroCode): bytecode (None deletes the macro)
+            name (str): name (max. 11 characters)
+            persist (bool): the macro survives a reset, otherwise it is deleted at boot
+
+        Returns:
+            PendingRequest: completed by DATA (macro stored) or ERROR
+        """
+        req = line_protocol_pb2.Request()
+        # pylint: disable=no-member
+        req.macro.macro_id = macro_id
+        req.macro.name = name
+        if code is not None:
+            req.macro.code = code.assemble()
+        req.macro.persist = persist
+        return self.submit(req)
+
+    def schedule(self, request, at=None, delay=None):
+        """Sends an action which is executed by the firmware at a host time (clock
+        synchronised with McuDriver.sync_clock()) or after a delay. The ACK arrives now,
+        DATA/ERROR when the action was executed.
+
+        Args:
+            request (line_protocol_pb2.Request): action request
+            at (float): host time of the execution [s] (time.time())
+            delay (float): delay of the execution after the reception [s]
+
+        Returns:
+            PendingRequest: completed by the response of the executed action
+        """
+        # pylint: disable=no-member
+        if at is not None:
+            at_us = device_clock.to_device(at)
+            if at_us is None:
+                raise RuntimeError("device clock is not synchronised (sync_clock())")
+            request.action.at_us = at_us
+        else:
+            request.action.delay_us = int(delay * 1e6)
+        return self.submit(request)
+
 
 """" ---------- Profile creations ---------- """
 
 # create list of all profiles
 profiles = ProfileManager()
+# device clock (MCUAction TIME_SYNC)
+device_clock = DeviceClock()
 
 # define used Profile IDs (div: green will change to blue)
 mcu_driver_id = 0
@@ -0,0 +1,40 @@
+#ifndef _NATIVE_HAL_ADAFRUIT_TCS34725_H_
+#define _NATIVE_HAL_ADAFRUIT_TCS34725_H_
+
+/*
+    Simulated TCS34725 color sensor: returns the raw values set with hal_set_color().
+*/
+
+#include <Arduino.h>
+
+#define TCS34725_ADDRESS 0x29
+
+#define TCS34725_CDATAL 0x14
+#define TCS34725_RDATAL 0x16
+#define TCS34725_GDATAL 0x18
+#define TCS34725_BDATAL 0x1A
+
+#define TCS34725_INTEGRATIONTIME_2_4MS 0xFF
+#define TCS34725_INTEGRATIONTIME_50MS 0xEB
+#define TCS34725_INTEGRATIONTIME_700MS 0x00
+
+#define TCS34725_GAIN_1X 0x00
+#define TCS34725_GAIN_4X 0x01
+#define TCS34725_GAIN_16X 0x02
+#define TCS34725_GAIN_60X 0x03
+
+class Adafruit_TCS34725
+{
+public:
+    Adafruit_TCS34725(uint8_t integration_time = TCS34725_INTEGRATIONTIME_2_4MS, uint8_t gain = TCS34725_GAIN_1X);
+
+    // false if no sensor is simulated (see hal_set_color())
+    bool begin();
+    void enable();
+    void disable();
+    uint8_t read8(uint8_t reg);
+    uint16_t read16(uint8_t reg);
+    void getRawData(uint16_t *r, uint16_t *g, uint16_t *b, uint16_t *c);
+};
+
+#endif
@@ -0,0 +1,160 @@
+#ifndef _NATIVE_HAL_ARDUINO_H_
+#define _NATIVE_HAL_ARDUINO_H_
+
+/*
+    Arduino API of the simulated HAL (env:native).
+    Only the parts used by the controller firmware are provided.
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+
+#include <avr/io.h>
+#include <avr/pgmspace.h>
+#include <avr/interrupt.h>
+
+/*========================================================================*/
+/*                          PUBLIC DEFINITIONS                            */
+/*========================================================================*/
+
+typedef uint8_t byte;
+typedef bool boolean;
+typedef uint16_t word;
+
+#define HIGH 0x1
+#define LOW 0x0
+
+#define INPUT 0x0
+#define OUTPUT 0x1
+#define INPUT_PULLUP 0x2
+
+#define CHANGE 1
+#define FALLING 2
+#define RISING 3
+
+#define B10000000 128
+
+/* Pins of the ATmega2560 (Arduino Mega) */
+#define NUM_DIGITAL_PINS 70
+#define A0 54
+#define A1 55
+#define A2 56
+#define A3 57
+#define A4 58
+#define A5 59
+#define A6 60
+#define A7 61
+#define A8 62
+#define A9 63
+#define A10 64
+#define A11 65
+#define A12 66
+#define A13 67
+#define A14 68
+#define A15 69
+
+#define SERIAL_8N1 0x06
+
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+#define bit(b) (1UL << (b))
+#define bitRead(value, bit) (((value) >> (bit)) & 0x01)
+#define digitalPinToInterrupt(p) (p)
+
+#define noInterrupts() cli()
+#define interrupts() sei()
+
+/*========================================================================*/
+/*                          PUBLIC FUNCTIONS                              */
+/*========================================================================*/
+
+/* Pins */
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+int analogRead(uint8_t pin);
+unsigned long pulseIn(uint8_t pin, uint8_t state, unsigned long timeout = 1000000L);
+
+/* Time */
+unsigned long millis(void);
+unsigned long micros(void);
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void yield(void);
+
+/* Sketch */
+void setup(void);
+void loop(void);
+
+/*========================================================================*/
+/*                          SERIAL PORTS                                  */
+/*========================================================================*/
+
+class Print
+{
+public:
+    virtual ~Print() {}
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t *buffer, size_t size);
+    size_t write(const char *str) { return str == NULL ? 0 : write((const uint8_t *)str, strlen(str)); }
+    size_t write(const char *buffer, size_t size) { return write((const uint8_t *)buffer, size); }
+    virtual int availableForWrite() { return 0; }
+    virtual void flush() {}
+
+    size_t print(const char *str) { return write(str); }
+    size_t print(long n);
+    size_t println(const char *str) { return print(str) + print("\r\n"); }
+    size_t println(long n) { return print(n) + print("\r\n"); }
+};
+
+class Stream : public Print
+{
+public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+
+    void setTimeout(unsigned long timeout) { _timeout = timeout; }
+    // reads until count bytes are received or the timeout expired
+    size_t readBytes(uint8_t *buffer, size_t length);
+    size_t readBytes(char *buffer, size_t length) { return readBytes((uint8_t *)buffer, length); }
+
+protected:
+    unsigned long _timeout = 1000;
+    int timedRead();
+};
+
+class HardwareSerial : public Stream
+{
+public:
+    explicit HardwareSerial(uint8_t port) : _port(port) {}
+
+    void begin(unsigned long baud, uint8_t config = SERIAL_8N1);
+    void end();
+    int available();
+    int peek();
+    int read();
+    int availableForWrite();
+    void flush();
+    size_t write(uint8_t c);
+    size_t write(const uint8_t *buffer, size_t size);
+    inline size_t write(unsigned long n) { return write((uint8_t)n); }
+    inline size_t write(long n) { return write((uint8_t)n); }
+    inline size_t write(unsigned int n) { return write((uint8_t)n); }
+    inline size_t write(int n) { return write((uint8_t)n); }
+    using Print::write;
+    operator bool() { return true; }
+
+private:
+    uint8_t _port;
+};
+
+extern HardwareSerial Serial;
+extern HardwareSerial Serial1;
+extern HardwareSerial Serial2;
+extern HardwareSerial Serial3;
+
+#endif
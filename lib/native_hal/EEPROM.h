@@ -0,0 +1,44 @@
+#ifndef _NATIVE_HAL_EEPROM_H_
+#define _NATIVE_HAL_EEPROM_H_
+
+/*
+    EEPROM of the simulated HAL: 4 KB in RAM, erased cells read 0xFF.
+    The cells can be accessed directly with hal_eeprom() (see hal.h).
+*/
+
+#include <stdint.h>
+#include <string.h>
+
+#define EEPROM_SIZE 4096
+
+class EEPROMClass
+{
+public:
+    uint8_t read(int idx);
+    void write(int idx, uint8_t value);
+    // only writes the cell if the value changed (saves erase/write cycles)
+    void update(int idx, uint8_t value);
+    uint16_t length() { return EEPROM_SIZE; }
+
+    template <typename T>
+    T &get(int idx, T &t)
+    {
+        uint8_t *ptr = (uint8_t *)&t;
+        for (size_t i = 0; i < sizeof(T); i++)
+            ptr[i] = read(idx + i);
+        return t;
+    }
+
+    template <typename T>
+    const T &put(int idx, const T &t)
+    {
+        const uint8_t *ptr = (const uint8_t *)&t;
+        for (size_t i = 0; i < sizeof(T); i++)
+            update(idx + i, ptr[i]);
+        return t;
+    }
+};
+
+extern EEPROMClass EEPROM;
+
+#endif
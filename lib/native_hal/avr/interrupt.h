@@ -0,0 +1,15 @@
+#ifndef _NATIVE_HAL_AVR_INTERRUPT_H_
+#define _NATIVE_HAL_AVR_INTERRUPT_H_
+
+/*
+    Interrupts of the simulated HAL: an ISR is a plain function, called by
+    the HAL while the simulated time advances (see hal_advance()).
+*/
+
+#define ISR(vector) extern "C" void vector(void)
+
+// ISRs are called synchronously => nothing to lock
+#define cli()
+#define sei()
+
+#endif
@@ -0,0 +1,77 @@
+#ifndef _NATIVE_HAL_AVR_IO_H_
+#define _NATIVE_HAL_AVR_IO_H_
+
+/*
+    Registers of the ATmega2560 used by the firmware (simulated HAL).
+    The registers are plain variables, see hal.cpp for the simulated behaviour.
+*/
+
+#include <stdint.h>
+
+#define _BV(bit) (1 << (bit))
+
+/* Ports */
+extern volatile uint8_t DDRD, PORTD, PIND;
+extern volatile uint8_t DDRF, PORTF, PINF;
+extern volatile uint8_t PINE;
+
+/* External interrupts INT0 - INT5 (pins 21, 20, 19, 18, 2, 3), simulated on level changes of the pins */
+extern volatile uint8_t EICRA, EICRB, EIMSK, EIFR;
+
+/* Timer/Counter 4 (16 bit), compare match A interrupt is simulated */
+extern volatile uint8_t TCCR4A, TCCR4B, TIMSK4, TIFR4;
+extern volatile uint16_t TCNT4, OCR4A, OCR4B, OCR4C;
+
+#define WGM40 0
+#define WGM41 1
+#define WGM42 3
+#define WGM43 4
+#define CS40 0
+#define CS41 1
+#define CS42 2
+#define OCIE4A 1
+
+/* Timer/Counter 1, 3, 5 (16 bit), overflow interrupt in fast PWM mode (TOP = ICRn) is simulated */
+extern volatile uint8_t TCCR1A, TCCR1B, TIMSK1;
+extern volatile uint8_t TCCR3A, TCCR3B, TIMSK3;
+extern volatile uint8_t TCCR5A, TCCR5B, TIMSK5;
+extern volatile uint16_t ICR1, OCR1A, OCR1B, OCR1C;
+extern volatile uint16_t ICR3, OCR3A, OCR3B, OCR3C;
+extern volatile uint16_t ICR5, OCR5A, OCR5B, OCR5C;
+
+#define COM1A1 7
+#define COM1B1 5
+#define COM1C1 3
+#define WGM11 1
+#define WGM12 3
+#define WGM13 4
+#define TOIE1 0
+
+/* ADC, free-running conversions + interrupt are simulated (analogRead() values) */
+extern volatile uint8_t ADMUX, ADCSRA, ADCSRB, DIDR0, DIDR2;
+extern volatile uint16_t ADC;
+
+#define REFS0 6
+#define ADEN 7
+#define ADSC 6
+#define ADATE 5
+#define ADIF 4
+#define ADIE 3
+#define ADPS2 2
+#define ADPS1 1
+#define ADPS0 0
+#define MUX5 3
+
+/* General purpose I/O registers */
+extern volatile uint8_t GPIOR0, GPIOR1, GPIOR2;
+
+/* MCU status */
+extern volatile uint8_t MCUSR;
+extern volatile uint8_t SREG;
+
+#define PORF 0
+#define EXTRF 1
+#define BORF 2
+#define WDRF 3
+
+#endif
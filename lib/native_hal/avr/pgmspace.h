@@ -0,0 +1,27 @@
+#ifndef _NATIVE_HAL_AVR_PGMSPACE_H_
+#define _NATIVE_HAL_AVR_PGMSPACE_H_
+
+/*
+    Program memory of the simulated HAL: flash and RAM share one address space.
+*/
+
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+
+#define PROGMEM
+#define PSTR(s) (s)
+#define F(s) (s)
+
+#define pgm_read_byte(addr) (*(const uint8_t *)(addr))
+#define pgm_read_word(addr) (*(const uint16_t *)(addr))
+#define pgm_read_dword(addr) (*(const uint32_t *)(addr))
+#define pgm_read_ptr(addr) (*(void *const *)(addr))
+
+#define memcpy_P memcpy
+#define strlen_P strlen
+#define strcmp_P strcmp
+#define strncpy_P strncpy
+#define snprintf_P snprintf
+
+#endif
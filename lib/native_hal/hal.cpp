@@ -0,0 +1,774 @@
+/**************************************************************************/
+/*!
+    @file     hal.cpp
+
+    Simulated Arduino HAL used to run the controller firmware on the host.
+
+    Following parts are simulated:
+        - time: host clock + the time skipped by delay() (see hal_set_realtime()),
+          a poll function can serve simulated devices while the time advances
+        - timer4: compare match A interrupt in CTC mode (used by the step motor)
+        - timer1, 3, 5: overflow interrupt in fast PWM mode (used by the PWM outputs)
+        - ADC: free-running conversions with interrupt (used by the analog inputs)
+        - watchdog: calls the reset handler of the host program when it expires
+        - pins: level + mode of every pin, pulseIn()/analogRead() return preset values
+        - external interrupts INT0 - INT5: ISR on a level change of the pin (any change, edges)
+        - serial ports: in-memory receive/transmit buffers
+        - EEPROM + TCS34725 color sensor
+*/
+/**************************************************************************/
+#include "hal.h"
+#include <EEPROM.h>
+#include <Adafruit_TCS34725.h>
+#include <pb_arduino.h>
+
+#include <chrono>
+#include <deque>
+#include <thread>
+
+/*========================================================================*/
+/*                          PRIVATE DEFINITIONS                           */
+/*========================================================================*/
+
+/* Registers */
+volatile uint8_t DDRD, PORTD, PIND;
+volatile uint8_t DDRF, PORTF, PINF;
+volatile uint8_t PINE;
+volatile uint8_t EICRA, EICRB, EIMSK, EIFR;
+volatile uint8_t TCCR4A, TCCR4B, TIMSK4, TIFR4;
+volatile uint16_t TCNT4, OCR4A, OCR4B, OCR4C;
+volatile uint8_t TCCR1A, TCCR1B, TIMSK1;
+volatile uint8_t TCCR3A, TCCR3B, TIMSK3;
+volatile uint8_t TCCR5A, TCCR5B, TIMSK5;
+volatile uint16_t ICR1, OCR1A, OCR1B, OCR1C;
+volatile uint16_t ICR3, OCR3A, OCR3B, OCR3C;
+volatile uint16_t ICR5, OCR5A, OCR5B, OCR5C;
+volatile uint8_t ADMUX, ADCSRB, DIDR0, DIDR2;
+// init() of the Arduino core enables the ADC for analogRead() (prescaler 128)
+volatile uint8_t ADCSRA = _BV(ADEN) | _BV(ADPS2) | _BV(ADPS1) | _BV(ADPS0);
+volatile uint16_t ADC;
+volatile uint8_t GPIOR0, GPIOR1, GPIOR2;
+volatile uint8_t MCUSR, SREG;
+
+// heap pointers of avr-libc (used to measure the free RAM)
+int __heap_start;
+int *__brkval;
+
+// default ISR: replaced by the firmware if it uses timer4
+extern "C" void __attribute__((weak)) TIMER4_COMPA_vect(void) {}
+// default ISRs: replaced by the firmware if it uses the PWM timers
+extern "C" void __attribute__((weak)) TIMER1_OVF_vect(void) {}
+extern "C" void __attribute__((weak)) TIMER3_OVF_vect(void) {}
+extern "C" void __attribute__((weak)) TIMER5_OVF_vect(void) {}
+// default ISRs: replaced by the firmware if it uses the external interrupts
+extern "C" void __attribute__((weak)) INT0_vect(void) {}
+extern "C" void __attribute__((weak)) INT1_vect(void) {}
+extern "C" void __attribute__((weak)) INT2_vect(void) {}
+extern "C" void __attribute__((weak)) INT3_vect(void) {}
+extern "C" void __attribute__((weak)) INT4_vect(void) {}
+extern "C" void __attribute__((weak)) INT5_vect(void) {}
+// default ISR: replaced by the firmware if it uses the ADC
+extern "C" void __attribute__((weak)) ADC_vect(void) {}
+
+/* Time */
+static bool realtime = false;
+// called while the time advances (simulated devices)
+static void (*poll_hook)(void) = NULL;
+static bool in_poll = false;
+// simulated time skipped by delay() [us]
+static uint64_t skipped_us = 0;
+static const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+/* Timer4: last simulated compare match [cpu cycles] */
+static uint64_t timer4_cycles = 0;
+static bool in_isr = false;
+
+/* Timer1, 3, 5: registers + last simulated overflow [cpu cycles] */
+struct HalPwmTimer
+{
+    volatile uint8_t *tccrb;
+    volatile uint8_t *timsk;
+    volatile uint16_t *icr;
+    void (*isr)(void);
+    uint64_t cycles;
+};
+
+static HalPwmTimer pwm_timers[] = {
+    {&TCCR1B, &TIMSK1, &ICR1, TIMER1_OVF_vect, 0},
+    {&TCCR3B, &TIMSK3, &ICR3, TIMER3_OVF_vect, 0},
+    {&TCCR5B, &TIMSK5, &ICR5, TIMER5_OVF_vect, 0},
+};
+
+/* ADC: end of the running conversion [cpu cycles] + its latched channel */
+static uint64_t adc_cycles = 0;
+static bool adc_running = false;
+static uint8_t adc_channel = 0;
+
+/* Watchdog */
+static hal_reset_handler_t reset_handler = NULL;
+// 0 => watchdog disabled [us]
+static uint64_t watchdog_timeout_us = 0;
+static uint64_t watchdog_last_us = 0;
+
+/* Pins */
+static uint8_t pin_level[NUM_DIGITAL_PINS];
+static uint8_t pin_mode[NUM_DIGITAL_PINS];
+static uint16_t analog_value[NUM_DIGITAL_PINS];
+static unsigned long pulse_us[NUM_DIGITAL_PINS];
+
+/* External interrupts: pin + bit in the input register of INT0 - INT5 */
+struct HalExternalInterrupt
+{
+    uint8_t pin;
+    volatile uint8_t *port;
+    uint8_t bit;
+    void (*isr)(void);
+};
+
+static const HalExternalInterrupt external_interrupts[] = {
+    {21, &PIND, 0, INT0_vect}, {20, &PIND, 1, INT1_vect}, {19, &PIND, 2, INT2_vect},
+    {18, &PIND, 3, INT3_vect}, {2, &PINE, 4, INT4_vect}, {3, &PINE, 5, INT5_vect},
+};
+
+/* Serial ports */
+struct SerialPort
+{
+    std::deque<uint8_t> rx;
+    std::deque<uint8_t> tx;
+    HalSerialStats stats;
+    hal_serial_responder_t responder;
+};
+static SerialPort ports[HAL_NUM_SERIAL];
+
+HardwareSerial Serial(0);
+HardwareSerial Serial1(1);
+HardwareSerial Serial2(2);
+HardwareSerial Serial3(3);
+
+/* Devices */
+EEPROMClass EEPROM;
+static uint32_t eeprom_writes = 0;
+
+struct ColorSensor
+{
+    bool present;
+    uint16_t r, g, b;
+};
+static ColorSensor color_sensor = {true, 0, 0, 0};
+
+/**
+    @brief  Simulated time since start [us]
+*/
+static uint64_t now_us(void);
+
+/**
+    @brief  Runs the timer interrupts which are due until now
+*/
+static void run_timers(void);
+
+/**
+    @brief  Single ended ADC channel selected in ADMUX/ADCSRB (0xFF: GND or differential input)
+*/
+static uint8_t adc_input(void);
+
+/**
+    @brief  Sets the level of a pin, updates the input register + runs the ISR
+            of an enabled external interrupt on the pin
+*/
+static void set_level(uint8_t pin, uint8_t level);
+
+/**
+    @brief  Resets the firmware if the watchdog expired
+*/
+static void run_watchdog(void);
+
+/*========================================================================*/
+/*                          TIME                                          */
+/*========================================================================*/
+
+static uint64_t now_us(void)
+{
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count() + skipped_us;
+}
+
+unsigned long millis(void)
+{
+    return (unsigned long)(now_us() / 1000);
+}
+
+unsigned long micros(void)
+{
+    return (unsigned long)now_us();
+}
+
+void delay(unsigned long ms)
+{
+    hal_advance(ms * 1000UL);
+}
+
+void delayMicroseconds(unsigned int us)
+{
+    hal_advance(us);
+}
+
+void yield(void)
+{
+    hal_advance(HAL_YIELD_US);
+}
+
+void hal_set_realtime(bool enabled)
+{
+    realtime = enabled;
+}
+
+void hal_set_poll(void (*poll)(void))
+{
+    poll_hook = poll;
+}
+
+uint64_t hal_time_us(void)
+{
+    return now_us();
+}
+
+void hal_advance(unsigned long us)
+{
+    do
+    {
+        // sleep in slices => timers + simulated devices are served in time
+        unsigned long slice = (realtime && us > HAL_POLL_US) ? HAL_POLL_US : us;
+        if (realtime)
+            std::this_thread::sleep_for(std::chrono::microseconds(slice));
+        else
+            skipped_us += slice;
+        us -= slice;
+
+        run_timers();
+        run_watchdog();
+        if (poll_hook != NULL && !in_poll)
+        {
+            in_poll = true;
+            poll_hook();
+            in_poll = false;
+        }
+    } while (us > 0);
+}
+
+/*========================================================================*/
+/*                          WATCHDOG                                      */
+/*========================================================================*/
+
+void wdt_enable(uint8_t timeout)
+{
+    // WDTO_15MS (0) = 16 ms, every step doubles the timeout
+    watchdog_timeout_us = 16000ULL << timeout;
+    watchdog_last_us = now_us();
+}
+
+void wdt_disable(void)
+{
+    watchdog_timeout_us = 0;
+}
+
+void wdt_reset(void)
+{
+    watchdog_last_us = now_us();
+}
+
+void hal_set_reset_handler(hal_reset_handler_t handler)
+{
+    reset_handler = handler;
+}
+
+static void run_watchdog(void)
+{
+    if (reset_handler == NULL || watchdog_timeout_us == 0 || now_us() - watchdog_last_us < watchdog_timeout_us)
+        return;
+
+    watchdog_timeout_us = 0;
+    MCUSR |= _BV(WDRF);
+    reset_handler();
+}
+
+/*========================================================================*/
+/*                          TIMER4                                        */
+/*========================================================================*/
+
+static void run_timers(void)
+{
+    static const uint16_t prescalers[8] = {0, 1, 8, 64, 256, 1024, 0, 0};
+    uint64_t now_cycles = now_us() * (HAL_F_CPU / 1000000UL);
+
+    // ISRs can't interrupt each other
+    if (in_isr)
+        return;
+    in_isr = true;
+
+    /* timer4: CTC mode, compare match A after (OCR4A + 1) timer ticks */
+    while (true)
+    {
+        uint16_t prescaler = prescalers[TCCR4B & 0x07];
+        uint64_t period = (uint64_t)(OCR4A + 1) * prescaler;
+
+        // timer stopped or interrupt disabled => restart counting from now
+        if (prescaler == 0 || !(TIMSK4 & _BV(OCIE4A)))
+        {
+            timer4_cycles = now_cycles;
+            break;
+        }
+        if (timer4_cycles + period > now_cycles)
+            break;
+        timer4_cycles += period;
+        TIMER4_COMPA_vect();
+    }
+
+    /* timer1, 3, 5: fast PWM mode, overflow after (ICRn + 1) timer ticks */
+    for (HalPwmTimer &timer : pwm_timers)
+    {
+        while (true)
+        {
+            uint16_t prescaler = prescalers[*timer.tccrb & 0x07];
+            uint64_t period = (uint64_t)(*timer.icr + 1) * prescaler;
+
+            if (prescaler == 0 || !(*timer.timsk & _BV(TOIE1)))
+            {
+                timer.cycles = now_cycles;
+                break;
+            }
+            if (timer.cycles + period > now_cycles)
+                break;
+            timer.cycles += period;
+            timer.isr();
+        }
+    }
+
+    /* ADC: 13 ADC clocks per conversion, the channel is latched at the start of a conversion */
+    if (!(ADCSRA & _BV(ADEN)) || !(ADCSRA & _BV(ADSC)))
+        adc_running = false;
+    else
+    {
+        uint8_t adps = ADCSRA & 0x07;
+        uint64_t conversion = 13ULL << (adps == 0 ? 1 : adps);
+
+        if (!adc_running)
+        {
+            adc_running = true;
+            adc_channel = adc_input();
+            adc_cycles = now_cycles + conversion;
+        }
+        while (adc_running && adc_cycles <= now_cycles)
+        {
+            ADC = (adc_channel < 16) ? analog_value[A0 + adc_channel] : 0;
+            // free-running mode: the next conversion starts right away
+            if (ADCSRA & _BV(ADATE))
+            {
+                adc_channel = adc_input();
+                adc_cycles += conversion;
+            }
+            else
+            {
+                ADCSRA &= ~_BV(ADSC);
+                adc_running = false;
+            }
+            if (ADCSRA & _BV(ADIE))
+                ADC_vect();
+            else
+                ADCSRA |= _BV(ADIF);
+        }
+    }
+    in_isr = false;
+}
+
+static uint8_t adc_input(void)
+{
+    uint8_t mux = (ADMUX & 0x1F) | ((ADCSRB & _BV(MUX5)) ? 0x20 : 0);
+
+    // single ended channels 0 - 7 + 8 - 15, everything else (GND, differential) reads 0
+    if (mux < 8)
+        return mux;
+    if (mux >= 0x20 && mux < 0x28)
+        return 8 + (mux & 0x07);
+    return 0xFF;
+}
+
+/*========================================================================*/
+/*                          PINS                                          */
+/*========================================================================*/
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+    if (pin >= NUM_DIGITAL_PINS)
+        return;
+    pin_mode[pin] = mode;
+    // pull-up => unconnected input reads HIGH
+    if (mode == INPUT_PULLUP)
+        set_level(pin, HIGH);
+}
+
+void digitalWrite(uint8_t pin, uint8_t value)
+{
+    if (pin < NUM_DIGITAL_PINS)
+        set_level(pin, value ? HIGH : LOW);
+}
+
+int digitalRead(uint8_t pin)
+{
+    return (pin < NUM_DIGITAL_PINS) ? pin_level[pin] : LOW;
+}
+
+int analogRead(uint8_t pin)
+{
+    // analog channel number or pin number
+    if (pin < A0)
+        pin += A0;
+    return (pin < NUM_DIGITAL_PINS) ? analog_value[pin] : 0;
+}
+
+unsigned long pulseIn(uint8_t pin, uint8_t state, unsigned long timeout)
+{
+    if (pin >= NUM_DIGITAL_PINS || pulse_us[pin] == 0 || pulse_us[pin] > timeout)
+    {
+        hal_advance(timeout);
+        return 0;
+    }
+    hal_advance(pulse_us[pin]);
+    return pulse_us[pin];
+}
+
+void hal_set_pin(uint8_t pin, uint8_t value)
+{
+    if (pin < NUM_DIGITAL_PINS)
+        set_level(pin, value ? HIGH : LOW);
+}
+
+uint8_t hal_get_pin(uint8_t pin)
+{
+    return (pin < NUM_DIGITAL_PINS) ? pin_level[pin] : LOW;
+}
+
+uint8_t hal_get_pin_mode(uint8_t pin)
+{
+    return (pin < NUM_DIGITAL_PINS) ? pin_mode[pin] : INPUT;
+}
+
+void hal_set_analog(uint8_t pin, uint16_t value)
+{
+    if (pin < A0)
+        pin += A0;
+    if (pin < NUM_DIGITAL_PINS)
+        analog_value[pin] = value;
+}
+
+void hal_set_pulse(uint8_t pin, unsigned long us)
+{
+    if (pin < NUM_DIGITAL_PINS)
+        pulse_us[pin] = us;
+}
+
+static void set_level(uint8_t pin, uint8_t level)
+{
+    uint8_t old = pin_level[pin];
+
+    pin_level[pin] = level;
+    for (uint8_t i = 0; i < sizeof(external_interrupts) / sizeof(HalExternalInterrupt); i++)
+    {
+        const HalExternalInterrupt &ext = external_interrupts[i];
+        if (ext.pin != pin)
+            continue;
+        if (level)
+            *ext.port |= _BV(ext.bit);
+        else
+            *ext.port &= ~_BV(ext.bit);
+
+        // ISCn1:0: 01 any change, 10 falling edge, 11 rising edge (00: low level, not simulated)
+        uint8_t sense = (((i < 4) ? EICRA : EICRB) >> (2 * (i & 0x03))) & 0x03;
+        bool edge = (sense == 1 && level != old) || (sense == 2 && old && !level) || (sense == 3 && !old && level);
+        if (edge && (EIMSK & _BV(i)))
+            ext.isr();
+    }
+}
+
+/*========================================================================*/
+/*                          SERIAL PORTS                                  */
+/*========================================================================*/
+
+size_t Print::write(const uint8_t *buffer, size_t size)
+{
+    size_t n = 0;
+    while (size--)
+        n += write(*buffer++);
+    return n;
+}
+
+size_t Print::print(long n)
+{
+    char str[24];
+    snprintf(str, sizeof(str), "%ld", n);
+    return write(str);
+}
+
+int Stream::timedRead()
+{
+    unsigned long start_ms = millis();
+    do
+    {
+        int c = read();
+        if (c >= 0)
+            return c;
+        yield();
+    } while (millis() - start_ms < _timeout);
+    return -1;
+}
+
+size_t Stream::readBytes(uint8_t *buffer, size_t length)
+{
+    size_t count = 0;
+    while (count < length)
+    {
+        int c = timedRead();
+        if (c < 0)
+            break;
+        buffer[count++] = (uint8_t)c;
+    }
+    return count;
+}
+
+void HardwareSerial::begin(unsigned long baud, uint8_t config)
+{
+    ports[_port].stats.baud = baud;
+}
+
+void HardwareSerial::end()
+{
+    ports[_port].stats.baud = 0;
+    ports[_port].rx.clear();
+}
+
+int HardwareSerial::available()
+{
+    // nothing received: the firmware polls => let the simulated time pass
+    if (ports[_port].rx.empty())
+        yield();
+    return (int)ports[_port].rx.size();
+}
+
+int HardwareSerial::peek()
+{
+    return ports[_port].rx.empty() ? -1 : ports[_port].rx.front();
+}
+
+int HardwareSerial::read()
+{
+    SerialPort &port = ports[_port];
+    if (port.rx.empty())
+        return -1;
+    uint8_t c = port.rx.front();
+    port.rx.pop_front();
+    port.stats.rx_bytes++;
+    return c;
+}
+
+int HardwareSerial::availableForWrite()
+{
+    // size of the transmit buffer of the Arduino core - 1
+    return 63;
+}
+
+void HardwareSerial::flush()
+{
+}
+
+size_t HardwareSerial::write(uint8_t c)
+{
+    SerialPort &port = ports[_port];
+    port.tx.push_back(c);
+    port.stats.tx_bytes++;
+    if (port.responder != NULL)
+        port.responder(_port, c);
+    return 1;
+}
+
+size_t HardwareSerial::write(const uint8_t *buffer, size_t size)
+{
+    return Print::write(buffer, size);
+}
+
+void hal_serial_feed(uint8_t port, const uint8_t *data, size_t length)
+{
+    if (port < HAL_NUM_SERIAL)
+        ports[port].rx.insert(ports[port].rx.end(), data, data + length);
+}
+
+size_t hal_serial_take(uint8_t port, uint8_t *buffer, size_t size)
+{
+    if (port >= HAL_NUM_SERIAL)
+        return 0;
+    std::deque<uint8_t> &tx = ports[port].tx;
+    size_t count = 0;
+    while (count < size && !tx.empty())
+    {
+        buffer[count++] = tx.front();
+        tx.pop_front();
+    }
+    return count;
+}
+
+size_t hal_serial_rx_pending(uint8_t port)
+{
+    return (port < HAL_NUM_SERIAL) ? ports[port].rx.size() : 0;
+}
+
+size_t hal_serial_tx_pending(uint8_t port)
+{
+    return (port < HAL_NUM_SERIAL) ? ports[port].tx.size() : 0;
+}
+
+void hal_serial_set_responder(uint8_t port, hal_serial_responder_t responder)
+{
+    if (port < HAL_NUM_SERIAL)
+        ports[port].responder = responder;
+}
+
+HalSerialStats hal_serial_stats(uint8_t port)
+{
+    HalSerialStats empty = {0, 0, 0};
+    return (port < HAL_NUM_SERIAL) ? ports[port].stats : empty;
+}
+
+void hal_serial_reset_stats(uint8_t port)
+{
+    if (port < HAL_NUM_SERIAL)
+    {
+        ports[port].stats.rx_bytes = 0;
+        ports[port].stats.tx_bytes = 0;
+    }
+}
+
+/* nanopb streams (same as the nanopb-arduino library) */
+static bool pb_stream_read(pb_istream_t *stream, pb_byte_t *buf, size_t count)
+{
+    Stream *s = (Stream *)stream->state;
+    return s->readBytes(buf, count) == count;
+}
+
+static bool pb_print_write(pb_ostream_t *stream, const pb_byte_t *buf, size_t count)
+{
+    Print *p = (Print *)stream->state;
+    return p->write(buf, count) == count;
+}
+
+pb_istream_s as_pb_istream(Stream &stream)
+{
+    pb_istream_s istream = {};
+    istream.callback = &pb_stream_read;
+    istream.state = &stream;
+    istream.bytes_left = SIZE_MAX;
+    return istream;
+}
+
+pb_ostream_s as_pb_ostream(Print &print)
+{
+    pb_ostream_s ostream = {};
+    ostream.callback = &pb_print_write;
+    ostream.state = &print;
+    ostream.max_size = SIZE_MAX;
+    return ostream;
+}
+
+/*========================================================================*/
+/*                          DEVICES                                       */
+/*========================================================================*/
+
+/* EEPROM */
+uint8_t *hal_eeprom(void)
+{
+    static uint8_t cells[EEPROM_SIZE];
+    static bool erased = false;
+    if (!erased)
+    {
+        memset(cells, 0xFF, sizeof(cells));
+        erased = true;
+    }
+    return cells;
+}
+
+uint32_t hal_eeprom_writes(void)
+{
+    return eeprom_writes;
+}
+
+uint8_t EEPROMClass::read(int idx)
+{
+    return (idx >= 0 && idx < EEPROM_SIZE) ? hal_eeprom()[idx] : 0xFF;
+}
+
+void EEPROMClass::write(int idx, uint8_t value)
+{
+    if (idx < 0 || idx >= EEPROM_SIZE)
+        return;
+    hal_eeprom()[idx] = value;
+    eeprom_writes++;
+}
+
+void EEPROMClass::update(int idx, uint8_t value)
+{
+    if (read(idx) != value)
+        write(idx, value);
+}
+
+/* TCS34725 color sensor */
+Adafruit_TCS34725::Adafruit_TCS34725(uint8_t integration_time, uint8_t gain)
+{
+}
+
+bool Adafruit_TCS34725::begin()
+{
+    return color_sensor.present;
+}
+
+void Adafruit_TCS34725::enable()
+{
+}
+
+void Adafruit_TCS34725::disable()
+{
+}
+
+uint16_t Adafruit_TCS34725::read16(uint8_t reg)
+{
+    switch (reg)
+    {
+    case TCS34725_RDATAL:
+        return color_sensor.r;
+    case TCS34725_GDATAL:
+        return color_sensor.g;
+    case TCS34725_BDATAL:
+        return color_sensor.b;
+    case TCS34725_CDATAL:
+        return color_sensor.r + color_sensor.g + color_sensor.b;
+    default:
+        return 0;
+    }
+}
+
+uint8_t Adafruit_TCS34725::read8(uint8_t reg)
+{
+    return (uint8_t)read16(reg);
+}
+
+void Adafruit_TCS34725::getRawData(uint16_t *r, uint16_t *g, uint16_t *b, uint16_t *c)
+{
+    *r = read16(TCS34725_RDATAL);
+    *g = read16(TCS34725_GDATAL);
+    *b = read16(TCS34725_BDATAL);
+    *c = read16(TCS34725_CDATAL);
+}
+
+void hal_set_color(bool present, uint16_t r, uint16_t g, uint16_t b)
+{
+    color_sensor.present = present;
+    color_sensor.r = r;
+    color_sensor.g = g;
+    color_sensor.b = b;
+}
@@ -0,0 +1,140 @@
+#ifndef _NATIVE_HAL_H_
+#define _NATIVE_HAL_H_
+
+/*
+    Simulation interface of the native HAL: used by the host programs
+    (e.g. tools/benchmark) to drive the simulated hardware of the firmware.
+*/
+
+#include <Arduino.h>
+
+/*========================================================================*/
+/*                          PUBLIC DEFINITIONS                            */
+/*========================================================================*/
+
+// number of simulated serial ports (Serial, Serial1, Serial2, Serial3)
+#define HAL_NUM_SERIAL 4
+
+// simulated clock of the ATmega2560 (used for the timer periods)
+#define HAL_F_CPU 16000000UL
+
+// time advanced by yield(), e.g. while Stream::readBytes() waits for data [us]
+#define HAL_YIELD_US 100
+
+// max. sleep between two calls of the poll function in realtime mode [us]
+#define HAL_POLL_US 500
+
+// called for every byte the firmware writes to a serial port (simulated device behind the port)
+typedef void (*hal_serial_responder_t)(uint8_t port, uint8_t value);
+
+// called when the watchdog expires (MCUSR is set to WDRF): has to restart the firmware, must not return
+typedef void (*hal_reset_handler_t)(void);
+
+// traffic of a serial port since the last hal_serial_reset_stats()
+struct HalSerialStats
+{
+    unsigned long baud; // baudrate set with begin() (0 if the port is closed)
+    uint32_t rx_bytes;  // bytes read by the firmware
+    uint32_t tx_bytes;  // bytes written by the firmware
+};
+
+/*========================================================================*/
+/*                          PUBLIC FUNCTIONS                              */
+/*========================================================================*/
+
+/* Time */
+/**
+    @brief  Selects how delay() behaves
+    @param  realtime: true => delay() sleeps, false (default) => delay() only advances the simulated clock
+*/
+void hal_set_realtime(bool realtime);
+
+/**
+    @brief  Advances the simulated clock + runs the due timer interrupts and the poll function
+*/
+void hal_advance(unsigned long us);
+
+/**
+    @brief  Simulated time since start [us] (64 bit: no rollover like micros())
+*/
+uint64_t hal_time_us(void);
+
+/**
+    @brief  Sets a function called whenever the time advances (delay(), yield(), polling of Serial)
+            e.g. to exchange bytes between the simulated serial ports and the host
+*/
+void hal_set_poll(void (*poll)(void));
+
+/* Watchdog */
+/**
+    @brief  Sets the function called when the watchdog expires
+            (NULL, default: the watchdog is not simulated, e.g. for benchmarks with a simulated clock)
+*/
+void hal_set_reset_handler(hal_reset_handler_t handler);
+
+/* Serial ports */
+/**
+    @brief  Appends bytes to the receive buffer of a port (read by the firmware)
+*/
+void hal_serial_feed(uint8_t port, const uint8_t *data, size_t length);
+
+/**
+    @brief  Takes the bytes written by the firmware out of the transmit buffer of a port
+    @return number of bytes copied into buffer
+*/
+size_t hal_serial_take(uint8_t port, uint8_t *buffer, size_t size);
+
+/**
+    @brief  Number of bytes in the receive/transmit buffer of a port
+*/
+size_t hal_serial_rx_pending(uint8_t port);
+size_t hal_serial_tx_pending(uint8_t port);
+
+/**
+    @brief  Sets the simulated device behind a port (NULL: bytes are only buffered)
+*/
+void hal_serial_set_responder(uint8_t port, hal_serial_responder_t responder);
+
+HalSerialStats hal_serial_stats(uint8_t port);
+void hal_serial_reset_stats(uint8_t port);
+
+/* Pins */
+/**
+    @brief  Sets the level of an input pin (read with digitalRead(), runs an enabled INT0 - INT5 ISR)
+*/
+void hal_set_pin(uint8_t pin, uint8_t value);
+
+/**
+    @brief  Returns the level/mode of a pin (set with digitalWrite()/pinMode())
+*/
+uint8_t hal_get_pin(uint8_t pin);
+uint8_t hal_get_pin_mode(uint8_t pin);
+
+/**
+    @brief  Sets the value returned by analogRead() + the ADC conversions (0-1023)
+*/
+void hal_set_analog(uint8_t pin, uint16_t value);
+
+/**
+    @brief  Sets the pulse length returned by pulseIn() [us] (0 simulates a timeout)
+*/
+void hal_set_pulse(uint8_t pin, unsigned long us);
+
+/* Devices */
+/**
+    @brief  Simulates a TCS34725 color sensor on the I2C bus
+    @param  present: false => begin() of the sensor fails
+*/
+void hal_set_color(bool present, uint16_t r, uint16_t g, uint16_t b);
+
+/**
+    @brief  Direct access to the simulated EEPROM (EEPROM_SIZE bytes)
+*/
+uint8_t *hal_eeprom(void);
+
+/**
+    @brief  Number of EEPROM cells written (erase/write cycles) since start
+*/
+uint32_t hal_eeprom_writes(void);
+
+#endif
@@ -0,0 +1,16 @@
+#ifndef _NATIVE_HAL_PB_ARDUINO_H_
+#define _NATIVE_HAL_PB_ARDUINO_H_
+
+/*
+    nanopb streams on top of the simulated serial ports
+    (same interface as the nanopb-arduino library used on the target)
+*/
+
+#include <Arduino.h>
+#include <pb_encode.h>
+#include <pb_decode.h>
+
+pb_istream_s as_pb_istream(Stream &stream);
+pb_ostream_s as_pb_ostream(Print &print);
+
+#endif
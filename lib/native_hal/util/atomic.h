@@ -0,0 +1,12 @@
+#ifndef _NATIVE_HAL_UTIL_ATOMIC_H_
+#define _NATIVE_HAL_UTIL_ATOMIC_H_
+
+/*
+    Atomic blocks of the simulated HAL: ISRs only run inside delay()/yield() => nothing to lock
+*/
+
+#define ATOMIC_RESTORESTATE
+#define ATOMIC_FORCEON
+#define ATOMIC_BLOCK(type) for (uint8_t __atomic_done = 0; !__atomic_done; __atomic_done = 1)
+
+#endif
@@ -0,0 +1,14 @@
+#ifndef _NATIVE_HAL_UTIL_DELAY_H_
+#define _NATIVE_HAL_UTIL_DELAY_H_
+
+/*
+    Busy wait delays of the simulated HAL (mapped to the simulated time)
+*/
+
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+#define _delay_ms(ms) delay(ms)
+#define _delay_us(us) delayMicroseconds(us)
+
+#endif
@@ -0,0 +1,40 @@
+/**************************************************************************/
+/*!
+    @file     deadline.cpp
+    @author   Jonas Brütsch
+
+    Deadlines of the blocking waits (UART-TTL responses, step motor moves,
+    ultrasonic echo). A wait polls its deadline, which also feeds the
+    watchdog: only a wait without deadline can trigger a watchdog reset.
+*/
+/**************************************************************************/
+#include "deadline.h"
+
+/*========================================================================*/
+/*                          PUBLIC FUNCTIONS                              */
+/*========================================================================*/
+
+Deadline deadline_start(uint32_t timeout_ms)
+{
+    return {(uint32_t)millis(), timeout_ms};
+}
+
+bool deadline_expired(const Deadline &deadline)
+{
+    watchdog_feed();
+    return deadline_elapsed(deadline) >= deadline.timeout_ms;
+}
+
+uint32_t deadline_elapsed(const Deadline &deadline)
+{
+    return millis() - deadline.start_ms;
+}
+
+/**************************************************************************/
+/*
+    Timeout error with the elapsed time of the wait
+*/
+bool send_timeout(uint32_t profile_id, const Deadline &deadline)
+{
+    return send_error(profile_id, ErrorCode_ERR_TIMEOUT, deadline_elapsed(deadline));
+}
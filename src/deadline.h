@@ -0,0 +1,71 @@
+#ifndef _DEADLINE_H_
+#define _DEADLINE_H_
+
+#include "main.h"
+
+/*
+    Deadlines of the blocking waits: every wait of the firmware polls a
+    deadline and gives up with a timeout error once it expired.
+*/
+
+/*========================================================================*/
+/*                          PUBLIC DEFINITIONS                            */
+/*========================================================================*/
+
+/* Timeouts of the blocking waits [ms] (can be set with build flags) */
+// UART-TTL: port ready after begin()
+#ifndef TIMEOUT_UART_READY_MS
+#define TIMEOUT_UART_READY_MS 100
+#endif
+// UART-TTL: complete response line of the device
+#ifndef TIMEOUT_UART_RESPONSE_MS
+#define TIMEOUT_UART_RESPONSE_MS 2000
+#endif
+// step motor: blocking move (action.wait)
+#ifndef TIMEOUT_STEP_MOVE_MS
+#define TIMEOUT_STEP_MOVE_MS 30000
+#endif
+// ultrasonic sensor: echo pulse (400 cm => ~23 ms)
+#ifndef TIMEOUT_ULTRASONIC_MS
+#define TIMEOUT_ULTRASONIC_MS 30
+#endif
+// analog input: first value after the registration (4 channels x 64 conversions => ~27 ms)
+#ifndef TIMEOUT_ANALOG_MS
+#define TIMEOUT_ANALOG_MS 50
+#endif
+
+struct Deadline
+{
+    uint32_t start_ms;
+    uint32_t timeout_ms;
+};
+
+/*========================================================================*/
+/*                          PUBLIC FUNCTIONS                              */
+/*========================================================================*/
+
+/**
+    @brief  Starts a deadline
+    @param  timeout_ms: time until the deadline expires
+*/
+Deadline deadline_start(uint32_t timeout_ms);
+
+/**
+    @brief  Checks a deadline, feeds the watchdog (called in every pass of a wait loop)
+    @return true if the deadline expired
+*/
+bool deadline_expired(const Deadline &deadline);
+
+/**
+    @brief  Time since the start of a deadline [ms]
+*/
+uint32_t deadline_elapsed(const Deadline &deadline);
+
+/**
+    @brief  Sends the timeout error of a wait (ERR_TIMEOUT, detail: elapsed time [ms])
+    @param  profile_id: Profile_id
+    @param  deadline: expired deadline
+*/
+bool send_timeout(uint32_t profile_id, const Deadline &deadline);
+
+#endif
@@ -0,0 +1,39 @@
+/**************************************************************************/
+/*!
+    @file     device_clock.cpp
+    @author   Jonas Brütsch
+
+    64-bit device clock: counts the rollovers of micros().
+    The rollover detection is done inside an atomic block (device_time_us()
+    can be called with interrupts enabled from any path of the loop).
+*/
+/**************************************************************************/
+#include "device_clock.h"
+#include <util/atomic.h>
+
+/*========================================================================*/
+/*                          PRIVATE DEFINITIONS                           */
+/*========================================================================*/
+
+// last value of micros() + number of rollovers
+static uint32_t last_us = 0;
+static uint32_t rollovers = 0;
+
+/*========================================================================*/
+/*                          PUBLIC FUNCTIONS                              */
+/*========================================================================*/
+
+uint64_t device_time_us(void)
+{
+    uint64_t time_us;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        uint32_t now = micros();
+        if (now < last_us)
+            rollovers++;
+        last_us = now;
+        time_us = ((uint64_t)rollovers << 32) | now;
+    }
+    return time_us;
+}
@@ -0,0 +1,22 @@
+#ifndef _DEVICE_CLOCK_H_
+#define _DEVICE_CLOCK_H_
+
+#include <Arduino.h>
+
+/*
+    Device clock: micros() extended to 64 bit (no rollover after ~71 min).
+    Used for the timestamps of the responses + the clock synchronisation
+    with the gateway (MCUAction TIME_SYNC).
+*/
+
+/*========================================================================*/
+/*                          PUBLIC FUNCTIONS                              */
+/*========================================================================*/
+
+/**
+    @brief  Time since the start of the controller [us]
+            (has to be called at least once per rollover of micros(), done by loop())
+*/
+uint64_t device_time_us(void);
+
+#endif
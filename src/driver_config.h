@@ -0,0 +1,59 @@
+#ifndef _DRIVER_CONFIG_H_
+#define _DRIVER_CONFIG_H_
+
+/*
+    Drivers compiled into the firmware (manifest of a deployment).
+
+    Every driver is enabled by default, a build flag removes it, e.g. in platformio.ini:
+        build_flags = -D DRIVER_ENABLE_COLOR_SENSOR=0
+    The values have to be 0 or 1 (used by the driver table, see driver_table.h).
+
+    A disabled driver keeps its oneof tag and an empty row of the driver table:
+    its registrations are rejected with ERR_NO_DRIVER, stored registrations
+    are skipped after a reset. Its code, ISRs and buffers are not compiled.
+    MCUAction DRIVERS returns the compiled-in drivers.
+*/
+
+/*========================================================================*/
+/*                          PUBLIC DEFINITIONS                            */
+/*========================================================================*/
+
+#ifndef DRIVER_ENABLE_DIGITAL_GENERIC
+#define DRIVER_ENABLE_DIGITAL_GENERIC 1
+#endif
+
+#ifndef DRIVER_ENABLE_UART_TTL_GENERIC
+#define DRIVER_ENABLE_UART_TTL_GENERIC 1
+#endif
+
+#ifndef DRIVER_ENABLE_COLOR_SENSOR
+#define DRIVER_ENABLE_COLOR_SENSOR 1
+#endif
+
+#ifndef DRIVER_ENABLE_ULTRASONIC_SENSOR
+#define DRIVER_ENABLE_ULTRASONIC_SENSOR 1
+#endif
+
+#ifndef DRIVER_ENABLE_STEP_MOTOR
+#define DRIVER_ENABLE_STEP_MOTOR 1
+#endif
+
+#ifndef DRIVER_ENABLE_MCU_DRIVER
+#define DRIVER_ENABLE_MCU_DRIVER 1
+#endif
+
+#ifndef DRIVER_ENABLE_ANALOG_GENERIC
+#define DRIVER_ENABLE_ANALOG_GENERIC 1
+#endif
+
+#ifndef DRIVER_ENABLE_PWM_GENERIC
+#define DRIVER_ENABLE_PWM_GENERIC 1
+#endif
+
+#ifndef DRIVER_ENABLE_ENCODER_GENERIC
+#define DRIVER_ENABLE_ENCODER_GENERIC 1
+#endif
+
+// ADI-DRIVER-Config: Label for automatic driver initialization (Do not move!)
+
+#endif
@@ -0,0 +1,77 @@
+/**************************************************************************/
+/*!
+    @file     driver_table.cpp
+    @author   Jonas Brütsch
+
+    Driver dispatch table: one DriverDescriptor per driver, indexed by the
+    oneof tag of the driver in Action/Registration.
+
+    The table is generated at compile time from drivers/driver_list.h and
+    stored in flash. Every driver row also generates the adapter functions
+    that extract the driver specific message from the oneof.
+
+    Every driver has to implement: init_<name>, run_<name>, resources_<name> and teardown_<name>.
+    Disabled drivers (see driver_config.h) get an empty row.
+*/
+/**************************************************************************/
+#include "driver_table.h"
+
+/*========================================================================*/
+/*                          PRIVATE DEFINITIONS                           */
+/*========================================================================*/
+
+/* Adapter functions: Registration/Action => driver specific message */
+#define DRIVER(name, enabled, capabilities, state_size, event)                      \
+    DRIVER_IF(enabled)(                                                             \
+    bool init_##name##_entry(uint32_t profile_id, const Registration &registration) \
+    {                                                                               \
+        return init_##name(profile_id, registration.driver.r_##name);              \
+    }                                                                               \
+    void run_##name##_entry(uint32_t profile_id, const Action &action)             \
+    {                                                                               \
+        run_##name(profile_id, action.driver.a_##name);                            \
+    }                                                                               \
+    uint8_t resources_##name##_entry(const Registration &registration,             \
+                                     Resource *resources)                           \
+    {                                                                               \
+        return resources_##name(registration.driver.r_##name, resources);          \
+    })
+#include "drivers/driver_list.h"
+#undef DRIVER
+
+/* Compile time checks: table index has to match the oneof tags + state has to fit into the slot */
+#define DRIVER(name, enabled, capabilities, state_size, event)                                               \
+    static_assert(Registration_r_##name##_tag == DRIVER_TAG_FIRST + DRIVER_INDEX_##name,                     \
+                  "drivers/driver_list.h: order of " #name " does not match the Registration oneof tag");    \
+    static_assert(Action_a_##name##_tag == DRIVER_TAG_FIRST + DRIVER_INDEX_##name,                           \
+                  "drivers/driver_list.h: order of " #name " does not match the Action oneof tag");          \
+    static_assert((state_size) <= PROFILE_STATE_SIZE, "State of " #name " does not fit into PROFILE_STATE_SIZE");
+#include "drivers/driver_list.h"
+#undef DRIVER
+
+/* Driver table */
+constexpr DriverDescriptor driver_table[DRIVER_COUNT] PROGMEM = {
+#define DRIVER(name, enabled, capabilities, state_size, event)                                                         \
+    DRIVER_IF(enabled)({&init_##name##_entry, &run_##name##_entry, event, &resources_##name##_entry, &teardown_##name, \
+                        state_size, capabilities},)                                                                    \
+    DRIVER_IF_NOT(enabled)({NULL, NULL, NULL, NULL, NULL, 0, 0},)
+#include "drivers/driver_list.h"
+#undef DRIVER
+};
+
+/*========================================================================*/
+/*                          PUBLIC FUNCTIONS                              */
+/*========================================================================*/
+
+/**************************************************************************/
+/*
+    Copy the descriptor of a driver from flash
+*/
+bool get_driver(pb_size_t which_driver, DriverDescriptor *descriptor)
+{
+    if (which_driver < DRIVER_TAG_FIRST || which_driver >= DRIVER_TAG_FIRST + DRIVER_COUNT)
+        return false;
+
+    memcpy_P(descriptor, &driver_table[which_driver - DRIVER_TAG_FIRST], sizeof(DriverDescriptor));
+    return descriptor->init != NULL;
+}
@@ -0,0 +1,74 @@
+#ifndef _DRIVER_TABLE_H_
+#define _DRIVER_TABLE_H_
+
+#include "main.h"
+
+/*========================================================================*/
+/*                          PUBLIC DEFINITIONS                            */
+/*========================================================================*/
+
+// oneof tag of the first driver in Action/Registration (tag 1 is the profile_id)
+#define DRIVER_TAG_FIRST 2
+
+/* Compiled-in drivers: DRIVER_IF(enabled)(code) / DRIVER_IF_NOT(enabled)(code), enabled: 0 or 1 */
+#define DRIVER_IF(enabled) DRIVER_IF_I(enabled)
+#define DRIVER_IF_I(enabled) DRIVER_IF_##enabled
+#define DRIVER_IF_0(...)
+#define DRIVER_IF_1(...) __VA_ARGS__
+#define DRIVER_IF_NOT(enabled) DRIVER_IF_NOT_I(enabled)
+#define DRIVER_IF_NOT_I(enabled) DRIVER_IF_NOT_##enabled
+#define DRIVER_IF_NOT_0(...) __VA_ARGS__
+#define DRIVER_IF_NOT_1(...)
+
+/* Driver capabilities */
+#define DRIVER_CAP_EVENT 0x01    // driver uses the event handler (event function is set)
+#define DRIVER_CAP_BLOCKING 0x02 // action function may block until the device responded
+
+// index of every driver inside the table (oneof tag - DRIVER_TAG_FIRST)
+enum DriverIndex
+{
+#define DRIVER(name, enabled, capabilities, state_size, event) DRIVER_INDEX_##name,
+#include "drivers/driver_list.h"
+#undef DRIVER
+    DRIVER_COUNT
+};
+
+// bit <DriverIndex> is set for every driver compiled into the firmware
+constexpr uint32_t DRIVER_ENABLED_MASK = 0
+#define DRIVER(name, enabled, capabilities, state_size, event) | ((uint32_t)(enabled) << DRIVER_INDEX_##name)
+#include "drivers/driver_list.h"
+#undef DRIVER
+    ;
+
+// descriptor of a driver: entry of the driver table (stored in flash)
+struct DriverDescriptor
+{
+    // initialization function (Registration message)
+    bool (*init)(uint32_t profile_id, const Registration &registration);
+    // action function (Action message)
+    void (*run)(uint32_t profile_id, const Action &action);
+    // event function: returns true if an event occurred (NULL if not supported)
+    bool (*event)(uint32_t profile_id);
+    // lists the hardware resources of a registration, returns the number of resources
+    uint8_t (*resources)(const Registration &registration, Resource *resources);
+    // releases the hardware of a profile (called before the profile gets deleted)
+    void (*teardown)(uint32_t profile_id);
+    // number of bytes used in the profile slot state
+    uint8_t state_size;
+    // DRIVER_CAP_* flags
+    uint8_t capabilities;
+};
+
+/*========================================================================*/
+/*                          PUBLIC FUNCTIONS                              */
+/*========================================================================*/
+
+/**
+    @brief  Reads the descriptor of a driver from the driver table
+    @param  which_driver: oneof tag of the driver (Action.which_driver or Registration.which_driver)
+    @param  descriptor: copy of the descriptor
+    @return false if no driver is defined for the tag or the driver is not compiled in
+*/
+bool get_driver(pb_size_t which_driver, DriverDescriptor *descriptor);
+
+#endif
@@ -0,0 +1,413 @@
+/**************************************************************************/
+/*!
+    @file     analog_generic.cpp
+    @author   Jonas Brütsch
+
+    Generic driver for analog inputs (ADC channels A0 - A15).
+
+    The ADC runs in free-running mode: the ISR of every conversion selects
+    the channel of the conversion after the next one (the running conversion
+    has already latched its channel). It cycles through all
+    ANALOG_CHANNELS_MAX slots of the sampling table, unused slots convert
+    GND => every channel is sampled at a fixed rate, independent of the
+    number of registered channels:
+        value period = ANALOG_CONVERSION_US * ANALOG_CHANNELS_MAX * 4^extra_bits
+    With extra_bits, 4^n conversions are summed up + decimated (>> n) into
+    one value with 10 + n bits. The values are written into a ring buffer
+    per channel, a read returns the newest value without a conversion wait.
+*/
+/**************************************************************************/
+
+#include "analog_generic.h"
+
+#if DRIVER_ENABLE_ANALOG_GENERIC
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+
+/*========================================================================*/
+/*                    PRIVATE DEFINITIONS                                 */
+/*========================================================================*/
+
+// returned if the sampling table is full
+#define ANALOG_SLOT_NONE 0xFF
+
+// ADMUX/MUX5 selection of GND (0 V) for unused slots
+#define ANALOG_MUX_GND 0x1F
+
+// conversions of a new channel which are discarded (started before the channel was selected)
+#define ANALOG_DISCARD 2
+
+#define ANALOG_RING_MASK (ANALOG_RING_SIZE - 1)
+
+/* Threshold events */
+#define ANALOG_EVENT_NONE 0
+#define ANALOG_EVENT_ABOVE 1
+#define ANALOG_EVENT_BELOW 2
+
+static_assert((ANALOG_RING_SIZE & ANALOG_RING_MASK) == 0, "ANALOG_RING_SIZE has to be a power of 2");
+
+// channel sampled by the ADC
+struct AnalogChannel
+{
+    uint8_t channel;
+    uint8_t extra_bits;
+    volatile bool used;
+    volatile uint8_t discard;
+    /* decimation */
+    uint16_t sum;
+    uint8_t count;
+    /* threshold event (checked by the ISR) */
+    uint8_t event_mode;
+    uint16_t threshold;
+    volatile bool armed;
+    volatile bool triggered;
+    volatile uint16_t trigger_value;
+    /* ring buffer: head counts all values */
+    volatile uint16_t head;
+    uint16_t values[ANALOG_RING_SIZE];
+};
+
+static AnalogChannel channels[ANALOG_CHANNELS_MAX];
+// slot of the running conversion + of the conversion selected in ADMUX
+static volatile uint8_t converting = 0;
+static volatile uint8_t queued = 0;
+
+/**
+    @brief  Selects the channel of a slot in ADMUX/ADCSRB (AVCC reference, free-running mode)
+*/
+void select_slot(uint8_t slot);
+
+/**
+    @brief  Starts the ADC if a channel is used, stops it if none is used
+*/
+void adc_update(void);
+
+/**
+    @brief  Waits for the first value of a new channel (deadline TIMEOUT_ANALOG_MS)
+    @return false if the timeout error was sent
+*/
+bool wait_value(uint32_t profile_id, AnalogChannel &ch);
+
+/**
+    @brief  Sends the next block of the stream if enough values are available
+    @return true if DATA was sent
+*/
+bool send_block(uint32_t profile_id, Analog_Generic_State *state);
+
+/*========================================================================*/
+/*                          FUNCTION DEFINITIONS                          */
+/*========================================================================*/
+
+/**************************************************************************/
+/*!
+    Initialization: takes a slot of the sampling table
+*/
+bool init_analog_generic(uint32_t profile_id, const R_Analog_Generic &profile)
+{
+    uint8_t slot = ANALOG_SLOT_NONE;
+
+    if (profile.channel > 15 || profile.extra_bits > ANALOG_EXTRA_BITS_MAX)
+        return false;
+
+    for (uint8_t i = 0; slot == ANALOG_SLOT_NONE && i < ANALOG_CHANNELS_MAX; i++)
+    {
+        if (!channels[i].used)
+            slot = i;
+    }
+    if (slot == ANALOG_SLOT_NONE)
+        return false;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        memset((void *)&channels[slot], 0, sizeof(AnalogChannel));
+        channels[slot].channel = (uint8_t)profile.channel;
+        channels[slot].extra_bits = (uint8_t)profile.extra_bits;
+        channels[slot].discard = ANALOG_DISCARD;
+        channels[slot].used = true;
+    }
+    profile_manager.get_state<Analog_Generic_State>(profile_id)->channel_slot = slot;
+
+    // digital input buffer off (less noise + current)
+    if (profile.channel < 8)
+        DIDR0 |= _BV(profile.channel);
+    else
+        DIDR2 |= _BV(profile.channel - 8);
+
+    adc_update();
+    return true;
+}
+
+/**************************************************************************/
+/*!
+    Action function for analog_generic:
+        - read: newest value (DATA: 2 bytes packed)
+        - above/below: ACK, DATA with the value once it is > or < the threshold
+        - stream_block: DATA with the value period [us] (4 bytes packed), then
+          one DATA per block: lost values (2 bytes) + stream_block values (2 bytes each),
+          all packed (see pack_value())
+*/
+void run_analog_generic(uint32_t profile_id, const A_Analog_Generic &action)
+{
+    Analog_Generic_State *state = profile_manager.get_state<Analog_Generic_State>(profile_id);
+    AnalogChannel &ch = channels[state->channel_slot];
+    byte data[4];
+    uint16_t value = 0;
+
+    switch (action.which_mode)
+    {
+    case A_Analog_Generic_read_tag:
+        if (!wait_value(profile_id, ch))
+            return;
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+        {
+            value = ch.values[(ch.head - 1) & ANALOG_RING_MASK];
+        }
+        send_data(profile_id, data, pack_value(data, value, 2));
+        break;
+
+    case A_Analog_Generic_above_tag:
+    case A_Analog_Generic_below_tag:
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+        {
+            ch.event_mode = (action.which_mode == A_Analog_Generic_above_tag) ? ANALOG_EVENT_ABOVE : ANALOG_EVENT_BELOW;
+            ch.threshold = (uint16_t)((action.which_mode == A_Analog_Generic_above_tag) ? action.mode.above : action.mode.below);
+            ch.triggered = false;
+            ch.armed = true;
+        }
+        profile_manager.set_event(profile_id, true);
+        send_ack(profile_id);
+        break;
+
+    case A_Analog_Generic_stream_block_tag:
+        if (action.mode.stream_block > ANALOG_RING_SIZE)
+        {
+            send_error(profile_id, ErrorCode_ERR_OUT_OF_RANGE);
+            return;
+        }
+        state->stream_block = (uint8_t)action.mode.stream_block;
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+        {
+            state->stream_tail = ch.head;
+        }
+        if (state->stream_block != 0)
+        {
+            profile_manager.set_event(profile_id, true);
+            uint32_t period_us = ((uint32_t)ANALOG_CONVERSION_US * ANALOG_CHANNELS_MAX) << (2 * ch.extra_bits);
+            send_data(profile_id, data, pack_value(data, period_us, 4));
+        }
+        else
+            send_data(profile_id);
+        break;
+
+    default:
+        send_error(profile_id, ErrorCode_ERR_NO_MODE);
+        break;
+    }
+}
+
+/**************************************************************************/
+/*!
+    Event function for analog_generic: threshold event (detected by the ISR)
+    + stream blocks. Only a threshold event takes priority over the requests
+    of the loop pass, a stream block does not (it would starve them).
+*/
+bool event_analog_generic(uint32_t profile_id)
+{
+    Analog_Generic_State *state = profile_manager.get_state<Analog_Generic_State>(profile_id);
+    AnalogChannel &ch = channels[state->channel_slot];
+    bool sent = false;
+
+    if (ch.triggered)
+    {
+        byte data[2];
+        uint16_t value;
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+        {
+            value = ch.trigger_value;
+            ch.triggered = false;
+        }
+        protobuf_complete(profile_id);
+        send_data(profile_id, data, pack_value(data, value, 2));
+        // next pending request: same threshold
+        ch.armed = pending_count(profile_id) > 0;
+        sent = true;
+    }
+    else if (state->stream_block != 0)
+        send_block(profile_id, state);
+
+    // stop event listening if neither a threshold nor a stream is active
+    profile_manager.set_event(profile_id, ch.armed || ch.triggered || state->stream_block != 0);
+    return sent;
+}
+
+/**************************************************************************/
+/*!
+    Resources of an analog input: the pin of the channel (the ADC is shared)
+*/
+uint8_t resources_analog_generic(const R_Analog_Generic &profile, Resource *resources)
+{
+    resources[0] = {RESOURCE_PIN, resource_id(A0 + profile.channel)};
+    return 1;
+}
+
+/**************************************************************************/
+/*!
+    Teardown of an analog input: frees the slot, the ADC stops with the last channel
+*/
+void teardown_analog_generic(uint32_t profile_id)
+{
+    uint8_t channel = (uint8_t)profile_manager.get_registration(profile_id)->driver.r_analog_generic.channel;
+    AnalogChannel &ch = channels[profile_manager.get_state<Analog_Generic_State>(profile_id)->channel_slot];
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        ch.used = false;
+        ch.armed = false;
+        ch.triggered = false;
+    }
+    if (channel < 8)
+        DIDR0 &= ~_BV(channel);
+    else
+        DIDR2 &= ~_BV(channel - 8);
+
+    adc_update();
+}
+
+/*========================================================================*/
+/*                          PRIVATE FUNCTIONS                             */
+/*========================================================================*/
+
+void select_slot(uint8_t slot)
+{
+    uint8_t channel = channels[slot].used ? channels[slot].channel : ANALOG_MUX_GND;
+
+    // channels 8 - 15: MUX5 in ADCSRB (ADTS = 0: free-running mode)
+    if (channel == ANALOG_MUX_GND)
+    {
+        ADMUX = _BV(REFS0) | ANALOG_MUX_GND;
+        ADCSRB = 0;
+    }
+    else
+    {
+        ADMUX = _BV(REFS0) | (channel & 0x07);
+        ADCSRB = (channel & 0x08) ? _BV(MUX5) : 0;
+    }
+}
+
+void adc_update(void)
+{
+    bool used = false;
+
+    for (uint8_t i = 0; i < ANALOG_CHANNELS_MAX; i++)
+        used |= channels[i].used;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        if (!used)
+        {
+            // stop + clear a pending interrupt, enabled like after init() of the Arduino core (analogRead())
+            ADCSRA = _BV(ADEN) | _BV(ADIF) | _BV(ADPS2) | _BV(ADPS1) | _BV(ADPS0);
+        }
+        else if (!(ADCSRA & _BV(ADIE)))
+        {
+            // ADEN is already set by the Arduino core => started: interrupt enabled
+            // the first two conversions use slot 0
+            converting = 0;
+            queued = 0;
+            select_slot(0);
+            // prescaler 128: 125 kHz ADC clock
+            ADCSRA = _BV(ADEN) | _BV(ADSC) | _BV(ADATE) | _BV(ADIE) | _BV(ADPS2) | _BV(ADPS1) | _BV(ADPS0);
+        }
+    }
+}
+
+bool wait_value(uint32_t profile_id, AnalogChannel &ch)
+{
+    Deadline deadline = deadline_start(TIMEOUT_ANALOG_MS);
+
+    // head wraps after 65536 values => waits for one value at most
+    while (ch.head == 0)
+    {
+        if (deadline_expired(deadline))
+        {
+            send_timeout(profile_id, deadline);
+            return false;
+        }
+        delay(1);
+    }
+    return true;
+}
+
+bool send_block(uint32_t profile_id, Analog_Generic_State *state)
+{
+    AnalogChannel &ch = channels[state->channel_slot];
+    byte data[2 + 2 * ANALOG_RING_SIZE];
+    uint16_t values[ANALOG_RING_SIZE];
+    uint16_t lost = 0;
+    uint8_t index = 0;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        uint16_t available = ch.head - state->stream_tail;
+        if (available < state->stream_block)
+            return false;
+        // the ISR has overwritten the oldest values
+        if (available > ANALOG_RING_SIZE)
+        {
+            lost = available - ANALOG_RING_SIZE;
+            state->stream_tail += lost;
+        }
+        for (uint8_t i = 0; i < state->stream_block; i++)
+            values[i] = ch.values[(state->stream_tail + i) & ANALOG_RING_MASK];
+        state->stream_tail += state->stream_block;
+    }
+
+    index += pack_value(&data[index], lost, 2);
+    for (uint8_t i = 0; i < state->stream_block; i++)
+        index += pack_value(&data[index], values[i], 2);
+    send_data(profile_id, data, index);
+    return true;
+}
+
+/**************************************************************************/
+/*!
+    ADC ISR: result of the running conversion, the next conversion has
+    already started => select the channel of the one after it
+*/
+ISR(ADC_vect)
+{
+    uint16_t sample = ADC;
+    AnalogChannel &ch = channels[converting];
+
+    if (ch.used)
+    {
+        if (ch.discard != 0)
+            ch.discard--;
+        else
+        {
+            ch.sum += sample;
+            if (++ch.count == (1 << (2 * ch.extra_bits)))
+            {
+                uint16_t value = ch.sum >> ch.extra_bits;
+                ch.values[ch.head & ANALOG_RING_MASK] = value;
+                ch.head++;
+                ch.sum = 0;
+                ch.count = 0;
+
+                if (ch.armed && ((ch.event_mode == ANALOG_EVENT_ABOVE && value > ch.threshold) ||
+                                 (ch.event_mode == ANALOG_EVENT_BELOW && value < ch.threshold)))
+                {
+                    ch.trigger_value = value;
+                    ch.triggered = true;
+                    ch.armed = false;
+                }
+            }
+        }
+    }
+
+    converting = queued;
+    queued = (queued + 1 == ANALOG_CHANNELS_MAX) ? 0 : queued + 1;
+    select_slot(queued);
+}
+
+#endif
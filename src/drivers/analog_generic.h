@@ -0,0 +1,76 @@
+#ifndef _ANALOG_GENERIC_H_
+#define _ANALOG_GENERIC_H_
+
+#include "main.h"
+
+/*========================================================================*/
+/*                          PUBLIC DEFINITIONS                            */
+/*========================================================================*/
+
+// max. number of analog channels sampled by the ADC (can be set with a build flag)
+#ifndef ANALOG_CHANNELS_MAX
+#define ANALOG_CHANNELS_MAX 4
+#endif
+
+// values per channel in the ring buffer (power of 2, max. block of the stream).
+// A stream only keeps up if a loop pass is shorter than the ring: 32 values of
+// 4 x 104 us (extra_bits 0) => 13.3 ms > LOOP_IDLE_US (10 ms) + a short loop pass
+#ifndef ANALOG_RING_SIZE
+#define ANALOG_RING_SIZE 32
+#endif
+
+// one conversion: 13 ADC clocks, 16 MHz / 128 => 104 us
+#define ANALOG_CONVERSION_US 104
+
+// max. extra bits by oversampling (sum of 4^3 conversions fits into 16 bit)
+#define ANALOG_EXTRA_BITS_MAX 3
+
+// driver state stored in the profile slot
+struct Analog_Generic_State
+{
+    // index of the channel in the sampling table
+    uint8_t channel_slot;
+    // values per DATA block of the stream (0 => no stream)
+    uint8_t stream_block;
+    // read position of the stream (counts values like the head of the ring buffer)
+    uint16_t stream_tail;
+};
+
+/*========================================================================*/
+/*                          PUBLIC FUNCTIONS                              */
+/*========================================================================*/
+
+/**************************************************************************/
+/*!
+    @brief  Initialization function for analog_generic driver
+    @return boolean if initialization was successful or not
+*/
+bool init_analog_generic(uint32_t profile_id, const R_Analog_Generic &profile);
+
+/**************************************************************************/
+/*!
+    @brief  Action function for analog_generic driver
+*/
+void run_analog_generic(uint32_t profile_id, const A_Analog_Generic &action);
+
+/**************************************************************************/
+/*!
+    @brief  Event function for analog_generic driver (threshold events + stream)
+    @return true if a threshold event was sent (stream blocks: false)
+*/
+bool event_analog_generic(uint32_t profile_id);
+
+/**************************************************************************/
+/*!
+    @brief  Lists the hardware resources used by a analog_generic registration
+    @return number of resources
+*/
+uint8_t resources_analog_generic(const R_Analog_Generic &profile, Resource *resources);
+
+/**************************************************************************/
+/*!
+    @brief  Teardown function for analog_generic driver: releases the hardware of the profile
+*/
+void teardown_analog_generic(uint32_t profile_id);
+
+#endif
@@ -1,4 +1,6 @@
 #include "color_sensor.h"
+
+#if DRIVER_ENABLE_COLOR_SENSOR
 #include "Adafruit_TCS34725.h"
 
 /*========================================================================*/
@@ -24,7 +26,7 @@ byte data[3];
 /*!
     Initialization function for color_sensor
 */
-bool init_color_sensor(uint32_t profile_id, R_Color_Sensor profile)
+bool init_color_sensor(uint32_t profile_id, const R_Color_Sensor &profile)
 {
     r = 0;
     g = 0;
@@ -42,7 +44,7 @@ bool init_color_sensor(uint32_t profile_id, R_Color_Sensor profile)
     Action function for color_sensor
     TODO: implement event-handling => event on specific color (rgb) value
 */
-void run_color_sensor(uint32_t profile_id, A_Color_Sensor action)
+void run_color_sensor(uint32_t profile_id, const A_Color_Sensor &action)
 {
     /* read value */
     // TODO: check if /255 gives a valid resolution => why not use read8 ?
@@ -58,3 +60,24 @@ void run_color_sensor(uint32_t profile_id, A_Color_Sensor action)
 
     send_data(profile_id, data, 3);
 }
+
+/**************************************************************************/
+/*!
+    Resources of the color sensor: I2C address of the TCS34725
+*/
+uint8_t resources_color_sensor(const R_Color_Sensor &profile, Resource *resources)
+{
+    resources[0] = {RESOURCE_I2C, TCS34725_ADDRESS};
+    return 1;
+}
+
+/**************************************************************************/
+/*!
+    Teardown of the color sensor: power down the sensor
+*/
+void teardown_color_sensor(uint32_t profile_id)
+{
+    tcs.disable();
+}
+
+#endif
@@ -12,12 +12,25 @@
     @brief  Initialization function for color_sensor driver
     @return boolean if initialization was successful or not
 */
-bool init_color_sensor(uint32_t profile_id, R_Color_Sensor profile);
+bool init_color_sensor(uint32_t profile_id, const R_Color_Sensor &profile);
 
 /**************************************************************************/
 /*!
     @brief  Action function for color_sensor ddriver
 */
-void run_color_sensor(uint32_t profile_id, A_Color_Sensor action);
+void run_color_sensor(uint32_t profile_id, const A_Color_Sensor &action);
+
+/**************************************************************************/
+/*!
+    @brief  Lists the hardware resources used by a color_sensor registration
+    @return number of resources
+*/
+uint8_t resources_color_sensor(const R_Color_Sensor &profile, Resource *resources);
+
+/**************************************************************************/
+/*!
+    @brief  Teardown function for color_sensor driver: releases the hardware of the profile
+*/
+void teardown_color_sensor(uint32_t profile_id);
 
 #endif
@@ -1,12 +1,6 @@
 #include "digital_generic.h"
 
-/*========================================================================*/
-/*                          PRIVATE DEFINITIONS                           */
-/*========================================================================*/
-
-/* Definitions used for event handling */
-// indicates if corresponding profile has trigger on HIGH or LOW (default = true)
-bool event_trigger[256] = {1};
+#if DRIVER_ENABLE_DIGITAL_GENERIC
 
 /*========================================================================*/
 /*                          PUBLIC FUNCTIONS                              */
@@ -16,7 +10,7 @@ bool event_trigger[256] = {1};
 /*
     Initialization of digital pin
 */
-bool init_digital_generic(uint32_t profile_id, R_Digital_Generic profile)
+bool init_digital_generic(uint32_t profile_id, const R_Digital_Generic &profile)
 {
     // initialize pin
     pinMode((uint8_t)profile.pin, (uint8_t)profile.mode);
@@ -33,10 +27,10 @@ bool init_digital_generic(uint32_t profile_id, R_Digital_Generic profile)
         - read digital pin in blocking mode: return value on request
         - read digital pin in non-blocking mode: return value on event (HIGH/LOW/CHANGE?)
 */
-void run_digital_generic(uint32_t profile_id, A_Digital_Generic action)
+void run_digital_generic(uint32_t profile_id, const A_Digital_Generic &action)
 {
     // get registration profile
-    R_Digital_Generic profile = profile_manager.profiles[profile_id].driver.r_digital_generic;
+    const R_Digital_Generic &profile = profile_manager.get_registration(profile_id)->driver.r_digital_generic;
 
     /* action: write digital pin */
     if (profile.mode == DigitalMode_OUTPUT)
@@ -56,15 +50,15 @@ void run_digital_generic(uint32_t profile_id, A_Digital_Generic action)
     else if (profile.mode != DigitalMode_OUTPUT && action.event_triggered)
     {
         // set event flag for profile to true => starts event listening
-        profile_manager.events[profile_id] = true;
+        profile_manager.set_event(profile_id, true);
         // set trigger for event
-        event_trigger[profile_id] = action.output;
+        profile_manager.get_state<Digital_Generic_State>(profile_id)->event_trigger = action.output;
         // acknowledge start of event listening
         send_ack(profile_id);
     }
     /* ERROR */
     else
-        send_error(profile_id, "Action for digital generic failed.");
+        send_error(profile_id, ErrorCode_ERR_ACTION_FAILED);
 }
 
 /**************************************************************************/
@@ -73,18 +67,40 @@ void run_digital_generic(uint32_t profile_id, A_Digital_Generic action)
 */
 bool event_digital_generic(uint32_t profile_id)
 {
-    int result = digitalRead((uint8_t)profile_manager.profiles[profile_id].driver.r_digital_generic.pin);
+    int result = digitalRead((uint8_t)profile_manager.get_registration(profile_id)->driver.r_digital_generic.pin);
 
     /* event occured: pin has trigger value */
-    if (result == event_trigger[profile_id])
+    if (result == profile_manager.get_state<Digital_Generic_State>(profile_id)->event_trigger)
     {
         ++result; // to avoid empty byte field => cannot be parsed otherwise
+        protobuf_complete(profile_id);
         send_data(profile_id, &result, 1);
-        // set event flag for profile to false => stop event listening
-        profile_manager.events[profile_id] = false;
+        // stop event listening if no other request is pending (the last trigger value is used)
+        profile_manager.set_event(profile_id, pending_count(profile_id) > 0);
         return true;
     }
     /* event did not occure */
     else
         return false;
 }
+
+/**************************************************************************/
+/*!
+    Resources of a digital pin: the pin itself
+*/
+uint8_t resources_digital_generic(const R_Digital_Generic &profile, Resource *resources)
+{
+    resources[0] = {RESOURCE_PIN, resource_id(profile.pin)};
+    return 1;
+}
+
+/**************************************************************************/
+/*!
+    Teardown of a digital pin: set pin back to INPUT (default after reset)
+*/
+void teardown_digital_generic(uint32_t profile_id)
+{
+    pinMode((uint8_t)profile_manager.get_registration(profile_id)->driver.r_digital_generic.pin, INPUT);
+}
+
+#endif
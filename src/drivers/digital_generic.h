@@ -3,6 +3,18 @@
 
 #include "main.h"
 
+/*========================================================================*/
+/*                          PUBLIC DEFINITIONS                            */
+/*========================================================================*/
+
+/* Definitions used for event handling */
+// driver state stored in the profile slot
+struct Digital_Generic_State
+{
+    // indicates if corresponding profile has trigger on HIGH or LOW
+    uint8_t event_trigger;
+};
+
 /*========================================================================*/
 /*                          PUBLIC FUNCTIONS                              */
 /*========================================================================*/
@@ -12,13 +24,13 @@
     @brief  Initialization function for generic driver for digital I/O
     @return boolean if initialization was successful or not
 */
-bool init_digital_generic(uint32_t profile_id, R_Digital_Generic profile);
+bool init_digital_generic(uint32_t profile_id, const R_Digital_Generic &profile);
 
 /**************************************************************************/
 /*!
     @brief  Action function for generic driver for digital I/O
 */
-void run_digital_generic(uint32_t profile_id, A_Digital_Generic action);
+void run_digital_generic(uint32_t profile_id, const A_Digital_Generic &action);
 
 /**************************************************************************/
 /*!
@@ -26,4 +38,18 @@ void run_digital_generic(uint32_t profile_id, A_Digital_Generic action);
     @return boolean if event for specific profile occured
 */
 bool event_digital_generic(uint32_t profile_id);
+
+/**************************************************************************/
+/*!
+    @brief  Lists the hardware resources used by a digital_generic registration
+    @return number of resources
+*/
+uint8_t resources_digital_generic(const R_Digital_Generic &profile, Resource *resources);
+
+/**************************************************************************/
+/*!
+    @brief  Teardown function for digital_generic driver: releases the hardware of the profile
+*/
+void teardown_digital_generic(uint32_t profile_id);
+
 #endif
@@ -0,0 +1,31 @@
+/**************************************************************************/
+/*!
+    @file     driver_list.h
+
+    List of all drivers, used to generate the driver table (see driver_table.cpp).
+    No include guard: the file is included once per generated part of the table.
+
+    Every driver is added with one line:
+        DRIVER(name, enabled, capabilities, state_size, event)
+        - name: functions init_<name>/run_<name>/resources_<name>/teardown_<name>,
+                oneof fields r_<name>/a_<name>
+        - enabled: DRIVER_ENABLE_<NAME> (see driver_config.h)
+        - capabilities: DRIVER_CAP_* flags
+        - state_size: bytes used in the profile slot state (0 if none)
+        - event: event function (NULL if not supported)
+
+    The order has to match the oneof tags in line_protocol.proto (checked at compile time).
+*/
+/**************************************************************************/
+
+DRIVER(digital_generic, DRIVER_ENABLE_DIGITAL_GENERIC, DRIVER_CAP_EVENT, sizeof(Digital_Generic_State), event_digital_generic)
+DRIVER(uart_ttl_generic, DRIVER_ENABLE_UART_TTL_GENERIC, DRIVER_CAP_EVENT | DRIVER_CAP_BLOCKING, 0, event_uart_ttl_generic)
+DRIVER(color_sensor, DRIVER_ENABLE_COLOR_SENSOR, 0, 0, NULL)
+DRIVER(ultrasonic_sensor, DRIVER_ENABLE_ULTRASONIC_SENSOR, DRIVER_CAP_BLOCKING, 0, NULL)
+DRIVER(step_motor, DRIVER_ENABLE_STEP_MOTOR, DRIVER_CAP_EVENT | DRIVER_CAP_BLOCKING, sizeof(Step_Motor_State), event_step_motor)
+DRIVER(mcu_driver, DRIVER_ENABLE_MCU_DRIVER, 0, 0, NULL)
+DRIVER(analog_generic, DRIVER_ENABLE_ANALOG_GENERIC, DRIVER_CAP_EVENT, sizeof(Analog_Generic_State), event_analog_generic)
+DRIVER(pwm_generic, DRIVER_ENABLE_PWM_GENERIC, DRIVER_CAP_EVENT, 0, event_pwm_generic)
+DRIVER(encoder_generic, DRIVER_ENABLE_ENCODER_GENERIC, DRIVER_CAP_EVENT, sizeof(Encoder_Generic_State), event_encoder_generic)
+// ADI-DRIVER-List: Label for automatic driver initialization (Do not move!)
+// END: needed for proper driver initialization
@@ -0,0 +1,524 @@
+/**************************************************************************/
+/*!
+    @file     encoder_generic.cpp
+    @author   Jonas Brütsch
+
+    Generic driver for quadrature encoders (e.g. on the belt of the conveyor).
+
+    The inputs A and B are connected to external interrupt pins (INT0 - INT5),
+    both edges of both inputs are counted (x4 decoding): the ISR reads A + B
+    from the port registers and looks the step up in a table with the old
+    and the new state. A transition of both inputs at once (missed edge) is
+    counted as error.
+
+    Velocity [counts/s]:
+        - high speed: counts since the last measurement / elapsed time
+          (>= ENCODER_COUNTS_MIN counts within ENCODER_STANDSTILL_US)
+        - low speed: period between the last two edges in the same direction,
+          measured by the ISR (0 after ENCODER_STANDSTILL_US without an edge)
+
+    A linked step motor profile (step_profile_id) gives the following error:
+        position - motor steps * ratio_counts / ratio_steps
+    Both are counted from the registration or the last reset.
+*/
+/**************************************************************************/
+
+#include "encoder_generic.h"
+
+#if DRIVER_ENABLE_ENCODER_GENERIC
+#include "helper_files/step_lowlevel.h"
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+
+/*========================================================================*/
+/*                    PRIVATE DEFINITIONS                                 */
+/*========================================================================*/
+
+// returned if a pin has no external interrupt/the encoder table is full
+#define ENCODER_NONE 0xFF
+
+// external interrupts INT0 - INT5
+#define ENCODER_INTERRUPTS 6
+
+// step table entry of a transition of both inputs
+#define ENCODER_INVALID 2
+
+/* Position events */
+#define ENCODER_EVENT_NONE 0
+#define ENCODER_EVENT_ABOVE 1
+#define ENCODER_EVENT_BELOW 2
+
+// pin + input register of an external interrupt
+struct EncoderInput
+{
+    uint8_t pin;
+    volatile uint8_t *port;
+    uint8_t mask;
+};
+
+static const EncoderInput encoder_inputs[ENCODER_INTERRUPTS] PROGMEM = {
+    {21, &PIND, _BV(0)}, {20, &PIND, _BV(1)}, {19, &PIND, _BV(2)},
+    {18, &PIND, _BV(3)}, {2, &PINE, _BV(4)}, {3, &PINE, _BV(5)},
+};
+
+// step per transition: index = old state << 2 | new state (state = A << 1 | B),
+// in RAM => no flash read in the ISR
+static const int8_t encoder_steps[16] = {
+    0, 1, -1, ENCODER_INVALID,
+    -1, 0, ENCODER_INVALID, 1,
+    1, ENCODER_INVALID, 0, -1,
+    ENCODER_INVALID, -1, 1, 0};
+
+struct Encoder
+{
+    volatile bool used;
+    uint8_t interrupt_a;
+    uint8_t interrupt_b;
+    /* inputs (read by the ISR) */
+    volatile uint8_t *port_a;
+    volatile uint8_t *port_b;
+    uint8_t mask_a;
+    uint8_t mask_b;
+    uint8_t last;
+    /* counted by the ISR */
+    volatile int32_t position;
+    volatile uint16_t errors;
+    volatile uint32_t edge_us;
+    // 0 => the last edge changed the direction
+    volatile uint32_t edge_period_us;
+    volatile int8_t direction;
+    /* position event (checked by the ISR) */
+    uint8_t event_mode;
+    int32_t threshold;
+    volatile bool armed;
+    volatile bool triggered;
+    volatile int32_t trigger_position;
+    /* count based velocity */
+    int32_t velocity_position;
+    uint32_t velocity_us;
+    /* following error */
+    long step_reference;
+    uint32_t max_error;
+    bool error_armed;
+};
+
+static Encoder encoders[ENCODER_MAX];
+// encoder of every external interrupt
+static uint8_t interrupt_owner[ENCODER_INTERRUPTS];
+
+/**
+    @brief  Index of the external interrupt of a pin
+    @return ENCODER_NONE if the pin has no external interrupt
+*/
+uint8_t encoder_interrupt(uint32_t pin);
+
+/**
+    @brief  Enables (any logical change) or disables an external interrupt
+*/
+void encoder_interrupt_enable(uint8_t interrupt, bool enabled);
+
+/**
+    @brief  Velocity [counts/s], see the file description
+*/
+int32_t encoder_velocity(Encoder &enc);
+
+/**
+    @brief  Following error to the linked step motor [counts]
+    @return false if no step motor profile is linked
+*/
+bool encoder_follow_error(uint32_t profile_id, Encoder &enc, int32_t *error);
+
+/**
+    @brief  Edge on input A or B of an encoder
+*/
+void encoder_isr(Encoder &enc);
+
+/**
+    @brief  Position of the step motor [steps] (0 if the step motor driver is not compiled in)
+*/
+long step_position(void);
+
+/*========================================================================*/
+/*                          FUNCTION DEFINITIONS                          */
+/*========================================================================*/
+
+/**************************************************************************/
+/*!
+    Initialization: takes an encoder slot, inputs with pull-up, enables the
+    external interrupts of both pins
+*/
+bool init_encoder_generic(uint32_t profile_id, const R_Encoder_Generic &profile)
+{
+    uint8_t interrupt_a = encoder_interrupt(profile.pin_a);
+    uint8_t interrupt_b = encoder_interrupt(profile.pin_b);
+    uint8_t slot = ENCODER_NONE;
+
+    if (interrupt_a == ENCODER_NONE || interrupt_b == ENCODER_NONE || interrupt_a == interrupt_b ||
+        (profile.step_profile_id != 0 && (profile.ratio_counts == 0 || profile.ratio_steps == 0)))
+        return false;
+
+    for (uint8_t i = 0; slot == ENCODER_NONE && i < ENCODER_MAX; i++)
+    {
+        if (!encoders[i].used)
+            slot = i;
+    }
+    if (slot == ENCODER_NONE)
+        return false;
+
+    Encoder &enc = encoders[slot];
+    long step_reference = step_position();
+
+    pinMode(profile.pin_a, INPUT_PULLUP);
+    pinMode(profile.pin_b, INPUT_PULLUP);
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        memset((void *)&enc, 0, sizeof(Encoder));
+        enc.interrupt_a = interrupt_a;
+        enc.interrupt_b = interrupt_b;
+        enc.port_a = (volatile uint8_t *)pgm_read_ptr(&encoder_inputs[interrupt_a].port);
+        enc.port_b = (volatile uint8_t *)pgm_read_ptr(&encoder_inputs[interrupt_b].port);
+        enc.mask_a = pgm_read_byte(&encoder_inputs[interrupt_a].mask);
+        enc.mask_b = pgm_read_byte(&encoder_inputs[interrupt_b].mask);
+        enc.last = ((*enc.port_a & enc.mask_a) ? 2 : 0) | ((*enc.port_b & enc.mask_b) ? 1 : 0);
+        enc.direction = 1;
+        enc.velocity_us = micros();
+        enc.step_reference = step_reference;
+        enc.used = true;
+
+        interrupt_owner[interrupt_a] = slot;
+        interrupt_owner[interrupt_b] = slot;
+        encoder_interrupt_enable(interrupt_a, true);
+        encoder_interrupt_enable(interrupt_b, true);
+    }
+    profile_manager.get_state<Encoder_Generic_State>(profile_id)->encoder_slot = slot;
+    return true;
+}
+
+/**************************************************************************/
+/*!
+    Action function for encoder_generic (values packed, see pack_value()):
+        - read: DATA with position (5 bytes), velocity (5 bytes), errors (2 bytes)
+        - above/below: ACK, DATA with the position (5 bytes) once it is > or < the threshold
+        - follow_error: DATA with the following error (5 bytes)
+        - max_error: ACK, DATA with the following error (5 bytes) once |error| > max_error
+        - reset: position + following error = 0, DATA
+*/
+void run_encoder_generic(uint32_t profile_id, const A_Encoder_Generic &action)
+{
+    Encoder &enc = encoders[profile_manager.get_state<Encoder_Generic_State>(profile_id)->encoder_slot];
+    byte data[12];
+    uint8_t index = 0;
+    int32_t error;
+
+    switch (action.which_mode)
+    {
+    case A_Encoder_Generic_read_tag:
+    {
+        int32_t velocity = encoder_velocity(enc);
+        int32_t position;
+        uint16_t errors;
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+        {
+            position = enc.position;
+            errors = enc.errors;
+        }
+        index += pack_value(&data[index], (uint32_t)position, 5);
+        index += pack_value(&data[index], (uint32_t)velocity, 5);
+        index += pack_value(&data[index], errors, 2);
+        send_data(profile_id, data, index);
+        break;
+    }
+
+    case A_Encoder_Generic_above_tag:
+    case A_Encoder_Generic_below_tag:
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+        {
+            enc.event_mode = (action.which_mode == A_Encoder_Generic_above_tag) ? ENCODER_EVENT_ABOVE : ENCODER_EVENT_BELOW;
+            enc.threshold = (action.which_mode == A_Encoder_Generic_above_tag) ? action.mode.above : action.mode.below;
+            enc.triggered = false;
+            enc.armed = true;
+        }
+        profile_manager.set_event(profile_id, true);
+        send_ack(profile_id);
+        break;
+
+    case A_Encoder_Generic_follow_error_tag:
+        if (!encoder_follow_error(profile_id, enc, &error))
+        {
+            send_error(profile_id, ErrorCode_ERR_NOT_FOUND);
+            return;
+        }
+        send_data(profile_id, data, pack_value(data, (uint32_t)error, 5));
+        break;
+
+    case A_Encoder_Generic_max_error_tag:
+        if (!encoder_follow_error(profile_id, enc, &error))
+        {
+            send_error(profile_id, ErrorCode_ERR_NOT_FOUND);
+            return;
+        }
+        enc.max_error = action.mode.max_error;
+        enc.error_armed = true;
+        profile_manager.set_event(profile_id, true);
+        send_ack(profile_id);
+        break;
+
+    case A_Encoder_Generic_reset_tag:
+    {
+        long step_reference = step_position();
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+        {
+            enc.position = 0;
+            enc.errors = 0;
+        }
+        enc.velocity_position = 0;
+        enc.step_reference = step_reference;
+        send_data(profile_id);
+        break;
+    }
+
+    default:
+        send_error(profile_id, ErrorCode_ERR_NO_MODE);
+        break;
+    }
+}
+
+/**************************************************************************/
+/*!
+    Event function for encoder_generic: position event (detected by the ISR)
+    + following error (checked on every call)
+*/
+bool event_encoder_generic(uint32_t profile_id)
+{
+    Encoder &enc = encoders[profile_manager.get_state<Encoder_Generic_State>(profile_id)->encoder_slot];
+    bool sent = false;
+    byte data[5];
+
+    if (enc.triggered)
+    {
+        int32_t position;
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+        {
+            position = enc.trigger_position;
+            enc.triggered = false;
+        }
+        protobuf_complete(profile_id);
+        send_data(profile_id, data, pack_value(data, (uint32_t)position, 5));
+        // next pending request: same threshold
+        enc.armed = pending_count(profile_id) > 0;
+        sent = true;
+    }
+
+    int32_t error;
+    if (enc.error_armed && encoder_follow_error(profile_id, enc, &error) &&
+        (uint32_t)labs(error) > enc.max_error)
+    {
+        protobuf_complete(profile_id);
+        send_data(profile_id, data, pack_value(data, (uint32_t)error, 5));
+        enc.error_armed = pending_count(profile_id) > 0;
+        sent = true;
+    }
+
+    // stop event listening if no event is active
+    profile_manager.set_event(profile_id, enc.armed || enc.triggered || enc.error_armed);
+    return sent;
+}
+
+/**************************************************************************/
+/*!
+    Resources of an encoder: both pins (the external interrupts belong to the pins)
+*/
+uint8_t resources_encoder_generic(const R_Encoder_Generic &profile, Resource *resources)
+{
+    resources[0] = {RESOURCE_PIN, resource_id(profile.pin_a)};
+    resources[1] = {RESOURCE_PIN, resource_id(profile.pin_b)};
+    return 2;
+}
+
+/**************************************************************************/
+/*!
+    Teardown of an encoder: disables the external interrupts, frees the slot
+*/
+void teardown_encoder_generic(uint32_t profile_id)
+{
+    const R_Encoder_Generic &profile = profile_manager.get_registration(profile_id)->driver.r_encoder_generic;
+    Encoder &enc = encoders[profile_manager.get_state<Encoder_Generic_State>(profile_id)->encoder_slot];
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        encoder_interrupt_enable(enc.interrupt_a, false);
+        encoder_interrupt_enable(enc.interrupt_b, false);
+        enc.used = false;
+        enc.armed = false;
+        enc.triggered = false;
+        enc.error_armed = false;
+    }
+    pinMode(profile.pin_a, INPUT);
+    pinMode(profile.pin_b, INPUT);
+}
+
+/*========================================================================*/
+/*                          PRIVATE FUNCTIONS                             */
+/*========================================================================*/
+
+uint8_t encoder_interrupt(uint32_t pin)
+{
+    for (uint8_t i = 0; i < ENCODER_INTERRUPTS; i++)
+    {
+        if (pgm_read_byte(&encoder_inputs[i].pin) == pin)
+            return i;
+    }
+    return ENCODER_NONE;
+}
+
+void encoder_interrupt_enable(uint8_t interrupt, bool enabled)
+{
+    // ISCn1:0 = 01: any logical change (INT0 - INT3: EICRA, INT4 - INT7: EICRB)
+    volatile uint8_t *eicr = (interrupt < 4) ? &EICRA : &EICRB;
+    uint8_t shift = 2 * (interrupt & 0x03);
+
+    if (enabled)
+    {
+        *eicr = (*eicr & ~(0x03 << shift)) | (0x01 << shift);
+        EIFR = _BV(interrupt);
+        EIMSK |= _BV(interrupt);
+    }
+    else
+        EIMSK &= ~_BV(interrupt);
+}
+
+int32_t encoder_velocity(Encoder &enc)
+{
+    int32_t position;
+    uint32_t edge_us, edge_period_us;
+    int8_t direction;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        position = enc.position;
+        edge_us = enc.edge_us;
+        edge_period_us = enc.edge_period_us;
+        direction = enc.direction;
+    }
+    uint32_t now = micros();
+    int32_t counts = position - enc.velocity_position;
+    uint32_t elapsed = now - enc.velocity_us;
+
+    // high speed: enough counts in a short time => better than the period of a single edge
+    if (elapsed <= ENCODER_STANDSTILL_US && labs(counts) >= ENCODER_COUNTS_MIN)
+    {
+        enc.velocity_position = position;
+        enc.velocity_us = now;
+        return (int32_t)((int64_t)counts * 1000000L / (int32_t)elapsed);
+    }
+    // too old to be measured against the next read
+    if (elapsed > ENCODER_STANDSTILL_US)
+    {
+        enc.velocity_position = position;
+        enc.velocity_us = now;
+    }
+
+    // low speed: period of the last edge, the time since the last edge limits it while slowing down
+    uint32_t since = now - edge_us;
+    if (edge_period_us == 0 || since > ENCODER_STANDSTILL_US)
+        return 0;
+    if (since > edge_period_us)
+        edge_period_us = since;
+    return direction * (int32_t)(1000000UL / edge_period_us);
+}
+
+bool encoder_follow_error(uint32_t profile_id, Encoder &enc, int32_t *error)
+{
+    const R_Encoder_Generic &profile = profile_manager.get_registration(profile_id)->driver.r_encoder_generic;
+    Registration *motor = profile_manager.get_registration(profile.step_profile_id);
+
+    if (profile.step_profile_id == 0 || motor == NULL || motor->which_driver != Registration_r_step_motor_tag)
+        return false;
+
+    long step = step_position();
+    int32_t position;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        position = enc.position;
+    }
+    int64_t expected = (int64_t)(step - enc.step_reference) * profile.ratio_counts / profile.ratio_steps;
+    *error = position - (int32_t)expected;
+    return true;
+}
+
+void encoder_isr(Encoder &enc)
+{
+    uint8_t state = ((*enc.port_a & enc.mask_a) ? 2 : 0) | ((*enc.port_b & enc.mask_b) ? 1 : 0);
+    int8_t step = encoder_steps[(enc.last << 2) | state];
+
+    enc.last = state;
+    if (step == 0)
+        return;
+    if (step == ENCODER_INVALID)
+    {
+        enc.errors++;
+        return;
+    }
+
+    uint32_t now = micros();
+    enc.edge_period_us = (step == enc.direction) ? now - enc.edge_us : 0;
+    enc.edge_us = now;
+    enc.direction = step;
+
+    int32_t position = enc.position + step;
+    enc.position = position;
+    if (enc.armed && ((enc.event_mode == ENCODER_EVENT_ABOVE && position > enc.threshold) ||
+                      (enc.event_mode == ENCODER_EVENT_BELOW && position < enc.threshold)))
+    {
+        enc.trigger_position = position;
+        enc.armed = false;
+        enc.triggered = true;
+    }
+}
+
+long step_position(void)
+{
+#if DRIVER_ENABLE_STEP_MOTOR
+    struct step_status_t status;
+    get_step_status(&status);
+    return status.position;
+#else
+    return 0;
+#endif
+}
+
+/**************************************************************************/
+/*!
+    External interrupt ISRs: only enabled for the pins of a registered encoder
+*/
+ISR(INT0_vect)
+{
+    encoder_isr(encoders[interrupt_owner[0]]);
+}
+
+ISR(INT1_vect)
+{
+    encoder_isr(encoders[interrupt_owner[1]]);
+}
+
+ISR(INT2_vect)
+{
+    encoder_isr(encoders[interrupt_owner[2]]);
+}
+
+ISR(INT3_vect)
+{
+    encoder_isr(encoders[interrupt_owner[3]]);
+}
+
+ISR(INT4_vect)
+{
+    encoder_isr(encoders[interrupt_owner[4]]);
+}
+
+ISR(INT5_vect)
+{
+    encoder_isr(encoders[interrupt_owner[5]]);
+}
+
+#endif
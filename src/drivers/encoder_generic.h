@@ -0,0 +1,67 @@
+#ifndef _ENCODER_GENERIC_H_
+#define _ENCODER_GENERIC_H_
+
+#include "main.h"
+
+/*========================================================================*/
+/*                          PUBLIC DEFINITIONS                            */
+/*========================================================================*/
+
+// max. number of encoders (2 of the 6 external interrupts each)
+#define ENCODER_MAX 3
+
+// velocity: counts since the last measurement for the count based velocity (below: edge period)
+#ifndef ENCODER_COUNTS_MIN
+#define ENCODER_COUNTS_MIN 16
+#endif
+
+// velocity: no edge for this time => standstill [us]
+#ifndef ENCODER_STANDSTILL_US
+#define ENCODER_STANDSTILL_US 200000UL
+#endif
+
+// driver state stored in the profile slot
+struct Encoder_Generic_State
+{
+    // index of the encoder (ISR data)
+    uint8_t encoder_slot;
+};
+
+/*========================================================================*/
+/*                          PUBLIC FUNCTIONS                              */
+/*========================================================================*/
+
+/**************************************************************************/
+/*!
+    @brief  Initialization function for encoder_generic driver
+    @return boolean if initialization was successful or not
+*/
+bool init_encoder_generic(uint32_t profile_id, const R_Encoder_Generic &profile);
+
+/**************************************************************************/
+/*!
+    @brief  Action function for encoder_generic driver
+*/
+void run_encoder_generic(uint32_t profile_id, const A_Encoder_Generic &action);
+
+/**************************************************************************/
+/*!
+    @brief  Event function for encoder_generic driver (position + following error events)
+    @return boolean if DATA was sent
+*/
+bool event_encoder_generic(uint32_t profile_id);
+
+/**************************************************************************/
+/*!
+    @brief  Lists the hardware resources used by a encoder_generic registration
+    @return number of resources
+*/
+uint8_t resources_encoder_generic(const R_Encoder_Generic &profile, Resource *resources);
+
+/**************************************************************************/
+/*!
+    @brief  Teardown function for encoder_generic driver: releases the hardware of the profile
+*/
+void teardown_encoder_generic(uint32_t profile_id);
+
+#endif
@@ -11,6 +11,12 @@
 /**************************************************************************/
 
 #include "step_lowlevel.h"
+#include "../../driver_config.h"
+
+#if DRIVER_ENABLE_STEP_MOTOR
+#include "../../perf_markers.h"
+#include "../../perf_counters.h"
+#include "../../trace.h"
 
 enum step_state_e
 {
@@ -41,6 +47,10 @@ struct step_param_t
     void (*speed_complete_callback)(void);
 } step_param = {0};
 
+// absolute step counter (not cleared between moves) + direction of the current move
+volatile long step_position = 0;
+volatile int8_t step_direction = 1;
+
 bool step_init_ll(void)
 {
     DIR_OUTPUT;
@@ -52,6 +62,8 @@ bool step_init_ll(void)
     ENABLE_LOW;
     //  ENABLE_HIGH;
     memset(&step_param, 0x00, sizeof(struct step_param_t));
+    step_position = 0;
+    step_direction = 1;
 
     noInterrupts();
     TCCR4A = 0; // <! clear register value
@@ -66,9 +78,20 @@ bool step_init_ll(void)
     return true;
 }
 
+void step_deinit_ll(void)
+{
+    noInterrupts();
+    TIMSK4 &= ~(1 << OCIE4A); // <! disable timer4 interrupt
+    TCCR4A = 0;               // <! stop timer4
+    TCCR4B = 0;
+    interrupts();
+
+    memset(&step_param, 0x00, sizeof(struct step_param_t));
+    ENABLE_HIGH; // <! disable motor driver
+}
+
 bool set_steps(long steps, long timer_min_val, void (*complete_callback)(void), bool wait = true)
 {
-    Serial.println(step_param.n);
     if (step_param.n > 1) // <! already work
     {
         return false;
@@ -88,10 +111,12 @@ bool set_steps(long steps, long timer_min_val, void (*complete_callback)(void),
     if (steps > 0) // <! changed the direction
     {
         DIR_HIGH;
+        step_direction = 1;
     }
     else
     {
         DIR_LOW;
+        step_direction = -1;
     }
 
     step_param.n = 0;
@@ -118,6 +143,8 @@ bool set_speed(int8_t direction, long timer_min_val, void (*complete_callback)(v
             return false;
         }
         step_param.state = SPEED_DOWN;
+        // <! completion is reported at standstill
+        step_param.speed_complete_callback = complete_callback;
         if (wait)
         {
             while (step_param.n > 1)
@@ -138,10 +165,12 @@ bool set_speed(int8_t direction, long timer_min_val, void (*complete_callback)(v
         if (direction > 0) // <! changed the direction
         {
             DIR_HIGH;
+            step_direction = 1;
         }
         else
         {
             DIR_LOW;
+            step_direction = -1;
         }
 
         step_param.state = SPEED_UP;
@@ -167,6 +196,7 @@ void position_interrrupt_handle(void)
     {
         STEP_HIGH;
         STEP_LOW;
+        step_position += step_direction;
     }
     else
     {
@@ -219,6 +249,7 @@ void speed_interrupt_handle(void)
 {
     STEP_HIGH;
     STEP_LOW;
+    step_position += step_direction;
 
     switch (step_param.state)
     {
@@ -261,8 +292,30 @@ void speed_interrupt_handle(void)
     OCR4A = step_param.timer_load_val;
 }
 
+void get_step_status(struct step_status_t *status)
+{
+    // copy the ISR owned fields atomically
+    noInterrupts();
+    bool running = TIMSK4 & (1 << OCIE4A);
+    long position = step_position;
+    long timer_load_val = step_param.timer_load_val;
+    enum step_state_e state = step_param.state;
+    int8_t direction = step_direction;
+    interrupts();
+
+    status->position = position;
+    // timer4 runs with prescaler 64 in CTC mode => one step every (OCR4A + 1) ticks of 250 kHz
+    status->velocity = (running && timer_load_val > 0) ? direction * (STEP_TIMER_FREQ / (timer_load_val + 1)) : 0;
+    status->ramp_state = running ? (uint8_t)(state + 1) : STEP_RAMP_IDLE;
+    // the low level driver only holds the move that is currently executed
+    status->queue_depth = running ? 1 : 0;
+}
+
 ISR(TIMER4_COMPA_vect)
 {
+    PERF_ISR_BEGIN(PERF_ISR_TIMER4_COMPA);
+    uint32_t start_us = micros();
+    TRACE(TRACE_EVENT_ISR_ENTER, 0, PERF_ISR_TIMER4_COMPA);
     switch (step_param.mode)
     {
     case POSITION_MODE:
@@ -272,4 +325,9 @@ ISR(TIMER4_COMPA_vect)
         speed_interrupt_handle();
         break;
     }
+    TRACE(TRACE_EVENT_ISR_EXIT, 0, PERF_ISR_TIMER4_COMPA);
+    perf_isr(micros() - start_us);
+    PERF_ISR_END(PERF_ISR_TIMER4_COMPA);
 }
+
+#endif
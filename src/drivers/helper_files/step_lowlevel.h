@@ -37,12 +37,34 @@
 #define ENABLE_HIGH ENABLE_PORT |= (1 << ENABLE_PIN)
 #define ENABLE_LOW ENABLE_PORT &= ~(1 << ENABLE_PIN)
 
+// timer4 tick frequency: 16 MHz / prescaler 64
+#define STEP_TIMER_FREQ 250000L
+
+/* ramp states reported by get_step_status() */
+#define STEP_RAMP_IDLE 0
+#define STEP_RAMP_SPEED_UP 1
+#define STEP_RAMP_CONSTANT 2
+#define STEP_RAMP_SPEED_DOWN 3
+
+struct step_status_t
+{
+    long position;       // absolute step counter since step_init_ll()
+    long velocity;       // current step rate [steps/s], negative for backward moves
+    uint8_t ramp_state;  // one of STEP_RAMP_*
+    uint8_t queue_depth; // number of moves not yet completed
+};
+
 /*
 NOTE:
 		the time creater is timer4, must sure you didn't use timer4 to do other things!
 */
 bool step_init_ll(void);
 
+/*
+* stops timer4 and disables the motor driver (step_init_ll() has to be called again before the next move)
+*/
+void step_deinit_ll(void);
+
 /*
 * steps 				:the pulse num   steps>0 forward,steps<0 backward
 * timer_min_val 		:the timer minimum load count   80 max
@@ -60,4 +82,9 @@ bool set_steps(long steps, long timer_min_val, void (*complete_callback)(void),
 
 bool set_speed(int8_t direction, long timer_min_val, void (*complete_callback)(void), bool wait = false);
 
+/*
+* status 				:filled with position, velocity, ramp state and queue depth (safe to call outside the ISR)
+*/
+void get_step_status(struct step_status_t *status);
+
 #endif
@@ -1,5 +1,7 @@
 #include "mcu_driver.h"
 
+#if DRIVER_ENABLE_MCU_DRIVER
+
 /*========================================================================*/
 /*                    PRIVATE DEFINITIONS                                 */
 /*========================================================================*/
@@ -7,6 +9,23 @@
 // Controller firmware version
 #define VERSION "v1.0"
 
+/*
+    Actions with big buffers: not inlined => the buffers are only on the
+    stack while their action runs (the frame of run_mcu_driver() is
+    allocated for every MCU action)
+*/
+
+/**
+    @brief  Sends the snapshot of the performance counters
+*/
+void send_stats(uint32_t profile_id) __attribute__((noinline));
+
+/**
+    @brief  Sends a chunk of the trace buffer (ERR_NOT_FOUND if there is none)
+    @param  chunk: index of the chunk (see trace_dump())
+*/
+void send_trace_chunk(uint32_t profile_id, uint16_t chunk) __attribute__((noinline));
+
 /*========================================================================*/
 /*                          FUNCTION DEFINITIONS                          */
 /*========================================================================*/
@@ -15,7 +34,7 @@
 /*!
     TODO: Description of initialization function for mcu_driver
 */
-bool init_mcu_driver(uint32_t profile_id, R_MCU_Driver profile)
+bool init_mcu_driver(uint32_t profile_id, const R_MCU_Driver &profile)
 {
     // nothing to do for now
     return true;
@@ -26,12 +45,29 @@ bool init_mcu_driver(uint32_t profile_id, R_MCU_Driver profile)
     Action handler for MCU driver: following actions are possible:
         - Version: return firmware version
         - RAM: get current RAM usage 
-        - RESET: reset the MCU => not implemented yet TODO:
+        - RESET: reset the MCU with the watchdog (empty DATA is sent before the reset)
+        - STATS: snapshot of the performance counters (see perf_counters.h)
+        - RESET_STATS: clear the performance counters, continue an incomplete trace dump
+        - TRACE_DUMP: chunk <arg> of the trace buffer (see trace.h)
+        - RESET_CAUSE: MCUSR flags of the last reset + RESET_CAUSE_REQUESTED (see watchdog.h)
+        - TIME_SYNC: empty DATA, timestamp = time of the response, duration = time since the request
+          was received (turns the timestamps on)
+        - TIMESTAMPS: timestamps of all responses on (arg != 0) or off
+        - CANCEL_SCHEDULED: cancel all scheduled actions (see scheduler.h)
+        - MACRO_RUN: start macro <arg>, ACK + PROGRESS per action + DATA/ERROR at the end (see macro.h)
+        - MACRO_STOP: stop the running macro
+        - FAST_PATH: fast path frames on (arg != 0) or off, DATA: FAST_PATH_VERSION + number
+          of opcodes (see fast_path.h)
+        - DRIVERS: DATA: DRIVER_COUNT + DRIVER_ENABLED_MASK (7 drivers per byte, see driver_config.h)
+        - BAUD: DATA (baudrate <arg>) at the current rate, then switch to <arg>, the current rate
+          is the ping and then the confirmation of a switch (see link_speed.h)
+        - BAUD_PERSIST: store (arg != 0) or delete the current baudrate, ERR_BUSY if not confirmed
 */
-void run_mcu_driver(uint32_t profile_id, A_MCU_Driver action)
+void run_mcu_driver(uint32_t profile_id, const A_MCU_Driver &action)
 {
     uint16_t free_ram = 0;
     byte data[4] = {0};
+    uint8_t length = 0;
 
     switch (action.mcu_action)
     {
@@ -52,10 +88,129 @@ void run_mcu_driver(uint32_t profile_id, A_MCU_Driver action)
         break;
 
     case MCUAction_RESET:
-        /* TODO: code */
+        send_data(profile_id);
+        watchdog_restart();
+        break;
+
+    case MCUAction_STATS:
+        send_stats(profile_id);
+        break;
+
+    case MCUAction_RESET_STATS:
+        perf_reset();
+        trace_resume();
+        send_data(profile_id);
+        break;
+
+    case MCUAction_TRACE_DUMP:
+        send_trace_chunk(profile_id, (uint16_t)action.arg);
+        break;
+
+    case MCUAction_RESET_CAUSE:
+        length = pack_value(data, watchdog_reset_cause(), 2);
+        send_data(profile_id, data, length);
+        break;
+
+    case MCUAction_TIME_SYNC:
+        protobuf_set_timestamps(true);
+        send_data(profile_id);
+        break;
+
+    case MCUAction_TIMESTAMPS:
+        protobuf_set_timestamps(action.arg != 0);
+        send_data(profile_id);
+        break;
+
+    case MCUAction_CANCEL_SCHEDULED:
+        scheduler_cancel_all();
+        send_data(profile_id);
+        break;
+
+    case MCUAction_MACRO_RUN:
+        macro_run(profile_id, action.arg);
+        break;
+
+    case MCUAction_MACRO_STOP:
+        if (macro_stop())
+            send_data(profile_id);
+        else
+            send_error(profile_id, ErrorCode_ERR_NOT_FOUND);
+        break;
+
+    case MCUAction_FAST_PATH:
+        fast_path_enable(action.arg != 0);
+        length += pack_value(&data[length], FAST_PATH_VERSION, 1);
+        length += pack_value(&data[length], FAST_OP_COUNT, 1);
+        send_data(profile_id, data, length);
+        break;
+
+    case MCUAction_DRIVERS:
+        static_assert(1 + (DRIVER_COUNT + 6) / 7 <= sizeof(data), "DRIVER_ENABLED_MASK does not fit into data");
+        length += pack_value(&data[length], DRIVER_COUNT, 1);
+        length += pack_value(&data[length], DRIVER_ENABLED_MASK, (DRIVER_COUNT + 6) / 7);
+        send_data(profile_id, data, length);
+        break;
+
+    case MCUAction_BAUD:
+        if (!link_supported(action.arg))
+        {
+            send_error(profile_id, ErrorCode_ERR_OUT_OF_RANGE, action.arg);
+            break;
+        }
+        // rates up to 2^21
+        length += pack_value(&data[length], action.arg, 3);
+        send_data(profile_id, data, length);
+        link_switch(profile_id, action.arg);
+        break;
+
+    case MCUAction_BAUD_PERSIST:
+        if (link_save(action.arg != 0))
+            send_data(profile_id);
+        else
+            send_error(profile_id, ErrorCode_ERR_BUSY);
         break;
 
     default:
         break;
     }
 }
+
+/**************************************************************************/
+/*!
+    Resources of the MCU driver: none
+*/
+uint8_t resources_mcu_driver(const R_MCU_Driver &profile, Resource *resources)
+{
+    return 0;
+}
+
+/**************************************************************************/
+/*!
+    Teardown of the MCU driver: nothing to do
+*/
+void teardown_mcu_driver(uint32_t profile_id)
+{
+}
+
+/*========================================================================*/
+/*                          PRIVATE FUNCTIONS                             */
+/*========================================================================*/
+
+void send_stats(uint32_t profile_id)
+{
+    byte snapshot[PERF_SNAPSHOT_SIZE];
+    send_data(profile_id, snapshot, perf_snapshot(snapshot));
+}
+
+void send_trace_chunk(uint32_t profile_id, uint16_t chunk)
+{
+    byte trace_chunk[TRACE_CHUNK_SIZE];
+    uint8_t length = trace_dump(chunk, trace_chunk);
+
+    if (length == 0)
+        send_error(profile_id, ErrorCode_ERR_NOT_FOUND);
+    else
+        send_data(profile_id, trace_chunk, length);
+}
+
+#endif
@@ -12,12 +12,25 @@
     @brief  Initialization function for mcu_driver driver
     @return boolean if initialization was successful or not
 */
-bool init_mcu_driver(uint32_t profile_id, R_MCU_Driver profile);
+bool init_mcu_driver(uint32_t profile_id, const R_MCU_Driver &profile);
 
 /**************************************************************************/
 /*!
     @brief  Action function for mcu_driver driver
 */
-void run_mcu_driver(uint32_t profile_id, A_MCU_Driver action);
+void run_mcu_driver(uint32_t profile_id, const A_MCU_Driver &action);
+
+/**************************************************************************/
+/*!
+    @brief  Lists the hardware resources used by a mcu_driver registration
+    @return number of resources
+*/
+uint8_t resources_mcu_driver(const R_MCU_Driver &profile, Resource *resources);
+
+/**************************************************************************/
+/*!
+    @brief  Teardown function for mcu_driver driver: releases the hardware of the profile
+*/
+void teardown_mcu_driver(uint32_t profile_id);
 
 #endif
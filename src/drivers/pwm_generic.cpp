@@ -0,0 +1,367 @@
+/**************************************************************************/
+/*!
+    @file     pwm_generic.cpp
+    @author   Jonas Brütsch
+
+    Generic driver for PWM/servo outputs on the 16-bit timers 1, 3 and 5.
+
+    A profile owns one timer (RESOURCE_TIMER, like the step motor owns
+    timer4) and up to 3 of its output compare channels. The timer runs in
+    fast PWM mode with ICRn as TOP: the smallest prescaler which reaches the
+    frequency is used => max. resolution of the duty cycle.
+
+    Ramps are timed by the hardware: the overflow ISR of the timer moves the
+    compare value of a channel once per PWM period (fixed point 24.8), the
+    double buffered OCRnx takes it over at the begin of the next period.
+*/
+/**************************************************************************/
+
+#include "pwm_generic.h"
+
+#if DRIVER_ENABLE_PWM_GENERIC
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+
+/*========================================================================*/
+/*                    PRIVATE DEFINITIONS                                 */
+/*========================================================================*/
+
+// returned by pwm_index() for timers without PWM support
+#define PWM_TIMER_NONE 0xFF
+
+// timer clock without prescaler (16 MHz)
+#define PWM_TIMER_CLOCK 16000000UL
+
+// fractional bits of the ramp values
+#define PWM_RAMP_SHIFT 8
+
+// registers + output pins of a timer
+struct PwmTimer
+{
+    volatile uint8_t *tccra;
+    volatile uint8_t *tccrb;
+    volatile uint8_t *timsk;
+    volatile uint16_t *icr;
+    volatile uint16_t *ocr[PWM_CHANNELS];
+    uint8_t pins[PWM_CHANNELS];
+};
+
+static const PwmTimer pwm_timers[] PROGMEM = {
+    {&TCCR1A, &TCCR1B, &TIMSK1, &ICR1, {&OCR1A, &OCR1B, &OCR1C}, {11, 12, 13}},
+    {&TCCR3A, &TCCR3B, &TIMSK3, &ICR3, {&OCR3A, &OCR3B, &OCR3C}, {5, 2, 3}},
+    {&TCCR5A, &TCCR5B, &TIMSK5, &ICR5, {&OCR5A, &OCR5B, &OCR5C}, {46, 45, 44}},
+};
+
+// clock select bits 1 - 5 of the timers
+static const uint16_t pwm_prescalers[] PROGMEM = {1, 8, 64, 256, 1024};
+
+struct PwmRamp
+{
+    // current compare value << PWM_RAMP_SHIFT
+    uint32_t value;
+    int32_t step;
+    uint16_t target;
+    // remaining PWM periods (0 => no ramp)
+    uint16_t periods;
+};
+
+// state of a timer used by a profile
+struct PwmState
+{
+    // copy of the flash table (used by the ISR)
+    PwmTimer regs;
+    uint16_t top;
+    uint16_t prescaler;
+    PwmRamp ramps[PWM_CHANNELS];
+    // finished/replaced ramps per channel: one DATA each (written by the ISR)
+    volatile uint8_t completed[PWM_CHANNELS];
+};
+
+static PwmState timers[sizeof(pwm_timers) / sizeof(PwmTimer)];
+
+/**
+    @brief  Index of a timer in pwm_timers
+    @return PWM_TIMER_NONE if the timer has no PWM support
+*/
+uint8_t pwm_index(uint32_t timer);
+
+/**
+    @brief  Ramp step of the overflow ISR: moves the compare values of all ramping channels
+*/
+void pwm_ramp_isr(PwmState &state);
+
+/*========================================================================*/
+/*                          FUNCTION DEFINITIONS                          */
+/*========================================================================*/
+
+/**************************************************************************/
+/*!
+    Initialization: fast PWM (mode 14, TOP = ICRn), non-inverting outputs,
+    all duty cycles 0
+*/
+bool init_pwm_generic(uint32_t profile_id, const R_PWM_Generic &profile)
+{
+    uint8_t index = pwm_index(profile.timer);
+    uint8_t clock_select = 0;
+    uint32_t ticks = 0;
+
+    if (index == PWM_TIMER_NONE || profile.channels == 0 || profile.channels >= (1 << PWM_CHANNELS) ||
+        profile.frequency == 0 || profile.resolution == 0 || profile.resolution > 16)
+        return false;
+
+    // smallest prescaler => highest resolution
+    for (uint8_t i = 0; clock_select == 0 && i < sizeof(pwm_prescalers) / sizeof(uint16_t); i++)
+    {
+        ticks = PWM_TIMER_CLOCK / ((uint32_t)pgm_read_word(&pwm_prescalers[i]) * profile.frequency);
+        if (ticks >= 2 && ticks <= 0x10000UL)
+            clock_select = i + 1;
+    }
+    // frequency out of range or the period has less ticks than the resolution
+    if (clock_select == 0 || ticks < (1UL << profile.resolution))
+        return false;
+
+    PwmState &state = timers[index];
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        memset((void *)&state, 0, sizeof(PwmState));
+        memcpy_P(&state.regs, &pwm_timers[index], sizeof(PwmTimer));
+        state.top = (uint16_t)(ticks - 1);
+        state.prescaler = pgm_read_word(&pwm_prescalers[clock_select - 1]);
+
+        *state.regs.tccrb = 0;
+        *state.regs.timsk = 0;
+        *state.regs.icr = state.top;
+        uint8_t outputs = 0;
+        for (uint8_t c = 0; c < PWM_CHANNELS; c++)
+        {
+            if (!(profile.channels & (1 << c)))
+                continue;
+            *state.regs.ocr[c] = 0;
+            pinMode(state.regs.pins[c], OUTPUT);
+            // COMnA1, COMnB1, COMnC1
+            outputs |= _BV(COM1A1 - 2 * c);
+        }
+        *state.regs.tccra = outputs | _BV(WGM11);
+        *state.regs.tccrb = _BV(WGM13) | _BV(WGM12) | clock_select;
+    }
+    return true;
+}
+
+/**************************************************************************/
+/*!
+    Action function for pwm_generic: sets the duty cycle or pulse width of a channel
+        - immediately (ramp_ms = 0): DATA with the channel
+        - ramp: ACK, DATA with the channel at the end of the ramp (a replaced
+          ramp is completed at the same time)
+*/
+void run_pwm_generic(uint32_t profile_id, const A_PWM_Generic &action)
+{
+    const R_PWM_Generic &profile = profile_manager.get_registration(profile_id)->driver.r_pwm_generic;
+    PwmState &state = timers[pwm_index(profile.timer)];
+    uint32_t compare;
+    byte data[1];
+
+    if (action.channel >= PWM_CHANNELS || !(profile.channels & (1 << action.channel)))
+    {
+        send_error(profile_id, ErrorCode_ERR_NOT_FOUND);
+        return;
+    }
+    if (action.which_value == A_PWM_Generic_duty_tag)
+    {
+        if (action.value.duty >> profile.resolution)
+        {
+            send_error(profile_id, ErrorCode_ERR_OUT_OF_RANGE);
+            return;
+        }
+        compare = (action.value.duty * ((uint32_t)state.top + 1)) >> profile.resolution;
+    }
+    else if (action.which_value == A_PWM_Generic_pulse_us_tag)
+    {
+        compare = action.value.pulse_us * (PWM_TIMER_CLOCK / 1000000UL) / state.prescaler;
+        if (compare > state.top)
+        {
+            send_error(profile_id, ErrorCode_ERR_OUT_OF_RANGE);
+            return;
+        }
+    }
+    else
+    {
+        send_error(profile_id, ErrorCode_ERR_NO_MODE);
+        return;
+    }
+
+    PwmRamp &ramp = state.ramps[action.channel];
+    uint32_t periods = action.ramp_ms * profile.frequency / 1000;
+    if (periods > 0xFFFF)
+        periods = 0xFFFF;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        uint16_t current = *state.regs.ocr[action.channel];
+        // running ramp: continue from its value, the request is completed
+        if (ramp.periods != 0)
+        {
+            current = (uint16_t)(ramp.value >> PWM_RAMP_SHIFT);
+            ramp.periods = 0;
+            state.completed[action.channel]++;
+        }
+        if (periods == 0)
+            *state.regs.ocr[action.channel] = (uint16_t)compare;
+        else
+        {
+            ramp.value = (uint32_t)current << PWM_RAMP_SHIFT;
+            ramp.step = (((int32_t)compare - current) * (1L << PWM_RAMP_SHIFT)) / (int32_t)periods;
+            ramp.target = (uint16_t)compare;
+            ramp.periods = (uint16_t)periods;
+            *state.regs.timsk |= _BV(TOIE1);
+        }
+    }
+
+    if (periods == 0)
+        send_data(profile_id, data, pack_value(data, action.channel, 1));
+    else
+    {
+        profile_manager.set_event(profile_id, true);
+        send_ack(profile_id);
+    }
+}
+
+/**************************************************************************/
+/*!
+    Event function for pwm_generic: one DATA per finished ramp
+*/
+bool event_pwm_generic(uint32_t profile_id)
+{
+    PwmState &state = timers[pwm_index(profile_manager.get_registration(profile_id)->driver.r_pwm_generic.timer)];
+    bool running = false;
+    bool sent = false;
+    byte data[1];
+
+    for (uint8_t c = 0; c < PWM_CHANNELS; c++)
+    {
+        uint8_t completed;
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+        {
+            completed = state.completed[c];
+            state.completed[c] = 0;
+            running |= (state.ramps[c].periods != 0);
+        }
+        for (; completed > 0; completed--)
+        {
+            protobuf_complete(profile_id);
+            send_data(profile_id, data, pack_value(data, c, 1));
+            sent = true;
+        }
+    }
+    profile_manager.set_event(profile_id, running);
+    return sent;
+}
+
+/**************************************************************************/
+/*!
+    Resources of the PWM outputs: the timer + the pins of the used channels
+*/
+uint8_t resources_pwm_generic(const R_PWM_Generic &profile, Resource *resources)
+{
+    uint8_t index = pwm_index(profile.timer);
+    uint8_t num_resources = 0;
+
+    resources[num_resources++] = {RESOURCE_TIMER, resource_id(profile.timer)};
+    if (index == PWM_TIMER_NONE)
+        return num_resources;
+
+    for (uint8_t c = 0; c < PWM_CHANNELS; c++)
+    {
+        if (profile.channels & (1 << c))
+            resources[num_resources++] = {RESOURCE_PIN, pgm_read_byte(&pwm_timers[index].pins[c])};
+    }
+    return num_resources;
+}
+
+/**************************************************************************/
+/*!
+    Teardown of the PWM outputs: stop the timer, pins back to INPUT
+*/
+void teardown_pwm_generic(uint32_t profile_id)
+{
+    const R_PWM_Generic &profile = profile_manager.get_registration(profile_id)->driver.r_pwm_generic;
+    PwmState &state = timers[pwm_index(profile.timer)];
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        *state.regs.timsk = 0;
+        *state.regs.tccra = 0;
+        *state.regs.tccrb = 0;
+        for (uint8_t c = 0; c < PWM_CHANNELS; c++)
+        {
+            state.ramps[c].periods = 0;
+            if (profile.channels & (1 << c))
+                pinMode(state.regs.pins[c], INPUT);
+        }
+    }
+}
+
+/*========================================================================*/
+/*                          PRIVATE FUNCTIONS                             */
+/*========================================================================*/
+
+uint8_t pwm_index(uint32_t timer)
+{
+    switch (timer)
+    {
+    case 1:
+        return 0;
+    case 3:
+        return 1;
+    case 5:
+        return 2;
+    default:
+        return PWM_TIMER_NONE;
+    }
+}
+
+void pwm_ramp_isr(PwmState &state)
+{
+    bool running = false;
+
+    for (uint8_t c = 0; c < PWM_CHANNELS; c++)
+    {
+        PwmRamp &ramp = state.ramps[c];
+        if (ramp.periods == 0)
+            continue;
+        if (--ramp.periods == 0)
+        {
+            *state.regs.ocr[c] = ramp.target;
+            state.completed[c]++;
+        }
+        else
+        {
+            ramp.value += ramp.step;
+            *state.regs.ocr[c] = (uint16_t)(ramp.value >> PWM_RAMP_SHIFT);
+            running = true;
+        }
+    }
+    if (!running)
+        *state.regs.timsk &= ~_BV(TOIE1);
+}
+
+/**************************************************************************/
+/*!
+    Overflow ISRs (TOP reached): one ramp step per PWM period
+*/
+ISR(TIMER1_OVF_vect)
+{
+    pwm_ramp_isr(timers[0]);
+}
+
+ISR(TIMER3_OVF_vect)
+{
+    pwm_ramp_isr(timers[1]);
+}
+
+ISR(TIMER5_OVF_vect)
+{
+    pwm_ramp_isr(timers[2]);
+}
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef _PWM_GENERIC_H_
+#define _PWM_GENERIC_H_
+
+#include "main.h"
+
+/*========================================================================*/
+/*                          PUBLIC DEFINITIONS                            */
+/*========================================================================*/
+
+// output compare channels per timer (A, B, C)
+#define PWM_CHANNELS 3
+
+/*========================================================================*/
+/*                          PUBLIC FUNCTIONS                              */
+/*========================================================================*/
+
+/**************************************************************************/
+/*!
+    @brief  Initialization function for pwm_generic driver
+    @return boolean if initialization was successful or not
+*/
+bool init_pwm_generic(uint32_t profile_id, const R_PWM_Generic &profile);
+
+/**************************************************************************/
+/*!
+    @brief  Action function for pwm_generic driver
+*/
+void run_pwm_generic(uint32_t profile_id, const A_PWM_Generic &action);
+
+/**************************************************************************/
+/*!
+    @brief  Event function for pwm_generic driver (end of the ramps)
+    @return boolean if DATA was sent
+*/
+bool event_pwm_generic(uint32_t profile_id);
+
+/**************************************************************************/
+/*!
+    @brief  Lists the hardware resources used by a pwm_generic registration
+    @return number of resources
+*/
+uint8_t resources_pwm_generic(const R_PWM_Generic &profile, Resource *resources);
+
+/**************************************************************************/
+/*!
+    @brief  Teardown function for pwm_generic driver: releases the hardware of the profile
+*/
+void teardown_pwm_generic(uint32_t profile_id);
+
+#endif
@@ -13,7 +13,10 @@
 /**************************************************************************/
 
 #include "step_motor.h"
+
+#if DRIVER_ENABLE_STEP_MOTOR
 #include "helper_files/step_lowlevel.h"
+#include <util/atomic.h>
 
 /*========================================================================*/
 /*                    PRIVATE DEFINITIONS                                 */
@@ -25,11 +28,27 @@
 #define MS2 A11
 #define MS1 A10
 
-// can only be used if just one motor is supported per controller => change in the future
-static uint32_t static_profile_id;
+// finished moves/ramps counted by the timer4 ISR, sent by the loop (responses are not sent from ISRs)
+static volatile uint8_t completed = 0;
+
+/* Telemetry subscription */
+// telemetry payload: position (5 bytes) + velocity (5 bytes) + ramp state + queue depth
+#define TELEMETRY_SIZE 12
 
 void response_callback();
 
+/**
+    @brief  Sends the current position, velocity, ramp state and queue depth as DATA
+*/
+void send_telemetry(uint32_t profile_id);
+
+/**
+    @brief  Blocking move: waits until the ramp state is reached, sends a timeout error
+            if it takes longer than TIMEOUT_STEP_MOVE_MS (the move continues)
+    @param  ramp_state: STEP_RAMP_IDLE (move done/stopped) or STEP_RAMP_CONSTANT (speed reached)
+*/
+void wait_move(uint32_t profile_id, uint8_t ramp_state);
+
 /*========================================================================*/
 /*                          FUNCTION DEFINITIONS                          */
 /*========================================================================*/
@@ -39,9 +58,9 @@ void response_callback();
     Initialization function for step_motor
     For now, no registration data has to be sent (in the future multiple ports may be supported).
 */
-bool init_step_motor(uint32_t profile_id, R_Step_Motor profile)
+bool init_step_motor(uint32_t profile_id, const R_Step_Motor &profile)
 {
-    static_profile_id = profile_id;
+    completed = 0;
 
     /* Init Belt */
     pinMode(MS3, OUTPUT);
@@ -59,38 +78,196 @@ bool init_step_motor(uint32_t profile_id, R_Step_Motor profile)
 /**************************************************************************/
 /*!
     Action function for step_motor:
-        - Possible actions are: set speed or set steps
+        - Possible actions are: set speed, set steps or subscribe to telemetry
         - Events are handled by an ISR with timer4 (see .\helper_files\step_lowlevel.cpp)
+        - Telemetry is streamed by the event handler (see event_step_motor())
 
 */
-void run_step_motor(uint32_t profile_id, A_Step_Motor action)
+void run_step_motor(uint32_t profile_id, const A_Step_Motor &action)
 {
     /* handle action to set the speed */
     if (action.which_mode == A_Step_Motor_direction_tag)
     {
-        set_speed((int8_t)action.mode.direction, action.time_min_val, &response_callback, action.wait);
-        if (!action.wait)
+        // waiting is done with a deadline in wait_move()
+        bool started = set_speed((int8_t)action.mode.direction, action.time_min_val, &response_callback, false);
+        if (!started)
+            send_error(profile_id, ErrorCode_ERR_BUSY);
+        else if (!action.wait)
+        {
+            // the event handler sends the DATA at the end of the ramp
+            profile_manager.set_event(profile_id, true);
             send_ack(profile_id);
+        }
+        else
+            wait_move(profile_id, action.time_min_val == -1 ? STEP_RAMP_IDLE : STEP_RAMP_CONSTANT);
     }
     /* handle action to set the steps */
     else if (action.which_mode == A_Step_Motor_steps_tag)
     {
-        set_steps((int8_t)action.mode.steps, action.time_min_val, &response_callback, action.wait);
-        if (!action.wait)
+        bool started = set_steps((int8_t)action.mode.steps, action.time_min_val, &response_callback, false);
+        if (!started)
+            send_error(profile_id, ErrorCode_ERR_BUSY);
+        else if (!action.wait)
+        {
+            profile_manager.set_event(profile_id, true);
             send_ack(profile_id);
+        }
+        else
+            wait_move(profile_id, STEP_RAMP_IDLE);
+    }
+    /* handle action to (un)subscribe to the telemetry stream */
+    else if (action.which_mode == A_Step_Motor_telemetry_interval_tag)
+    {
+        Step_Motor_State *state = profile_manager.get_state<Step_Motor_State>(profile_id);
+        state->telemetry_interval = action.mode.telemetry_interval;
+        // event flag keeps the event handler streaming until the subscription is stopped
+        // (cleared by the event handler if no move is running either)
+        profile_manager.set_event(profile_id, true);
+        if (state->telemetry_interval != 0)
+        {
+            // first sample confirms the subscription
+            send_telemetry(profile_id);
+            state->telemetry_last = millis();
+        }
+        else
+            send_data(profile_id);
     }
     else
-        send_error(profile_id, "Step Motor: One of speed or steps has to be selected!");
+        send_error(profile_id, ErrorCode_ERR_NO_MODE);
+}
+
+/**************************************************************************/
+/*!
+    Event function for step_motor: DATA for every finished move/ramp (counted
+    by the ISR) + telemetry at the subscribed rate. A telemetry sample does
+    not count as event: the requests of the loop pass are still handled
+    (e.g. the one which stops the stream).
+*/
+bool event_step_motor(uint32_t profile_id)
+{
+    Step_Motor_State *state = profile_manager.get_state<Step_Motor_State>(profile_id);
+    struct step_status_t status;
+    uint8_t done;
+
+    // status before the completions: a move finishing in between is sent in the next pass
+    get_step_status(&status);
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        done = completed;
+        completed = 0;
+    }
+    for (uint8_t i = 0; i < done; i++)
+    {
+        // completes the pending request of a non-blocking move
+        protobuf_complete(profile_id);
+        send_data(profile_id);
+    }
+    profile_manager.set_event(profile_id, state->telemetry_interval != 0 || status.ramp_state != STEP_RAMP_IDLE);
+    if (done != 0)
+        return true;
+
+    if (state->telemetry_interval == 0 || millis() - state->telemetry_last < state->telemetry_interval)
+        return false;
+
+    state->telemetry_last += state->telemetry_interval;
+    // don't try to catch up if the loop was blocked for more than one interval
+    if (millis() - state->telemetry_last >= state->telemetry_interval)
+        state->telemetry_last = millis();
+
+    send_telemetry(profile_id);
+    return false;
 }
 
 /**************************************************************************/
 /*!
-    Handles callbacks of the step_lowlevel functions:
-        - For simplicity send just an empty DATA msg (to be adapted in the future).
-        - As the callback function has no
+    Sends one telemetry sample of the low level driver to the gateway.
+*/
+void send_telemetry(uint32_t profile_id)
+{
+    struct step_status_t status;
+    byte data[TELEMETRY_SIZE];
+    uint8_t index = 0;
+
+    get_step_status(&status);
+
+    index += pack_value(&data[index], (uint32_t)status.position, 5);
+    index += pack_value(&data[index], (uint32_t)status.velocity, 5);
+    index += pack_value(&data[index], status.ramp_state, 1);
+    index += pack_value(&data[index], status.queue_depth, 1);
+
+    send_data(profile_id, data, index);
+}
+
+/**************************************************************************/
+/*!
+    Blocking move: polls the low level driver until the ramp state is reached,
+    then sends the DATA of the move (the ISR has counted it in the same step).
+*/
+void wait_move(uint32_t profile_id, uint8_t ramp_state)
+{
+    struct step_status_t status;
+    Deadline deadline = deadline_start(TIMEOUT_STEP_MOVE_MS);
+
+    get_step_status(&status);
+    while (status.ramp_state != ramp_state)
+    {
+        if (deadline_expired(deadline))
+        {
+            // the move continues: DATA at its end from the event handler
+            profile_manager.set_event(profile_id, true);
+            send_timeout(profile_id, deadline);
+            return;
+        }
+        delay(1);
+        get_step_status(&status);
+    }
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        if (completed != 0)
+            completed--;
+    }
+    send_data(profile_id);
+}
+
+/**************************************************************************/
+/*!
+    Resources of the step motor: port pins + timer4 used by step_lowlevel
+*/
+uint8_t resources_step_motor(const R_Step_Motor &profile, Resource *resources)
+{
+    resources[0] = {RESOURCE_PIN, STEP_PWM};
+    resources[1] = {RESOURCE_PIN, MS1};
+    resources[2] = {RESOURCE_PIN, MS2};
+    resources[3] = {RESOURCE_PIN, MS3};
+    resources[4] = {RESOURCE_PIN, A0}; // STEP (PF0)
+    resources[5] = {RESOURCE_PIN, A1}; // DIR (PF1)
+    resources[6] = {RESOURCE_PIN, 38}; // ENABLE (PD7)
+    resources[7] = {RESOURCE_TIMER, 4};
+    return 8;
+}
+
+/**************************************************************************/
+/*!
+    Teardown of the step motor: stop timer4 + disable the motor driver
+*/
+void teardown_step_motor(uint32_t profile_id)
+{
+    step_deinit_ll();
+    pinMode(MS3, INPUT);
+    pinMode(MS2, INPUT);
+    pinMode(MS1, INPUT);
+    pinMode(STEP_PWM, INPUT);
+}
+
+/**************************************************************************/
+/*!
+    Handles callbacks of the step_lowlevel functions (timer4 ISR): counts the
+    finished move/ramp, the DATA is sent by the loop (wait_move() or
+    event_step_motor()) => no response is written into a frame of the loop.
 */
 void response_callback()
 {
-    // send received message to the gateway
-    send_data(static_profile_id);
+    completed++;
 }
+
+#endif
@@ -3,6 +3,19 @@
 
 #include "main.h"
 
+/*========================================================================*/
+/*                          PUBLIC DEFINITIONS                            */
+/*========================================================================*/
+
+// driver state stored in the profile slot (telemetry subscription)
+struct Step_Motor_State
+{
+    // interval between two telemetry messages [ms] (0 => no subscription)
+    uint32_t telemetry_interval;
+    // timestamp of the last telemetry message [ms]
+    uint32_t telemetry_last;
+};
+
 /*========================================================================*/
 /*                          PUBLIC FUNCTIONS                              */
 /*========================================================================*/
@@ -12,12 +25,32 @@
     @brief  Initialization function for step_motor driver
     @return boolean if initialization was successful or not
 */
-bool init_step_motor(uint32_t profile_id, R_Step_Motor profile);
+bool init_step_motor(uint32_t profile_id, const R_Step_Motor &profile);
 
 /**************************************************************************/
 /*!
     @brief  Action function for step_motor ddriver
 */
-void run_step_motor(uint32_t profile_id, A_Step_Motor action);
+void run_step_motor(uint32_t profile_id, const A_Step_Motor &action);
+
+/**************************************************************************/
+/*!
+    @brief  Event function for step_motor driver (telemetry stream)
+    @return false: a telemetry sample is a stream, not an event which takes priority over the requests
+*/
+bool event_step_motor(uint32_t profile_id);
+
+/**************************************************************************/
+/*!
+    @brief  Lists the hardware resources used by a step_motor registration
+    @return number of resources
+*/
+uint8_t resources_step_motor(const R_Step_Motor &profile, Resource *resources);
+
+/**************************************************************************/
+/*!
+    @brief  Teardown function for step_motor driver: releases the hardware of the profile
+*/
+void teardown_step_motor(uint32_t profile_id);
 
 #endif
@@ -1,10 +1,12 @@
 #include "uart_ttl_generic.h"
 
+#if DRIVER_ENABLE_UART_TTL_GENERIC
+
 /*========================================================================*/
 /*                          PRIVATE DEFINITIONS                           */
 /*========================================================================*/
 // used to receive and send feedback to gateway
-void feedback_handler(uint32_t profile_id, HardwareSerial *Serialref);
+void feedback_handler(uint32_t profile_id, HardwareSerial *Serialref, const Deadline &deadline);
 
 /*========================================================================*/
 /*                          FUNCTION DEFINITIONS                          */
@@ -14,15 +16,18 @@ void feedback_handler(uint32_t profile_id, HardwareSerial *Serialref);
 /*!
     TODO: Description of initialization function for uart_ttl_generic
 */
-bool init_uart_ttl_generic(uint32_t profile_id, R_UART_TTL_Generic profile)
+bool init_uart_ttl_generic(uint32_t profile_id, const R_UART_TTL_Generic &profile)
 {
 
+    Deadline deadline = deadline_start(TIMEOUT_UART_READY_MS);
+
     if (profile.port == UartPort_UART2)
     {
         Serial2.begin(profile.baudrate);
         while (!Serial2)
         { // wait until it's ready
-            ;
+            if (deadline_expired(deadline))
+                return false;
         }
         return true;
     }
@@ -31,7 +36,8 @@ bool init_uart_ttl_generic(uint32_t profile_id, R_UART_TTL_Generic profile)
         Serial3.begin(profile.baudrate);
         while (!Serial3)
         { // wait until it's ready
-            ;
+            if (deadline_expired(deadline))
+                return false;
         }
         return true;
     }
@@ -46,10 +52,10 @@ bool init_uart_ttl_generic(uint32_t profile_id, R_UART_TTL_Generic profile)
     Start event-listening for uArm response
     TODO: add header + tail defined in registration
 */
-void run_uart_ttl_generic(uint32_t profile_id, A_UART_TTL_Generic action)
+void run_uart_ttl_generic(uint32_t profile_id, const A_UART_TTL_Generic &action)
 {
     /* get corresponding port for profile to select correct Serial port */
-    UartPort port = profile_manager.profiles[profile_id].driver.r_uart_ttl_generic.port;
+    UartPort port = profile_manager.get_registration(profile_id)->driver.r_uart_ttl_generic.port;
     HardwareSerial *Serialref = NULL;
     if (port == UartPort_UART2)
         Serialref = &Serial2;
@@ -64,7 +70,7 @@ void run_uart_ttl_generic(uint32_t profile_id, A_UART_TTL_Generic action)
     if (action.event_triggered)
     {
         // set event flag for profile to true => starts event listening
-        profile_manager.events[profile_id] = true;
+        profile_manager.set_event(profile_id, true);
         /* Send ACK feedback with profile_id */
         send_ack(profile_id);
     }
@@ -72,10 +78,17 @@ void run_uart_ttl_generic(uint32_t profile_id, A_UART_TTL_Generic action)
     else
     {
         /* wait until response is available */
+        Deadline deadline = deadline_start(TIMEOUT_UART_RESPONSE_MS);
         while (!Serialref->available())
-            ;
+        {
+            if (deadline_expired(deadline))
+            {
+                send_timeout(profile_id, deadline);
+                return;
+            }
+        }
         // receive feedback and send to gateway as DATA message
-        feedback_handler(profile_id, Serialref);
+        feedback_handler(profile_id, Serialref, deadline);
     }
 }
 
@@ -87,7 +100,7 @@ void run_uart_ttl_generic(uint32_t profile_id, A_UART_TTL_Generic action)
 bool event_uart_ttl_generic(uint32_t profile_id)
 {
     /* get corresponding port for profile to select correct Serial port */
-    UartPort port = profile_manager.profiles[profile_id].driver.r_uart_ttl_generic.port;
+    UartPort port = profile_manager.get_registration(profile_id)->driver.r_uart_ttl_generic.port;
     HardwareSerial *Serialref = NULL;
     if (port == UartPort_UART2)
         Serialref = &Serial2;
@@ -97,10 +110,12 @@ bool event_uart_ttl_generic(uint32_t profile_id)
     // if serial buffer is filled
     if (Serialref->available())
     {
+        // the device answers in the order of the commands => oldest pending request
+        protobuf_complete(profile_id);
         // receive feedback and send to gateway as DATA message
-        feedback_handler(profile_id, Serialref);
-        // set event flag for profile to false => stop event listening
-        profile_manager.events[profile_id] = false;
+        feedback_handler(profile_id, Serialref, deadline_start(TIMEOUT_UART_RESPONSE_MS));
+        // stop event listening after the response of the last pending command
+        profile_manager.set_event(profile_id, pending_count(profile_id) > 0);
         return true;
     }
     /* event did not occure */
@@ -112,8 +127,9 @@ bool event_uart_ttl_generic(uint32_t profile_id)
 /*!
     Handle feedback messages:
     Receive data on serial port and send DATA to the gateway
+    (the complete line has to be received before the deadline expires)
 */
-void feedback_handler(uint32_t profile_id, HardwareSerial *Serialref)
+void feedback_handler(uint32_t profile_id, HardwareSerial *Serialref, const Deadline &deadline)
 {
     // response char array (max. length same as command defined in .proto file)
     char response[40] = {0};
@@ -128,7 +144,7 @@ void feedback_handler(uint32_t profile_id, HardwareSerial *Serialref)
         /* handle overflow of index */
         if (response_index > 40)
         {
-            send_error(profile_id, "Overflow Error: Response index is bigger than max. response size.");
+            send_error(profile_id, ErrorCode_ERR_OVERFLOW);
             break;
         }
         // break if terminating char is received
@@ -136,9 +152,50 @@ void feedback_handler(uint32_t profile_id, HardwareSerial *Serialref)
             break;
         // wait until next char is available
         while (!Serialref->available())
-            ;
+        {
+            if (deadline_expired(deadline))
+            {
+                send_timeout(profile_id, deadline);
+                return;
+            }
+        }
     }
 
     // send received message to the gateway
     send_data(profile_id, response, response_index);
 }
+
+/**************************************************************************/
+/*!
+    Resources of a UART-TTL port: UART + RX/TX pins
+*/
+uint8_t resources_uart_ttl_generic(const R_UART_TTL_Generic &profile, Resource *resources)
+{
+    if (profile.port == UartPort_UART2)
+    {
+        resources[0] = {RESOURCE_UART, 2};
+        resources[1] = {RESOURCE_PIN, 16}; // TX2
+        resources[2] = {RESOURCE_PIN, 17}; // RX2
+    }
+    else
+    {
+        resources[0] = {RESOURCE_UART, 3};
+        resources[1] = {RESOURCE_PIN, 14}; // TX3
+        resources[2] = {RESOURCE_PIN, 15}; // RX3
+    }
+    return 3;
+}
+
+/**************************************************************************/
+/*!
+    Teardown of a UART-TTL port: stop the serial port
+*/
+void teardown_uart_ttl_generic(uint32_t profile_id)
+{
+    if (profile_manager.get_registration(profile_id)->driver.r_uart_ttl_generic.port == UartPort_UART2)
+        Serial2.end();
+    else
+        Serial3.end();
+}
+
+#endif
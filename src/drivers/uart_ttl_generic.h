@@ -12,13 +12,13 @@
     @brief  Initialization function for uart_ttl_generic driver
     @return boolean if initialization was successful or not
 */
-bool init_uart_ttl_generic(uint32_t profile_id, R_UART_TTL_Generic profile);
+bool init_uart_ttl_generic(uint32_t profile_id, const R_UART_TTL_Generic &profile);
 
 /**************************************************************************/
 /*!
     @brief  Action function for uart_ttl_generic driver
 */
-void run_uart_ttl_generic(uint32_t profile_id, A_UART_TTL_Generic action);
+void run_uart_ttl_generic(uint32_t profile_id, const A_UART_TTL_Generic &action);
 
 /**************************************************************************/
 /*!
@@ -27,4 +27,17 @@ void run_uart_ttl_generic(uint32_t profile_id, A_UART_TTL_Generic action);
 */
 bool event_uart_ttl_generic(uint32_t profile_id);
 
+/**************************************************************************/
+/*!
+    @brief  Lists the hardware resources used by a uart_ttl_generic registration
+    @return number of resources
+*/
+uint8_t resources_uart_ttl_generic(const R_UART_TTL_Generic &profile, Resource *resources);
+
+/**************************************************************************/
+/*!
+    @brief  Teardown function for uart_ttl_generic driver: releases the hardware of the profile
+*/
+void teardown_uart_ttl_generic(uint32_t profile_id);
+
 #endif
@@ -1,5 +1,7 @@
 #include "ultrasonic_sensor.h"
 
+#if DRIVER_ENABLE_ULTRASONIC_SENSOR
+
 /*========================================================================*/
 /*                          PRIVATE DEFINITIONS                           */
 /*========================================================================*/
@@ -15,7 +17,7 @@ byte buf[2] = {0};
 /*!
     Initialization function for ultrasonic_sensor
 */
-bool init_ultrasonic_sensor(uint32_t profile_id, R_Ultrasonic_Sensor profile)
+bool init_ultrasonic_sensor(uint32_t profile_id, const R_Ultrasonic_Sensor &profile)
 {
     // nothing to do for now
     return true;
@@ -25,9 +27,9 @@ bool init_ultrasonic_sensor(uint32_t profile_id, R_Ultrasonic_Sensor profile)
 /*!
     Action function for ultrasonic_sensor: measure distance in cm and send to gateway
 */
-void run_ultrasonic_sensor(uint32_t profile_id, A_Ultrasonic_Sensor action)
+void run_ultrasonic_sensor(uint32_t profile_id, const A_Ultrasonic_Sensor &action)
 {
-    uint32_t _pin = profile_manager.profiles[profile_id].driver.r_digital_generic.pin;
+    uint32_t _pin = profile_manager.get_registration(profile_id)->driver.r_ultrasonic_sensor.pin;
 
     /* read distance from sensor */
     pinMode(_pin, OUTPUT);
@@ -39,7 +41,13 @@ void run_ultrasonic_sensor(uint32_t profile_id, A_Ultrasonic_Sensor action)
     pinMode(_pin, INPUT);
 
     /*The measured distance from the range 0 to 400 Centimeters*/
-    unsigned long duration = pulseIn(_pin, HIGH);
+    Deadline deadline = deadline_start(TIMEOUT_ULTRASONIC_MS);
+    unsigned long duration = pulseIn(_pin, HIGH, TIMEOUT_ULTRASONIC_MS * 1000UL);
+    if (duration == 0)
+    {
+        send_timeout(profile_id, deadline);
+        return;
+    }
     uint16_t range_in_centimeters = (duration / 29 / 2);
 
     /* ensure no NULL byte is sent => use msb as flag*/
@@ -49,3 +57,24 @@ void run_ultrasonic_sensor(uint32_t profile_id, A_Ultrasonic_Sensor action)
     //send_debug((const char *)buf);
     send_data(profile_id, buf, 2);
 }
+
+/**************************************************************************/
+/*!
+    Resources of the ultrasonic sensor: SIG pin
+*/
+uint8_t resources_ultrasonic_sensor(const R_Ultrasonic_Sensor &profile, Resource *resources)
+{
+    resources[0] = {RESOURCE_PIN, resource_id(profile.pin)};
+    return 1;
+}
+
+/**************************************************************************/
+/*!
+    Teardown of the ultrasonic sensor: set SIG pin back to INPUT
+*/
+void teardown_ultrasonic_sensor(uint32_t profile_id)
+{
+    pinMode((uint8_t)profile_manager.get_registration(profile_id)->driver.r_ultrasonic_sensor.pin, INPUT);
+}
+
+#endif
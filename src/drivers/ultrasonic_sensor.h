@@ -12,12 +12,25 @@
     @brief  Initialization function for ultrasonic_sensor driver
     @return boolean if initialization was successful or not
 */
-bool init_ultrasonic_sensor(uint32_t profile_id, R_Ultrasonic_Sensor profile);
+bool init_ultrasonic_sensor(uint32_t profile_id, const R_Ultrasonic_Sensor &profile);
 
 /**************************************************************************/
 /*!
     @brief  Action function for ultrasonic_sensor ddriver
 */
-void run_ultrasonic_sensor(uint32_t profile_id, A_Ultrasonic_Sensor action);
+void run_ultrasonic_sensor(uint32_t profile_id, const A_Ultrasonic_Sensor &action);
+
+/**************************************************************************/
+/*!
+    @brief  Lists the hardware resources used by a ultrasonic_sensor registration
+    @return number of resources
+*/
+uint8_t resources_ultrasonic_sensor(const R_Ultrasonic_Sensor &profile, Resource *resources);
+
+/**************************************************************************/
+/*!
+    @brief  Teardown function for ultrasonic_sensor driver: releases the hardware of the profile
+*/
+void teardown_ultrasonic_sensor(uint32_t profile_id);
 
 #endif
@@ -0,0 +1,187 @@
+/**************************************************************************/
+/*!
+    @file     fast_path.cpp
+    @author   Jonas Brütsch
+
+    Decoder of the binary fast path frames (format: see fast_path.h).
+    The opcode indexes a table with the number of argument bytes and a
+    function which fills the Action, the action is executed by the loop
+    through action_handler() like a decoded protobuf Action. The responses
+    are written in the fast format by protobuf_helper.cpp.
+*/
+/**************************************************************************/
+#include "fast_path.h"
+
+/*========================================================================*/
+/*                          PRIVATE DEFINITIONS                           */
+/*========================================================================*/
+
+// marker + opcode + profile_id
+#define FAST_HEADER_SIZE (2 + FAST_PROFILE_BYTES)
+// max. argument bytes of an opcode
+#define FAST_ARGS_MAX 8
+
+// fills the action of an opcode (driver: oneof tag of the registered profile)
+typedef void (*fast_build_t)(const byte *args, pb_size_t driver, Action *action);
+
+struct FastOp
+{
+    uint8_t arg_bytes;
+    fast_build_t build;
+};
+
+static bool enabled = false;
+
+/**
+    @brief  Builders of the opcodes
+*/
+void build_digital_write(const byte *args, pb_size_t driver, Action *action);
+void build_digital_read(const byte *args, pb_size_t driver, Action *action);
+void build_step_steps(const byte *args, pb_size_t driver, Action *action);
+void build_step_speed(const byte *args, pb_size_t driver, Action *action);
+void build_sensor_read(const byte *args, pb_size_t driver, Action *action);
+
+// index: opcode (0 is not used)
+static const FastOp fast_ops[FAST_OP_COUNT] PROGMEM = {
+    {0, NULL},
+    {1, build_digital_write},
+    {0, build_digital_read},
+    {8, build_step_steps},
+    {4, build_step_speed},
+    {0, build_sensor_read},
+};
+
+/**
+    @brief  Unpacks 7-bit groups (see pack_value())
+    @param  is_signed: sign extension from the highest packed bit
+*/
+uint32_t fast_unpack(const byte *buf, uint8_t num_bytes, bool is_signed);
+
+/**
+    @brief  Sends ERROR for an invalid frame
+    @return false (no action)
+*/
+bool fast_reject(uint32_t profile_id, ErrorCode error, uint32_t detail);
+
+/*========================================================================*/
+/*                          PUBLIC FUNCTIONS                              */
+/*========================================================================*/
+
+void fast_path_enable(bool on)
+{
+    enabled = on;
+}
+
+/**************************************************************************/
+/*
+    Fast frame: marker, opcode + profile_id, arguments of the opcode, terminator.
+    The whole frame is read up to the terminator first => an invalid frame
+    does not affect the next one.
+*/
+bool fast_decode(Action *action)
+{
+    byte frame[FAST_HEADER_SIZE + FAST_ARGS_MAX];
+    uint16_t length = 0;
+    byte value = FAST_MARKER;
+    FastOp op;
+
+    memset(action, 0, sizeof(Action));
+    // a frame never contains a NULL byte (longer frames are only counted)
+    while (Serial.readBytes(&value, 1) == 1 && value != 0)
+    {
+        if (length < sizeof(frame))
+            frame[length] = value;
+        length++;
+    }
+    if (value != 0 || length < FAST_HEADER_SIZE)
+        return fast_reject(404, ErrorCode_ERR_DECODE, length);
+
+    uint32_t profile_id = fast_unpack(&frame[2], FAST_PROFILE_BYTES, false);
+    uint8_t opcode = frame[1] & 0x7F;
+    if (!enabled || opcode == 0 || opcode >= FAST_OP_COUNT)
+        return fast_reject(profile_id, ErrorCode_ERR_FAST_PATH, opcode);
+
+    memcpy_P(&op, &fast_ops[opcode], sizeof(FastOp));
+    if (length != FAST_HEADER_SIZE + op.arg_bytes)
+        return fast_reject(profile_id, ErrorCode_ERR_FAST_PATH, opcode);
+    perf_request(true);
+
+    Registration *registration = profile_manager.get_registration(profile_id);
+    action->profile_id = profile_id;
+    op.build(&frame[FAST_HEADER_SIZE], registration != NULL ? registration->which_driver : 0, action);
+    return true;
+}
+
+/*========================================================================*/
+/*                          PRIVATE FUNCTIONS                             */
+/*========================================================================*/
+
+void build_digital_write(const byte *args, pb_size_t, Action *action)
+{
+    action->which_driver = Action_a_digital_generic_tag;
+    action->driver.a_digital_generic.output = (args[0] & 0x7F) ? DigitalOutput_HIGH : DigitalOutput_LOW;
+}
+
+void build_digital_read(const byte *, pb_size_t, Action *action)
+{
+    action->which_driver = Action_a_digital_generic_tag;
+}
+
+void build_step_steps(const byte *args, pb_size_t, Action *action)
+{
+    action->which_driver = Action_a_step_motor_tag;
+    action->driver.a_step_motor.which_mode = A_Step_Motor_steps_tag;
+    action->driver.a_step_motor.mode.steps = (int32_t)fast_unpack(&args[0], 5, true);
+    action->driver.a_step_motor.time_min_val = (int32_t)fast_unpack(&args[5], 3, true);
+}
+
+void build_step_speed(const byte *args, pb_size_t, Action *action)
+{
+    action->which_driver = Action_a_step_motor_tag;
+    action->driver.a_step_motor.which_mode = A_Step_Motor_direction_tag;
+    action->driver.a_step_motor.mode.direction = (int32_t)fast_unpack(&args[0], 1, true);
+    action->driver.a_step_motor.time_min_val = (int32_t)fast_unpack(&args[1], 3, true);
+}
+
+// read action of the registered sensor driver (other drivers: mismatch error of action_handler())
+void build_sensor_read(const byte *, pb_size_t driver, Action *action)
+{
+    switch (driver)
+    {
+    case Action_a_ultrasonic_sensor_tag:
+    case Action_a_color_sensor_tag:
+        action->which_driver = driver;
+        break;
+    case Action_a_analog_generic_tag:
+        action->which_driver = driver;
+        action->driver.a_analog_generic.which_mode = A_Analog_Generic_read_tag;
+        action->driver.a_analog_generic.mode.read = true;
+        break;
+    case Action_a_encoder_generic_tag:
+        action->which_driver = driver;
+        action->driver.a_encoder_generic.which_mode = A_Encoder_Generic_read_tag;
+        action->driver.a_encoder_generic.mode.read = true;
+        break;
+    default:
+        break;
+    }
+}
+
+uint32_t fast_unpack(const byte *buf, uint8_t num_bytes, bool is_signed)
+{
+    uint32_t value = 0;
+    uint8_t bits = 7 * num_bytes;
+
+    for (uint8_t i = 0; i < num_bytes; i++)
+        value |= (uint32_t)(buf[i] & 0x7F) << (7 * i);
+    if (is_signed && bits < 32 && (value & (1UL << (bits - 1))))
+        value |= ~((1UL << bits) - 1);
+    return value;
+}
+
+bool fast_reject(uint32_t profile_id, ErrorCode error, uint32_t detail)
+{
+    perf_request(false);
+    send_error(profile_id, error, detail);
+    return false;
+}
@@ -0,0 +1,64 @@
+#ifndef _FAST_PATH_H_
+#define _FAST_PATH_H_
+
+#include "main.h"
+
+/*
+    Binary fast path: fixed layout frames for the most frequent actions,
+    dispatched through a table without nanopb. Same framing as the
+    protobuf messages (terminated by a NULL byte, no NULL byte inside),
+    a frame starts with FAST_MARKER (never the first byte of a Request).
+
+    Request:  FAST_MARKER | 0x80 + opcode | profile_id (2) | arguments | 0x00
+    Response: FAST_MARKER | 0x80 + ResponseCode | profile_id (2) | payload | 0x00
+    ERROR:    FAST_MARKER | 0x80 + ERROR | profile_id (2) | ErrorCode (1) | detail (5) | 0x00
+
+    All values are packed into 7-bit groups (see pack_value()), signed
+    arguments are sign extended from the packed bits. The payload of a
+    response is the same as in the protobuf Response. Responses in the
+    fast format are only sent while a fast request is handled: a later
+    completion (ACK => DATA) is a protobuf Response. Fast frames carry no
+    sequence id and no timestamp.
+
+    The fast path is off after a reset, the gateway turns it on with the
+    MCUAction FAST_PATH (DATA: FAST_PATH_VERSION + number of opcodes).
+*/
+
+/*========================================================================*/
+/*                          PUBLIC DEFINITIONS                            */
+/*========================================================================*/
+
+// first byte of a fast frame
+#define FAST_MARKER 0xFF
+
+// layout version of the fast frames (reported on negotiation)
+#define FAST_PATH_VERSION 1
+
+// bytes of the packed profile_id (profile ids < 16384)
+#define FAST_PROFILE_BYTES 2
+
+/* Opcodes: arguments (packed bytes) */
+#define FAST_OP_DIGITAL_WRITE 1 // level (1)
+#define FAST_OP_DIGITAL_READ 2  // none
+#define FAST_OP_STEP_STEPS 3    // steps (5, signed), time_min_val (3, signed), no wait
+#define FAST_OP_STEP_SPEED 4    // direction (1, signed), time_min_val (3, signed), no wait
+#define FAST_OP_SENSOR_READ 5   // none: ultrasonic, color, analog generic, encoder generic (read)
+#define FAST_OP_COUNT 6
+
+/*========================================================================*/
+/*                          PUBLIC FUNCTIONS                              */
+/*========================================================================*/
+
+/**
+    @brief  Turns the fast path on/off (MCUAction FAST_PATH)
+*/
+void fast_path_enable(bool enabled);
+
+/**
+    @brief  Reads a fast frame from Serial (the next byte is FAST_MARKER) + builds its action
+            with the table of the opcode, sends ERROR for an invalid frame
+    @return false if no action has to be executed (action is cleared)
+*/
+bool fast_decode(Action *action);
+
+#endif
@@ -0,0 +1,223 @@
+/**************************************************************************/
+/*!
+    @file     link_speed.cpp
+    @author   Jonas Brütsch
+
+    Baudrate of the gateway link: negotiation with fallback (see link_speed.h)
+    + stored rate in the EEPROM.
+
+    The USART runs in double speed mode: baud = F_CPU / (8 * (UBRR + 1)).
+    At 16 MHz the default 115200 has an error of 2.1 %, the faster rates of
+    link_rates[] divide F_CPU without remainder (0 % error). Faster rates
+    need a loop which empties the 64 byte RX buffer in time (rx_high_water
+    of the performance counters).
+
+    EEPROM record: [version][baudrate (4, LSB first)][crc16]
+*/
+/**************************************************************************/
+#include "link_speed.h"
+#include <EEPROM.h>
+
+/*========================================================================*/
+/*                          PRIVATE DEFINITIONS                           */
+/*========================================================================*/
+
+#define LINK_STORAGE_VERSION 1
+#define LINK_RECORD_SIZE 7
+
+static_assert(LINK_STORAGE_START + LINK_RECORD_SIZE <= 4096, "Link record does not fit into the EEPROM");
+
+// rates with 0 % baud error at 16 MHz (+ the default)
+static const uint32_t link_rates[] PROGMEM = {LINK_BAUDRATE_DEFAULT, 250000, 500000, 1000000};
+
+/* States of the link */
+#define LINK_CONFIRMED 0 // valid requests received at the current rate
+#define LINK_SWITCHED 1  // switched, waiting for the ping of the gateway (LINK_CONFIRM_MS)
+#define LINK_STORED 2    // stored rate after a reset, waiting for the first valid request
+#define LINK_PINGED 3    // ping answered, waiting for the confirmation of the gateway (LINK_CONFIRM_MS)
+
+static uint32_t baudrate = LINK_BAUDRATE_DEFAULT;
+static uint8_t state = LINK_CONFIRMED;
+
+/* Switch in progress */
+static uint32_t previous_baudrate = LINK_BAUDRATE_DEFAULT;
+static uint8_t previous_state = LINK_CONFIRMED;
+static uint32_t switch_profile_id = 0;
+static uint32_t switch_seq = 0;
+static Deadline switch_deadline;
+
+// invalid requests at the stored rate
+static uint8_t invalid_requests = 0;
+
+/**
+    @brief  Reopens Serial with a new baudrate after the TX buffer is sent
+*/
+void link_begin(uint32_t rate);
+
+/**
+    @brief  Reads the stored baudrate
+    @return 0 if no valid record is stored
+*/
+uint32_t link_load(void);
+
+/*========================================================================*/
+/*                          PUBLIC FUNCTIONS                              */
+/*========================================================================*/
+
+/**************************************************************************/
+/*
+    Link Initializer: a stored rate has to be confirmed by the gateway
+*/
+void link_init(void)
+{
+    uint32_t stored = link_load();
+
+    baudrate = LINK_BAUDRATE_DEFAULT;
+    state = LINK_CONFIRMED;
+    if (stored != 0 && stored != LINK_BAUDRATE_DEFAULT && link_supported(stored))
+    {
+        baudrate = stored;
+        state = LINK_STORED;
+    }
+    Serial.begin(baudrate);
+}
+
+uint32_t link_baudrate(void)
+{
+    return baudrate;
+}
+
+bool link_supported(uint32_t rate)
+{
+    for (uint8_t i = 0; i < sizeof(link_rates) / sizeof(link_rates[0]); i++)
+    {
+        if (pgm_read_dword(&link_rates[i]) == rate)
+            return true;
+    }
+    return false;
+}
+
+/**************************************************************************/
+/*
+    Switch: the response to the request is still in the TX buffer
+    => sent at the current rate before the switch
+*/
+void link_switch(uint32_t profile_id, uint32_t rate)
+{
+    if (rate == baudrate)
+        return;
+
+    // a confirmed rate is the fallback of the next switch
+    if (state != LINK_SWITCHED && state != LINK_PINGED)
+    {
+        previous_baudrate = baudrate;
+        previous_state = state;
+    }
+    switch_profile_id = profile_id;
+    switch_seq = protobuf_get_seq();
+    link_begin(rate);
+    state = LINK_SWITCHED;
+    switch_deadline = deadline_start(LINK_CONFIRM_MS);
+}
+
+/**************************************************************************/
+/*
+    Requests at an unconfirmed rate: after a switch the first valid request
+    is the ping, the second one the confirmation of the gateway (it has
+    received the answer to the ping). The first valid request confirms a
+    stored rate, garbage at a stored rate leads to the default rate.
+*/
+void link_request(bool valid)
+{
+    if (state == LINK_CONFIRMED)
+        return;
+
+    if (valid && state == LINK_SWITCHED)
+    {
+        state = LINK_PINGED;
+        switch_deadline = deadline_start(LINK_CONFIRM_MS);
+    }
+    else if (valid)
+    {
+        state = LINK_CONFIRMED;
+        invalid_requests = 0;
+    }
+    else if (state == LINK_STORED && ++invalid_requests >= LINK_FALLBACK_ERRORS)
+    {
+        link_begin(LINK_BAUDRATE_DEFAULT);
+        state = LINK_CONFIRMED;
+        invalid_requests = 0;
+        send_debug("Link: stored baudrate not confirmed, default baudrate");
+    }
+}
+
+/**************************************************************************/
+/*
+    Fallback: unsolicited error, tagged with the sequence id of the BAUD
+    request (not a pending request of the profile)
+*/
+void link_poll(void)
+{
+    if ((state != LINK_SWITCHED && state != LINK_PINGED) || !deadline_expired(switch_deadline))
+        return;
+
+    link_begin(previous_baudrate);
+    state = previous_state;
+    uint32_t request_seq = protobuf_get_seq();
+    protobuf_set_seq(switch_seq);
+    send_timeout(switch_profile_id, switch_deadline);
+    protobuf_set_seq(request_seq);
+}
+
+/**************************************************************************/
+/*
+    Stored rate: EEPROM.update() only writes changed cells
+*/
+bool link_save(bool persist)
+{
+    byte record[LINK_RECORD_SIZE];
+
+    if (state != LINK_CONFIRMED)
+        return false;
+
+    record[0] = persist ? LINK_STORAGE_VERSION : 0xFF;
+    for (uint8_t i = 0; i < 4; i++)
+        record[1 + i] = (byte)(baudrate >> (8 * i));
+    uint16_t crc = crc16(0xFFFF, record, 5);
+    record[5] = (byte)crc;
+    record[6] = (byte)(crc >> 8);
+
+    for (uint8_t i = 0; i < LINK_RECORD_SIZE; i++)
+        EEPROM.update(LINK_STORAGE_START + i, record[i]);
+    return true;
+}
+
+/*========================================================================*/
+/*                          PRIVATE FUNCTIONS                             */
+/*========================================================================*/
+
+void link_begin(uint32_t rate)
+{
+    Serial.flush();
+    Serial.end();
+    Serial.begin(rate);
+    baudrate = rate;
+}
+
+uint32_t link_load(void)
+{
+    byte record[LINK_RECORD_SIZE];
+    uint32_t rate = 0;
+
+    for (uint8_t i = 0; i < LINK_RECORD_SIZE; i++)
+        record[i] = EEPROM.read(LINK_STORAGE_START + i);
+    // erased EEPROM (0xFF), deleted rate or record of an older firmware
+    if (record[0] != LINK_STORAGE_VERSION)
+        return 0;
+    if (crc16(0xFFFF, record, 5) != (record[5] | ((uint16_t)record[6] << 8)))
+        return 0;
+
+    for (uint8_t i = 0; i < 4; i++)
+        rate |= (uint32_t)record[1 + i] << (8 * i);
+    return rate;
+}
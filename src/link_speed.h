@@ -0,0 +1,95 @@
+#ifndef _LINK_SPEED_H_
+#define _LINK_SPEED_H_
+
+#include "main.h"
+
+/*
+    Baudrate of the serial link to the gateway.
+
+    Negotiation (MCUAction BAUD, arg: baudrate):
+        1. gateway: BAUD <new rate> at the current rate
+        2. controller: DATA (new rate) at the current rate, then switches
+        3. gateway: switches + sends BAUD <new rate> as ping => DATA
+        4. gateway: received the DATA => sends BAUD <new rate> as confirmation => DATA
+    The second valid request at the new rate confirms it, the controller
+    keeps the fallback until then: without the ping or the confirmation
+    within LINK_CONFIRM_MS (each), it falls back to the previous rate and
+    sends ERR_TIMEOUT there (sequence id of the BAUD request). A gateway
+    without the answer to the confirmation retries it at the new rate.
+
+    A confirmed rate can be stored in the EEPROM (MCUAction BAUD_PERSIST),
+    the controller starts with it after a reset. LINK_FALLBACK_ERRORS invalid
+    requests before the first valid one (gateway at another rate) switch
+    back to LINK_BAUDRATE_DEFAULT.
+*/
+
+/*========================================================================*/
+/*                          PUBLIC DEFINITIONS                            */
+/*========================================================================*/
+
+// baudrate without a stored rate (can be set with build flags)
+#ifndef LINK_BAUDRATE_DEFAULT
+#define LINK_BAUDRATE_DEFAULT 115200
+#endif
+
+// max. time from the switch to the ping + from the ping to the confirmation
+#ifndef LINK_CONFIRM_MS
+#define LINK_CONFIRM_MS 1000
+#endif
+
+// invalid requests at a stored rate before the fallback to LINK_BAUDRATE_DEFAULT
+#ifndef LINK_FALLBACK_ERRORS
+#define LINK_FALLBACK_ERRORS 3
+#endif
+
+// EEPROM record of the stored rate: last 8 bytes
+#ifndef LINK_STORAGE_START
+#define LINK_STORAGE_START (4096 - 8)
+#endif
+
+/*========================================================================*/
+/*                          PUBLIC FUNCTIONS                              */
+/*========================================================================*/
+
+/**
+    @brief  Opens the link with the stored (if valid) or the default baudrate
+*/
+void link_init(void);
+
+/**
+    @brief  Current baudrate of the link
+*/
+uint32_t link_baudrate(void);
+
+/**
+    @brief  Checks if a baudrate is in the list of rates without baud error at F_CPU
+*/
+bool link_supported(uint32_t baudrate);
+
+/**
+    @brief  Switches to a new baudrate after the pending responses are sent,
+            falls back if the ping + confirmation do not follow within LINK_CONFIRM_MS
+    @param  profile_id: Profile_id of the timeout error (sequence id: the request which is handled)
+    @param  baudrate: supported baudrate (current rate: nothing to do)
+*/
+void link_switch(uint32_t profile_id, uint32_t baudrate);
+
+/**
+    @brief  Received request at the current baudrate (called by protobuf_decode())
+    @param  valid: decoded with a known request type
+*/
+void link_request(bool valid);
+
+/**
+    @brief  Falls back to the previous baudrate if the switch was not confirmed in time (polled by the loop)
+*/
+void link_poll(void);
+
+/**
+    @brief  Stores the current baudrate in the EEPROM or deletes the stored rate
+    @param  persist: store (true) or delete (false)
+    @return false if the current rate is not confirmed yet
+*/
+bool link_save(bool persist);
+
+#endif
@@ -0,0 +1,531 @@
+/**************************************************************************/
+/*!
+    @file     macro.cpp
+    @author   Jonas Brütsch
+
+    Storage + interpreter of the macros.
+
+    Every macro slot of the EEPROM holds one record:
+        [version][macro_id][flags][name (12)][length][code (length)][crc16]
+    Uploads are rare => no wear levelling, EEPROM.update() only writes
+    the changed cells.
+
+    The interpreter runs the macro copied into RAM. It is polled by the
+    loop and never blocks: actions are returned to the caller, waits for
+    completions and delays return until the next poll.
+*/
+/**************************************************************************/
+#include "macro.h"
+#include <EEPROM.h>
+#include <util/atomic.h>
+
+/*========================================================================*/
+/*                          PRIVATE DEFINITIONS                           */
+/*========================================================================*/
+
+/* Record layout */
+#define MACRO_STORAGE_VERSION 1
+#define MACRO_NAME_SIZE sizeof(((Macro *)0)->name)
+#define MACRO_CODE_SIZE sizeof(((Macro *)0)->code.bytes)
+#define MACRO_HEADER_SIZE (3 + MACRO_NAME_SIZE + 1) // version, macro_id, flags, name, length
+#define MACRO_RECORD_SIZE (MACRO_HEADER_SIZE + MACRO_CODE_SIZE + 2)
+
+// record flags
+#define MACRO_FLAG_PERSIST 0x01
+
+// returned by find_macro() if a macro is not stored
+#define MACRO_SLOT_NONE 0xFF
+
+// max. number of instructions per poll (jump loops without action/delay)
+#define MACRO_INSTRUCTIONS_PER_POLL 32
+
+// poll interval while an acknowledged action is running [us]
+#define MACRO_POLL_US 200
+
+static_assert(MACRO_CODE_SIZE < 0xFF, "Targets of the macro code are limited to one byte");
+static_assert(MACRO_STORAGE_START + MACRO_CAPACITY * MACRO_RECORD_SIZE <= LINK_STORAGE_START,
+              "Macros do not fit into the EEPROM (in front of the link record)");
+
+struct MacroHeader
+{
+    uint8_t version;
+    uint8_t macro_id;
+    uint8_t flags;
+    char name[MACRO_NAME_SIZE];
+    uint8_t length;
+};
+
+enum MacroState
+{
+    MACRO_IDLE = 0,
+    MACRO_READY,     // next instruction can be executed
+    MACRO_EXECUTING, // action was returned by macro_poll()
+    MACRO_WAITING,   // action was acknowledged, waiting for DATA/ERROR
+    MACRO_DELAY,     // DELAY instruction
+};
+
+/* Running macro */
+static uint8_t code[MACRO_CODE_SIZE];
+static uint8_t code_length;
+static uint8_t running_id;
+static uint8_t pc;
+static uint16_t step;
+static MacroState state = MACRO_IDLE;
+static Deadline deadline;
+// MACRO_RUN request: profile + sequence id
+static uint32_t run_profile_id;
+static uint32_t run_seq;
+
+/* Response of the executed action (written by macro_response()) */
+static volatile uint32_t target_profile_id;
+static volatile bool acked;
+static volatile bool done;
+static volatile uint8_t result_code;
+static volatile uint8_t result[8];
+static volatile uint8_t result_length;
+
+/**
+    @brief  Returns the EEPROM address of a macro slot
+*/
+int macro_address(uint8_t slot);
+
+/**
+    @brief  Reads the header of a macro slot + checks the CRC
+    @param  code: destination of the code (NULL: not copied)
+    @return true if the slot holds a valid macro
+*/
+bool read_macro(uint8_t slot, MacroHeader *header, uint8_t *code);
+
+/**
+    @brief  Looks up the slot of a macro
+    @return slot index or MACRO_SLOT_NONE
+*/
+uint8_t find_macro(uint32_t macro_id);
+
+/**
+    @brief  Checks the instructions of a macro
+    @param  error_pos: offset of the invalid instruction
+    @return false if the code is invalid
+*/
+bool check_code(const uint8_t *bytes, uint8_t length, uint8_t *error_pos);
+
+/**
+    @brief  Completion of the executed action: PROGRESS, a failed action stops the macro (without JUMP_ERR)
+*/
+void finish_step(void);
+
+/**
+    @brief  Ends the macro: DATA (success: NO_ERROR) or ERROR for the MACRO_RUN request (detail: step)
+*/
+void finish_macro(ErrorCode error);
+
+/**
+    @brief  Result of the last action for JUMP_IF
+*/
+uint16_t result_value(uint8_t offset, uint8_t size);
+
+/*========================================================================*/
+/*                          PUBLIC FUNCTIONS                              */
+/*========================================================================*/
+
+void macro_init(void)
+{
+    MacroHeader header;
+
+    for (uint8_t slot = 0; slot < MACRO_CAPACITY; slot++)
+    {
+        if (read_macro(slot, &header, NULL) && !(header.flags & MACRO_FLAG_PERSIST))
+            EEPROM.update(macro_address(slot), 0xFF);
+    }
+}
+
+/**************************************************************************/
+/*
+    Macro Handler: the responses use the macro_id as profile_id
+*/
+void macro_handler(const Macro &macro)
+{
+    uint8_t slot = find_macro(macro.macro_id);
+
+    if (macro.macro_id > 0xFF)
+    {
+        send_error(macro.macro_id, ErrorCode_ERR_OUT_OF_RANGE);
+        return;
+    }
+    // the running macro is executed from RAM => can be replaced
+    /* delete macro */
+    if (macro.code.size == 0)
+    {
+        if (slot != MACRO_SLOT_NONE)
+            EEPROM.update(macro_address(slot), 0xFF);
+        send_data(macro.macro_id);
+        return;
+    }
+
+    uint8_t error_pos;
+    if (!check_code(macro.code.bytes, (uint8_t)macro.code.size, &error_pos))
+    {
+        send_error(macro.macro_id, ErrorCode_ERR_INVALID_MACRO, error_pos);
+        return;
+    }
+
+    // otherwise take the first free slot
+    MacroHeader header;
+    for (uint8_t i = 0; slot == MACRO_SLOT_NONE && i < MACRO_CAPACITY; i++)
+    {
+        if (!read_macro(i, &header, NULL))
+            slot = i;
+    }
+    if (slot == MACRO_SLOT_NONE)
+    {
+        send_error(macro.macro_id, ErrorCode_ERR_TABLE_FULL);
+        return;
+    }
+
+    header.version = MACRO_STORAGE_VERSION;
+    header.macro_id = (uint8_t)macro.macro_id;
+    header.flags = macro.persist ? MACRO_FLAG_PERSIST : 0;
+    memcpy(header.name, macro.name, MACRO_NAME_SIZE);
+    header.length = (uint8_t)macro.code.size;
+
+    uint16_t crc = crc16(0xFFFF, (const uint8_t *)&header, MACRO_HEADER_SIZE);
+    crc = crc16(crc, macro.code.bytes, header.length);
+
+    // write the code first and the version last => an interrupted write leaves an invalid record
+    int address = macro_address(slot);
+    EEPROM.update(address, 0xFF);
+    for (uint8_t i = 0; i < header.length; i++)
+        EEPROM.update(address + MACRO_HEADER_SIZE + i, macro.code.bytes[i]);
+    EEPROM.update(address + MACRO_HEADER_SIZE + header.length, (uint8_t)crc);
+    EEPROM.update(address + MACRO_HEADER_SIZE + header.length + 1, (uint8_t)(crc >> 8));
+    for (uint8_t i = MACRO_HEADER_SIZE; i > 0; i--)
+        EEPROM.update(address + i - 1, ((uint8_t *)&header)[i - 1]);
+
+    send_data(macro.macro_id);
+}
+
+/**************************************************************************/
+/*
+    Run: the macro is copied into RAM, the request stays pending until the end
+*/
+void macro_run(uint32_t profile_id, uint32_t macro_id)
+{
+    uint8_t slot = find_macro(macro_id);
+    MacroHeader header;
+
+    if (state != MACRO_IDLE)
+    {
+        send_error(profile_id, ErrorCode_ERR_BUSY);
+        return;
+    }
+    if (slot == MACRO_SLOT_NONE || !read_macro(slot, &header, code))
+    {
+        send_error(profile_id, ErrorCode_ERR_NOT_FOUND);
+        return;
+    }
+
+    code_length = header.length;
+    running_id = header.macro_id;
+    pc = 0;
+    step = 0;
+    run_profile_id = profile_id;
+    run_seq = protobuf_get_seq();
+    state = MACRO_READY;
+    send_ack(profile_id);
+}
+
+bool macro_stop(void)
+{
+    if (state == MACRO_IDLE)
+        return false;
+    finish_macro(ErrorCode_ERR_CANCELLED);
+    return true;
+}
+
+/**************************************************************************/
+/*
+    Interpreter: executes instructions until an action is returned or the
+    macro has to wait
+*/
+bool macro_poll(Action *action)
+{
+    for (uint8_t i = 0; i < MACRO_INSTRUCTIONS_PER_POLL; i++)
+    {
+        switch (state)
+        {
+        case MACRO_IDLE:
+            return false;
+
+        case MACRO_EXECUTING:
+            // action_handler() returned: completed, acknowledged or no response at all
+            if (acked && !done)
+            {
+                state = MACRO_WAITING;
+                deadline = deadline_start(MACRO_TIMEOUT_MS);
+                return false;
+            }
+            finish_step();
+            continue;
+
+        case MACRO_WAITING:
+            if (!done)
+            {
+                if (!deadline_expired(deadline))
+                    return false;
+                result_code = ResponseCode_ERROR;
+                result_length = 0;
+            }
+            finish_step();
+            continue;
+
+        case MACRO_DELAY:
+            if (!deadline_expired(deadline))
+                return false;
+            state = MACRO_READY;
+            continue;
+
+        default:
+            break;
+        }
+
+        /* MACRO_READY: next instruction (checked on upload) */
+        uint8_t op = (pc < code_length) ? code[pc] : MACRO_OP_END;
+        switch (op)
+        {
+        case MACRO_OP_ACTION:
+        {
+            // within the code (checked on upload, the record is protected by the crc)
+            if (pc + 2 + code[pc + 1] > code_length)
+            {
+                finish_macro(ErrorCode_ERR_INVALID_MACRO);
+                return false;
+            }
+            pb_istream_t stream = pb_istream_from_buffer(&code[pc + 2], code[pc + 1]);
+            *action = {};
+            pc += 2 + code[pc + 1];
+            if (!pb_decode(&stream, Action_fields, action))
+            {
+                finish_macro(ErrorCode_ERR_INVALID_MACRO);
+                return false;
+            }
+            ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+            {
+                target_profile_id = action->profile_id;
+                acked = false;
+                done = false;
+                result_code = ResponseCode_DATA;
+                result_length = 0;
+            }
+            state = MACRO_EXECUTING;
+            return true;
+        }
+        case MACRO_OP_DELAY:
+            deadline = deadline_start(code[pc + 1] | ((uint16_t)code[pc + 2] << 8));
+            pc += 3;
+            state = MACRO_DELAY;
+            break;
+        case MACRO_OP_JUMP:
+            pc = code[pc + 1];
+            break;
+        case MACRO_OP_JUMP_IF:
+        {
+            uint16_t value = result_value(code[pc + 2], code[pc + 3]);
+            uint16_t operand = code[pc + 4] | ((uint16_t)code[pc + 5] << 8);
+            uint8_t cmp = code[pc + 1];
+            bool jump = (cmp == MACRO_CMP_EQ && value == operand) || (cmp == MACRO_CMP_NE && value != operand) ||
+                        (cmp == MACRO_CMP_LT && value < operand) || (cmp == MACRO_CMP_GE && value >= operand);
+            pc = jump ? code[pc + 6] : pc + 7;
+            break;
+        }
+        case MACRO_OP_JUMP_ERR:
+            pc = (result_code == ResponseCode_ERROR) ? code[pc + 1] : pc + 2;
+            break;
+        default:
+            finish_macro(ErrorCode_NO_ERROR);
+            return false;
+        }
+    }
+    return false;
+}
+
+uint32_t macro_wait_us(void)
+{
+    if (state == MACRO_WAITING)
+        return MACRO_POLL_US;
+    if (state != MACRO_DELAY)
+        return UINT32_MAX;
+
+    uint32_t elapsed_ms = deadline_elapsed(deadline);
+    return (elapsed_ms >= deadline.timeout_ms) ? 0 : (deadline.timeout_ms - elapsed_ms) * 1000UL;
+}
+
+void macro_response(uint32_t profile_id, ResponseCode code, const void *data, uint32_t length)
+{
+    if ((state != MACRO_EXECUTING && state != MACRO_WAITING) || profile_id != target_profile_id || done)
+        return;
+
+    if (code == ResponseCode_ACK)
+    {
+        acked = true;
+        return;
+    }
+    result_code = code;
+    result_length = (length > sizeof(result)) ? sizeof(result) : (uint8_t)length;
+    for (uint8_t i = 0; i < result_length; i++)
+        result[i] = ((const uint8_t *)data)[i];
+    done = true;
+}
+
+/*========================================================================*/
+/*                          PRIVATE FUNCTIONS                             */
+/*========================================================================*/
+
+int macro_address(uint8_t slot)
+{
+    return MACRO_STORAGE_START + (int)slot * MACRO_RECORD_SIZE;
+}
+
+bool read_macro(uint8_t slot, MacroHeader *header, uint8_t *code)
+{
+    int address = macro_address(slot);
+    uint8_t *bytes = (uint8_t *)header;
+
+    for (uint8_t i = 0; i < MACRO_HEADER_SIZE; i++)
+        bytes[i] = EEPROM.read(address + i);
+
+    // erased EEPROM (0xFF), deleted macro or record of an older firmware
+    if (header->version != MACRO_STORAGE_VERSION || header->length > MACRO_CODE_SIZE)
+        return false;
+
+    uint16_t crc = crc16(0xFFFF, bytes, MACRO_HEADER_SIZE);
+    for (uint8_t i = 0; i < header->length; i++)
+    {
+        uint8_t value = EEPROM.read(address + MACRO_HEADER_SIZE + i);
+        crc = crc16(crc, &value, 1);
+        if (code != NULL)
+            code[i] = value;
+    }
+    int crc_address = address + MACRO_HEADER_SIZE + header->length;
+    return crc == (EEPROM.read(crc_address) | ((uint16_t)EEPROM.read(crc_address + 1) << 8));
+}
+
+uint8_t find_macro(uint32_t macro_id)
+{
+    MacroHeader header;
+
+    for (uint8_t slot = 0; slot < MACRO_CAPACITY; slot++)
+    {
+        if (read_macro(slot, &header, NULL) && header.macro_id == macro_id)
+            return slot;
+    }
+    return MACRO_SLOT_NONE;
+}
+
+bool check_code(const uint8_t *bytes, uint8_t length, uint8_t *error_pos)
+{
+    // begin of every instruction (targets have to point to one)
+    uint8_t starts[(MACRO_CODE_SIZE + 7) / 8] = {0};
+    static const uint8_t sizes[] = {1, 2, 3, 2, 7, 2};
+
+    for (uint8_t pos = 0; pos < length;)
+    {
+        uint8_t op = bytes[pos];
+        *error_pos = pos;
+        if (op > MACRO_OP_JUMP_ERR)
+            return false;
+        // 16 bit: the length byte of an action must not wrap the size
+        uint16_t size = sizes[op];
+        if (op == MACRO_OP_ACTION && pos + 1 < length)
+            size += bytes[pos + 1];
+        if (pos + size > length)
+            return false;
+        if (op == MACRO_OP_ACTION)
+        {
+            // encoded action within the code (the loops below + macro_poll() rely on it)
+            if (pos + 2 + bytes[pos + 1] > length)
+                return false;
+            Action action = {};
+            pb_istream_t stream = pb_istream_from_buffer(&bytes[pos + 2], bytes[pos + 1]);
+            if (!pb_decode(&stream, Action_fields, &action))
+                return false;
+        }
+        starts[pos / 8] |= 1 << (pos % 8);
+        pos += size;
+    }
+
+    // targets: begin of an instruction or end of the code
+    for (uint8_t pos = 0; pos < length;)
+    {
+        uint8_t op = bytes[pos];
+        int16_t target = -1;
+        *error_pos = pos;
+        if (op == MACRO_OP_JUMP || op == MACRO_OP_JUMP_ERR)
+            target = bytes[pos + 1];
+        else if (op == MACRO_OP_JUMP_IF)
+            target = bytes[pos + 6];
+        if (target >= 0 && target != length && (target > length || !(starts[target / 8] & (1 << (target % 8)))))
+            return false;
+        if (op == MACRO_OP_JUMP_IF && bytes[pos + 1] > MACRO_CMP_GE)
+            return false;
+        pos += sizes[op] + (op == MACRO_OP_ACTION ? bytes[pos + 1] : 0);
+    }
+    return true;
+}
+
+/**************************************************************************/
+/*
+    Step: PROGRESS for the MACRO_RUN request with the sequence id of it
+*/
+void finish_step(void)
+{
+    byte data[7];
+    uint8_t index = 0;
+
+    step++;
+    index += pack_value(&data[index], running_id, 2);
+    index += pack_value(&data[index], step, 2);
+    index += pack_value(&data[index], pc, 2);
+    index += pack_value(&data[index], result_code, 1);
+
+    uint32_t request_seq = protobuf_get_seq();
+    protobuf_set_seq(run_seq);
+    send_progress(run_profile_id, data, index);
+    protobuf_set_seq(request_seq);
+
+    state = MACRO_READY;
+    if (result_code == ResponseCode_ERROR && !(pc < code_length && code[pc] == MACRO_OP_JUMP_ERR))
+        finish_macro(ErrorCode_ERR_MACRO_FAILED);
+}
+
+void finish_macro(ErrorCode error)
+{
+    uint32_t request_seq = protobuf_get_seq();
+
+    state = MACRO_IDLE;
+    pending_cancel(run_profile_id, run_seq);
+    protobuf_set_seq(run_seq);
+    if (error != ErrorCode_NO_ERROR)
+        send_error(run_profile_id, error, step);
+    else
+    {
+        byte data[2];
+        send_data(run_profile_id, data, pack_value(data, step, 2));
+    }
+    protobuf_set_seq(request_seq);
+}
+
+uint16_t result_value(uint8_t offset, uint8_t size)
+{
+    uint16_t value = 0;
+    bool raw = size & MACRO_SIZE_RAW;
+
+    size &= ~MACRO_SIZE_RAW;
+    for (uint8_t i = 0; i < size && offset + i < result_length; i++)
+    {
+        if (raw)
+            value |= (uint16_t)result[offset + i] << (8 * i);
+        else
+            value |= (uint16_t)(result[offset + i] & 0x7F) << (7 * i);
+    }
+    return value;
+}
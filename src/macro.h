@@ -0,0 +1,112 @@
+#ifndef _MACRO_H_
+#define _MACRO_H_
+
+#include "main.h"
+
+/*
+    Macros: sequences of actions uploaded by the gateway (Macro request) and
+    executed by the firmware without a trip to the gateway per action.
+    A macro is started with MCUAction MACRO_RUN (arg: macro_id): ACK, one
+    PROGRESS per executed action, DATA at the end (ERROR if it failed).
+
+    Bytecode (multi-byte values little endian, targets are byte offsets):
+        END      0x00                                  end of the macro
+        ACTION   0x01 len <encoded Action (len)>       executes the action, an acknowledged
+                                                       action is waited for (DATA/ERROR)
+        DELAY    0x02 ms(2)                            waits
+        JUMP     0x03 target                           jumps
+        JUMP_IF  0x04 cmp offset size value(2) target  jumps if the result of the last action
+                                                       compares true (cmp: MACRO_CMP_*)
+        JUMP_ERR 0x05 target                           jumps if the last action failed
+
+    Result of an action: payload of its DATA at <offset>, <size> bytes of
+    7-bit groups (see pack_value()), or raw bytes with MACRO_SIZE_RAW.
+    Result of an ERROR: the ErrorCode (1 packed byte).
+    A failed action stops the macro, unless the next instruction is JUMP_ERR.
+    PROGRESS payload: macro_id (2), step (2), offset of the next instruction (2),
+    response code of the action (1), all packed with pack_value().
+*/
+
+/*========================================================================*/
+/*                          PUBLIC DEFINITIONS                            */
+/*========================================================================*/
+
+/* Opcodes */
+#define MACRO_OP_END 0x00
+#define MACRO_OP_ACTION 0x01
+#define MACRO_OP_DELAY 0x02
+#define MACRO_OP_JUMP 0x03
+#define MACRO_OP_JUMP_IF 0x04
+#define MACRO_OP_JUMP_ERR 0x05
+
+/* Comparisons of JUMP_IF */
+#define MACRO_CMP_EQ 0
+#define MACRO_CMP_NE 1
+#define MACRO_CMP_LT 2
+#define MACRO_CMP_GE 3
+
+// size flag of JUMP_IF: raw bytes instead of 7-bit groups
+#define MACRO_SIZE_RAW 0x80
+
+// number of macros stored in the EEPROM (can be set with a build flag)
+#ifndef MACRO_CAPACITY
+#define MACRO_CAPACITY 4
+#endif
+
+// EEPROM area of the macros: behind the registrations
+#ifndef MACRO_STORAGE_START
+#define MACRO_STORAGE_START (PROFILE_STORAGE_START + PROFILE_STORAGE_SIZE)
+#endif
+
+// max. wait for the completion of an acknowledged action
+#ifndef MACRO_TIMEOUT_MS
+#define MACRO_TIMEOUT_MS 30000
+#endif
+
+/*========================================================================*/
+/*                          PUBLIC FUNCTIONS                              */
+/*========================================================================*/
+
+/**
+    @brief  Deletes the macros which are not persistent (called in setup())
+*/
+void macro_init(void);
+
+/**
+    @brief  Handles incoming Macro messages: checks + stores or deletes (empty code) a macro,
+            sends DATA or ERROR
+*/
+void macro_handler(const Macro &macro);
+
+/**
+    @brief  Starts a stored macro (MCUAction MACRO_RUN): sends ACK or ERROR
+    @param  profile_id: profile of the MCU driver (PROGRESS + result)
+*/
+void macro_run(uint32_t profile_id, uint32_t macro_id);
+
+/**
+    @brief  Stops the running macro (ERROR for the MACRO_RUN request)
+    @return false if no macro is running
+*/
+bool macro_stop(void);
+
+/**
+    @brief  Executes the macro until the next action or wait
+    @param  action: next action of the macro (executed by the caller with muted responses,
+            its ACK does not add a pending request: completions are observed by macro_response())
+    @return false if there is no action to execute now
+*/
+bool macro_poll(Action *action);
+
+/**
+    @brief  Time until the macro has to be polled again [us] (UINT32_MAX if no delay is running)
+*/
+uint32_t macro_wait_us(void);
+
+/**
+    @brief  Response observer (called by send_error/ack/data()):
+            completion + result of the action executed by the macro
+*/
+void macro_response(uint32_t profile_id, ResponseCode code, const void *data, uint32_t length);
+
+#endif
@@ -23,6 +23,13 @@ ProfileManager profile_manager;
 // status to indicate setup phase => no feedback after device initialization
 bool setup_flag = false;
 
+// idle time at the end of every loop pass [us]
+#define LOOP_IDLE_US 10000
+
+// decode buffer of the requests: the handlers + drivers get references into it
+// (static: not on the stack of every request, request_handler() is not reentrant)
+static Request request;
+
 /* Function prototypes */
 /**
     @brief  Handles incoming  Request messages
@@ -33,13 +40,43 @@ void request_handler();
     @brief  Handles incoming Action messages
     @param  action: Action message
 */
-void action_handler(Action action);
+void action_handler(const Action &action);
+
+/**
+    @brief  Executes a scheduled action which is due (responses carry the sequence id of its request)
+    @param  action: Action message
+    @param  seq: sequence id of the scheduling request
+*/
+void scheduled_handler(const Action &action, uint32_t seq);
+
+/**
+    @brief  Executes the actions of the triggered reflex rules
+*/
+void reflex_handler();
+
+/**
+    @brief  Executes the actions of the running macro
+*/
+void macro_executor();
+
+/**
+    @brief  Idle time of the loop: waits until the scheduled actions are due + executes them
+    @param  idle_us: idle time
+*/
+void idle_handler(uint32_t idle_us);
 
 /**
     @brief  Handles incoming Registration messages
     @param  registration: Registration message
 */
-void registration_handler(Registration registration);
+void registration_handler(const Registration &registration);
+
+/**
+    @brief  Initializes the driver of a profile
+    @param  registration: Registration message
+    @return boolean if initialization was successful or not
+*/
+bool init_profile(const Registration &registration);
 
 /**
     @brief  Handles possible events
@@ -53,17 +90,31 @@ bool event_handler(uint32_t profile_id);
 
 void setup(void)
 {
+  // read the reset cause + start the watchdog
+  watchdog_init();
+
   // indicate setup phase: no feedback should be sent on re-initialization
   setup_flag = true;
 
   // initialize protobuf message communication
   protobuf_init();
+  scheduler_init();
+  macro_init();
 
-  // TODO: initialize SD card manager
-  // TODO: load registrations from SD card => re-initialize stored profiles
+  // load registrations from EEPROM => re-initialize stored profiles
+  profile_manager.load_profiles();
+  for (uint8_t slot = 0; slot < PROFILE_CAPACITY; slot++)
+  {
+    if (!(profile_manager.slots[slot].flags & PROFILE_FLAG_USED))
+      continue;
+    // device not ready (e.g. not powered yet): slot is freed for this boot, the EEPROM record is kept
+    if (!init_profile(profile_manager.slots[slot].registration))
+      profile_manager.delete_profile(profile_manager.slots[slot].registration.profile_id, false);
+  }
 
   // stop setup phase
   setup_flag = false;
+  watchdog_report();
   delay(1000);
 }
 
@@ -73,25 +124,41 @@ void setup(void)
 
 void loop(void)
 {
+  PERF_BEGIN(PERF_PATH_LOOP);
+  perf_loop_begin();
+  watchdog_feed();
+  // rollover detection of the device clock
+  device_time_us();
+  // fallback of an unconfirmed baudrate switch
+  link_poll();
+
   /* handle events */
-  for (uint32_t profile_id = 0; profile_id < 256; profile_id++)
+  for (uint8_t slot = 0; slot < PROFILE_CAPACITY; slot++)
   {
     // call event_handler for all profiles that expect an event
-    if (profile_manager.events[profile_id])
+    if (profile_manager.slots[slot].flags & PROFILE_FLAG_EVENT)
     {
       // event handler returns true if an event occurred
-      if (event_handler(profile_id))
+      if (event_handler(profile_manager.slots[slot].registration.profile_id))
+      {
+        // react on the event before anything else
+        reflex_handler();
         // jump to event_occured label (don't handle incoming message)
         goto event_occurred;
+      }
     }
   }
 
   /* process incoming message (only if no event occured)*/
   request_handler();
+  reflex_handler();
+  macro_executor();
 
   // jump here if event occured
 event_occurred:
-  delay(10);
+  perf_loop_end();
+  PERF_END(PERF_PATH_LOOP, 0);
+  idle_handler(LOOP_IDLE_US);
 }
 
 /*========================================================================*/
@@ -105,13 +172,32 @@ event_occurred:
 void request_handler()
 {
   // process the incoming packet if the buffer is not empty
-  if (Serial.available() > 0)
+  if (Serial.available() > 0 && Serial.peek() == FAST_MARKER)
   {
+    // binary fast path: fixed layout frame, no nanopb decode
+    PERF_BEGIN(PERF_PATH_REQUEST);
+    protobuf_request_begin();
+    protobuf_set_fast(true);
+    Action &action = request.request_type.action;
+    if (fast_decode(&action))
+    {
+      TRACE(TRACE_EVENT_REQUEST, action.profile_id, PERF_REQUEST_FAST | action.which_driver);
+      action_handler(action);
+    }
+    protobuf_set_fast(false);
+    protobuf_request_end();
+    PERF_END(PERF_PATH_REQUEST, PERF_REQUEST_FAST | action.which_driver);
+  }
+  else if (Serial.available() > 0)
+  {
+    PERF_BEGIN(PERF_PATH_REQUEST);
+    protobuf_request_begin();
     // current request message
-    Request req;
+    Request &req = request;
 
     // decode the received protobuf message
     protobuf_decode(&req);
+    TRACE(TRACE_EVENT_REQUEST, TRACE_REQUEST_PROFILE(req), PERF_REQUEST_ID(req));
 
     // check if action or registration
     if (req.which_request_type == Request_action_tag)
@@ -122,9 +208,20 @@ void request_handler()
     {
       registration_handler(req.request_type.registration);
     }
+    else if (req.which_request_type == Request_rule_tag)
+    {
+      rule_handler(req.request_type.rule);
+    }
+    else if (req.which_request_type == Request_macro_tag)
+    {
+      macro_handler(req.request_type.macro);
+    }
     else
       // ERROR: request type of msg is incorrect (404 as profile id is unknown)
-      send_error(404, "ERROR: request type of msg is incorrect");
+      send_error(404, ErrorCode_ERR_REQUEST_TYPE);
+
+    protobuf_request_end();
+    PERF_END(PERF_PATH_REQUEST, PERF_REQUEST_ID(req));
   }
 }
 
@@ -132,115 +229,182 @@ void request_handler()
 /*
     Action Handler: handles incoming actions
 */
-void action_handler(Action action)
+void action_handler(const Action &action)
 {
-  // TODO: check if profile_id is registered => if not: send ERROR msg
-  // use corresponding driver function
-  switch (action.which_driver)
+  // check if profile_id is registered with the driver of the action
+  Registration *registration = profile_manager.get_registration(action.profile_id);
+  if (registration == NULL)
   {
+    send_error(action.profile_id, ErrorCode_ERR_NOT_REGISTERED);
+    return;
+  }
+  // Action and Registration share the oneof tags of the drivers
+  if (registration->which_driver != action.which_driver)
+  {
+    send_error(action.profile_id, ErrorCode_ERR_DRIVER_MISMATCH);
+    return;
+  }
 
-  case Action_a_digital_generic_tag:
-    // call action function of digital_generic driver
-    run_digital_generic(action.profile_id, action.driver.a_digital_generic);
-    break;
-
-  case Action_a_uart_ttl_generic_tag:
-    //call action function of generic UART TTL driver
-    run_uart_ttl_generic(action.profile_id, action.driver.a_uart_ttl_generic);
-    break;
-
-  case Action_a_color_sensor_tag:
-    // call action function of color_sensor driver
-    run_color_sensor(action.profile_id, action.driver.a_color_sensor);
-    break;
-
-  case Action_a_ultrasonic_sensor_tag:
-    // call action function of ultrasonic_sensor driver
-    run_ultrasonic_sensor(action.profile_id, action.driver.a_ultrasonic_sensor);
-    break;
-
-  case Action_a_step_motor_tag:
-    // call action function of step_motor driver
-    run_step_motor(action.profile_id, action.driver.a_step_motor);
-    break;
-
-  case Action_a_mcu_driver_tag:
-    // call action function of mcu_driver driver
-    run_mcu_driver(action.profile_id, action.driver.a_mcu_driver);
-    break;
-    // ADI-MAIN-Action: Label for automatic driver initialization (Do not move!)
-
-  default:
-    // ERROR: no driver functions definded for specified registration
-    break;
+  // scheduled action: acknowledged now, executed by the idle handler
+  if (action.at_us != 0 || action.delay_us != 0)
+  {
+    schedule_action(action);
+    return;
   }
+
+  // use corresponding driver function (same tag as the registration => driver exists)
+  DriverDescriptor driver;
+  get_driver(action.which_driver, &driver);
+  uint32_t start_us = micros();
+  TRACE(TRACE_EVENT_DRIVER_ENTER, action.profile_id, TRACE_DRIVER_ACTION | action.which_driver);
+  driver.run(action.profile_id, action);
+  TRACE(TRACE_EVENT_DRIVER_EXIT, action.profile_id, TRACE_DRIVER_ACTION | action.which_driver);
+  perf_action(action.which_driver, micros() - start_us);
 }
 
 /**************************************************************************/
 /*
-    Registration Handler: handles incoming registrations
+    Scheduled Handler: executes a due action like a request
+    (the profile is checked again, it could have been deleted in the meantime)
 */
-void registration_handler(Registration registration)
+void scheduled_handler(const Action &action, uint32_t seq)
 {
-  // clear old profile, if already registered
-  profile_manager.delete_profile(registration.profile_id);
+  // the scheduling request is completed by the responses of the action
+  protobuf_request_begin();
+  protobuf_set_seq(seq);
+  action_handler(action);
+  protobuf_request_end();
+}
 
-  // boolean to check whether initialization was successfull or not
-  bool reg_success = false;
+/**************************************************************************/
+/*
+    Reflex Handler: executes the actions of the triggered rules
+    (responses are only sent to the gateway if the rule has notify set)
+*/
+void reflex_handler()
+{
+  Action action;
+  bool notify;
 
-  /* initializing with corresponding driver function */
-  switch (registration.which_driver)
+  while (rules_poll(&action, &notify))
   {
-  case Registration_r_digital_generic_tag:
-    // call initialization function
-    reg_success = init_digital_generic(registration.profile_id, registration.driver.r_digital_generic);
-    break;
-
-  case Registration_r_uart_ttl_generic_tag:
-    //call initialization function
-    reg_success = init_uart_ttl_generic(registration.profile_id, registration.driver.r_uart_ttl_generic);
-    break;
-
-  case Registration_r_color_sensor_tag:
-    //call initialization function of color_sensor driver
-    reg_success = init_color_sensor(registration.profile_id, registration.driver.r_color_sensor);
-    break;
-
-  case Registration_r_ultrasonic_sensor_tag:
-    //call initialization function of ultrasonic_sensor driver
-    reg_success = init_ultrasonic_sensor(registration.profile_id, registration.driver.r_ultrasonic_sensor);
-    break;
-
-  case Registration_r_step_motor_tag:
-    //call initialization function of step_motor driver
-    reg_success = init_step_motor(registration.profile_id, registration.driver.r_step_motor);
-    break;
-
-  case Registration_r_mcu_driver_tag:
-    //call initialization function of mcu_driver driver
-    reg_success = init_mcu_driver(registration.profile_id, registration.driver.r_mcu_driver);
-    break;
-    // ADI-MAIN-Reg: Label for automatic driver initialization (Do not move!)
-
-  default:
-    /* ERROR: no driver functions definded for specified registration */
-    char str[100];
-    snprintf(str, 100, "No driver functions definded for driver: %i", registration.which_driver);
-    send_error(registration.profile_id, str);
-    break;
+    protobuf_set_muted(!notify, action.profile_id);
+    action_handler(action);
+    protobuf_set_muted(false);
+  }
+}
+
+/**************************************************************************/
+/*
+    Macro Executor: executes the actions of the running macro (the macro
+    only observes their responses, it reports PROGRESS itself)
+*/
+void macro_executor()
+{
+  Action action;
+
+  while (macro_poll(&action))
+  {
+    protobuf_set_muted(true, action.profile_id);
+    action_handler(action);
+    protobuf_set_muted(false);
+  }
+}
+
+/**************************************************************************/
+/*
+    Idle Handler: replaces a plain delay, the remaining time is waited in
+    steps until the next due action/tick of the timer wheel or the next
+    poll of the reflex rules/running macro
+*/
+void idle_handler(uint32_t idle_us)
+{
+  uint32_t start_us = micros();
+  uint32_t elapsed_us;
+
+  while ((elapsed_us = micros() - start_us) < idle_us)
+  {
+    Action action;
+    uint32_t seq;
+    uint64_t now_us = device_time_us();
+
+    reflex_handler();
+    macro_executor();
+    if (scheduler_poll(now_us, &action, &seq))
+    {
+      scheduled_handler(action, seq);
+      continue;
+    }
+    uint32_t wait_us = scheduler_wait_us(now_us);
+    if (wait_us > rules_wait_us())
+      wait_us = rules_wait_us();
+    if (wait_us > macro_wait_us())
+      wait_us = macro_wait_us();
+    if (wait_us > idle_us - elapsed_us)
+      wait_us = idle_us - elapsed_us;
+    delayMicroseconds(wait_us);
+  }
+}
+
+/**************************************************************************/
+/*
+    Registration Handler: handles incoming registrations
+*/
+void registration_handler(const Registration &registration)
+{
+  // store profile first: drivers keep their state inside the profile slot
+  // (an old profile with the same profile_id is torn down + overwritten)
+  ProfileStatus status = profile_manager.register_profile(registration);
+  if (status != PROFILE_OK)
+  {
+    if (status == PROFILE_TABLE_FULL)
+      send_error(registration.profile_id, ErrorCode_ERR_TABLE_FULL);
+    else if (status == PROFILE_RESOURCE_CONFLICT)
+      send_error(registration.profile_id, ErrorCode_ERR_RESOURCE_CONFLICT);
+    else
+      send_error(registration.profile_id, ErrorCode_ERR_NO_DRIVER, registration.which_driver);
+    return;
   }
 
+  // initialize driver
+  bool reg_success = init_profile(registration);
+
+  // EEPROM only for initialized profiles (only updated if it changed),
+  // release the slot again if the initialization failed
+  if (reg_success)
+    profile_manager.store_profile(registration.profile_id);
+  else
+    profile_manager.delete_profile(registration.profile_id);
+
   /* send feedback if not in re-initialization phase */
   // send confirmation if registration successfull
   if (!setup_flag && reg_success)
-  {
     send_data(registration.profile_id);
-    // use profile manager to save new registration on profile_manager.profiles + on SD card
-    profile_manager.register_profile(registration);
-  }
   // send ERROR if registration failed
   else if (!setup_flag && !reg_success)
-    send_error(registration.profile_id, "Registration failed");
+    send_error(registration.profile_id, ErrorCode_ERR_INIT_FAILED);
+}
+
+/**************************************************************************/
+/*
+    Profile Initialization: calls the initialization function of the driver
+    (used for new registrations and for profiles restored from the EEPROM)
+*/
+bool init_profile(const Registration &registration)
+{
+  DriverDescriptor driver;
+
+  /* initializing with corresponding driver function */
+  if (!get_driver(registration.which_driver, &driver))
+  {
+    /* ERROR: no driver functions definded for specified registration */
+    send_error(registration.profile_id, ErrorCode_ERR_NO_DRIVER, registration.which_driver);
+    return false;
+  }
+  TRACE(TRACE_EVENT_DRIVER_ENTER, registration.profile_id, TRACE_DRIVER_INIT | registration.which_driver);
+  bool success = driver.init(registration.profile_id, registration);
+  TRACE(TRACE_EVENT_DRIVER_EXIT, registration.profile_id, TRACE_DRIVER_INIT | registration.which_driver);
+  return success;
 }
 
 /**************************************************************************/
@@ -251,29 +415,28 @@ void registration_handler(Registration registration)
 */
 bool event_handler(uint32_t profile_id)
 {
-  // status if event occured for specific profile
-  bool profile_event_occured = false;
+  DriverDescriptor driver;
 
   /* call the corresponing driver function for event handling*/
-  // get registration_tag from profile_manager.profiles
-  switch (profile_manager.profiles[profile_id].which_driver)
+  // get registration_tag from the profile slot
+  pb_size_t which_driver = profile_manager.get_registration(profile_id)->which_driver;
+  get_driver(which_driver, &driver);
+
+  // driver without event handling => stop event listening
+  if (!(driver.capabilities & DRIVER_CAP_EVENT))
   {
-  case Registration_r_digital_generic_tag:
-    //call event handling function for digital_generic driver
-    profile_event_occured = event_digital_generic(profile_id);
-    break;
-
-  case Registration_r_uart_ttl_generic_tag:
-    //call event handling function for uart_ttl_generic driver
-    profile_event_occured = event_uart_ttl_generic(profile_id);
-    break;
-
-  default:
-    /* ERROR: no event driver functions definded for specified registration */
-    char str[100];
-    snprintf(str, 100, "No event driver functions definded for driver: %i", profile_manager.profiles[profile_id].which_driver);
-    send_error(profile_id, str);
-    break;
+    profile_manager.set_event(profile_id, false);
+    return false;
   }
-  return profile_event_occured;
+  // event handler returns true if an event occured for the specific profile
+  PERF_BEGIN(PERF_PATH_EVENT);
+  TRACE_MARK(mark);
+  TRACE(TRACE_EVENT_DRIVER_ENTER, profile_id, TRACE_DRIVER_EVENT | which_driver);
+  bool event_occurred = driver.event(profile_id);
+  TRACE(TRACE_EVENT_DRIVER_EXIT, profile_id, TRACE_DRIVER_EVENT | which_driver);
+  // polls without event would fill the trace
+  if (!event_occurred)
+    TRACE_DROP(mark);
+  PERF_END(PERF_PATH_EVENT, which_driver);
+  return event_occurred;
 }
@@ -5,8 +5,24 @@
 #include <pb_arduino.h>
 // include sub modules
 #include <protobuf/line_protocol.pb.h>
+#include <driver_config.h>
+#include <resource_manager.h>
 #include <profile_manager.h>
+#include <profile_storage.h>
 #include <protobuf_helper.h>
+#include <pending_requests.h>
+#include <device_clock.h>
+#include <watchdog.h>
+#include <deadline.h>
+#include <scheduler.h>
+#include <rules.h>
+#include <macro.h>
+#include <fast_path.h>
+#include <link_speed.h>
+#include <driver_table.h>
+#include <perf_markers.h>
+#include <perf_counters.h>
+#include <trace.h>
 // include drivers
 #include <drivers/digital_generic.h>
 #include <drivers/uart_ttl_generic.h>
@@ -14,6 +30,9 @@
 #include <drivers/ultrasonic_sensor.h>
 #include <drivers/step_motor.h>
 #include <drivers/mcu_driver.h>
+#include <drivers/analog_generic.h>
+#include <drivers/pwm_generic.h>
+#include <drivers/encoder_generic.h>
 // ADI-MAIN-Include: Label for automatic driver initialization (Do not move!)
 
 /*========================================================================*/
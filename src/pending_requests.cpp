@@ -0,0 +1,128 @@
+/**************************************************************************/
+/*!
+    @file     pending_requests.cpp
+    @author   Jonas Brütsch
+
+    FIFO of the pending (acknowledged) requests of all profiles.
+    The list is only changed inside atomic blocks (cheap, keeps it
+    consistent if an ISR ever completes a request).
+*/
+/**************************************************************************/
+#include "pending_requests.h"
+#include <util/atomic.h>
+
+/*========================================================================*/
+/*                          PRIVATE DEFINITIONS                           */
+/*========================================================================*/
+
+struct PendingRequest
+{
+    uint32_t profile_id;
+    uint32_t seq;
+};
+
+// pending requests in the order of the requests
+static PendingRequest pending[PENDING_CAPACITY];
+static uint8_t num_pending = 0;
+
+/**
+    @brief  Removes the entry at index (the order of the others is kept)
+*/
+void pending_remove(uint8_t index);
+
+/*========================================================================*/
+/*                          PUBLIC FUNCTIONS                              */
+/*========================================================================*/
+
+bool pending_add(uint32_t profile_id, uint32_t seq)
+{
+    bool added = false;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        if (num_pending < PENDING_CAPACITY)
+        {
+            pending[num_pending++] = {profile_id, seq};
+            added = true;
+        }
+    }
+    return added;
+}
+
+bool pending_take(uint32_t profile_id, uint32_t *seq)
+{
+    bool found = false;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        for (uint8_t i = 0; !found && i < num_pending; i++)
+        {
+            if (pending[i].profile_id == profile_id)
+            {
+                *seq = pending[i].seq;
+                pending_remove(i);
+                found = true;
+            }
+        }
+    }
+    return found;
+}
+
+bool pending_cancel(uint32_t profile_id, uint32_t seq)
+{
+    bool found = false;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        for (uint8_t i = 0; !found && i < num_pending; i++)
+        {
+            if (pending[i].profile_id == profile_id && pending[i].seq == seq)
+            {
+                pending_remove(i);
+                found = true;
+            }
+        }
+    }
+    return found;
+}
+
+uint8_t pending_count(uint32_t profile_id)
+{
+    uint8_t count = 0;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        for (uint8_t i = 0; i < num_pending; i++)
+        {
+            if (pending[i].profile_id == profile_id)
+                count++;
+        }
+    }
+    return count;
+}
+
+void pending_drop(uint32_t profile_id)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        uint8_t i = 0;
+        while (i < num_pending)
+        {
+            if (pending[i].profile_id == profile_id)
+                pending_remove(i);
+            else
+                i++;
+        }
+    }
+}
+
+/*========================================================================*/
+/*                          PRIVATE FUNCTIONS                             */
+/*========================================================================*/
+
+void pending_remove(uint8_t index)
+{
+    num_pending--;
+    for (uint8_t i = index; i < num_pending; i++)
+        pending[i] = pending[i + 1];
+}
@@ -0,0 +1,57 @@
+#ifndef _PENDING_REQUESTS_H_
+#define _PENDING_REQUESTS_H_
+
+#include <Arduino.h>
+
+/*
+    Pending requests: non-blocking actions which were acknowledged (ACK) and
+    are completed later by the driver (DATA/ERROR of an event or callback).
+    A profile can have several pending requests, they are completed in the
+    order of the requests (per profile). The completion carries the sequence
+    id of its request (Response.seq).
+*/
+
+/*========================================================================*/
+/*                          PUBLIC DEFINITIONS                            */
+/*========================================================================*/
+
+// max. number of pending requests of all profiles (can be set with a build flag)
+#ifndef PENDING_CAPACITY
+#define PENDING_CAPACITY 8
+#endif
+
+/*========================================================================*/
+/*                          PUBLIC FUNCTIONS                              */
+/*========================================================================*/
+
+/**
+    @brief  Adds a pending request of a profile
+    @param  seq: sequence id of the request (0: request without sequence id)
+    @return false if PENDING_CAPACITY requests are already pending
+*/
+bool pending_add(uint32_t profile_id, uint32_t seq);
+
+/**
+    @brief  Removes the oldest pending request of a profile
+    @param  seq: sequence id of the removed request
+    @return false if the profile has no pending request
+*/
+bool pending_take(uint32_t profile_id, uint32_t *seq);
+
+/**
+    @brief  Removes a specific pending request of a profile (oldest one with the sequence id)
+    @return false if the request is not pending
+*/
+bool pending_cancel(uint32_t profile_id, uint32_t seq);
+
+/**
+    @brief  Number of pending requests of a profile
+*/
+uint8_t pending_count(uint32_t profile_id);
+
+/**
+    @brief  Removes all pending requests of a profile (profile deleted/re-registered)
+*/
+void pending_drop(uint32_t profile_id);
+
+#endif
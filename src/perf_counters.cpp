@@ -0,0 +1,309 @@
+/**************************************************************************/
+/*!
+    @file     perf_counters.cpp
+    @author   Jonas Brütsch
+
+    Runtime performance counters: loop time, requests, driver actions,
+    ISR time, serial buffers and memory.
+
+    Stack high-water mark: the free RAM between heap and stack is painted
+    with STACK_CANARY before main() starts (.init1) and again on reset of
+    the counters. The lowest overwritten byte is the deepest stack used.
+    The serial buffers are sampled once per pass of loop(): RX before
+    the requests are read, TX after the responses are written.
+*/
+/**************************************************************************/
+#include "perf_counters.h"
+#include "main.h"
+
+/*========================================================================*/
+/*                          PRIVATE DEFINITIONS                           */
+/*========================================================================*/
+
+// value of the unused stack
+#define STACK_CANARY 0xC5
+// bytes below the stack pointer not painted on reset (frame of perf_paint_stack())
+#define STACK_PAINT_MARGIN 16
+
+// shortest loop pass counted in the second bin of the histogram [us] (log2)
+#define LOOP_BIN_SHIFT 7
+
+// transmit buffer of the Arduino core
+#ifndef SERIAL_TX_BUFFER_SIZE
+#define SERIAL_TX_BUFFER_SIZE 64
+#endif
+
+static_assert(PERF_SNAPSHOT_SIZE <= 0xFF, "Snapshot does not fit into one response");
+
+struct PerfCounters
+{
+    uint32_t start_ms;
+    uint32_t loop_start_us;
+    uint32_t loop_count;
+    uint32_t loop_time_us;
+    uint32_t loop_max_us;
+    uint32_t loop_bins[PERF_LOOP_BINS];
+    uint32_t requests_decoded;
+    uint32_t requests_failed;
+    uint16_t rx_high_water;
+    uint16_t tx_high_water;
+    uint32_t actions[DRIVER_COUNT];
+    uint32_t action_time_us[DRIVER_COUNT];
+};
+
+// ISR counters: only accessed with interrupts disabled outside of the ISR
+struct PerfIsrCounters
+{
+    uint32_t count;
+    uint32_t time_us;
+    uint32_t max_us;
+};
+
+static PerfCounters counters = {};
+static volatile PerfIsrCounters isr_counters = {};
+
+/**
+    @brief  Adds a time to a sum, saturated at 0xFFFFFFFF
+*/
+static inline uint32_t add_saturated(uint32_t sum, uint32_t value)
+{
+    return (sum > 0xFFFFFFFF - value) ? 0xFFFFFFFF : sum + value;
+}
+
+/**
+    @brief  Bytes of the stack used since the last painting
+*/
+uint16_t perf_stack_max(void);
+
+/**
+    @brief  Free RAM between the end of the heap and the stack pointer
+*/
+uint16_t perf_free_memory(void);
+
+/**
+    @brief  Paints the free RAM below the current stack pointer
+*/
+void perf_paint_stack(void);
+
+#ifdef __AVR__
+extern uint8_t _end;
+extern uint8_t __stack;
+extern uint8_t __heap_start;
+extern uint8_t *__brkval;
+
+/**
+    @brief  Paints the whole RAM after .bss before the C runtime is initialized
+            (no C code: .init1 runs before the zero register + stack pointer are set)
+*/
+void paint_stack_init(void) __attribute__((naked, used, section(".init1")));
+void paint_stack_init(void)
+{
+    __asm volatile("    ldi r30,lo8(_end)\n"
+                   "    ldi r31,hi8(_end)\n"
+                   "    ldi r24,lo8(0xc5)\n" // STACK_CANARY
+                   "    ldi r25,hi8(__stack)\n"
+                   "    rjmp .paint_cmp\n"
+                   ".paint_loop:\n"
+                   "    st Z+,r24\n"
+                   ".paint_cmp:\n"
+                   "    cpi r30,lo8(__stack)\n"
+                   "    cpc r31,r25\n"
+                   "    brlo .paint_loop\n"
+                   "    breq .paint_loop" ::);
+}
+#endif
+
+/*========================================================================*/
+/*                          PUBLIC FUNCTIONS                              */
+/*========================================================================*/
+
+/**************************************************************************/
+/*
+    Loop: time of one pass + serial buffers
+*/
+void perf_loop_begin(void)
+{
+    uint16_t rx = Serial.available();
+    if (rx > counters.rx_high_water)
+        counters.rx_high_water = rx;
+
+    counters.loop_start_us = micros();
+}
+
+void perf_loop_end(void)
+{
+    uint32_t time_us = micros() - counters.loop_start_us;
+
+    counters.loop_count++;
+    counters.loop_time_us = add_saturated(counters.loop_time_us, time_us);
+    if (time_us > counters.loop_max_us)
+        counters.loop_max_us = time_us;
+
+    // bin i: < 128us * 4^i
+    uint32_t scaled = time_us >> LOOP_BIN_SHIFT;
+    uint8_t bin = 0;
+    while (scaled > 0 && bin < PERF_LOOP_BINS - 1)
+    {
+        scaled >>= 2;
+        bin++;
+    }
+    counters.loop_bins[bin]++;
+
+    uint16_t tx = SERIAL_TX_BUFFER_SIZE - 1 - Serial.availableForWrite();
+    if (tx > counters.tx_high_water)
+        counters.tx_high_water = tx;
+}
+
+/**************************************************************************/
+/*
+    Requests + actions
+*/
+void perf_request(bool success)
+{
+    if (success)
+        counters.requests_decoded++;
+    else
+        counters.requests_failed++;
+}
+
+void perf_action(uint8_t which_driver, uint32_t time_us)
+{
+    uint8_t index = which_driver - DRIVER_TAG_FIRST;
+    if (index >= DRIVER_COUNT)
+        return;
+
+    counters.actions[index]++;
+    counters.action_time_us[index] = add_saturated(counters.action_time_us[index], time_us);
+}
+
+/**************************************************************************/
+/*
+    ISR (interrupts are disabled)
+*/
+void perf_isr(uint32_t time_us)
+{
+    isr_counters.count++;
+    isr_counters.time_us = add_saturated(isr_counters.time_us, time_us);
+    if (time_us > isr_counters.max_us)
+        isr_counters.max_us = time_us;
+}
+
+/**************************************************************************/
+/*
+    Snapshot of all counters, see perf_counters.h for the layout
+*/
+uint8_t perf_snapshot(byte *buf)
+{
+    uint8_t length = 0;
+
+    // copy the ISR counters atomically
+    noInterrupts();
+    uint32_t isr_count = isr_counters.count;
+    uint32_t isr_time_us = isr_counters.time_us;
+    uint32_t isr_max_us = isr_counters.max_us;
+    interrupts();
+
+    buf[length++] = PERF_SNAPSHOT_VERSION | B10000000;
+    length += pack_value(&buf[length], millis() - counters.start_ms, 5);
+
+    /* loop */
+    length += pack_value(&buf[length], counters.loop_count, 5);
+    length += pack_value(&buf[length], counters.loop_max_us, 5);
+    length += pack_value(&buf[length], counters.loop_count > 0 ? counters.loop_time_us / counters.loop_count : 0, 5);
+    for (uint8_t bin = 0; bin < PERF_LOOP_BINS; bin++)
+        length += pack_value(&buf[length], counters.loop_bins[bin], 5);
+
+    /* requests */
+    length += pack_value(&buf[length], counters.requests_decoded, 5);
+    length += pack_value(&buf[length], counters.requests_failed, 5);
+
+    /* ISR */
+    length += pack_value(&buf[length], isr_count, 5);
+    length += pack_value(&buf[length], isr_time_us, 5);
+    length += pack_value(&buf[length], isr_max_us, 5);
+
+    /* serial + memory */
+    length += pack_value(&buf[length], counters.rx_high_water, 3);
+    length += pack_value(&buf[length], counters.tx_high_water, 3);
+    length += pack_value(&buf[length], perf_stack_max(), 3);
+    length += pack_value(&buf[length], perf_free_memory(), 3);
+
+    /* drivers */
+    buf[length++] = DRIVER_COUNT | B10000000;
+    for (uint8_t index = 0; index < DRIVER_COUNT; index++)
+    {
+        length += pack_value(&buf[length], counters.actions[index], 5);
+        length += pack_value(&buf[length], counters.action_time_us[index], 5);
+    }
+    return length;
+}
+
+/**************************************************************************/
+/*
+    Clears all counters
+*/
+void perf_reset(void)
+{
+    counters = {};
+    counters.start_ms = millis();
+
+    noInterrupts();
+    isr_counters.count = 0;
+    isr_counters.time_us = 0;
+    isr_counters.max_us = 0;
+    interrupts();
+
+    perf_paint_stack();
+}
+
+/*========================================================================*/
+/*                          PRIVATE FUNCTIONS                             */
+/*========================================================================*/
+
+#ifdef __AVR__
+/**************************************************************************/
+/*
+    Stack: first byte above the heap which is not STACK_CANARY anymore
+*/
+uint16_t perf_stack_max(void)
+{
+    uint8_t *p = (__brkval == 0) ? &__heap_start : __brkval;
+    while (p <= &__stack && *p == STACK_CANARY)
+        p++;
+    return &__stack - p + 1;
+}
+
+uint16_t perf_free_memory(void)
+{
+    uint8_t top;
+    return &top - ((__brkval == 0) ? &__heap_start : __brkval);
+}
+
+/**************************************************************************/
+/*
+    Painting with interrupts enabled: an ISR only uses the stack below the
+    stack pointer while it runs, its frame is dead again when painting continues.
+*/
+void perf_paint_stack(void)
+{
+    uint8_t top;
+    uint8_t *p = (__brkval == 0) ? &__heap_start : __brkval;
+    while (p < &top - STACK_PAINT_MARGIN)
+        *p++ = STACK_CANARY;
+}
+#else
+/* Host build (native HAL): no stack painting */
+uint16_t perf_stack_max(void)
+{
+    return 0;
+}
+
+uint16_t perf_free_memory(void)
+{
+    return 0;
+}
+
+void perf_paint_stack(void)
+{
+}
+#endif
@@ -0,0 +1,91 @@
+#ifndef _PERF_COUNTERS_H_
+#define _PERF_COUNTERS_H_
+
+#include <Arduino.h>
+
+/*
+    Runtime performance counters of the firmware, read with the MCU driver
+    (MCUAction STATS) and cleared with MCUAction RESET_STATS.
+
+    Other than the perf markers (perf_markers.h), the counters are always
+    compiled: they are meant for controllers in production without a debugger.
+*/
+
+/*========================================================================*/
+/*                          PUBLIC DEFINITIONS                            */
+/*========================================================================*/
+
+// version of the snapshot layout (first byte of the snapshot)
+#define PERF_SNAPSHOT_VERSION 1
+
+// number of bins of the loop time histogram: bin i counts passes < 128us * 4^i, the last bin all longer passes
+#define PERF_LOOP_BINS 8
+
+/*
+    Snapshot layout: every value is packed with pack_value() => NULL-free,
+    32-bit values use 5 bytes, 16-bit values 3 bytes.
+        version                     1
+        elapsed time [ms]           5   since the last reset of the counters
+        loop passes                 5
+        max. loop time [us]         5   one pass of loop() without delay()
+        avg. loop time [us]         5
+        loop time histogram         5 * PERF_LOOP_BINS
+        requests decoded            5
+        requests failed             5   decoding failed
+        ISR calls                   5   timer4 compare (step motor)
+        ISR time [us]               5
+        max. ISR time [us]          5
+        serial RX high-water [B]    3   receive buffer of Serial
+        serial TX high-water [B]    3   transmit buffer of Serial
+        max. stack [B]              3   stack painting, since the last reset of the counters
+        free memory [B]             3   between heap and stack pointer
+        number of drivers           1   DRIVER_COUNT, in the order of the driver table
+        per driver: actions         5
+                    action time [us] 5
+    Times are added up saturated at 0xFFFFFFFF (~71 min).
+*/
+// size of the snapshot (DRIVER_COUNT: see driver_table.h)
+#define PERF_SNAPSHOT_SIZE (1 + 5 * 4 + 5 * PERF_LOOP_BINS + 5 * 2 + 5 * 3 + 3 * 2 + 3 * 2 + 1 + 10 * DRIVER_COUNT)
+
+/*========================================================================*/
+/*                          PUBLIC FUNCTIONS                              */
+/*========================================================================*/
+
+/**
+    @brief  Marks the begin/end of one pass of loop() (without delay())
+*/
+void perf_loop_begin(void);
+void perf_loop_end(void);
+
+/**
+    @brief  Counts a decoded request
+    @param  success: false if decoding failed
+*/
+void perf_request(bool success);
+
+/**
+    @brief  Adds an executed action to the counters of its driver
+    @param  which_driver: oneof tag of the driver
+    @param  time_us: execution time of the action
+*/
+void perf_action(uint8_t which_driver, uint32_t time_us);
+
+/**
+    @brief  Adds an ISR call (only called inside the ISR)
+    @param  time_us: execution time of the ISR
+*/
+void perf_isr(uint32_t time_us);
+
+/**
+    @brief  Writes the snapshot of all counters (see layout above)
+    @param  buf: destination buffer (at least PERF_SNAPSHOT_SIZE bytes)
+    @return number of bytes written
+*/
+uint8_t perf_snapshot(byte *buf);
+
+/**
+    @brief  Clears all counters and paints the free stack again
+*/
+void perf_reset(void);
+
+#endif
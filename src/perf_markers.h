@@ -0,0 +1,61 @@
+#ifndef _PERF_MARKERS_H_
+#define _PERF_MARKERS_H_
+
+#include <avr/io.h>
+
+/*
+    Performance markers used by the simavr harness (see tools/simavr).
+
+    Only compiled with -D PERF_MARKERS (env:perf), otherwise the macros are empty.
+    A marker is a write to a general purpose I/O register (1 cycle):
+        - GPIOR0: path id of the main program, bit 7 set marks the end of the path
+        - GPIOR1: sub id of the path (written before the end marker)
+        - GPIOR2: ISR id, bit 7 set marks the end of the ISR
+    ISRs only use GPIOR2 => they can't corrupt a GPIOR1/GPIOR0 sequence.
+*/
+
+/*========================================================================*/
+/*                          PUBLIC DEFINITIONS                            */
+/*========================================================================*/
+
+// end flag of a marker
+#define PERF_END_FLAG 0x80
+
+/* Paths of the main program (GPIOR0) */
+#define PERF_PATH_LOOP 1    // one pass of loop() without delay(), sub id: none
+#define PERF_PATH_REQUEST 2 // request_handler() with data, sub id: PERF_REQUEST_ID()
+#define PERF_PATH_EVENT 3   // event_handler(), sub id: driver tag
+
+/* ISRs (GPIOR2) */
+#define PERF_ISR_TIMER4_COMPA 1
+
+/* Sub ids of requests: type | driver tag */
+#define PERF_REQUEST_ACTION 0x00
+#define PERF_REQUEST_REGISTRATION 0x40
+#define PERF_REQUEST_FAST 0x20 // fast path frame | driver tag
+#define PERF_REQUEST_INVALID 0x7F
+#define PERF_REQUEST_ID(req)                                                        \
+    ((req).which_request_type == Request_action_tag                                 \
+         ? PERF_REQUEST_ACTION | (req).request_type.action.which_driver             \
+     : (req).which_request_type == Request_registration_tag                         \
+         ? PERF_REQUEST_REGISTRATION | (req).request_type.registration.which_driver \
+         : PERF_REQUEST_INVALID)
+
+#ifdef PERF_MARKERS
+#define PERF_BEGIN(path) (GPIOR0 = (path))
+#define PERF_END(path, sub)              \
+    do                                   \
+    {                                    \
+        GPIOR1 = (sub);                  \
+        GPIOR0 = (path) | PERF_END_FLAG; \
+    } while (0)
+#define PERF_ISR_BEGIN(isr) (GPIOR2 = (isr))
+#define PERF_ISR_END(isr) (GPIOR2 = (isr) | PERF_END_FLAG)
+#else
+#define PERF_BEGIN(path)
+#define PERF_END(path, sub)
+#define PERF_ISR_BEGIN(isr)
+#define PERF_ISR_END(isr)
+#endif
+
+#endif
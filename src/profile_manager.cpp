@@ -6,39 +6,192 @@
     Contains all tasks related to the management of registered profiles.
 
     Following main tasks are included:
-        - register: store all registered profiles in volatile registrations array
-        - save/update registrations on SD card for backup => not implemented yet!
-        - delete: delete the entry of a specific profile in the registered profile array
+        - register: store registered profiles in a fixed pool of slots (PROFILE_CAPACITY)
+          + claim the hardware resources (registrations with conflicting resources are rejected)
+        - lookup: map a profile_id to its slot (any uint32 profile_id is accepted)
+        - save/update registrations in the EEPROM for backup (see profile_storage.cpp)
+        - load: restore the stored registrations after a reset
+        - delete: tear down the driver + free the slot of a specific profile
 */
 /**************************************************************************/
 #include <profile_manager.h>
+#include <profile_storage.h>
 
 ProfileManager::ProfileManager(void)
 {
-    // initialize all profiles
-    for (int profile_id = 0; profile_id < 256; profile_id++)
+    // initialize all slots
+    memset(slots, 0, sizeof(slots));
+    memset(ids, 0, sizeof(ids));
+}
+
+// Store profile in a free slot + claim its resources
+ProfileStatus ProfileManager::register_profile(const Registration &registration)
+{
+    DriverDescriptor driver;
+    Resource resources[RESOURCES_MAX];
+
+    // ERROR: no driver defined for the registration
+    if (!get_driver(registration.which_driver, &driver))
+        return PROFILE_UNKNOWN_DRIVER;
+    uint8_t num_resources = driver.resources(registration, resources);
+
+    // re-use the slot if the profile is already registered
+    uint8_t slot = find_slot(registration.profile_id);
+
+    // resources of the old profile with the same profile_id can be used by the new registration
+    if (slot != PROFILE_SLOT_NONE)
+        release_resources(slot);
+
+    // ERROR: resources are used by another profile => keep the old profile
+    if (!resources_available(resources, num_resources))
+    {
+        if (slot != PROFILE_SLOT_NONE)
+            claim_resources(slot);
+        return PROFILE_RESOURCE_CONFLICT;
+    }
+
+    if (slot != PROFILE_SLOT_NONE)
+    {
+        // release the hardware of the old profile
+        get_driver(slots[slot].registration.which_driver, &driver);
+        driver.teardown(registration.profile_id);
+        // requests of the old profile are never completed
+        pending_drop(registration.profile_id);
+    }
+    else
     {
-        memset(&profiles[profile_id], 0, sizeof(Registration));
-        events[profile_id] = false;
+        // otherwise take the first free slot
+        for (uint8_t i = 0; slot == PROFILE_SLOT_NONE && i < PROFILE_CAPACITY; i++)
+        {
+            if (!(slots[i].flags & PROFILE_FLAG_USED))
+                slot = i;
+        }
+        // ERROR: profile table is full
+        if (slot == PROFILE_SLOT_NONE)
+            return PROFILE_TABLE_FULL;
     }
+
+    // store profile and clear the driver state
+    memset(&slots[slot], 0, sizeof(ProfileSlot));
+    slots[slot].registration = registration;
+    slots[slot].flags = PROFILE_FLAG_USED;
+    ids[slot] = registration.profile_id;
+    resources_claim(resources, num_resources);
+    return PROFILE_OK;
 }
 
-// Store profile in registered profiles list
-void ProfileManager::register_profile(Registration registration)
+// Store the registration of a profile in the EEPROM
+void ProfileManager::store_profile(uint32_t profile_id)
 {
-    // store profile to registered_profiles
-    profiles[registration.profile_id] = registration;
-    // TODO: update profile on SD card => add new profile
+    uint8_t slot = find_slot(profile_id);
+
+    // only written if changed
+    if (slot != PROFILE_SLOT_NONE)
+        storage_save_profile(slot, &slots[slot].registration);
 }
 
-// Delete corresponding profile field in registered profiles to avoid overlapping entries
-void ProfileManager::delete_profile(uint8_t profile_id)
+// Tear down the profile + free its slot
+void ProfileManager::delete_profile(uint32_t profile_id, bool erase)
 {
+    uint8_t slot = find_slot(profile_id);
+
     // check if the Profile_ID is already registered:
-    if (profiles[profile_id].profile_id != (uint32_t)0)
+    if (slot != PROFILE_SLOT_NONE)
     {
-        // clear entry in registered profiles
-        memset(&profiles[profile_id], 0, sizeof(Registration));
-        // TODO: update SD file => delete profile
+        // release the hardware + resources of the profile
+        DriverDescriptor driver;
+        get_driver(slots[slot].registration.which_driver, &driver);
+        driver.teardown(profile_id);
+        release_resources(slot);
+        pending_drop(profile_id);
+
+        // clear slot
+        memset(&slots[slot], 0, sizeof(ProfileSlot));
+        ids[slot] = 0;
+        // delete profile in the EEPROM
+        if (erase)
+            storage_delete_profile(slot);
     }
 }
+
+// Restore the registrations stored in the EEPROM
+uint8_t ProfileManager::load_profiles()
+{
+    uint8_t num_profiles = 0;
+
+    for (uint8_t slot = 0; slot < PROFILE_CAPACITY; slot++)
+    {
+        memset(&slots[slot], 0, sizeof(ProfileSlot));
+        ids[slot] = 0;
+
+        // same slot as before the reset => record ring stays assigned to the profile
+        if (!storage_load_profile(slot, &slots[slot].registration))
+            continue;
+
+        // skip records of unknown drivers or with conflicting resources (e.g. of an older firmware)
+        DriverDescriptor driver;
+        Resource resources[RESOURCES_MAX];
+        if (!get_driver(slots[slot].registration.which_driver, &driver))
+            continue;
+        uint8_t num_resources = driver.resources(slots[slot].registration, resources);
+        if (!resources_available(resources, num_resources))
+            continue;
+
+        resources_claim(resources, num_resources);
+        slots[slot].flags = PROFILE_FLAG_USED;
+        ids[slot] = slots[slot].registration.profile_id;
+        num_profiles++;
+    }
+    return num_profiles;
+}
+
+// Claim the resources of the profile stored in a slot
+void ProfileManager::claim_resources(uint8_t slot)
+{
+    DriverDescriptor driver;
+    Resource resources[RESOURCES_MAX];
+
+    if (get_driver(slots[slot].registration.which_driver, &driver))
+        resources_claim(resources, driver.resources(slots[slot].registration, resources));
+}
+
+// Release the resources of the profile stored in a slot
+void ProfileManager::release_resources(uint8_t slot)
+{
+    DriverDescriptor driver;
+    Resource resources[RESOURCES_MAX];
+
+    if (get_driver(slots[slot].registration.which_driver, &driver))
+        resources_release(resources, driver.resources(slots[slot].registration, resources));
+}
+
+// Search the slot of a registered profile
+uint8_t ProfileManager::find_slot(uint32_t profile_id)
+{
+    for (uint8_t slot = 0; slot < PROFILE_CAPACITY; slot++)
+    {
+        if (ids[slot] == profile_id && (slots[slot].flags & PROFILE_FLAG_USED))
+            return slot;
+    }
+    return PROFILE_SLOT_NONE;
+}
+
+// Get the registration of a profile
+Registration *ProfileManager::get_registration(uint32_t profile_id)
+{
+    uint8_t slot = find_slot(profile_id);
+    return (slot == PROFILE_SLOT_NONE) ? NULL : &slots[slot].registration;
+}
+
+// Start/stop event handling of a profile
+void ProfileManager::set_event(uint32_t profile_id, bool enabled)
+{
+    uint8_t slot = find_slot(profile_id);
+    if (slot == PROFILE_SLOT_NONE)
+        return;
+
+    if (enabled)
+        slots[slot].flags |= PROFILE_FLAG_EVENT;
+    else
+        slots[slot].flags &= ~PROFILE_FLAG_EVENT;
+}
@@ -3,22 +3,115 @@
 
 #include "main.h"
 
+/*========================================================================*/
+/*                          PUBLIC DEFINITIONS                            */
+/*========================================================================*/
+
+// max. number of profiles registered at the same time (can be set with a build flag)
+#ifndef PROFILE_CAPACITY
+#define PROFILE_CAPACITY 16
+#endif
+
+// number of bytes reserved in every slot for driver specific state
+#ifndef PROFILE_STATE_SIZE
+#define PROFILE_STATE_SIZE 8
+#endif
+
+// returned by find_slot() if a profile is not registered
+#define PROFILE_SLOT_NONE 0xFF
+
+/* Flags of a profile slot */
+#define PROFILE_FLAG_USED 0x01  // slot holds a registered profile
+#define PROFILE_FLAG_EVENT 0x02 // profile expects an event
+
+// result of ProfileManager::register_profile()
+enum ProfileStatus
+{
+    PROFILE_OK = 0,
+    PROFILE_TABLE_FULL,        // no free slot
+    PROFILE_UNKNOWN_DRIVER,    // no driver defined for the registration
+    PROFILE_RESOURCE_CONFLICT, // resources are used by another profile
+};
+
+// entry of the profile table
+struct ProfileSlot
+{
+    Registration registration;
+    uint8_t flags;
+    // driver specific state (see ProfileManager::get_state())
+    uint8_t state[PROFILE_STATE_SIZE];
+};
+
 class ProfileManager
 {
 public:
     ProfileManager();
 
-    // Registration array to store information for all registered profiles
-    Registration profiles[256];
+    // pool of profile slots, only slots flagged with PROFILE_FLAG_USED are valid
+    ProfileSlot slots[PROFILE_CAPACITY];
+
+    /**
+        @brief  Stores the registration in a free slot (driver state is cleared).
+                An old profile with the same profile_id is torn down and overwritten.
+                The EEPROM is written by store_profile() once the driver is initialized.
+        @return PROFILE_OK or the reason why the registration was rejected
+    */
+    ProfileStatus register_profile(const Registration &registration);
+
+    /**
+        @brief  Stores the registration of a profile in the EEPROM (only written if it changed)
+    */
+    void store_profile(uint32_t profile_id);
+
+    /**
+        @brief  Tears down the driver, frees the slot of a profile + deletes it from the EEPROM
+        @param  erase: false keeps the EEPROM record (restored again after the next reset)
+    */
+    void delete_profile(uint32_t profile_id, bool erase = true);
+
+    /**
+        @brief  Loads all registrations stored in the EEPROM into the slots
+                (drivers still have to be initialized)
+        @return number of loaded profiles
+    */
+    uint8_t load_profiles();
+
+    /**
+        @brief  Looks up the slot of a profile
+        @return slot index or PROFILE_SLOT_NONE if the profile is not registered
+    */
+    uint8_t find_slot(uint32_t profile_id);
+
+    /**
+        @brief  Returns the stored registration of a profile
+        @return NULL if the profile is not registered
+    */
+    Registration *get_registration(uint32_t profile_id);
+
+    /**
+        @brief  Enables/disables event handling for a profile
+    */
+    void set_event(uint32_t profile_id, bool enabled);
+
+    /**
+        @brief  Returns the driver specific state of a profile
+        @return NULL if the profile is not registered
+    */
+    template <typename T>
+    T *get_state(uint32_t profile_id)
+    {
+        static_assert(sizeof(T) <= PROFILE_STATE_SIZE, "Driver state does not fit into PROFILE_STATE_SIZE");
+        uint8_t slot = find_slot(profile_id);
+        return (slot == PROFILE_SLOT_NONE) ? NULL : (T *)slots[slot].state;
+    }
 
-    // array to store which profiles expect an event
-    // => true means we expect an event for the corresponding profile
-    bool events[256];
+private:
+    // id->slot index: profile ids of all slots (searched without touching the full slots)
+    uint32_t ids[PROFILE_CAPACITY];
 
-    void register_profile(Registration registration);
-    void delete_profile(uint8_t profile_id);
-    // function to initialize SD card
-    // function to re-initialize all stored profiles/registrations
+    // claim/release the hardware resources of the profile stored in a slot
+    void claim_resources(uint8_t slot);
+    void release_resources(uint8_t slot);
 };
 
 // instance of ProfileManager to handle all profiles
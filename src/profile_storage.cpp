@@ -0,0 +1,223 @@
+/**************************************************************************/
+/*!
+    @file     profile_storage.cpp
+    @author   Jonas Brütsch
+
+    Persistent storage of the registered profiles in the EEPROM.
+
+    Every profile slot owns a ring of PROFILE_STORAGE_COPIES records.
+    A record contains the nanopb encoded Registration:
+        [version][generation][length][payload (length bytes)][crc16]
+    A length of 0 marks a deleted profile.
+
+    Wear levelling: a changed registration is written to the next record
+    of the ring with an incremented generation, the newest valid record
+    wins on load. Unchanged registrations are not written at all.
+
+    The EEPROM is only accessed with EEPROM.read()/EEPROM.update(), which
+    can be replaced by a mocked EEPROM on the host.
+*/
+/**************************************************************************/
+#include "profile_storage.h"
+#include <EEPROM.h>
+
+/*========================================================================*/
+/*                          PRIVATE DEFINITIONS                           */
+/*========================================================================*/
+
+/* Record layout */
+#define RECORD_HEADER_SIZE 3 // version + generation + length
+#define RECORD_CRC_SIZE 2
+#define RECORD_SIZE (RECORD_HEADER_SIZE + Registration_size + RECORD_CRC_SIZE)
+
+// number of records per profile slot
+#define PROFILE_STORAGE_COPIES (PROFILE_STORAGE_SIZE / (PROFILE_CAPACITY * RECORD_SIZE))
+
+static_assert(PROFILE_STORAGE_COPIES >= 1, "PROFILE_STORAGE_SIZE is too small for PROFILE_CAPACITY");
+static_assert(Registration_size < 0xFF, "Encoded registration does not fit into the record length");
+
+// header + payload of a record
+struct StorageRecord
+{
+    uint8_t version;
+    uint8_t generation;
+    uint8_t length;
+    uint8_t payload[Registration_size];
+};
+
+// ring position of the newest record of a slot
+struct RecordPosition
+{
+    bool valid;
+    uint8_t copy;
+    uint8_t generation;
+};
+
+/**
+    @brief  Returns the EEPROM address of a record
+*/
+int record_address(uint8_t slot, uint8_t copy);
+
+/**
+    @brief  Reads a record and checks version + CRC
+    @return true if the record is valid
+*/
+bool read_record(uint8_t slot, uint8_t copy, StorageRecord *record);
+
+/**
+    @brief  Searches the newest valid record of a slot
+*/
+RecordPosition find_newest(uint8_t slot, StorageRecord *record);
+
+/**
+    @brief  Writes a record to the next copy of the ring (only if it differs from the newest record)
+*/
+void write_record(uint8_t slot, const uint8_t *payload, uint8_t length);
+
+/*========================================================================*/
+/*                          PUBLIC FUNCTIONS                              */
+/*========================================================================*/
+
+/**************************************************************************/
+/*
+    Encode registration + store it in the ring of the slot
+*/
+bool storage_save_profile(uint8_t slot, const Registration *registration)
+{
+    uint8_t payload[Registration_size];
+    pb_ostream_t stream = pb_ostream_from_buffer(payload, sizeof(payload));
+
+    if (!pb_encode(&stream, Registration_fields, registration))
+        return false;
+
+    // an empty registration can't be stored (length 0 marks deleted profiles)
+    if (stream.bytes_written == 0)
+        return false;
+
+    write_record(slot, payload, (uint8_t)stream.bytes_written);
+    return true;
+}
+
+/**************************************************************************/
+/*
+    Store a deleted record (length 0) for the slot
+*/
+void storage_delete_profile(uint8_t slot)
+{
+    write_record(slot, NULL, 0);
+}
+
+/**************************************************************************/
+/*
+    Load + decode the newest valid record of the slot
+*/
+bool storage_load_profile(uint8_t slot, Registration *registration)
+{
+    StorageRecord record;
+    RecordPosition newest = find_newest(slot, &record);
+
+    // no record or deleted profile
+    if (!newest.valid || record.length == 0)
+        return false;
+
+    pb_istream_t stream = pb_istream_from_buffer(record.payload, record.length);
+    return pb_decode(&stream, Registration_fields, registration);
+}
+
+/*========================================================================*/
+/*                          PRIVATE FUNCTIONS                             */
+/*========================================================================*/
+
+int record_address(uint8_t slot, uint8_t copy)
+{
+    return PROFILE_STORAGE_START + ((int)slot * PROFILE_STORAGE_COPIES + copy) * RECORD_SIZE;
+}
+
+bool read_record(uint8_t slot, uint8_t copy, StorageRecord *record)
+{
+    int address = record_address(slot, copy);
+    uint8_t *bytes = (uint8_t *)record;
+
+    // header
+    for (uint8_t i = 0; i < RECORD_HEADER_SIZE; i++)
+        bytes[i] = EEPROM.read(address + i);
+
+    // erased EEPROM (0xFF) or record of an older firmware
+    if (record->version != PROFILE_STORAGE_VERSION || record->length > Registration_size)
+        return false;
+
+    // payload
+    for (uint8_t i = 0; i < record->length; i++)
+        record->payload[i] = EEPROM.read(address + RECORD_HEADER_SIZE + i);
+
+    // crc is stored after the payload
+    int crc_address = address + RECORD_HEADER_SIZE + record->length;
+    uint16_t crc = EEPROM.read(crc_address) | ((uint16_t)EEPROM.read(crc_address + 1) << 8);
+
+    return crc == crc16(0xFFFF, bytes, RECORD_HEADER_SIZE + record->length);
+}
+
+RecordPosition find_newest(uint8_t slot, StorageRecord *record)
+{
+    RecordPosition newest = {false, 0, 0};
+    StorageRecord current;
+
+    for (uint8_t copy = 0; copy < PROFILE_STORAGE_COPIES; copy++)
+    {
+        if (!read_record(slot, copy, &current))
+            continue;
+
+        // generations wrap around => compare the difference
+        if (!newest.valid || (int8_t)(current.generation - newest.generation) > 0)
+        {
+            newest.valid = true;
+            newest.copy = copy;
+            newest.generation = current.generation;
+            *record = current;
+        }
+    }
+    return newest;
+}
+
+void write_record(uint8_t slot, const uint8_t *payload, uint8_t length)
+{
+    StorageRecord record;
+    RecordPosition newest = find_newest(slot, &record);
+
+    /* only write if the content changed */
+    if (newest.valid && record.length == length && (length == 0 || memcmp(record.payload, payload, length) == 0))
+        return;
+    // nothing to delete
+    if (!newest.valid && length == 0)
+        return;
+
+    // next record of the ring
+    record.version = PROFILE_STORAGE_VERSION;
+    record.generation = newest.valid ? newest.generation + 1 : 0;
+    record.length = length;
+    if (length > 0)
+        memcpy(record.payload, payload, length);
+
+    uint8_t copy = newest.valid ? (newest.copy + 1) % PROFILE_STORAGE_COPIES : 0;
+    int address = record_address(slot, copy);
+    uint16_t crc = crc16(0xFFFF, (uint8_t *)&record, RECORD_HEADER_SIZE + length);
+
+    // write payload first and the header last => an interrupted write leaves an invalid record
+    for (uint8_t i = 0; i < length; i++)
+        EEPROM.update(address + RECORD_HEADER_SIZE + i, record.payload[i]);
+    EEPROM.update(address + RECORD_HEADER_SIZE + length, (uint8_t)crc);
+    EEPROM.update(address + RECORD_HEADER_SIZE + length + 1, (uint8_t)(crc >> 8));
+    for (uint8_t i = 0; i < RECORD_HEADER_SIZE; i++)
+        EEPROM.update(address + i, ((uint8_t *)&record)[i]);
+}
+
+uint16_t crc16(uint16_t crc, const uint8_t *data, uint16_t length)
+{
+    for (uint16_t i = 0; i < length; i++)
+    {
+        crc ^= (uint16_t)data[i] << 8;
+        for (uint8_t bit = 0; bit < 8; bit++)
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : (crc << 1);
+    }
+    return crc;
+}
@@ -0,0 +1,52 @@
+#ifndef _PROFILE_STORAGE_H_
+#define _PROFILE_STORAGE_H_
+
+#include "main.h"
+
+/*========================================================================*/
+/*                          PUBLIC DEFINITIONS                            */
+/*========================================================================*/
+
+// EEPROM area used to store the registrations (can be set with build flags)
+#ifndef PROFILE_STORAGE_START
+#define PROFILE_STORAGE_START 0
+#endif
+#ifndef PROFILE_STORAGE_SIZE
+#define PROFILE_STORAGE_SIZE 2048
+#endif
+
+// version of the record layout => stored records with another version are ignored
+#define PROFILE_STORAGE_VERSION 1
+
+/*========================================================================*/
+/*                          PUBLIC FUNCTIONS                              */
+/*========================================================================*/
+
+/**
+    @brief  Stores the registration of a profile slot (EEPROM is only written if it changed)
+    @param  slot: slot index of the profile in the profile manager
+    @param  registration: registration to store
+    @return false if the registration could not be encoded
+*/
+bool storage_save_profile(uint8_t slot, const Registration *registration);
+
+/**
+    @brief  Marks the record of a profile slot as deleted (if not already deleted)
+    @param  slot: slot index of the profile in the profile manager
+*/
+void storage_delete_profile(uint8_t slot);
+
+/**
+    @brief  Loads the newest valid registration of a profile slot
+    @param  slot: slot index of the profile in the profile manager
+    @param  registration: decoded registration
+    @return true if a valid registration was found
+*/
+bool storage_load_profile(uint8_t slot, Registration *registration);
+
+/**
+    @brief  CRC-16/CCITT over a byte array (records of the EEPROM)
+*/
+uint16_t crc16(uint16_t crc, const uint8_t *data, uint16_t length);
+
+#endif
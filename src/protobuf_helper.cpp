@@ -9,26 +9,85 @@
 */
 /**************************************************************************/
 #include "protobuf_helper.h"
+#include <util/atomic.h>
 
 /*========================================================================*/
 /*                          PRIVATE DEFINITIONS                           */
 /*========================================================================*/
 
 /* Macros */
-#define BAUDRATE 115200
 #define TERMINATOR 0
 
+#ifdef ERROR_STRINGS
+// texts of the ErrorCodes (index: code), separated by NULL
+static const char error_strings[] PROGMEM =
+    "\0"
+    "Decoding failed\0"
+    "Request type is incorrect\0"
+    "Profile is not registered\0"
+    "Action does not match the registered driver\0"
+    "Table is full\0"
+    "Resources are used by another profile\0"
+    "No driver functions defined for driver\0"
+    "Initialization of the driver failed\0"
+    "Timeout\0"
+    "No mode selected\0"
+    "Action failed\0"
+    "Value is out of range\0"
+    "Busy\0"
+    "Not found\0"
+    "Response is bigger than the buffer\0"
+    "Scheduled time has already passed\0"
+    "Cancelled\0"
+    "Condition does not fit the trigger profile\0"
+    "Invalid macro\0"
+    "Action of the macro failed\0"
+    "Fast path disabled or invalid frame\0";
+#endif
+
 /* Protobuf streams */
 pb_istream_s pb_in;
 pb_ostream_s pb_out;
 
-// length of payload: number of bytes
-uint32_t payload_length;
+/* Sequence ids of the responses */
+// sequence id of the request which is handled at the moment (0: none)
+static uint32_t request_seq = 0;
+// completion of a pending request: next response of the profile carries the sequence id of the request
+static volatile uint32_t completion_profile_id = 0;
+static volatile uint32_t completion_seq = 0;
+static volatile bool completion_set = false;
+
+// responses of reflex rule actions without notify are not sent (only the ones of the action's profile)
+static bool muted = false;
+static uint32_t muted_profile_id = 0;
+
+// responses to a fast path request are written as fast frames (see fast_path.h)
+static bool fast = false;
+
+/* Timestamps of the responses */
+// responses carry the device time (enabled by the gateway)
+static bool timestamps_enabled = false;
+// begin of the request which is handled at the moment (0: no request)
+static uint64_t request_start_us = 0;
+
+/**
+    @brief  Adds the sequence id + timestamp + duration (if enabled) to a response
+*/
+void stamp_response(Response *response);
 
 /**
-    @brief  Callback function for bytes type encoding
+    @brief  Writes a response + terminator: protobuf or fast frame (fast path request)
+    @param  payload: bytes of the payload field (NULL: no payload)
+    @param  length: number of payload bytes
+    @return false if the encoding failed
 */
-bool encode_bytes(pb_ostream_t *stream, const pb_field_t *field, void *const *arg);
+bool write_response(const Response *response, const void *payload = NULL, uint32_t length = 0);
+
+/**
+    @brief  Checks if a response of the profile is muted: responses of other profiles
+            and completions of pending requests are still sent
+*/
+bool response_muted(uint32_t profile_id);
 
 /*========================================================================*/
 /*                          PUBLIC FUNCTIONS                              */
@@ -40,8 +99,8 @@ bool encode_bytes(pb_ostream_t *stream, const pb_field_t *field, void *const *ar
 */
 void protobuf_init()
 {
-    // init serial1
-    Serial.begin(BAUDRATE);
+    // init serial (stored or default baudrate, see link_speed.h)
+    link_init();
     pb_in = as_pb_istream(Serial);
     pb_out = as_pb_ostream(Serial);
 }
@@ -52,25 +111,89 @@ void protobuf_init()
 */
 void protobuf_decode(Request *req)
 {
-    if (!pb_decode_ex(&pb_in, Request_fields, req, PB_DECODE_NULLTERMINATED))
+    bool success = pb_decode_ex(&pb_in, Request_fields, req, PB_DECODE_NULLTERMINATED);
+    perf_request(success);
+    // responses to the request echo its sequence id
+    request_seq = success ? req->seq : 0;
+    if (!success)
+        send_error(404, ErrorCode_ERR_DECODE);
+    // confirms a new baudrate (garbage: wrong baudrate)
+    link_request(success && req->which_request_type != 0);
+}
+
+/**************************************************************************/
+/*
+    Request time: responses sent in between carry the duration since the begin
+*/
+void protobuf_request_begin()
+{
+    request_start_us = device_time_us();
+}
+
+void protobuf_request_end()
+{
+    request_start_us = 0;
+    request_seq = 0;
+}
+
+uint32_t protobuf_get_seq()
+{
+    return request_seq;
+}
+
+void protobuf_set_seq(uint32_t seq)
+{
+    request_seq = seq;
+}
+
+/**************************************************************************/
+/*
+    Completion of a pending request (ACK sent before): the next response of
+    the profile carries the sequence id of its oldest pending request
+*/
+void protobuf_complete(uint32_t profile_id)
+{
+    uint32_t seq;
+
+    if (!pending_take(profile_id, &seq))
+        return;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
     {
-        char msg[100];
-        snprintf_P(msg, sizeof(msg), PSTR("Decoding failed: %s\n"), PB_GET_ERROR(&pb_in));
-        send_error(404, msg);
+        completion_profile_id = profile_id;
+        completion_seq = seq;
+        completion_set = true;
     }
 }
 
+void protobuf_set_timestamps(bool enabled)
+{
+    timestamps_enabled = enabled;
+}
+
+void protobuf_set_muted(bool enabled, uint32_t profile_id)
+{
+    muted = enabled;
+    muted_profile_id = profile_id;
+}
+
+void protobuf_set_fast(bool enabled)
+{
+    fast = enabled;
+}
+
 /*========================================================================*/
 /*                FUNCTIONS USED TO SEND MESSAGES                         */
 /*========================================================================*/
 /*
     Functions used to send response to the gateway.
 
-    For pb_callback_t message types:
-        - use .arg [void*] to pass data to callback
-        - use .funcs.encode to define callback function to encode
-        - use .funcs.decode to define callback function to decode
-    ! callback only working for simple messages (not oneof)
+    The payload is not set in the Response (no encode callback): it is
+    passed to write_response(), which appends it as last field => the
+    functions can be called from nested paths (e.g. a DATA which triggers
+    a reflex rule). They must not be called from ISRs: pb_out + the TX
+    stream of Serial are shared, a response of an ISR would be written
+    into a frame of the loop. ISRs count/flag the event, the event handler
+    of the driver sends the response.
 */
 
 /**************************************************************************/
@@ -82,60 +205,81 @@ bool send_debug(const char *msg)
     // initiate Response msg
     Response response = {};
 
-    // update data length for data field [bytes]
-    payload_length = strlen(msg);
-
     /* add response fields */
     response.code = ResponseCode_DEBUG;
-    response.payload.arg = (void *)msg;
-    response.payload.funcs.encode = &encode_bytes;
+    stamp_response(&response);
+    TRACE(TRACE_EVENT_RESPONSE, response.profile_id, response.code);
     // encode protobuf message
-    bool res = pb_encode(&pb_out, Response_fields, &response);
-    // send termination
-    Serial.write(TERMINATOR);
+    bool res = write_response(&response, msg, strlen(msg));
     return res;
 }
 
 /**************************************************************************/
 /*
-    Function used to send a simple error message to the gateway.
+    Function used to send an error code to the gateway.
+    Result of the error for a macro: the packed error code.
 */
-bool send_error(uint32_t profile_id, const char *msg)
+bool send_error(uint32_t profile_id, ErrorCode error, uint32_t detail)
 {
+    byte result[1];
+    macro_response(profile_id, ResponseCode_ERROR, result, pack_value(result, error, 1));
+    if (response_muted(profile_id))
+        return true;
+
     // initiate Response msg
     Response response = {};
 
-    // update data length for data field [bytes]
-    payload_length = strlen(msg);
-
     /* add response fields */
     response.code = ResponseCode_ERROR;
     response.profile_id = profile_id;
-    response.payload.arg = (void *)msg;
-    response.payload.funcs.encode = &encode_bytes;
+    response.error = error;
+    response.error_detail = detail;
+#ifdef ERROR_STRINGS
+    // text of the code: skip the texts of the lower codes
+    char msg[48];
+    const char *text = error_strings;
+    for (uint8_t i = 0; i < (uint8_t)error; i++)
+        text += strlen_P(text) + 1;
+    strncpy_P(msg, text, sizeof(msg) - 1);
+    msg[sizeof(msg) - 1] = 0;
+#endif
+    stamp_response(&response);
+    TRACE(TRACE_EVENT_RESPONSE, response.profile_id, response.code);
     // encode protobuf message
-    bool res = pb_encode(&pb_out, Response_fields, &response);
-    // send termination
-    Serial.write(TERMINATOR);
+#ifdef ERROR_STRINGS
+    bool res = write_response(&response, msg, strlen(msg));
+#else
+    bool res = write_response(&response);
+#endif
     return res;
 }
 
 /**************************************************************************/
 /*
     Function used to send a simple ACK message to the gateway.
+    The action is completed later => pending request until protobuf_complete()
 */
-bool send_ack(uint32_t profile_id)
+bool send_ack(uint32_t profile_id, bool pending)
 {
     // initiate Response msg
     Response response = {};
 
+    macro_response(profile_id, ResponseCode_ACK, NULL, 0);
+    // muted action (rule, macro step): the gateway does not wait for a completion,
+    // also if the ACK itself is sent (completion of the profile in progress)
+    // full list: the completion is sent without sequence id
+    if (pending && !(muted && profile_id == muted_profile_id))
+        pending_add(profile_id, request_seq);
+    if (response_muted(profile_id))
+        return true;
+
     /* add response fields */
     response.code = ResponseCode_ACK;
     response.profile_id = profile_id;
+    stamp_response(&response);
+    TRACE(TRACE_EVENT_RESPONSE, response.profile_id, response.code);
     // encode protobuf message
-    bool res = pb_encode(&pb_out, Response_fields, &response);
-    // send termination
-    Serial.write(TERMINATOR);
+    bool res = write_response(&response);
     return res;
 }
 
@@ -147,42 +291,143 @@ bool send_ack(uint32_t profile_id)
 */
 bool send_data(uint32_t profile_id, void *data, uint32_t length)
 {
+    macro_response(profile_id, ResponseCode_DATA, data, length);
+    if (response_muted(profile_id))
+        return true;
+
     // initiate Response msg
     Response response = {};
 
     /* add response fields */
     response.code = ResponseCode_DATA;
     response.profile_id = profile_id;
-
-    // check if argument data is used
+    stamp_response(&response);
+    TRACE(TRACE_EVENT_RESPONSE, response.profile_id, response.code);
+    // encode protobuf message (without data: empty data message)
+    bool res = write_response(&response, data, length);
+    // reflex rules on the DATA of a trigger profile
     if (data != NULL)
-    {
-        // update data length for data field [bytes]
-        payload_length = length;
-        /* add response fields for payload */
-        response.payload.arg = data;
-        response.payload.funcs.encode = &encode_bytes;
-    }
+        rules_data(profile_id, data, length);
+    return res;
+}
+
+/**************************************************************************/
+/*
+    Function used to send an intermediate report of a running request
+    (does not complete the request).
+*/
+bool send_progress(uint32_t profile_id, void *data, uint32_t length)
+{
+    // initiate Response msg
+    Response response = {};
+
+    /* add response fields */
+    response.code = ResponseCode_PROGRESS;
+    response.profile_id = profile_id;
+    stamp_response(&response);
+    TRACE(TRACE_EVENT_RESPONSE, response.profile_id, response.code);
     // encode protobuf message
-    bool res = pb_encode(&pb_out, Response_fields, &response);
-    // send termination
-    Serial.write(TERMINATOR);
+    bool res = write_response(&response, data, length);
     return res;
 }
 
+/**************************************************************************/
+/*
+    Packs a value into NULL-free bytes: 7 data bits per byte, msb used as flag.
+*/
+uint8_t pack_value(byte *buf, uint32_t value, uint8_t num_bytes)
+{
+    for (uint8_t i = 0; i < num_bytes; i++)
+    {
+        buf[i] = ((byte)(value & 0x7F)) | B10000000;
+        value >>= 7;
+    }
+    return num_bytes;
+}
+
 /*========================================================================*/
 /*                          PRIVATE FUNCTIONS                             */
 /*========================================================================*/
 
 /**************************************************************************/
 /*
-    Callback funtion for encoding bytes types (only working for simple messages, non-oneof)
+    Sequence id: completed request or request which is handled at the moment,
+    timestamp: device time when the response is sent,
+    duration: time since the begin of the request (responses to requests only)
 */
-bool encode_bytes(pb_ostream_t *stream, const pb_field_t *field, void *const *arg)
+void stamp_response(Response *response)
 {
-    void *const *msg = (void *const *)*arg;
-    if (!pb_encode_tag_for_field(stream, field))
+    response->seq = request_seq;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        if (completion_set && completion_profile_id == response->profile_id)
+        {
+            response->seq = completion_seq;
+            completion_set = false;
+        }
+    }
+
+    if (!timestamps_enabled)
+        return;
+
+    response->timestamp = device_time_us();
+    if (request_start_us != 0)
+        response->duration = (uint32_t)(response->timestamp - request_start_us);
+}
+
+/**************************************************************************/
+/*
+    Muted rule action: only its own responses are dropped, a completion of
+    a pending request of the profile belongs to a request of the gateway
+*/
+bool response_muted(uint32_t profile_id)
+{
+    bool completion;
+
+    if (!muted || profile_id != muted_profile_id)
         return false;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        completion = completion_set && completion_profile_id == profile_id;
+    }
+    return !completion;
+}
+
+/**************************************************************************/
+/*
+    Response on the wire: fast frame (marker, code, profile_id, payload) while
+    a fast path request is handled, protobuf message otherwise.
+    The payload is written after the other fields (the order of the fields
+    is free in protobuf) => no encode callback.
+*/
+bool write_response(const Response *response, const void *payload, uint32_t length)
+{
+    if (fast)
+    {
+        byte header[2 + FAST_PROFILE_BYTES];
+        header[0] = FAST_MARKER;
+        header[1] = B10000000 | (byte)response->code;
+        pack_value(&header[2], response->profile_id, FAST_PROFILE_BYTES);
+        Serial.write(header, sizeof(header));
+        if (response->code == ResponseCode_ERROR)
+        {
+            // ERROR: code + detail instead of the payload
+            byte error[1 + 5];
+            pack_value(error, response->error, 1);
+            pack_value(&error[1], response->error_detail, 5);
+            Serial.write(error, sizeof(error));
+        }
+        else if (payload != NULL)
+            Serial.write((const uint8_t *)payload, length);
+        Serial.write(TERMINATOR);
+        return true;
+    }
 
-    return pb_encode_string(stream, (uint8_t *)msg, payload_length);
+    bool res = pb_encode(&pb_out, Response_fields, response);
+    if (res && payload != NULL)
+        res = pb_encode_tag(&pb_out, PB_WT_STRING, Response_payload_tag) &&
+              pb_encode_string(&pb_out, (const pb_byte_t *)payload, length);
+    // send termination
+    Serial.write(TERMINATOR);
+    return res;
 }
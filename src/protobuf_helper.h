@@ -18,6 +18,44 @@ void protobuf_init();
 */
 void protobuf_decode(Request *req);
 
+/**
+    @brief  Marks the begin/end of a request: responses sent in between carry the duration since the begin
+*/
+void protobuf_request_begin();
+void protobuf_request_end();
+
+/**
+    @brief  Sequence id of the responses of the request which is handled at the moment
+            (set by protobuf_decode(), scheduled actions restore the id of their request)
+*/
+uint32_t protobuf_get_seq();
+void protobuf_set_seq(uint32_t seq);
+
+/**
+    @brief  Marks the next response of a profile as completion of its oldest pending request
+            (non-blocking action acknowledged with send_ack()): the response carries the sequence id
+            of that request. Called by the event handlers/callbacks before the completion is sent.
+*/
+void protobuf_complete(uint32_t profile_id);
+
+/**
+    @brief  Enables/disables the device timestamp + duration in all responses (default: disabled)
+*/
+void protobuf_set_timestamps(bool enabled);
+
+/**
+    @brief  Mutes the ERROR/ACK/DATA responses of a profile (actions of reflex rules without notify),
+            a muted ACK does not add a pending request
+    @param  enabled: mute (true) or unmute (false)
+    @param  profile_id: Profile_id of the executed action
+*/
+void protobuf_set_muted(bool enabled, uint32_t profile_id = 0);
+
+/**
+    @brief  Writes the responses as fast frames while a fast path request is handled (see fast_path.h)
+*/
+void protobuf_set_fast(bool enabled);
+
 /**
     @brief  Sends simple debug message to the gateway
     @param  msg: feedback message for debugging purpose 
@@ -25,17 +63,21 @@ void protobuf_decode(Request *req);
 bool send_debug(const char *msg);
 
 /**
-    @brief  Sends simple error message to the gateway
+    @brief  Sends error code to the gateway (payload: text of the code if built with ERROR_STRINGS)
     @param  profile_id: Profile_id
-    @param  msg: feedback message for debugging purpose 
+    @param  error: cause of the error
+    @param  detail: value described by the ErrorCode (e.g. elapsed time of a timeout)
 */
-bool send_error(uint32_t profile_id, const char *msg);
+bool send_error(uint32_t profile_id, ErrorCode error, uint32_t detail = 0);
 
 /**
-    @brief  Sends simple acknowledgement message to the gateway
+    @brief  Sends simple acknowledgement message to the gateway, the request stays pending
+            until it is completed (see protobuf_complete())
     @param  profile_id: Profile_id
+    @param  pending: false if the request is not completed by an event of the driver
+            (e.g. scheduled action: completed by the responses of its execution)
 */
-bool send_ack(uint32_t profile_id);
+bool send_ack(uint32_t profile_id, bool pending = true);
 
 /**
     @brief  Sends data message to the gateway
@@ -45,4 +87,21 @@ bool send_ack(uint32_t profile_id);
 */
 bool send_data(uint32_t profile_id, void *data = NULL, uint32_t length = 0);
 
+/**
+    @brief  Sends an intermediate report of a running request to the gateway (e.g. macro step)
+    @param  profile_id: Profile_id
+    @param  data: void pointer to raw data
+    @param  length: number of bytes used to store data
+*/
+bool send_progress(uint32_t profile_id, void *data, uint32_t length);
+
+/**
+    @brief  Packs a value into 7-bit groups (LSB first) with the msb set to avoid NULL bytes
+    @param  buf: destination buffer (at least num_bytes long)
+    @param  value: value to pack (signed values are packed as two's complement)
+    @param  num_bytes: number of 7-bit groups to use (5 for a full 32-bit value)
+    @return number of bytes written
+*/
+uint8_t pack_value(byte *buf, uint32_t value, uint8_t num_bytes);
+
 #endif
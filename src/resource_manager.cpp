@@ -0,0 +1,107 @@
+/**************************************************************************/
+/*!
+    @file     resource_manager.cpp
+    @author   Jonas Brütsch
+
+    Ownership tracking of the hardware resources (pins, timers, UARTs, I2C addresses).
+
+    Every driver declares the resources of a registration (see driver_table.h),
+    the profile manager claims them on registration and releases them on delete.
+    A registration with resources already used by another profile is rejected.
+*/
+/**************************************************************************/
+#include "resource_manager.h"
+
+/*========================================================================*/
+/*                          PRIVATE DEFINITIONS                           */
+/*========================================================================*/
+
+/* Number of resources per type (ATmega2560) */
+#define RESOURCE_PIN_COUNT 70
+#define RESOURCE_TIMER_COUNT 6
+#define RESOURCE_UART_COUNT 4
+#define RESOURCE_I2C_COUNT 128
+
+/* Offsets of the resource types inside the bitmap */
+#define RESOURCE_PIN_OFFSET 0
+#define RESOURCE_TIMER_OFFSET (RESOURCE_PIN_OFFSET + RESOURCE_PIN_COUNT)
+#define RESOURCE_UART_OFFSET (RESOURCE_TIMER_OFFSET + RESOURCE_TIMER_COUNT)
+#define RESOURCE_I2C_OFFSET (RESOURCE_UART_OFFSET + RESOURCE_UART_COUNT)
+#define RESOURCE_BITS (RESOURCE_I2C_OFFSET + RESOURCE_I2C_COUNT)
+
+// one bit per resource: 1 => claimed by a profile
+uint8_t claimed_resources[(RESOURCE_BITS + 7) / 8] = {0};
+
+/**
+    @brief  Returns the bit index of a resource
+    @return -1 if the resource is not valid
+*/
+int16_t resource_bit(Resource resource);
+
+/*========================================================================*/
+/*                          PUBLIC FUNCTIONS                              */
+/*========================================================================*/
+
+/**************************************************************************/
+/*
+    Check if the resources are valid and free
+*/
+bool resources_available(const Resource *resources, uint8_t num_resources)
+{
+    for (uint8_t i = 0; i < num_resources; i++)
+    {
+        int16_t bit = resource_bit(resources[i]);
+        if (bit < 0 || (claimed_resources[bit / 8] & (1 << (bit % 8))))
+            return false;
+    }
+    return true;
+}
+
+/**************************************************************************/
+/*
+    Mark the resources as claimed
+*/
+void resources_claim(const Resource *resources, uint8_t num_resources)
+{
+    for (uint8_t i = 0; i < num_resources; i++)
+    {
+        int16_t bit = resource_bit(resources[i]);
+        if (bit >= 0)
+            claimed_resources[bit / 8] |= (1 << (bit % 8));
+    }
+}
+
+/**************************************************************************/
+/*
+    Mark the resources as free
+*/
+void resources_release(const Resource *resources, uint8_t num_resources)
+{
+    for (uint8_t i = 0; i < num_resources; i++)
+    {
+        int16_t bit = resource_bit(resources[i]);
+        if (bit >= 0)
+            claimed_resources[bit / 8] &= ~(1 << (bit % 8));
+    }
+}
+
+/*========================================================================*/
+/*                          PRIVATE FUNCTIONS                             */
+/*========================================================================*/
+
+int16_t resource_bit(Resource resource)
+{
+    switch (resource.type)
+    {
+    case RESOURCE_PIN:
+        return (resource.id < RESOURCE_PIN_COUNT) ? RESOURCE_PIN_OFFSET + resource.id : -1;
+    case RESOURCE_TIMER:
+        return (resource.id < RESOURCE_TIMER_COUNT) ? RESOURCE_TIMER_OFFSET + resource.id : -1;
+    case RESOURCE_UART:
+        return (resource.id < RESOURCE_UART_COUNT) ? RESOURCE_UART_OFFSET + resource.id : -1;
+    case RESOURCE_I2C:
+        return (resource.id < RESOURCE_I2C_COUNT) ? RESOURCE_I2C_OFFSET + resource.id : -1;
+    default:
+        return -1;
+    }
+}
@@ -0,0 +1,56 @@
+#ifndef _RESOURCE_MANAGER_H_
+#define _RESOURCE_MANAGER_H_
+
+#include <Arduino.h>
+
+/*========================================================================*/
+/*                          PUBLIC DEFINITIONS                            */
+/*========================================================================*/
+
+/* Resource types */
+#define RESOURCE_PIN 0   // digital/analog pin number (0 - 69)
+#define RESOURCE_TIMER 1 // hardware timer (0 - 5)
+#define RESOURCE_UART 2  // hardware UART (0 - 3)
+#define RESOURCE_I2C 3   // 7-bit I2C address
+
+// max. number of resources used by one profile
+#define RESOURCES_MAX 10
+
+// hardware resource used by a profile
+struct Resource
+{
+    uint8_t type;
+    uint8_t id;
+};
+
+/*========================================================================*/
+/*                          PUBLIC FUNCTIONS                              */
+/*========================================================================*/
+
+/**
+    @brief  Converts a registration field (uint32) into a resource id (out of range values are invalid)
+*/
+constexpr uint8_t resource_id(uint32_t value)
+{
+    return value > 0xFF ? 0xFF : (uint8_t)value;
+}
+
+/**
+    @brief  Checks if resources are valid and not used by another profile
+    @param  resources: list of resources
+    @param  num_resources: number of resources in the list
+    @return true if all resources can be claimed
+*/
+bool resources_available(const Resource *resources, uint8_t num_resources);
+
+/**
+    @brief  Marks resources as used
+*/
+void resources_claim(const Resource *resources, uint8_t num_resources);
+
+/**
+    @brief  Marks resources as free
+*/
+void resources_release(const Resource *resources, uint8_t num_resources);
+
+#endif
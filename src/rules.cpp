@@ -0,0 +1,276 @@
+/**************************************************************************/
+/*!
+    @file     rules.cpp
+    @author   Jonas Brütsch
+
+    Table of the reflex rules. A triggered rule is marked in a bit mask,
+    its action is executed by the loop through action_handler() right after
+    the event/request which triggered it, or within RULES_POLL_US in the
+    idle time of the loop.
+    The responses of the action are muted unless the rule has notify set
+    (only the ones of the action's profile, see protobuf_set_muted()).
+*/
+/**************************************************************************/
+#include "rules.h"
+#include <util/atomic.h>
+
+/*========================================================================*/
+/*                          PRIVATE DEFINITIONS                           */
+/*========================================================================*/
+
+// returned by find_rule() if a rule does not exist
+#define RULE_NONE 0xFF
+
+static_assert(RULES_CAPACITY <= 8, "RULES_CAPACITY is limited by the bit mask of the triggered rules");
+
+struct ReflexRule
+{
+    Rule rule;
+    // last polled pin level (level rules)
+    uint8_t last_level;
+    bool used;
+};
+
+static ReflexRule rules[RULES_CAPACITY];
+// one bit per rule: action has to be executed
+static volatile uint8_t triggered = 0;
+
+/**
+    @brief  Looks up the slot of a rule
+    @return slot index or RULE_NONE
+*/
+uint8_t find_rule(uint32_t rule_id);
+
+/**
+    @brief  Checks if the condition fits the driver of the trigger profile
+    @return error code, NO_ERROR if the rule is valid
+*/
+ErrorCode check_rule(const Rule &rule);
+
+/**
+    @brief  Pin of a digital generic input used by a level rule
+    @return false if the trigger profile is not a digital generic profile (anymore)
+*/
+bool level_pin(const Rule &rule, uint8_t *pin);
+
+/*========================================================================*/
+/*                          PUBLIC FUNCTIONS                              */
+/*========================================================================*/
+
+/**************************************************************************/
+/*
+    Rule Handler: the responses use the trigger profile as profile_id
+*/
+void rule_handler(const Rule &rule)
+{
+    uint8_t slot = find_rule(rule.rule_id);
+
+    /* delete rule */
+    if (!rule.has_action)
+    {
+        if (slot != RULE_NONE)
+        {
+            ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+            {
+                rules[slot].used = false;
+                triggered &= ~(1 << slot);
+            }
+        }
+        send_data(rule.trigger_profile_id);
+        return;
+    }
+
+    ErrorCode error = check_rule(rule);
+    if (error != ErrorCode_NO_ERROR)
+    {
+        send_error(rule.trigger_profile_id, error, rule.which_condition);
+        return;
+    }
+
+    // otherwise take the first free slot
+    for (uint8_t i = 0; slot == RULE_NONE && i < RULES_CAPACITY; i++)
+    {
+        if (!rules[i].used)
+            slot = i;
+    }
+    if (slot == RULE_NONE)
+    {
+        send_error(rule.trigger_profile_id, ErrorCode_ERR_TABLE_FULL);
+        return;
+    }
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        rules[slot].rule = rule;
+        rules[slot].used = true;
+        triggered &= ~(1 << slot);
+    }
+    // a level rule is triggered by the next edge, not by the current level
+    uint8_t pin;
+    if (level_pin(rule, &pin))
+        rules[slot].last_level = digitalRead(pin);
+
+    send_data(rule.trigger_profile_id);
+}
+
+/**************************************************************************/
+/*
+    DATA of a trigger profile: payloads of the drivers (see run_<driver>())
+*/
+void rules_data(uint32_t profile_id, const void *data, uint32_t length)
+{
+    const byte *payload = (const byte *)data;
+
+    for (uint8_t i = 0; i < RULES_CAPACITY; i++)
+    {
+        const Rule &rule = rules[i].rule;
+        if (!rules[i].used || rule.trigger_profile_id != profile_id)
+            continue;
+
+        bool match = false;
+        switch (rule.which_condition)
+        {
+        case Rule_distance_below_tag:
+            // ultrasonic sensor: 2 x 7 bits [cm]
+            if (length >= 2)
+                match = (uint32_t)((payload[0] & 0x7F) | ((payload[1] & 0x7F) << 7)) < rule.condition.distance_below;
+            break;
+        case Rule_dominant_channel_tag:
+            // color sensor: r, g, b
+            if (length >= 3)
+            {
+                uint8_t channel = 0;
+                for (uint8_t c = 1; c < 3; c++)
+                {
+                    if (payload[c] > payload[channel])
+                        channel = c;
+                }
+                match = (channel == rule.condition.dominant_channel);
+            }
+            break;
+        case Rule_reply_prefix_tag:
+        {
+            size_t prefix_length = strlen(rule.condition.reply_prefix);
+            match = (length >= prefix_length && memcmp(payload, rule.condition.reply_prefix, prefix_length) == 0);
+            break;
+        }
+        default:
+            break;
+        }
+        if (match)
+        {
+            ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+            {
+                triggered |= (1 << i);
+            }
+        }
+    }
+}
+
+/**************************************************************************/
+/*
+    Level rules are polled: an edge into the level triggers the rule
+*/
+bool rules_poll(Action *action, bool *notify)
+{
+    for (uint8_t i = 0; i < RULES_CAPACITY; i++)
+    {
+        uint8_t pin;
+        if (!rules[i].used || !level_pin(rules[i].rule, &pin))
+            continue;
+
+        uint8_t level = digitalRead(pin);
+        if (level != rules[i].last_level && level == (uint8_t)rules[i].rule.condition.level)
+        {
+            ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+            {
+                triggered |= (1 << i);
+            }
+        }
+        rules[i].last_level = level;
+    }
+
+    bool found = false;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        for (uint8_t i = 0; !found && i < RULES_CAPACITY; i++)
+        {
+            if (triggered & (1 << i))
+            {
+                triggered &= ~(1 << i);
+                *action = rules[i].rule.action;
+                *notify = rules[i].rule.notify;
+                found = true;
+            }
+        }
+    }
+    return found;
+}
+
+uint32_t rules_wait_us(void)
+{
+    for (uint8_t i = 0; i < RULES_CAPACITY; i++)
+    {
+        if (rules[i].used && rules[i].rule.which_condition == Rule_level_tag)
+            return RULES_POLL_US;
+    }
+    return UINT32_MAX;
+}
+
+/*========================================================================*/
+/*                          PRIVATE FUNCTIONS                             */
+/*========================================================================*/
+
+uint8_t find_rule(uint32_t rule_id)
+{
+    for (uint8_t i = 0; i < RULES_CAPACITY; i++)
+    {
+        if (rules[i].used && rules[i].rule.rule_id == rule_id)
+            return i;
+    }
+    return RULE_NONE;
+}
+
+ErrorCode check_rule(const Rule &rule)
+{
+    Registration *registration = profile_manager.get_registration(rule.trigger_profile_id);
+    if (registration == NULL)
+        return ErrorCode_ERR_NOT_REGISTERED;
+
+    switch (rule.which_condition)
+    {
+    case Rule_level_tag:
+        if (registration->which_driver != Registration_r_digital_generic_tag ||
+            registration->driver.r_digital_generic.mode == DigitalMode_OUTPUT)
+            return ErrorCode_ERR_INVALID_RULE;
+        break;
+    case Rule_distance_below_tag:
+        if (registration->which_driver != Registration_r_ultrasonic_sensor_tag)
+            return ErrorCode_ERR_INVALID_RULE;
+        break;
+    case Rule_dominant_channel_tag:
+        if (registration->which_driver != Registration_r_color_sensor_tag || rule.condition.dominant_channel > 2)
+            return ErrorCode_ERR_INVALID_RULE;
+        break;
+    case Rule_reply_prefix_tag:
+        if (registration->which_driver != Registration_r_uart_ttl_generic_tag)
+            return ErrorCode_ERR_INVALID_RULE;
+        break;
+    default:
+        return ErrorCode_ERR_INVALID_RULE;
+    }
+    return ErrorCode_NO_ERROR;
+}
+
+bool level_pin(const Rule &rule, uint8_t *pin)
+{
+    if (rule.which_condition != Rule_level_tag)
+        return false;
+
+    Registration *registration = profile_manager.get_registration(rule.trigger_profile_id);
+    if (registration == NULL || registration->which_driver != Registration_r_digital_generic_tag)
+        return false;
+
+    *pin = (uint8_t)registration->driver.r_digital_generic.pin;
+    return true;
+}
@@ -0,0 +1,60 @@
+#ifndef _RULES_H_
+#define _RULES_H_
+
+#include "main.h"
+
+/*
+    Reflex rules: an event of a trigger profile executes an action on
+    another profile directly in the firmware, e.g. "light barrier (profile 3)
+    goes HIGH => stop the conveyor (profile 7)".
+
+    Conditions:
+        - level: polled pin of a digital generic input (edge into the level)
+        - distance_below, dominant_channel, reply_prefix: checked on every
+          DATA sent for the trigger profile (request, event or scheduled action)
+*/
+
+/*========================================================================*/
+/*                          PUBLIC DEFINITIONS                            */
+/*========================================================================*/
+
+// max. number of rules (can be set with a build flag)
+#ifndef RULES_CAPACITY
+#define RULES_CAPACITY 4
+#endif
+
+// poll interval of the level rules in the idle time of the loop [us]
+#ifndef RULES_POLL_US
+#define RULES_POLL_US 100
+#endif
+
+/*========================================================================*/
+/*                          PUBLIC FUNCTIONS                              */
+/*========================================================================*/
+
+/**
+    @brief  Handles incoming Rule messages: stores/replaces or deletes (action not set) a rule,
+            sends DATA or ERROR
+*/
+void rule_handler(const Rule &rule);
+
+/**
+    @brief  Checks the DATA of a profile against the rules (called by send_data()),
+            the actions of the matching rules are executed by rules_poll()
+*/
+void rules_data(uint32_t profile_id, const void *data, uint32_t length);
+
+/**
+    @brief  Polls the level rules + takes the next triggered action
+    @param  action: action of the triggered rule
+    @param  notify: responses of the action are sent to the gateway
+    @return false if no rule was triggered
+*/
+bool rules_poll(Action *action, bool *notify);
+
+/**
+    @brief  Time until the level rules have to be polled again [us] (UINT32_MAX if there are none)
+*/
+uint32_t rules_wait_us(void);
+
+#endif
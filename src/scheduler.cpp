@@ -0,0 +1,201 @@
+/**************************************************************************/
+/*!
+    @file     scheduler.cpp
+    @author   Jonas Brütsch
+
+    Timer wheel of the scheduled actions: every action is linked into the
+    bucket of its tick (due time >> SCHEDULER_TICK_SHIFT). A poll only
+    checks the buckets of the ticks since the last poll, actions due in a
+    later revolution of the wheel stay in their bucket.
+
+    Accuracy: the idle time of loop() waits until the due time of the
+    current tick => a scheduled action is late by the time of the loop
+    parts in front of it (events, requests) and the ISRs.
+*/
+/**************************************************************************/
+#include "scheduler.h"
+
+/*========================================================================*/
+/*                          PRIVATE DEFINITIONS                           */
+/*========================================================================*/
+
+// end of a bucket list
+#define SCHEDULER_NONE 0xFF
+
+#define SCHEDULER_WHEEL_MASK (SCHEDULER_WHEEL_SIZE - 1)
+#define SCHEDULER_TICK(time_us) ((uint32_t)((time_us) >> SCHEDULER_TICK_SHIFT))
+
+static_assert((SCHEDULER_WHEEL_SIZE & SCHEDULER_WHEEL_MASK) == 0, "SCHEDULER_WHEEL_SIZE has to be a power of 2");
+static_assert(SCHEDULER_CAPACITY < SCHEDULER_NONE, "SCHEDULER_CAPACITY is too big");
+
+struct ScheduledAction
+{
+    Action action;
+    uint64_t due_us;
+    // sequence id of the scheduling request
+    uint32_t seq;
+    // next entry in the same bucket
+    uint8_t next;
+    bool used;
+};
+
+static ScheduledAction entries[SCHEDULER_CAPACITY];
+// first entry of every bucket
+static uint8_t buckets[SCHEDULER_WHEEL_SIZE];
+// last tick checked by scheduler_poll()
+static uint32_t current_tick = 0;
+static uint8_t num_scheduled = 0;
+
+/**
+    @brief  Removes an entry from its bucket + frees it
+*/
+void scheduler_remove(uint8_t index);
+
+/*========================================================================*/
+/*                          PUBLIC FUNCTIONS                              */
+/*========================================================================*/
+
+void scheduler_init(void)
+{
+    memset(entries, 0, sizeof(entries));
+    memset(buckets, SCHEDULER_NONE, sizeof(buckets));
+    num_scheduled = 0;
+    current_tick = SCHEDULER_TICK(device_time_us());
+}
+
+/**************************************************************************/
+/*
+    Scheduling request: the action is acknowledged now, its responses
+    (DATA/ERROR) are sent when it is executed
+*/
+void schedule_action(const Action &action)
+{
+    uint64_t now_us = device_time_us();
+    uint64_t due_us = (action.at_us != 0) ? action.at_us : now_us + action.delay_us;
+
+    if (due_us <= now_us)
+    {
+        send_error(action.profile_id, ErrorCode_ERR_TOO_LATE);
+        return;
+    }
+
+    uint8_t index = SCHEDULER_NONE;
+    for (uint8_t i = 0; index == SCHEDULER_NONE && i < SCHEDULER_CAPACITY; i++)
+    {
+        if (!entries[i].used)
+            index = i;
+    }
+    if (index == SCHEDULER_NONE)
+    {
+        send_error(action.profile_id, ErrorCode_ERR_TABLE_FULL);
+        return;
+    }
+
+    // executed like a request without schedule
+    entries[index].action = action;
+    entries[index].action.at_us = 0;
+    entries[index].action.delay_us = 0;
+    entries[index].due_us = due_us;
+    entries[index].seq = protobuf_get_seq();
+    entries[index].used = true;
+
+    uint8_t bucket = SCHEDULER_TICK(due_us) & SCHEDULER_WHEEL_MASK;
+    entries[index].next = buckets[bucket];
+    buckets[bucket] = index;
+    num_scheduled++;
+
+    // not pending: the events of the profile do not complete it
+    send_ack(action.profile_id, false);
+}
+
+/**************************************************************************/
+/*
+    Checks the buckets of all ticks since the last poll (max. one revolution)
+*/
+bool scheduler_poll(uint64_t now_us, Action *action, uint32_t *seq)
+{
+    uint32_t now_tick = SCHEDULER_TICK(now_us);
+
+    if (num_scheduled == 0)
+    {
+        current_tick = now_tick;
+        return false;
+    }
+
+    uint32_t passed = now_tick - current_tick;
+    if (passed >= SCHEDULER_WHEEL_SIZE)
+        passed = SCHEDULER_WHEEL_SIZE - 1;
+
+    for (uint32_t tick = now_tick - passed; tick != now_tick + 1; tick++)
+    {
+        for (uint8_t index = buckets[tick & SCHEDULER_WHEEL_MASK]; index != SCHEDULER_NONE; index = entries[index].next)
+        {
+            if (entries[index].due_us <= now_us)
+            {
+                *action = entries[index].action;
+                *seq = entries[index].seq;
+                scheduler_remove(index);
+                // continue with this tick in the next poll
+                current_tick = tick;
+                return true;
+            }
+        }
+    }
+    current_tick = now_tick;
+    return false;
+}
+
+uint32_t scheduler_wait_us(uint64_t now_us)
+{
+    if (num_scheduled == 0)
+        return UINT32_MAX;
+
+    // next tick: the poll checks its bucket
+    uint32_t wait_us = (uint32_t)((((uint64_t)SCHEDULER_TICK(now_us) + 1) << SCHEDULER_TICK_SHIFT) - now_us);
+
+    // actions due in the current tick
+    for (uint8_t index = buckets[SCHEDULER_TICK(now_us) & SCHEDULER_WHEEL_MASK]; index != SCHEDULER_NONE; index = entries[index].next)
+    {
+        if (entries[index].due_us <= now_us)
+            return 0;
+        if (entries[index].due_us - now_us < wait_us)
+            wait_us = (uint32_t)(entries[index].due_us - now_us);
+    }
+    return wait_us;
+}
+
+/**************************************************************************/
+/*
+    Cancel: every scheduling request is completed with an ERROR
+*/
+void scheduler_cancel_all(void)
+{
+    uint32_t request_seq = protobuf_get_seq();
+
+    for (uint8_t index = 0; index < SCHEDULER_CAPACITY; index++)
+    {
+        if (!entries[index].used)
+            continue;
+        uint32_t profile_id = entries[index].action.profile_id;
+        protobuf_set_seq(entries[index].seq);
+        send_error(profile_id, ErrorCode_ERR_CANCELLED);
+        scheduler_remove(index);
+    }
+    protobuf_set_seq(request_seq);
+}
+
+/*========================================================================*/
+/*                          PRIVATE FUNCTIONS                             */
+/*========================================================================*/
+
+void scheduler_remove(uint8_t index)
+{
+    uint8_t *link = &buckets[SCHEDULER_TICK(entries[index].due_us) & SCHEDULER_WHEEL_MASK];
+
+    while (*link != index)
+        link = &entries[*link].next;
+    *link = entries[index].next;
+
+    entries[index].used = false;
+    num_scheduled--;
+}
@@ -0,0 +1,61 @@
+#ifndef _SCHEDULER_H_
+#define _SCHEDULER_H_
+
+#include "main.h"
+
+/*
+    Scheduled (time-triggered) actions: an action with Action.at_us (device
+    time) or Action.delay_us is acknowledged and stored in a timer wheel.
+    The idle time of loop() fires it through action_handler() when it is due,
+    the responses carry the sequence id of the scheduling request.
+*/
+
+/*========================================================================*/
+/*                          PUBLIC DEFINITIONS                            */
+/*========================================================================*/
+
+// max. number of scheduled actions (can be set with a build flag)
+#ifndef SCHEDULER_CAPACITY
+#define SCHEDULER_CAPACITY 4
+#endif
+
+// timer wheel: SCHEDULER_WHEEL_SIZE buckets of 2^SCHEDULER_TICK_SHIFT us (32 x 1024 us)
+#define SCHEDULER_TICK_SHIFT 10
+#define SCHEDULER_WHEEL_SIZE 32
+
+/*========================================================================*/
+/*                          PUBLIC FUNCTIONS                              */
+/*========================================================================*/
+
+/**
+    @brief  Clears the timer wheel (called in setup())
+*/
+void scheduler_init(void);
+
+/**
+    @brief  Stores a scheduled action (sends ACK, or ERROR if it is late or the wheel is full)
+    @param  action: action with at_us or delay_us (the profile is already checked)
+*/
+void schedule_action(const Action &action);
+
+/**
+    @brief  Takes the next due action from the wheel
+    @param  now_us: device time (see device_time_us())
+    @param  action: due action (at_us + delay_us cleared)
+    @param  seq: sequence id of the scheduling request
+    @return false if no action is due
+*/
+bool scheduler_poll(uint64_t now_us, Action *action, uint32_t *seq);
+
+/**
+    @brief  Time until the wheel has to be polled again [us]
+            (due action in the current tick or begin of the next tick, UINT32_MAX if empty)
+*/
+uint32_t scheduler_wait_us(uint64_t now_us);
+
+/**
+    @brief  Cancels all scheduled actions, sends an ERROR for every action
+*/
+void scheduler_cancel_all(void);
+
+#endif
@@ -0,0 +1,207 @@
+/**************************************************************************/
+/*!
+    @file     trace.cpp
+    @author   Jonas Brütsch
+
+    Trace buffer: ring of timestamped records written at request decode,
+    driver entry/exit, ISR entry/exit and response send (see trace.h).
+
+    The records are written from the main program and from ISRs => every
+    access of the ring is done inside an atomic block.
+*/
+/**************************************************************************/
+#include "trace.h"
+#include "main.h"
+#include <util/atomic.h>
+
+#ifdef TRACE_ENABLED
+
+/*========================================================================*/
+/*                          PRIVATE DEFINITIONS                           */
+/*========================================================================*/
+
+// max. records dropped by trace_drop(): enter + exit + one time record
+#define TRACE_DROP_MAX 3
+
+static_assert(TRACE_CHUNK_SIZE <= 0xFF, "Trace chunk does not fit into one response");
+
+struct TraceRecord
+{
+    uint16_t delta_us;
+    uint8_t event;
+    uint8_t profile_id;
+    uint16_t arg;
+};
+
+static TraceRecord records[TRACE_BUFFER_SIZE];
+// index of the next record
+static uint16_t head = 0;
+// number of valid records in the ring
+static uint16_t count = 0;
+// records written since start
+static uint32_t written = 0;
+// time of the last record
+static uint32_t last_us = 0;
+// recording stopped during a dump
+static bool frozen = false;
+
+/**
+    @brief  Writes a record into the ring (interrupts are disabled)
+*/
+static void write_record(uint16_t delta_us, uint8_t event, uint8_t profile_id, uint16_t arg)
+{
+    records[head] = {delta_us, event, profile_id, arg};
+    head = (head + 1) % TRACE_BUFFER_SIZE;
+    if (count < TRACE_BUFFER_SIZE)
+        count++;
+    written++;
+}
+
+/*========================================================================*/
+/*                          PUBLIC FUNCTIONS                              */
+/*========================================================================*/
+
+/**************************************************************************/
+/*
+    Adds a record: deltas longer than 16 bit are split into a time record
+*/
+void trace_record(uint8_t event, uint32_t profile_id, uint16_t arg)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        if (frozen)
+            return;
+
+        uint32_t now = micros();
+        uint32_t delta = now - last_us;
+        last_us = now;
+        if (delta > 0xFFFF)
+        {
+            write_record(delta & 0xFFFF, TRACE_EVENT_TIME, 0, delta >> 16);
+            delta = 0;
+        }
+        write_record(delta, event, profile_id, arg);
+    }
+}
+
+/**************************************************************************/
+/*
+    Marks + dropping of records
+*/
+TraceMark trace_mark(void)
+{
+    TraceMark mark;
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        mark = {written, last_us};
+    }
+    return mark;
+}
+
+void trace_drop(TraceMark mark)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        uint32_t num_records = written - mark.written;
+        if (frozen || num_records > TRACE_DROP_MAX || num_records > count)
+            return;
+
+        // keep everything if an ISR was traced in between
+        for (uint16_t i = 1; i <= num_records; i++)
+        {
+            uint8_t event = records[(head + TRACE_BUFFER_SIZE - i) % TRACE_BUFFER_SIZE].event;
+            if (event == TRACE_EVENT_ISR_ENTER || event == TRACE_EVENT_ISR_EXIT)
+                return;
+        }
+        head = (head + TRACE_BUFFER_SIZE - num_records) % TRACE_BUFFER_SIZE;
+        count -= num_records;
+        written = mark.written;
+        last_us = mark.last_us;
+    }
+}
+
+/**************************************************************************/
+/*
+    Dump of one chunk, see trace.h for the layout
+*/
+uint8_t trace_dump(uint16_t chunk, byte *buf)
+{
+    uint8_t length = 0;
+
+    // no records can be written during the dump => no atomic access needed afterwards
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        frozen = true;
+    }
+
+    uint16_t num_chunks = (count + TRACE_CHUNK_RECORDS - 1) / TRACE_CHUNK_RECORDS;
+    if (num_chunks == 0)
+        num_chunks = 1; // empty trace: one chunk without records
+    if (chunk >= num_chunks)
+    {
+        frozen = false;
+        return 0;
+    }
+
+    uint16_t first = chunk * TRACE_CHUNK_RECORDS;
+    uint8_t num_records = (count - first > TRACE_CHUNK_RECORDS) ? TRACE_CHUNK_RECORDS : count - first;
+    // oldest record of the ring
+    uint16_t tail = (head + TRACE_BUFFER_SIZE - count) % TRACE_BUFFER_SIZE;
+
+    buf[length++] = TRACE_DUMP_VERSION | B10000000;
+    length += pack_value(&buf[length], chunk, 3);
+    length += pack_value(&buf[length], num_chunks, 3);
+    buf[length++] = num_records | B10000000;
+    length += pack_value(&buf[length], written, 5);
+    for (uint8_t i = 0; i < num_records; i++)
+    {
+        const TraceRecord &record = records[(tail + first + i) % TRACE_BUFFER_SIZE];
+        length += pack_value(&buf[length], record.delta_us, 3);
+        buf[length++] = record.event | B10000000;
+        length += pack_value(&buf[length], record.profile_id, 2);
+        length += pack_value(&buf[length], record.arg, 3);
+    }
+
+    // last chunk sent => continue recording
+    if (chunk == num_chunks - 1)
+        frozen = false;
+    return length;
+}
+
+void trace_resume(void)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+    {
+        frozen = false;
+    }
+}
+
+#else
+
+/*========================================================================*/
+/*                          TRACE DISABLED                                */
+/*========================================================================*/
+
+void trace_record(uint8_t, uint32_t, uint16_t)
+{
+}
+
+TraceMark trace_mark(void)
+{
+    return {0, 0};
+}
+
+void trace_drop(TraceMark)
+{
+}
+
+uint8_t trace_dump(uint16_t, byte *)
+{
+    return 0;
+}
+
+void trace_resume(void)
+{
+}
+
+#endif
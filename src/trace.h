@@ -0,0 +1,126 @@
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+#include <Arduino.h>
+
+/*
+    Trace buffer: ring of timestamped records in RAM, dumped in chunks with
+    the MCU driver (MCUAction TRACE_DUMP) and converted into a Chrome trace
+    by tools/trace/trace_to_chrome.
+
+    Only compiled with -D TRACE_ENABLED (env:trace), otherwise the TRACE()
+    macros are empty and TRACE_DUMP returns an error.
+
+    Record (6 bytes): micros() delta to the previous record, event id, profile id (low byte), arg
+*/
+
+/*========================================================================*/
+/*                          PUBLIC DEFINITIONS                            */
+/*========================================================================*/
+
+// number of records in the ring (6 bytes each)
+#ifndef TRACE_BUFFER_SIZE
+#define TRACE_BUFFER_SIZE 128
+#endif
+
+// version of the dump layout (first byte of every chunk)
+#define TRACE_DUMP_VERSION 1
+
+/* Events */
+#define TRACE_EVENT_TIME 0         // delta > 0xFFFF us: arg holds the upper 16 bits of the delta
+#define TRACE_EVENT_REQUEST 1      // request decoded, arg: PERF_REQUEST_ID()
+#define TRACE_EVENT_DRIVER_ENTER 2 // arg: TRACE_DRIVER_* | driver tag
+#define TRACE_EVENT_DRIVER_EXIT 3  // arg: TRACE_DRIVER_* | driver tag
+#define TRACE_EVENT_ISR_ENTER 4    // arg: PERF_ISR_*
+#define TRACE_EVENT_ISR_EXIT 5     // arg: PERF_ISR_*
+#define TRACE_EVENT_RESPONSE 6     // response sent, arg: ResponseCode
+
+/* Driver functions (upper byte of the arg) */
+#define TRACE_DRIVER_ACTION 0x0100
+#define TRACE_DRIVER_EVENT 0x0200
+#define TRACE_DRIVER_INIT 0x0300
+
+// profile id of a request (0 if the request type is invalid)
+#define TRACE_REQUEST_PROFILE(req)                                         \
+    ((req).which_request_type == Request_action_tag                        \
+         ? (req).request_type.action.profile_id                            \
+     : (req).which_request_type == Request_registration_tag                \
+         ? (req).request_type.registration.profile_id                      \
+         : 0)
+
+/*
+    Dump: chunk n contains the records [n * TRACE_CHUNK_RECORDS, (n + 1) * TRACE_CHUNK_RECORDS)
+    of the ring (oldest first). Every value is packed with pack_value() => NULL-free:
+        version                     1
+        chunk                       3
+        number of chunks            3
+        records in the chunk        1
+        records written             5   since start (> records in the ring => older records are lost)
+        per record: delta [us]      3
+                    event           1
+                    profile id      2
+                    arg             3
+    Recording stops with the first requested chunk and continues after the last chunk
+    (or with trace_resume(): MCUAction RESET_STATS, if the dump was not completed).
+*/
+#define TRACE_CHUNK_RECORDS 16
+#define TRACE_CHUNK_SIZE (1 + 3 + 3 + 1 + 5 + 9 * TRACE_CHUNK_RECORDS)
+
+#ifdef TRACE_ENABLED
+#define TRACE(event, profile_id, arg) trace_record((event), (profile_id), (arg))
+#define TRACE_MARK(mark) TraceMark mark = trace_mark()
+#define TRACE_DROP(mark) trace_drop(mark)
+#else
+#define TRACE(event, profile_id, arg) \
+    do                                \
+    {                                 \
+    } while (0)
+#define TRACE_MARK(mark)
+#define TRACE_DROP(mark) \
+    do                   \
+    {                    \
+    } while (0)
+#endif
+
+// position in the trace: records written after a mark can be dropped again
+struct TraceMark
+{
+    uint32_t written;
+    uint32_t last_us;
+};
+
+/*========================================================================*/
+/*                          PUBLIC FUNCTIONS                              */
+/*========================================================================*/
+
+/**
+    @brief  Adds a record to the trace (use the TRACE() macro)
+*/
+void trace_record(uint8_t event, uint32_t profile_id, uint16_t arg);
+
+/**
+    @brief  Returns the current position in the trace (use the TRACE_MARK() macro)
+*/
+TraceMark trace_mark(void);
+
+/**
+    @brief  Drops the records written since a mark, e.g. polls of an event handler without event
+            (records of an ISR are never dropped => nothing is dropped if one was written)
+            use the TRACE_DROP() macro
+*/
+void trace_drop(TraceMark mark);
+
+/**
+    @brief  Writes one chunk of the trace (see dump layout above)
+    @param  chunk: index of the chunk
+    @param  buf: destination buffer (at least TRACE_CHUNK_SIZE bytes)
+    @return number of bytes written, 0 if the trace is disabled or the chunk does not exist
+*/
+uint8_t trace_dump(uint16_t chunk, byte *buf);
+
+/**
+    @brief  Continues the recording stopped by an incomplete dump
+*/
+void trace_resume(void);
+
+#endif
@@ -0,0 +1,121 @@
+/**************************************************************************/
+/*!
+    @file     watchdog.cpp
+    @author   Jonas Brütsch
+
+    Watchdog of the controller:
+        - resets a hanging controller after WATCHDOG_TIMEOUT (fed by loop()
+          and by every blocking wait, see deadline.h)
+        - resets the controller on request (MCUAction RESET)
+        - reports the cause of the last reset after the boot
+
+    The MCUSR flags are saved + cleared in .init3, before the C runtime
+    clears .bss (a watchdog reset would otherwise repeat itself).
+    Note: bootloaders which clear MCUSR themselves hide the reset cause.
+*/
+/**************************************************************************/
+#include "watchdog.h"
+
+/*========================================================================*/
+/*                          PRIVATE DEFINITIONS                           */
+/*========================================================================*/
+
+// marks a requested reset (kept over the reset)
+#define RESTART_MAGIC 0x5A3C
+
+#ifdef __AVR__
+// .noinit: not cleared by the C runtime => kept over a reset
+static uint8_t reset_flags __attribute__((section(".noinit")));
+static uint16_t restart_magic __attribute__((section(".noinit")));
+
+/**
+    @brief  Saves + clears MCUSR and stops the watchdog (it stays enabled after a watchdog reset)
+*/
+void save_reset_flags(void) __attribute__((naked, used, section(".init3")));
+void save_reset_flags(void)
+{
+    reset_flags = MCUSR;
+    MCUSR = 0;
+    wdt_disable();
+}
+#else
+// host build: the host program restarts the firmware, only MCUSR is kept (see hal_set_reset_handler())
+static uint8_t reset_flags = 0;
+static uint16_t restart_magic = 0;
+#endif
+
+// MCUSR flags + RESET_CAUSE_REQUESTED
+static uint8_t reset_cause = 0;
+
+/*========================================================================*/
+/*                          PUBLIC FUNCTIONS                              */
+/*========================================================================*/
+
+/**************************************************************************/
+/*
+    Reads the reset cause + starts the watchdog
+*/
+void watchdog_init(void)
+{
+#ifndef __AVR__
+    reset_flags = MCUSR;
+    MCUSR = 0;
+#endif
+    reset_cause = reset_flags;
+    if ((reset_flags & _BV(WDRF)) && restart_magic == RESTART_MAGIC)
+        reset_cause |= RESET_CAUSE_REQUESTED;
+    restart_magic = 0;
+
+#ifndef WATCHDOG_DISABLED
+    wdt_enable(WATCHDOG_TIMEOUT);
+#endif
+}
+
+void watchdog_feed(void)
+{
+#ifndef WATCHDOG_DISABLED
+    wdt_reset();
+#endif
+}
+
+/**************************************************************************/
+/*
+    Requested reset: the shortest watchdog timeout expires while waiting
+*/
+void watchdog_restart(void)
+{
+    restart_magic = RESTART_MAGIC;
+    // send the pending responses first
+    Serial.flush();
+    wdt_enable(WDTO_15MS);
+    while (true)
+        delay(1);
+}
+
+uint8_t watchdog_reset_cause(void)
+{
+    return reset_cause;
+}
+
+/**************************************************************************/
+/*
+    Reset cause as DEBUG message, e.g. "Reset cause: watchdog (MCUSR 0x08)"
+*/
+void watchdog_report(void)
+{
+    const char *cause = "unknown";
+    if (reset_cause & RESET_CAUSE_REQUESTED)
+        cause = "requested";
+    else if (reset_cause & _BV(WDRF))
+        cause = "watchdog";
+    else if (reset_cause & _BV(PORF))
+        cause = "power-on";
+    else if (reset_cause & _BV(BORF))
+        cause = "brown-out";
+    else if (reset_cause & _BV(EXTRF))
+        cause = "external";
+
+    char msg[48];
+    snprintf_P(msg, sizeof(msg), PSTR("Reset cause: %s (MCUSR 0x%02X)"), cause, reset_cause & ~RESET_CAUSE_REQUESTED);
+    send_debug(msg);
+}
@@ -0,0 +1,51 @@
+#ifndef _WATCHDOG_H_
+#define _WATCHDOG_H_
+
+#include "main.h"
+#include <avr/wdt.h>
+
+/*========================================================================*/
+/*                          PUBLIC DEFINITIONS                            */
+/*========================================================================*/
+
+// timeout of the watchdog which resets a hanging controller (can be set with build flags)
+// every blocking wait is bounded by a deadline (deadline.h) => only a bug can trigger it
+#ifndef WATCHDOG_TIMEOUT
+#define WATCHDOG_TIMEOUT WDTO_8S
+#endif
+
+// reset requested with MCUAction RESET (added to the MCUSR flags of watchdog_reset_cause())
+#define RESET_CAUSE_REQUESTED 0x80
+
+/*========================================================================*/
+/*                          PUBLIC FUNCTIONS                              */
+/*========================================================================*/
+
+/**
+    @brief  Reads the cause of the last reset + starts the watchdog (called first in setup())
+            with -D WATCHDOG_DISABLED, the watchdog is only used for MCUAction RESET
+*/
+void watchdog_init(void);
+
+/**
+    @brief  Restarts the timeout of the watchdog (loop() + every blocking wait)
+*/
+void watchdog_feed(void);
+
+/**
+    @brief  Resets the MCU with the watchdog (does not return)
+*/
+void watchdog_restart(void);
+
+/**
+    @brief  Cause of the last reset
+    @return MCUSR flags (PORF, EXTRF, BORF, WDRF) + RESET_CAUSE_REQUESTED
+*/
+uint8_t watchdog_reset_cause(void);
+
+/**
+    @brief  Sends the cause of the last reset as DEBUG message to the gateway
+*/
+void watchdog_report(void);
+
+#endif
@@ -0,0 +1,177 @@
+/**************************************************************************/
+/*!
+    @file     test_main.cpp
+    @author   Jonas Brütsch
+
+    Persistent registrations on the EEPROM of the simulated HAL (lib/native_hal):
+    run with pio test -e native_test. A reset is simulated with setup()
+    after the slots were freed (RAM of the resource manager).
+*/
+/**************************************************************************/
+#include <main.h>
+#include <hal.h>
+#include <EEPROM.h>
+#include <unity.h>
+
+/*========================================================================*/
+/*                          PRIVATE DEFINITIONS                           */
+/*========================================================================*/
+
+#define PROFILE_DIGITAL 1
+#define PROFILE_COLOR 2
+#define PIN_DIGITAL 22
+#define COLOR_ADDRESS 0x29
+
+// registration handler of main.cpp
+void registration_handler(const Registration &registration);
+
+Registration digital_registration(void)
+{
+    Registration registration = Registration_init_zero;
+    registration.profile_id = PROFILE_DIGITAL;
+    registration.which_driver = Registration_r_digital_generic_tag;
+    registration.driver.r_digital_generic.pin = PIN_DIGITAL;
+    registration.driver.r_digital_generic.mode = DigitalMode_OUTPUT;
+    return registration;
+}
+
+Registration color_registration(void)
+{
+    Registration registration = Registration_init_zero;
+    registration.profile_id = PROFILE_COLOR;
+    registration.which_driver = Registration_r_color_sensor_tag;
+    registration.driver.r_color_sensor.address = COLOR_ADDRESS;
+    return registration;
+}
+
+// slot of the profile has a valid record in the EEPROM
+bool stored(uint32_t profile_id, uint8_t slot)
+{
+    Registration registration;
+    return storage_load_profile(slot, &registration) && registration.profile_id == profile_id;
+}
+
+// frees all slots + resources (erase: delete the EEPROM records)
+void unload_profiles(bool erase)
+{
+    for (uint8_t slot = 0; slot < PROFILE_CAPACITY; slot++)
+    {
+        if (profile_manager.slots[slot].flags & PROFILE_FLAG_USED)
+            profile_manager.delete_profile(profile_manager.slots[slot].registration.profile_id, erase);
+    }
+}
+
+// reset of the controller: RAM is lost, the EEPROM is kept
+void reset_controller(void)
+{
+    unload_profiles(false);
+    setup();
+}
+
+void setUp(void)
+{
+    // erased EEPROM + reset
+    memset(hal_eeprom(), 0xFF, EEPROM_SIZE);
+    hal_set_color(true, 0, 0, 0);
+    reset_controller();
+}
+
+void tearDown(void)
+{
+    unload_profiles(true);
+}
+
+/*========================================================================*/
+/*                          TESTS                                         */
+/*========================================================================*/
+
+void test_registration_restored_after_reset(void)
+{
+    registration_handler(digital_registration());
+    uint8_t slot = profile_manager.find_slot(PROFILE_DIGITAL);
+    TEST_ASSERT_NOT_EQUAL(PROFILE_SLOT_NONE, slot);
+    TEST_ASSERT_TRUE(stored(PROFILE_DIGITAL, slot));
+
+    reset_controller();
+    Registration *registration = profile_manager.get_registration(PROFILE_DIGITAL);
+    TEST_ASSERT_NOT_NULL(registration);
+    TEST_ASSERT_EQUAL_UINT32(PIN_DIGITAL, registration->driver.r_digital_generic.pin);
+}
+
+void test_unchanged_registration_not_written(void)
+{
+    registration_handler(digital_registration());
+    uint32_t writes = hal_eeprom_writes();
+
+    registration_handler(digital_registration());
+    TEST_ASSERT_EQUAL_UINT32(writes, hal_eeprom_writes());
+}
+
+void test_failed_registration_not_written(void)
+{
+    uint32_t writes = hal_eeprom_writes();
+
+    // begin() of the sensor fails
+    hal_set_color(false, 0, 0, 0);
+    registration_handler(color_registration());
+    TEST_ASSERT_NULL(profile_manager.get_registration(PROFILE_COLOR));
+    TEST_ASSERT_EQUAL_UINT32(writes, hal_eeprom_writes());
+}
+
+void test_failed_init_at_boot_keeps_record(void)
+{
+    registration_handler(color_registration());
+    uint8_t slot = profile_manager.find_slot(PROFILE_COLOR);
+    TEST_ASSERT_NOT_EQUAL(PROFILE_SLOT_NONE, slot);
+
+    // sensor not powered at the boot: profile skipped, record kept
+    hal_set_color(false, 0, 0, 0);
+    reset_controller();
+    TEST_ASSERT_NULL(profile_manager.get_registration(PROFILE_COLOR));
+    TEST_ASSERT_TRUE(stored(PROFILE_COLOR, slot));
+
+    // restored at the next boot with the sensor
+    hal_set_color(true, 0, 0, 0);
+    reset_controller();
+    TEST_ASSERT_NOT_NULL(profile_manager.get_registration(PROFILE_COLOR));
+}
+
+void test_deleted_profile_not_restored(void)
+{
+    registration_handler(digital_registration());
+    uint8_t slot = profile_manager.find_slot(PROFILE_DIGITAL);
+
+    profile_manager.delete_profile(PROFILE_DIGITAL);
+    TEST_ASSERT_FALSE(stored(PROFILE_DIGITAL, slot));
+    reset_controller();
+    TEST_ASSERT_NULL(profile_manager.get_registration(PROFILE_DIGITAL));
+}
+
+void test_corrupted_record_ignored(void)
+{
+    registration_handler(digital_registration());
+
+    // flip one bit in every written cell of the registration area
+    for (uint16_t i = PROFILE_STORAGE_START; i < PROFILE_STORAGE_START + PROFILE_STORAGE_SIZE; i++)
+    {
+        if (hal_eeprom()[i] != 0xFF)
+            hal_eeprom()[i] ^= 0x10;
+    }
+    reset_controller();
+    TEST_ASSERT_NULL(profile_manager.get_registration(PROFILE_DIGITAL));
+}
+
+int main(void)
+{
+    // delay() of setup() only advances the simulated clock
+    hal_set_realtime(false);
+
+    UNITY_BEGIN();
+    RUN_TEST(test_registration_restored_after_reset);
+    RUN_TEST(test_unchanged_registration_not_written);
+    RUN_TEST(test_failed_registration_not_written);
+    RUN_TEST(test_failed_init_at_boot_keeps_record);
+    RUN_TEST(test_deleted_profile_not_restored);
+    RUN_TEST(test_corrupted_record_ignored);
+    return UNITY_END();
+}
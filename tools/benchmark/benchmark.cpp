@@ -0,0 +1,546 @@
+/**************************************************************************/
+/*!
+    @file     benchmark.cpp
+
+    Request benchmark of the controller firmware on the host (env:native).
+
+    The benchmark registers one profile per driver and replays request mixes
+    through the simulated Serial port (see lib/native_hal). For every mix it reports:
+        - requests/s: requests handled per second of handler time
+        - latency of request_handler() [us]: mean, p50, p99, max
+        - bytes on the wire per request (request + response frames) and the
+          max. request rate of the serial link at the configured baudrate
+
+    The fast_* mixes send the same actions as binary fast path frames
+    (src/fast_path.h) => compare them with their protobuf mix.
+
+    Usage: .pio/build/native/program [-n <requests per mix>] [--csv <file>]
+
+    Times are measured on the host CPU: use them to compare firmware changes
+    with each other, not as the timing of the ATmega2560.
+*/
+/**************************************************************************/
+#include <main.h>
+#include <hal.h>
+#include <Adafruit_TCS34725.h>
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+/*========================================================================*/
+/*                          PRIVATE DEFINITIONS                           */
+/*========================================================================*/
+
+// requests per mix (can be set with -n)
+#define BENCH_REQUESTS 2000
+// requests handled before the measurement starts
+#define BENCH_WARMUP 50
+// max. size of an encoded request/response frame (including the terminator)
+#define FRAME_SIZE 256
+
+// bits per byte on the serial link (start + 8 data + stop)
+#define BITS_PER_BYTE 10
+
+/* Profiles registered for the benchmark */
+#define PROFILE_DIGITAL_OUT 1
+#define PROFILE_DIGITAL_IN 2
+#define PROFILE_MCU 3
+#define PROFILE_UART 4
+#define PROFILE_ULTRASONIC 5
+#define PROFILE_COLOR 6
+#define PROFILE_STEP 7
+#define PROFILE_REREGISTER 8
+
+/* Simulated hardware */
+#define PIN_DIGITAL_OUT 22
+#define PIN_DIGITAL_IN 23
+#define PIN_ULTRASONIC 24
+#define PIN_REREGISTER 25
+// echo of an object in 100 cm distance [us]
+#define ULTRASONIC_ECHO_US 5800
+
+// G-code command sent to the simulated uArm
+#define UARM_COMMAND "#n G0 X100 Y100 Z100 F1000"
+
+/* Handlers of main.cpp */
+void request_handler();
+
+// fills the i-th request of a mix
+typedef void (*build_request_t)(uint32_t i, Request *req);
+
+// fills the i-th fast path frame of a mix
+// @return frame length (including the terminator)
+typedef uint8_t (*build_frame_t)(uint32_t i, uint8_t *frame);
+
+struct Mix
+{
+    const char *name;
+    build_request_t build;
+    // fast path mixes: build is NULL
+    build_frame_t fast;
+};
+
+// measurement of one mix
+struct Result
+{
+    const char *name;
+    std::vector<double> latency_us;
+    uint32_t request_bytes;
+    uint32_t response_bytes;
+    uint32_t responses;
+    uint32_t errors;
+};
+
+/**
+    @brief  Encodes a request, feeds it to Serial + handles it (latency is added to the result)
+    @return false if the request could not be encoded
+*/
+bool run_request(const Request *req, Result *result);
+
+/**
+    @brief  Feeds a frame (including the terminator) to Serial + handles it (latency is added to the result)
+*/
+void run_frame(const uint8_t *frame, size_t length, Result *result);
+
+/**
+    @brief  Splits the frames sent by the firmware + counts responses/errors
+*/
+void collect_responses(Result *result);
+
+/**
+    @brief  Runs a mix of requests
+*/
+Result run_mix(const Mix *mix, uint32_t requests);
+
+/**
+    @brief  Prints the results as table (+ optionally as CSV file)
+*/
+void print_results(const std::vector<Result> &results, const char *csv_path);
+
+/**
+    @brief  Simulated uArm on Serial2: answers every command with "ok"
+*/
+void uarm_responder(uint8_t port, uint8_t value);
+
+/*========================================================================*/
+/*                          REQUESTS                                      */
+/*========================================================================*/
+
+Registration *registration(Request *req, uint32_t profile_id, pb_size_t driver)
+{
+    memset(req, 0, sizeof(Request));
+    req->which_request_type = Request_registration_tag;
+    req->request_type.registration.profile_id = profile_id;
+    req->request_type.registration.which_driver = driver;
+    return &req->request_type.registration;
+}
+
+Action *action(Request *req, uint32_t profile_id, pb_size_t driver)
+{
+    memset(req, 0, sizeof(Request));
+    req->which_request_type = Request_action_tag;
+    req->request_type.action.profile_id = profile_id;
+    req->request_type.action.which_driver = driver;
+    return &req->request_type.action;
+}
+
+/* Registrations of the benchmark profiles */
+void register_digital_out(uint32_t i, Request *req)
+{
+    Registration *reg = registration(req, PROFILE_DIGITAL_OUT, Registration_r_digital_generic_tag);
+    reg->driver.r_digital_generic.pin = PIN_DIGITAL_OUT;
+    reg->driver.r_digital_generic.mode = DigitalMode_OUTPUT;
+}
+
+void register_digital_in(uint32_t i, Request *req)
+{
+    Registration *reg = registration(req, PROFILE_DIGITAL_IN, Registration_r_digital_generic_tag);
+    reg->driver.r_digital_generic.pin = PIN_DIGITAL_IN;
+    reg->driver.r_digital_generic.mode = DigitalMode_INPUT;
+}
+
+void register_mcu(uint32_t i, Request *req)
+{
+    registration(req, PROFILE_MCU, Registration_r_mcu_driver_tag);
+}
+
+void register_uart(uint32_t i, Request *req)
+{
+    Registration *reg = registration(req, PROFILE_UART, Registration_r_uart_ttl_generic_tag);
+    reg->driver.r_uart_ttl_generic.port = UartPort_UART2;
+    reg->driver.r_uart_ttl_generic.baudrate = 115200;
+}
+
+void register_ultrasonic(uint32_t i, Request *req)
+{
+    Registration *reg = registration(req, PROFILE_ULTRASONIC, Registration_r_ultrasonic_sensor_tag);
+    reg->driver.r_ultrasonic_sensor.pin = PIN_ULTRASONIC;
+}
+
+void register_color(uint32_t i, Request *req)
+{
+    Registration *reg = registration(req, PROFILE_COLOR, Registration_r_color_sensor_tag);
+    reg->driver.r_color_sensor.address = TCS34725_ADDRESS;
+}
+
+void register_step(uint32_t i, Request *req)
+{
+    registration(req, PROFILE_STEP, Registration_r_step_motor_tag);
+}
+
+// same registration every time: teardown + init of the driver, EEPROM stays unchanged
+void register_again(uint32_t i, Request *req)
+{
+    Registration *reg = registration(req, PROFILE_REREGISTER, Registration_r_digital_generic_tag);
+    reg->driver.r_digital_generic.pin = PIN_REREGISTER;
+    reg->driver.r_digital_generic.mode = DigitalMode_OUTPUT;
+}
+
+/* Actions */
+void digital_write(uint32_t i, Request *req)
+{
+    Action *act = action(req, PROFILE_DIGITAL_OUT, Action_a_digital_generic_tag);
+    act->driver.a_digital_generic.output = (i & 1) ? DigitalOutput_HIGH : DigitalOutput_LOW;
+}
+
+void digital_read(uint32_t i, Request *req)
+{
+    action(req, PROFILE_DIGITAL_IN, Action_a_digital_generic_tag);
+}
+
+void mcu_version(uint32_t i, Request *req)
+{
+    Action *act = action(req, PROFILE_MCU, Action_a_mcu_driver_tag);
+    act->driver.a_mcu_driver.mcu_action = MCUAction_VERSION;
+}
+
+void uart_command(uint32_t i, Request *req)
+{
+    Action *act = action(req, PROFILE_UART, Action_a_uart_ttl_generic_tag);
+    strncpy(act->driver.a_uart_ttl_generic.command, UARM_COMMAND, sizeof(act->driver.a_uart_ttl_generic.command) - 1);
+}
+
+void ultrasonic(uint32_t i, Request *req)
+{
+    action(req, PROFILE_ULTRASONIC, Action_a_ultrasonic_sensor_tag);
+}
+
+void color(uint32_t i, Request *req)
+{
+    action(req, PROFILE_COLOR, Action_a_color_sensor_tag);
+}
+
+// blocking move back and forth (the ISR runs in simulated time)
+void step_move(uint32_t i, Request *req)
+{
+    Action *act = action(req, PROFILE_STEP, Action_a_step_motor_tag);
+    act->driver.a_step_motor.which_mode = A_Step_Motor_steps_tag;
+    act->driver.a_step_motor.mode.steps = (i & 1) ? -50 : 50;
+    act->driver.a_step_motor.time_min_val = 200;
+    act->driver.a_step_motor.wait = true;
+}
+
+// all actions round robin
+void mixed(uint32_t i, Request *req)
+{
+    static const build_request_t actions[] = {digital_write, digital_read, mcu_version, uart_command, ultrasonic, color, step_move};
+    const uint32_t num_actions = sizeof(actions) / sizeof(actions[0]);
+    actions[i % num_actions](i / num_actions, req);
+}
+
+// turns on the fast path (before the fast_* mixes)
+void mcu_fast_path(uint32_t i, Request *req)
+{
+    Action *act = action(req, PROFILE_MCU, Action_a_mcu_driver_tag);
+    act->driver.a_mcu_driver.mcu_action = MCUAction_FAST_PATH;
+    act->driver.a_mcu_driver.arg = 1;
+}
+
+/* Fast path frames */
+uint8_t fast_header(uint8_t *frame, uint8_t opcode, uint32_t profile_id)
+{
+    frame[0] = FAST_MARKER;
+    frame[1] = 0x80 | opcode;
+    return 2 + pack_value(&frame[2], profile_id, FAST_PROFILE_BYTES);
+}
+
+uint8_t fast_digital_write(uint32_t i, uint8_t *frame)
+{
+    uint8_t length = fast_header(frame, FAST_OP_DIGITAL_WRITE, PROFILE_DIGITAL_OUT);
+    length += pack_value(&frame[length], i & 1, 1);
+    frame[length] = 0;
+    return length + 1;
+}
+
+uint8_t fast_digital_read(uint32_t i, uint8_t *frame)
+{
+    uint8_t length = fast_header(frame, FAST_OP_DIGITAL_READ, PROFILE_DIGITAL_IN);
+    frame[length] = 0;
+    return length + 1;
+}
+
+uint8_t fast_ultrasonic(uint32_t i, uint8_t *frame)
+{
+    uint8_t length = fast_header(frame, FAST_OP_SENSOR_READ, PROFILE_ULTRASONIC);
+    frame[length] = 0;
+    return length + 1;
+}
+
+uint8_t fast_color(uint32_t i, uint8_t *frame)
+{
+    uint8_t length = fast_header(frame, FAST_OP_SENSOR_READ, PROFILE_COLOR);
+    frame[length] = 0;
+    return length + 1;
+}
+
+/* Benchmark profiles + mixes */
+static const build_request_t registrations[] = {
+    register_digital_out,
+    register_digital_in,
+    register_mcu,
+    register_uart,
+    register_ultrasonic,
+    register_color,
+    register_step,
+    register_again,
+};
+
+static const Mix mixes[] = {
+    {"digital_write", digital_write},
+    {"digital_read", digital_read},
+    {"mcu_version", mcu_version},
+    {"uart_command", uart_command},
+    {"ultrasonic", ultrasonic},
+    {"color", color},
+    {"step_move", step_move},
+    {"registration", register_again},
+    {"mixed", mixed},
+    {"fast_digital_write", NULL, fast_digital_write},
+    {"fast_digital_read", NULL, fast_digital_read},
+    {"fast_ultrasonic", NULL, fast_ultrasonic},
+    {"fast_color", NULL, fast_color},
+};
+
+/*========================================================================*/
+/*                          MAIN                                          */
+/*========================================================================*/
+
+int main(int argc, char **argv)
+{
+    uint32_t requests = BENCH_REQUESTS;
+    const char *csv_path = NULL;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+            requests = (uint32_t)atol(argv[++i]);
+        else if (strcmp(argv[i], "--csv") == 0 && i + 1 < argc)
+            csv_path = argv[++i];
+        else
+        {
+            fprintf(stderr, "Usage: %s [-n <requests per mix>] [--csv <file>]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    /* simulated hardware */
+    hal_set_realtime(false);
+    hal_set_pin(PIN_DIGITAL_IN, HIGH);
+    hal_set_pulse(PIN_ULTRASONIC, ULTRASONIC_ECHO_US);
+    hal_set_color(true, 20000, 12000, 4000);
+    hal_serial_set_responder(2, uarm_responder);
+
+    /* boot firmware + register the benchmark profiles */
+    setup();
+    for (uint8_t i = 0; i < sizeof(registrations) / sizeof(registrations[0]); i++)
+    {
+        Request req;
+        Result result = {};
+        registrations[i](0, &req);
+        run_request(&req, &result);
+        if (result.responses == 0 || result.errors > 0)
+        {
+            fprintf(stderr, "Registration of profile %u failed\n", (unsigned)req.request_type.registration.profile_id);
+            return 1;
+        }
+    }
+    {
+        Request req;
+        Result result = {};
+        mcu_fast_path(0, &req);
+        run_request(&req, &result);
+        if (result.errors > 0)
+        {
+            fprintf(stderr, "Fast path could not be enabled\n");
+            return 1;
+        }
+    }
+
+    std::vector<Result> results;
+    for (uint8_t i = 0; i < sizeof(mixes) / sizeof(mixes[0]); i++)
+        results.push_back(run_mix(&mixes[i], requests));
+
+    print_results(results, csv_path);
+    return 0;
+}
+
+/*========================================================================*/
+/*                          PRIVATE FUNCTIONS                             */
+/*========================================================================*/
+
+Result run_mix(const Mix *mix, uint32_t requests)
+{
+    Result result = {};
+    Result warmup = {};
+    Request req;
+    uint8_t frame[FRAME_SIZE];
+
+    result.name = mix->name;
+    if (mix->fast != NULL)
+    {
+        for (uint32_t i = 0; i < BENCH_WARMUP; i++)
+            run_frame(frame, mix->fast(i, frame), &warmup);
+        result.latency_us.reserve(requests);
+        for (uint32_t i = 0; i < requests; i++)
+            run_frame(frame, mix->fast(i, frame), &result);
+        return result;
+    }
+
+    for (uint32_t i = 0; i < BENCH_WARMUP; i++)
+    {
+        mix->build(i, &req);
+        run_request(&req, &warmup);
+    }
+
+    result.latency_us.reserve(requests);
+    for (uint32_t i = 0; i < requests; i++)
+    {
+        mix->build(i, &req);
+        if (!run_request(&req, &result))
+        {
+            fprintf(stderr, "%s: encoding of request %u failed\n", mix->name, (unsigned)i);
+            break;
+        }
+    }
+    return result;
+}
+
+bool run_request(const Request *req, Result *result)
+{
+    uint8_t frame[FRAME_SIZE];
+    pb_ostream_t stream = pb_ostream_from_buffer(frame, sizeof(frame) - 1);
+
+    if (!pb_encode(&stream, Request_fields, req))
+        return false;
+    frame[stream.bytes_written] = 0;
+    run_frame(frame, stream.bytes_written + 1, result);
+    return true;
+}
+
+void run_frame(const uint8_t *frame, size_t length, Result *result)
+{
+    hal_serial_feed(0, frame, length);
+    result->request_bytes += length;
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    request_handler();
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+    result->latency_us.push_back(std::chrono::duration<double, std::micro>(end - start).count());
+    collect_responses(result);
+}
+
+void collect_responses(Result *result)
+{
+    uint8_t frame[FRAME_SIZE];
+    size_t length = 0;
+    uint8_t value;
+
+    while (hal_serial_take(0, &value, 1) == 1)
+    {
+        result->response_bytes++;
+        if (value != 0)
+        {
+            if (length < sizeof(frame))
+                frame[length++] = value;
+            continue;
+        }
+
+        /* end of frame: fast frame (code in the 2nd byte) or Response (payload callback is not set => payload is skipped) */
+        if (length > 0 && frame[0] == FAST_MARKER)
+        {
+            if (length < 2 || (frame[1] & 0x7F) == ResponseCode_ERROR)
+                result->errors++;
+        }
+        else
+        {
+            Response response = {};
+            pb_istream_t stream = pb_istream_from_buffer(frame, length);
+            if (!pb_decode(&stream, Response_fields, &response) || response.code == ResponseCode_ERROR)
+                result->errors++;
+        }
+        result->responses++;
+        length = 0;
+    }
+}
+
+void print_results(const std::vector<Result> &results, const char *csv_path)
+{
+    unsigned long baud = hal_serial_stats(0).baud;
+    FILE *csv = NULL;
+
+    if (csv_path != NULL)
+    {
+        csv = fopen(csv_path, "w");
+        if (csv == NULL)
+            fprintf(stderr, "Could not open %s\n", csv_path);
+        else
+            fprintf(csv, "mix,requests,requests_per_s,mean_us,p50_us,p99_us,max_us,request_bytes,response_bytes,wire_requests_per_s,errors\n");
+    }
+
+    printf("%-18s %8s %10s %9s %9s %9s %9s %7s %7s %10s %6s\n",
+           "mix", "requests", "req/s", "mean[us]", "p50[us]", "p99[us]", "max[us]", "req[B]", "resp[B]", "wire req/s", "errors");
+
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const Result &result = results[i];
+        std::vector<double> latency = result.latency_us;
+        size_t count = latency.size();
+        if (count == 0)
+            continue;
+
+        std::sort(latency.begin(), latency.end());
+        double total = 0;
+        for (size_t j = 0; j < count; j++)
+            total += latency[j];
+
+        double request_bytes = (double)result.request_bytes / count;
+        double response_bytes = (double)result.response_bytes / count;
+        // the link is full duplex => the longer direction limits the request rate
+        double wire_rate = (double)baud / BITS_PER_BYTE / std::max(request_bytes, response_bytes);
+        double rate = total > 0 ? count / (total / 1e6) : 0;
+
+        const char *format = "%-18s %8u %10.0f %9.2f %9.2f %9.2f %9.2f %7.1f %7.1f %10.0f %6u\n";
+        printf(format, result.name, (unsigned)count, rate, total / count, latency[count / 2],
+               latency[std::min(count - 1, count * 99 / 100)], latency[count - 1],
+               request_bytes, response_bytes, wire_rate, (unsigned)result.errors);
+        if (csv != NULL)
+            fprintf(csv, "%s,%u,%.0f,%.3f,%.3f,%.3f,%.3f,%.2f,%.2f,%.0f,%u\n", result.name, (unsigned)count, rate, total / count,
+                    latency[count / 2], latency[std::min(count - 1, count * 99 / 100)], latency[count - 1],
+                    request_bytes, response_bytes, wire_rate, (unsigned)result.errors);
+    }
+
+    printf("(serial link: %lu baud, %i bits per byte)\n", baud, BITS_PER_BYTE);
+    if (csv != NULL)
+        fclose(csv);
+}
+
+void uarm_responder(uint8_t port, uint8_t value)
+{
+    static const uint8_t response[] = {'o', 'k', '\n'};
+
+    // answer at the end of every command
+    if (value == '\n')
+        hal_serial_feed(port, response, sizeof(response));
+}
@@ -0,0 +1,38 @@
+#!/bin/bash
+
+# flash/RAM budget of every driver: builds the firmware once with all drivers and once
+# without each driver (-D DRIVER_ENABLE_<NAME>=0, see src/driver_config.h) => prints the savings
+# argument: PlatformIO environment (default: megaatmega2560)
+
+cd "$(dirname "$0")/.." || exit 2
+ENV=${1:-megaatmega2560}
+ELF=.pio/build/${ENV}/firmware.elf
+SIZE=${SIZE:-avr-size}
+command -v "$SIZE" > /dev/null || SIZE=~/.platformio/packages/toolchain-atmelavr/bin/avr-size
+
+# prints "<flash> <ram>" of the last build
+measure()
+{
+    "$SIZE" -A "$ELF" | awk '$1 == ".text" || $1 == ".data" { flash += $2 }
+                             $1 == ".data" || $1 == ".bss" || $1 == ".noinit" { ram += $2 }
+                             END { print flash, ram }'
+}
+
+build()
+{
+    PLATFORMIO_BUILD_FLAGS="$1" platformio run -s -e "$ENV" > /dev/null || exit 2
+}
+
+build ""
+read -r FLASH RAM < <(measure)
+printf "%-20s %8s %8s\n" "driver" "flash" "RAM"
+printf "%-20s %8i %8i\n" "(all drivers)" "$FLASH" "$RAM"
+
+for name in $(sed -n 's/^DRIVER(\([a-z_0-9]*\),.*/\1/p' src/drivers/driver_list.h); do
+    build "-D DRIVER_ENABLE_${name^^}=0"
+    read -r flash ram < <(measure)
+    printf "%-20s %8i %8i\n" "$name" $((FLASH - flash)) $((RAM - ram))
+done
+
+# restore the default build
+build ""
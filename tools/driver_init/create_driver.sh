@@ -27,9 +27,9 @@ create_driver()
         sed "s/Template_Driver/${Driver_Name}/g" ./tools/driver_init/templates/proto_reg.txt > ./tools/driver_init/templates/memory.txt
         sed -n -i -e "/ADI-PROTO-Reg/r ./tools/driver_init/templates/memory.txt" -e 1x -e '2,${x;p}' -e '${x;p}' ./protobuf/line_protocol.proto
         
-        # line_protocol.proto: oneof declerations => only working if .h files inside driver dir are only for drivers
-        num_of_files=$(ls ./src/drivers | egrep '\.h$' |wc -l)
-        new_message_index=$(((num_of_files) + 1))
+        # line_protocol.proto: oneof declerations => tag of the new driver follows the last row of driver_list.h (first tag is 2)
+        num_of_drivers=$(grep -c '^DRIVER(' ./src/drivers/driver_list.h)
+        new_message_index=$(((num_of_drivers) + 2))
         # oneof decleration: Action
         sed "s/Template_Driver/${Driver_Name}/g; s/template_driver/$1/g; s/INDEX/${new_message_index}/g" ./tools/driver_init/templates/proto_oneof_action.txt > ./tools/driver_init/templates/memory.txt
         sed -n -i -e "/ADI-PROTO-Oneof-Action/r ./tools/driver_init/templates/memory.txt" -e 1x -e '2,${x;p}' -e '${x;p}' ./protobuf/line_protocol.proto
@@ -37,12 +37,13 @@ create_driver()
         sed "s/Template_Driver/${Driver_Name}/g; s/template_driver/$1/g; s/INDEX/${new_message_index}/g" ./tools/driver_init/templates/proto_oneof_reg.txt > ./tools/driver_init/templates/memory.txt
         sed -n -i -e "/ADI-PROTO-Oneof-Reg/r ./tools/driver_init/templates/memory.txt" -e 1x -e '2,${x;p}' -e '${x;p}' ./protobuf/line_protocol.proto
 
-        # main.cpp: action_handler
-        sed "s/template_driver/$1/g" ./tools/driver_init/templates/main_action.txt > ./tools/driver_init/templates/memory.txt
-        sed -n -i -e "/ADI-MAIN-Action/r ./tools/driver_init/templates/memory.txt" -e 1x -e '2,${x;p}' -e '${x;p}' ./src/main.cpp
-        # main.cpp: registration_handler
-        sed "s/template_driver/$1/g" ./tools/driver_init/templates/main_reg.txt > ./tools/driver_init/templates/memory.txt
-        sed -n -i -e "/ADI-MAIN-Reg/r ./tools/driver_init/templates/memory.txt" -e 1x -e '2,${x;p}' -e '${x;p}' ./src/main.cpp
+        # driver_list.h: descriptor of the driver (generates the dispatch table entry)
+        sed "s/template_driver/$1/g; s/TEMPLATE_DRIVER/${DRIVER_NAME}/g" ./tools/driver_init/templates/driver_list.txt > ./tools/driver_init/templates/memory.txt
+        sed -n -i -e "/ADI-DRIVER-List/r ./tools/driver_init/templates/memory.txt" -e 1x -e '2,${x;p}' -e '${x;p}' ./src/drivers/driver_list.h
+
+        # driver_config.h: build flag of the driver (enabled by default)
+        sed "s/TEMPLATE_DRIVER/${DRIVER_NAME}/g" ./tools/driver_init/templates/driver_config.txt > ./tools/driver_init/templates/memory.txt
+        sed -n -i -e "/ADI-DRIVER-Config/r ./tools/driver_init/templates/memory.txt" -e 1x -e '2,${x;p}' -e '${x;p}' ./src/driver_config.h
 
         # main.h: include driver
         sed "s/template_driver/$1/g" ./tools/driver_init/templates/main_include.txt > ./tools/driver_init/templates/memory.txt
@@ -1,5 +1,7 @@
 #include "template_driver.h"
 
+#if DRIVER_ENABLE_TEMPLATE_DRIVER
+
 /*========================================================================*/
 /*                          FUNCTION DEFINITIONS                          */
 /*========================================================================*/
@@ -8,7 +10,7 @@
 /*!
     TODO: Description of initialization function for template_driver
 */
-bool init_template_driver(uint32_t profile_id, R_Template_Driver profile)
+bool init_template_driver(uint32_t profile_id, const R_Template_Driver &profile)
 {
     // TODO: implement initialization
 }
@@ -17,8 +19,29 @@ bool init_template_driver(uint32_t profile_id, R_Template_Driver profile)
 /*!
     TODO: Description of action function for template_driver
 */
-void run_template_driver(uint32_t profile_id, A_Template_Driver action)
+void run_template_driver(uint32_t profile_id, const A_Template_Driver &action)
 {
 
     // TODO: implement action function
 }
+
+/**************************************************************************/
+/*!
+    TODO: List the hardware resources (pins, timers, UARTs, I2C addresses) of template_driver
+*/
+uint8_t resources_template_driver(const R_Template_Driver &profile, Resource *resources)
+{
+    // TODO: add resources (e.g. resources[0] = {RESOURCE_PIN, resource_id(profile.pin)};)
+    return 0;
+}
+
+/**************************************************************************/
+/*!
+    TODO: Description of teardown function for template_driver
+*/
+void teardown_template_driver(uint32_t profile_id)
+{
+    // TODO: release the hardware (pin modes, serial ports, timers, interrupts)
+}
+
+#endif
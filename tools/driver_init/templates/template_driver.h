@@ -12,12 +12,25 @@
     @brief  Initialization function for template_driver driver
     @return boolean if initialization was successful or not
 */
-bool init_template_driver(uint32_t profile_id, R_Template_Driver profile);
+bool init_template_driver(uint32_t profile_id, const R_Template_Driver &profile);
 
 /**************************************************************************/
 /*!
     @brief  Action function for template_driver ddriver
 */
-void run_template_driver(uint32_t profile_id, A_Template_Driver action);
+void run_template_driver(uint32_t profile_id, const A_Template_Driver &action);
+
+/**************************************************************************/
+/*!
+    @brief  Lists the hardware resources used by a template_driver registration
+    @return number of resources
+*/
+uint8_t resources_template_driver(const R_Template_Driver &profile, Resource *resources);
+
+/**************************************************************************/
+/*!
+    @brief  Teardown function for template_driver driver: releases the hardware of the profile
+*/
+void teardown_template_driver(uint32_t profile_id);
 
 #endif
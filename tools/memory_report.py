@@ -0,0 +1,94 @@
+# -*- coding: utf-8 -*-
+"""
+PlatformIO post script: reports the RAM used by the profile table after linking.
+
+The old profile table used fixed arrays for 256 profiles:
+    Registration profiles[256] + bool events[256] + bool event_trigger[256]
+The report compares this with the size of the profile_manager symbol.
+
+It also lists the drivers compiled into the firmware (DRIVER_ENABLE_* flags,
+see src/driver_config.h) with the flash/RAM totals of the firmware.
+"""
+import os
+import re
+import subprocess
+
+Import("env")  # pylint: disable=undefined-variable
+
+# defaults must match src/profile_manager.h
+PROFILE_CAPACITY = 16
+PROFILE_STATE_SIZE = 8
+LEGACY_PROFILES = 256
+
+
+def get_define(name, default):
+    """ Returns the value of a -D build flag (or the default) """
+    for define in env.get("CPPDEFINES", []):
+        if isinstance(define, (list, tuple)) and define[0] == name:
+            return int(define[1])
+    return default
+
+
+def enabled_drivers():
+    """ Returns the drivers of src/drivers/driver_list.h + if they are compiled in """
+    path = os.path.join(env.subst("$PROJECT_SRC_DIR"), "drivers", "driver_list.h")
+    with open(path) as driver_list:
+        rows = re.findall(r"^DRIVER\((\w+), (\w+),", driver_list.read(), re.M)
+    return [(name, get_define(flag, 1) != 0) for name, flag in rows]
+
+
+def firmware_size(elf):
+    """ Returns flash (.text + .data) and RAM (.data + .bss + .noinit) of the ELF file """
+    size_tool = env.subst("$CC").replace("gcc", "size")
+    output = subprocess.check_output([size_tool, "-A", elf]).decode()
+    sections = {}
+    for line in output.splitlines():
+        fields = line.split()
+        if len(fields) == 3 and fields[1].isdigit():
+            sections[fields[0]] = int(fields[1])
+    flash = sections.get(".text", 0) + sections.get(".data", 0)
+    ram = sections.get(".data", 0) + sections.get(".bss", 0) + sections.get(".noinit", 0)
+    return flash, ram
+
+
+def symbol_size(elf, symbol):
+    """ Returns the size of a symbol in the ELF file (0 if not found) """
+    nm_tool = env.subst("$CC").replace("gcc", "nm")
+    output = subprocess.check_output([nm_tool, "-S", "-C", elf]).decode()
+    for line in output.splitlines():
+        fields = line.split(None, 3)
+        if len(fields) == 4 and fields[3] == symbol:
+            return int(fields[1], 16)
+    return 0
+
+
+def memory_report(source, target, env):
+    elf = str(target[0])
+
+    drivers = enabled_drivers()
+    flash, ram = firmware_size(elf)
+    print("Memory report: drivers")
+    print("  compiled in:     %s" % ", ".join(name for name, enabled in drivers if enabled))
+    print("  disabled:        %s" % (", ".join(name for name, enabled in drivers if not enabled) or "-"))
+    print("  firmware:        %i bytes flash, %i bytes RAM (static)" % (flash, ram))
+
+    capacity = get_define("PROFILE_CAPACITY", PROFILE_CAPACITY)
+    state_size = get_define("PROFILE_STATE_SIZE", PROFILE_STATE_SIZE)
+
+    table_size = symbol_size(elf, "profile_manager")
+    if table_size == 0:
+        print("Memory report: symbol profile_manager not found")
+        return
+
+    # per slot: Registration + flags + driver state, plus 4 bytes for the id index (no padding on AVR)
+    registration_size = table_size // capacity - 4 - 1 - state_size
+    legacy_size = LEGACY_PROFILES * (registration_size + 2)
+
+    print("Memory report: profile table")
+    print("  capacity:        %i profiles (%i bytes driver state each)" % (capacity, state_size))
+    print("  profile table:   %i bytes RAM" % table_size)
+    print("  256-entry table: %i bytes RAM" % legacy_size)
+    print("  saved:           %i bytes RAM" % (legacy_size - table_size))
+
+
+env.AddPostAction("$BUILD_DIR/${PROGNAME}.elf", memory_report)
@@ -0,0 +1,31 @@
+#!/bin/bash
+
+# stack depth per request of two commits: builds both firmware images with performance markers
+# (git worktrees), replays the request script of the current tree in simavr => prints the stack:<name>
+# lines of both + the delta [B]
+# arguments: <base commit> <commit> (default: HEAD~1 HEAD)
+
+cd "$(dirname "$0")/../.." || exit 2
+BASE=${1:-HEAD~1}
+HEAD=${2:-HEAD}
+TMP=$(mktemp -d)
+trap 'git worktree remove --force "$TMP/base" 2> /dev/null; git worktree remove --force "$TMP/head" 2> /dev/null; rm -rf "$TMP"' EXIT
+
+make -C tools/simavr > /dev/null || exit 2
+
+# writes the metrics of a commit to $TMP/<name>.txt
+measure()
+{
+    git worktree add --detach "$TMP/$1" "$2" > /dev/null 2>&1 || exit 2
+    platformio run -s -d "$TMP/$1" -e perf > /dev/null || exit 2
+    ./tools/simavr/perf_harness --update-baseline -b "$TMP/$1.txt" \
+        "$TMP/$1/.pio/build/perf/firmware.elf" tools/simavr/requests.script > /dev/null || exit 2
+}
+
+measure base "$BASE"
+measure head "$HEAD"
+
+printf "%-32s %8s %8s %8s\n" "request" "$BASE" "$HEAD" "delta"
+join <(grep '^stack:' "$TMP/base.txt" | awk '{ print $1, $3 }' | sort) \
+     <(grep '^stack:' "$TMP/head.txt" | awk '{ print $1, $3 }' | sort) |
+    awk '{ printf "%-32s %8i %8i %+8i\n", substr($1, 7), $2, $3, $3 - $2 }'
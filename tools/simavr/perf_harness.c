@@ -0,0 +1,552 @@
+/**************************************************************************/
+/*!
+    @file     perf_harness.c
+
+    Cycle accurate performance harness: runs the AVR firmware image in simavr,
+    replays a request script on UART0 and measures the cycles of the paths
+    marked in the firmware (see src/perf_markers.h, build with env:perf):
+        - loop:              one pass of loop() (without delay(10))
+        - loop:idle          pass of loop() without a request
+        - request:<name>     request_handler() for the requests of a script line
+        - event:driver<tag>  event_handler() of a driver
+        - isr:timer4_compa   TIMER4_COMPA ISR (step motor)
+        - stack:<name>       stack depth [B] of the requests of a script line
+                             (lowest SP from the begin to the end of request_handler(), ISRs included)
+
+    For every path the min/mean/max cycles are reported (max = worst case).
+    The results are compared with a baseline file: the harness fails if the
+    mean or the max of a path is more than <threshold> % above the baseline,
+    or if the baseline is missing/empty (create it with --update-baseline).
+
+    Usage:
+        perf_harness [-t <threshold %>] [-b <baseline>] [--update-baseline] <firmware.elf> <script>
+
+    Script lines (# starts a comment):
+        boot <ms>                     run the firmware for <ms> (setup())
+        idle <ms>                     run the firmware for <ms> (loop() without requests)
+        send <name> <count> <hex>...  send a request frame <count> times (terminator is added),
+                                      each time wait for a response frame
+*/
+/**************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include <simavr/sim_avr.h>
+#include <simavr/sim_elf.h>
+#include <simavr/sim_io.h>
+#include <simavr/sim_irq.h>
+#include <simavr/avr_uart.h>
+
+/*========================================================================*/
+/*                          PRIVATE DEFINITIONS                           */
+/*========================================================================*/
+
+#define F_CPU 16000000UL
+#define CYCLES_PER_MS (F_CPU / 1000)
+
+// data addresses of the marker registers (ATmega2560)
+#define ADDR_GPIOR0 0x3E
+#define ADDR_GPIOR1 0x4A
+#define ADDR_GPIOR2 0x4B
+
+/* Marker ids: must match src/perf_markers.h */
+#define PERF_END_FLAG 0x80
+#define PERF_PATH_LOOP 1
+#define PERF_PATH_REQUEST 2
+#define PERF_PATH_EVENT 3
+#define PERF_ISR_TIMER4_COMPA 1
+#define PERF_PATHS 8
+
+// default regression threshold [%]
+#define DEFAULT_THRESHOLD 5.0
+#define DEFAULT_BASELINE "tools/simavr/baseline.txt"
+
+// max. time to wait for the response of a request [ms]
+#define RESPONSE_TIMEOUT_MS 3000
+
+#define MAX_METRICS 64
+#define MAX_NAME 48
+#define MAX_FRAME 256
+#define MAX_LINE 1024
+
+// cycle statistics of a marked path
+struct metric
+{
+    char name[MAX_NAME];
+    uint32_t count;
+    uint64_t sum;
+    uint64_t min;
+    uint64_t max;
+};
+
+// simulated device behind a UART
+struct uart_port
+{
+    avr_irq_t *input;
+    int xon;
+    uint8_t queue[MAX_FRAME];
+    size_t queue_length;
+};
+
+static avr_t *avr;
+static struct metric metrics[MAX_METRICS];
+static int num_metrics = 0;
+
+/* Marker state */
+static uint8_t gpior1 = 0;
+static avr_cycle_count_t path_start[PERF_PATHS];
+static avr_cycle_count_t isr_start = 0;
+static int loop_busy = 0;
+static int request_done = 0;
+// request path is running: lowest stack pointer since its begin
+static int request_open = 0;
+static uint16_t request_sp_min = 0;
+// name of the script line which is replayed (request path)
+static char request_name[MAX_NAME] = "none";
+
+/* UART0: gateway, UART2: simulated uArm */
+static struct uart_port uart0 = {0};
+static struct uart_port uart2 = {0};
+static uint32_t frames_received = 0;
+
+/**
+    @brief  Adds a measurement to the metric with the given name
+*/
+static void record(const char *name, uint64_t cycles);
+
+/**
+    @brief  Current stack pointer of the firmware
+*/
+static uint16_t stack_pointer(void);
+
+/**
+    @brief  Runs the firmware until done() returns true or the time is over
+    @return 1 if done, 0 on timeout, -1 if the firmware crashed
+*/
+static int run(uint64_t ms, int (*done)(void));
+
+/**
+    @brief  Replays the script
+    @return 0 on success
+*/
+static int run_script(const char *path);
+
+/**
+    @brief  Compares the metrics with the baseline
+    @return number of regressed metrics
+*/
+static int check_baseline(const char *path, double threshold);
+
+/**
+    @brief  Writes the metrics as new baseline
+*/
+static int write_baseline(const char *path);
+
+/*========================================================================*/
+/*                          MARKERS                                       */
+/*========================================================================*/
+
+static uint16_t stack_pointer(void)
+{
+    return avr->data[R_SPL] | (avr->data[R_SPH] << 8);
+}
+
+static void record(const char *name, uint64_t cycles)
+{
+    struct metric *metric = NULL;
+
+    for (int i = 0; i < num_metrics && metric == NULL; i++)
+    {
+        if (strcmp(metrics[i].name, name) == 0)
+            metric = &metrics[i];
+    }
+    if (metric == NULL)
+    {
+        if (num_metrics == MAX_METRICS)
+            return;
+        metric = &metrics[num_metrics++];
+        snprintf(metric->name, sizeof(metric->name), "%s", name);
+        metric->min = UINT64_MAX;
+    }
+
+    metric->count++;
+    metric->sum += cycles;
+    if (cycles < metric->min)
+        metric->min = cycles;
+    if (cycles > metric->max)
+        metric->max = cycles;
+}
+
+static void gpior0_write(avr_t *avr, avr_io_addr_t addr, uint8_t v, void *param)
+{
+    uint8_t path = v & ~PERF_END_FLAG;
+    char name[MAX_NAME];
+
+    avr->data[addr] = v;
+    if (path >= PERF_PATHS)
+        return;
+
+    if (!(v & PERF_END_FLAG))
+    {
+        path_start[path] = avr->cycle;
+        if (path == PERF_PATH_LOOP)
+            loop_busy = 0;
+        else if (path == PERF_PATH_REQUEST)
+        {
+            loop_busy = 1;
+            request_open = 1;
+            request_sp_min = stack_pointer();
+        }
+        return;
+    }
+
+    uint64_t cycles = avr->cycle - path_start[path];
+    switch (path)
+    {
+    case PERF_PATH_LOOP:
+        record("loop", cycles);
+        if (!loop_busy)
+            record("loop:idle", cycles);
+        break;
+    case PERF_PATH_REQUEST:
+        snprintf(name, sizeof(name), "request:%s", request_name);
+        record(name, cycles);
+        snprintf(name, sizeof(name), "stack:%s", request_name);
+        record(name, avr->ramend - request_sp_min);
+        request_open = 0;
+        request_done = 1;
+        break;
+    case PERF_PATH_EVENT:
+        snprintf(name, sizeof(name), "event:driver%u", gpior1);
+        record(name, cycles);
+        break;
+    }
+}
+
+static void gpior1_write(avr_t *avr, avr_io_addr_t addr, uint8_t v, void *param)
+{
+    avr->data[addr] = v;
+    gpior1 = v;
+}
+
+static void gpior2_write(avr_t *avr, avr_io_addr_t addr, uint8_t v, void *param)
+{
+    avr->data[addr] = v;
+    if (!(v & PERF_END_FLAG))
+        isr_start = avr->cycle;
+    else if ((v & ~PERF_END_FLAG) == PERF_ISR_TIMER4_COMPA)
+        record("isr:timer4_compa", avr->cycle - isr_start);
+}
+
+/*========================================================================*/
+/*                          UART                                          */
+/*========================================================================*/
+
+static void uart_pump(struct uart_port *port)
+{
+    size_t sent = 0;
+    while (port->xon && sent < port->queue_length)
+        avr_raise_irq(port->input, port->queue[sent++]);
+    memmove(port->queue, port->queue + sent, port->queue_length - sent);
+    port->queue_length -= sent;
+}
+
+static void uart_send(struct uart_port *port, const uint8_t *data, size_t length)
+{
+    if (port->queue_length + length > sizeof(port->queue))
+        length = sizeof(port->queue) - port->queue_length;
+    memcpy(port->queue + port->queue_length, data, length);
+    port->queue_length += length;
+    uart_pump(port);
+}
+
+static void uart_xon(struct avr_irq_t *irq, uint32_t value, void *param)
+{
+    struct uart_port *port = (struct uart_port *)param;
+    port->xon = 1;
+    uart_pump(port);
+}
+
+static void uart_xoff(struct avr_irq_t *irq, uint32_t value, void *param)
+{
+    ((struct uart_port *)param)->xon = 0;
+}
+
+// UART0: responses of the firmware are terminated with 0
+static void uart0_output(struct avr_irq_t *irq, uint32_t value, void *param)
+{
+    if (value == 0)
+        frames_received++;
+}
+
+// UART2: simulated uArm answers every G-code line with "ok"
+static void uart2_output(struct avr_irq_t *irq, uint32_t value, void *param)
+{
+    static const uint8_t response[] = {'o', 'k', '\n'};
+    if (value == '\n')
+        uart_send(&uart2, response, sizeof(response));
+}
+
+static void uart_attach(struct uart_port *port, char name, avr_irq_notify_t output)
+{
+    uint32_t flags = 0;
+
+    // don't dump the UART to stdout
+    avr_ioctl(avr, AVR_IOCTL_UART_GET_FLAGS(name), &flags);
+    flags &= ~AVR_UART_FLAG_STDIO;
+    avr_ioctl(avr, AVR_IOCTL_UART_SET_FLAGS(name), &flags);
+
+    port->input = avr_io_getirq(avr, AVR_IOCTL_UART_GETIRQ(name), UART_IRQ_INPUT);
+    port->xon = 1;
+    avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_UART_GETIRQ(name), UART_IRQ_OUT_XON), uart_xon, port);
+    avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_UART_GETIRQ(name), UART_IRQ_OUT_XOFF), uart_xoff, port);
+    avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_UART_GETIRQ(name), UART_IRQ_OUTPUT), output, port);
+}
+
+/*========================================================================*/
+/*                          SCRIPT                                        */
+/*========================================================================*/
+
+static uint32_t frames_expected = 0;
+
+static int response_received(void)
+{
+    return request_done && frames_received >= frames_expected;
+}
+
+static int run(uint64_t ms, int (*done)(void))
+{
+    avr_cycle_count_t end = avr->cycle + ms * CYCLES_PER_MS;
+
+    while (avr->cycle < end)
+    {
+        int state = avr_run(avr);
+        if (state == cpu_Done || state == cpu_Crashed)
+            return -1;
+        if (request_open && stack_pointer() < request_sp_min)
+            request_sp_min = stack_pointer();
+        if (done != NULL && done())
+            return 1;
+    }
+    return 0;
+}
+
+static int run_script(const char *path)
+{
+    FILE *script = fopen(path, "r");
+    char line[MAX_LINE];
+    int line_number = 0;
+
+    if (script == NULL)
+    {
+        fprintf(stderr, "Could not open script %s\n", path);
+        return -1;
+    }
+
+    while (fgets(line, sizeof(line), script) != NULL)
+    {
+        char *command = strtok(line, " \t\r\n");
+        line_number++;
+        if (command == NULL || command[0] == '#')
+            continue;
+
+        if (strcmp(command, "boot") == 0 || strcmp(command, "idle") == 0)
+        {
+            char *ms = strtok(NULL, " \t\r\n");
+            if (ms == NULL || run(strtoull(ms, NULL, 10), NULL) < 0)
+                goto failed;
+        }
+        else if (strcmp(command, "send") == 0)
+        {
+            char *name = strtok(NULL, " \t\r\n");
+            char *count = strtok(NULL, " \t\r\n");
+            uint8_t frame[MAX_FRAME];
+            size_t length = 0;
+            char *byte;
+
+            if (name == NULL || count == NULL)
+                goto failed;
+            while ((byte = strtok(NULL, " \t\r\n")) != NULL && byte[0] != '#' && length < sizeof(frame) - 1)
+                frame[length++] = (uint8_t)strtoul(byte, NULL, 16);
+            // frame terminator
+            frame[length++] = 0;
+
+            snprintf(request_name, sizeof(request_name), "%s", name);
+            for (long i = strtol(count, NULL, 10); i > 0; i--)
+            {
+                request_done = 0;
+                frames_expected = frames_received + 1;
+                uart_send(&uart0, frame, length);
+                if (run(RESPONSE_TIMEOUT_MS, response_received) != 1)
+                {
+                    fprintf(stderr, "%s:%i: no response to request %s\n", path, line_number, name);
+                    fclose(script);
+                    return -1;
+                }
+            }
+        }
+        else
+            goto failed;
+    }
+    fclose(script);
+    return 0;
+
+failed:
+    fprintf(stderr, "%s:%i: invalid line or firmware crashed\n", path, line_number);
+    fclose(script);
+    return -1;
+}
+
+/*========================================================================*/
+/*                          BASELINE                                      */
+/*========================================================================*/
+
+static int check_baseline(const char *path, double threshold)
+{
+    FILE *file = fopen(path, "r");
+    char line[MAX_LINE];
+    int regressions = 0;
+    int checked = 0;
+
+    if (file == NULL)
+    {
+        printf("FAILED: no baseline %s, run with --update-baseline to create it\n", path);
+        return 1;
+    }
+
+    while (fgets(line, sizeof(line), file) != NULL)
+    {
+        char name[MAX_NAME];
+        unsigned long long base_mean, base_max;
+        if (line[0] == '#' || sscanf(line, "%47s %llu %llu", name, &base_mean, &base_max) != 3)
+            continue;
+
+        struct metric *metric = NULL;
+        for (int i = 0; i < num_metrics && metric == NULL; i++)
+        {
+            if (strcmp(metrics[i].name, name) == 0)
+                metric = &metrics[i];
+        }
+        if (metric == NULL)
+        {
+            printf("WARNING: %s of the baseline was not measured\n", name);
+            continue;
+        }
+
+        checked++;
+        double mean = (double)metric->sum / metric->count;
+        double limit = 1.0 + threshold / 100.0;
+        if (mean > base_mean * limit || metric->max > base_max * limit)
+        {
+            printf("REGRESSION: %-32s mean %.0f (baseline %llu), max %llu (baseline %llu)\n",
+                   name, mean, base_mean, (unsigned long long)metric->max, base_max);
+            regressions++;
+        }
+    }
+    fclose(file);
+
+    // an empty baseline would pass every firmware
+    if (checked == 0)
+    {
+        printf("FAILED: baseline %s is empty, run with --update-baseline to fill it\n", path);
+        return 1;
+    }
+    printf("%i metrics checked against %s (threshold %.1f %%), %i regressions\n", checked, path, threshold, regressions);
+    return regressions;
+}
+
+static int write_baseline(const char *path)
+{
+    FILE *file = fopen(path, "w");
+
+    if (file == NULL)
+    {
+        fprintf(stderr, "Could not write baseline %s\n", path);
+        return -1;
+    }
+    fprintf(file, "# Cycle baseline of tools/simavr/perf_harness (generated with --update-baseline)\n");
+    fprintf(file, "# <metric> <mean cycles> <max cycles> (stack:<name>: bytes)\n");
+    for (int i = 0; i < num_metrics; i++)
+        fprintf(file, "%s %llu %llu\n", metrics[i].name,
+                (unsigned long long)(metrics[i].sum / metrics[i].count), (unsigned long long)metrics[i].max);
+    fclose(file);
+    printf("Baseline written to %s\n", path);
+    return 0;
+}
+
+/*========================================================================*/
+/*                          MAIN                                          */
+/*========================================================================*/
+
+int main(int argc, char **argv)
+{
+    double threshold = DEFAULT_THRESHOLD;
+    const char *baseline = DEFAULT_BASELINE;
+    int update_baseline = 0;
+    const char *firmware_path = NULL;
+    const char *script_path = NULL;
+    elf_firmware_t firmware;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+            threshold = atof(argv[++i]);
+        else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc)
+            baseline = argv[++i];
+        else if (strcmp(argv[i], "--update-baseline") == 0)
+            update_baseline = 1;
+        else if (firmware_path == NULL)
+            firmware_path = argv[i];
+        else if (script_path == NULL)
+            script_path = argv[i];
+    }
+    if (firmware_path == NULL || script_path == NULL)
+    {
+        fprintf(stderr, "Usage: %s [-t <threshold %%>] [-b <baseline>] [--update-baseline] <firmware.elf> <script>\n", argv[0]);
+        return 2;
+    }
+
+    /* load the firmware (the Arduino ELF has no mmcu section) */
+    memset(&firmware, 0, sizeof(firmware));
+    if (elf_read_firmware(firmware_path, &firmware) != 0)
+    {
+        fprintf(stderr, "Could not read firmware %s\n", firmware_path);
+        return 2;
+    }
+    strcpy(firmware.mmcu, "atmega2560");
+    firmware.frequency = F_CPU;
+
+    avr = avr_make_mcu_by_name(firmware.mmcu);
+    if (avr == NULL)
+        return 2;
+    avr_init(avr);
+    avr_load_firmware(avr, &firmware);
+
+    /* markers + simulated devices */
+    avr_register_io_write(avr, ADDR_GPIOR0, gpior0_write, NULL);
+    avr_register_io_write(avr, ADDR_GPIOR1, gpior1_write, NULL);
+    avr_register_io_write(avr, ADDR_GPIOR2, gpior2_write, NULL);
+    uart_attach(&uart0, '0', uart0_output);
+    uart_attach(&uart2, '2', uart2_output);
+
+    if (run_script(script_path) != 0)
+        return 2;
+
+    /* report */
+    printf("%-32s %8s %10s %10s %10s %10s\n", "path", "count", "min", "mean", "max", "max[us]");
+    for (int i = 0; i < num_metrics; i++)
+    {
+        struct metric *metric = &metrics[i];
+        // stack depth: bytes, no time
+        double max_us = strncmp(metric->name, "stack:", 6) == 0 ? 0.0 : metric->max * 1e6 / F_CPU;
+        printf("%-32s %8u %10llu %10llu %10llu %10.1f\n", metric->name, metric->count,
+               (unsigned long long)metric->min, (unsigned long long)(metric->sum / metric->count),
+               (unsigned long long)metric->max, max_us);
+    }
+
+    if (update_baseline)
+        return write_baseline(baseline) == 0 ? 0 : 2;
+    return check_baseline(baseline, threshold) == 0 ? 0 : 1;
+}
@@ -0,0 +1,9 @@
+#!/bin/bash
+
+# build the firmware with performance markers + the harness => replay the request script in simavr
+# arguments are passed to the harness (e.g. -t 10 or --update-baseline)
+
+cd "$(dirname "$0")/../.." || exit 2
+platformio run -e perf || exit 2
+make -C tools/simavr || exit 2
+./tools/simavr/perf_harness "$@" .pio/build/perf/firmware.elf tools/simavr/requests.script
@@ -0,0 +1,258 @@
+/**************************************************************************/
+/*!
+    @file     trace_to_chrome.cpp
+
+    Converts a dump of the trace buffer (src/trace.h) into the Chrome trace
+    event format (JSON), which can be opened in chrome://tracing or in
+    Perfetto (https://ui.perfetto.dev).
+
+    The dump file contains the payloads of all TRACE_DUMP chunks in order,
+    as stored by McuDriver.dump_trace() of examples/simple_gateway.py.
+
+    Usage: trace_to_chrome <dump file> [<json file>]   (default: stdout)
+
+    Timeline:
+        - thread "main": driver functions (action/event/init) as slices,
+          decoded requests and sent responses as instant events
+        - thread "isr": ISRs as slices
+    A slice without end at the end of the trace is reported on stderr:
+    the firmware was still inside this function when the dump started.
+*/
+/**************************************************************************/
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+/*========================================================================*/
+/*                          PRIVATE DEFINITIONS                           */
+/*========================================================================*/
+
+/* Dump layout: see src/trace.h */
+#define TRACE_DUMP_VERSION 1
+
+#define TRACE_EVENT_TIME 0
+#define TRACE_EVENT_REQUEST 1
+#define TRACE_EVENT_DRIVER_ENTER 2
+#define TRACE_EVENT_DRIVER_EXIT 3
+#define TRACE_EVENT_ISR_ENTER 4
+#define TRACE_EVENT_ISR_EXIT 5
+#define TRACE_EVENT_RESPONSE 6
+
+#define TRACE_DRIVER_ACTION 0x0100
+#define TRACE_DRIVER_EVENT 0x0200
+#define TRACE_DRIVER_INIT 0x0300
+
+/* Request ids (src/perf_markers.h) */
+#define PERF_REQUEST_REGISTRATION 0x40
+#define PERF_REQUEST_INVALID 0x7F
+
+/* Thread ids in the timeline */
+#define TID_MAIN 1
+#define TID_ISR 2
+
+struct Record
+{
+    uint32_t delta_us;
+    uint8_t event;
+    uint8_t profile_id;
+    uint32_t arg;
+};
+
+// reader of the packed values (7-bit groups, LSB first, msb used as flag)
+struct Reader
+{
+    const std::vector<uint8_t> &data;
+    size_t pos;
+
+    bool take(uint8_t num_bytes, uint32_t *value)
+    {
+        if (pos + num_bytes > data.size())
+            return false;
+        *value = 0;
+        for (uint8_t i = 0; i < num_bytes; i++)
+            *value |= (uint32_t)(data[pos + i] & 0x7F) << (7 * i);
+        pos += num_bytes;
+        return true;
+    }
+};
+
+/**
+    @brief  Reads all chunks of a dump
+    @return false if the dump is invalid
+*/
+bool read_dump(const std::vector<uint8_t> &data, std::vector<Record> *records, uint32_t *written);
+
+/**
+    @brief  Name of a slice/instant event of a record
+*/
+std::string record_name(const Record &record);
+
+/*========================================================================*/
+/*                          MAIN                                          */
+/*========================================================================*/
+
+int main(int argc, char **argv)
+{
+    if (argc < 2 || argc > 3)
+    {
+        fprintf(stderr, "Usage: %s <dump file> [<json file>]\n", argv[0]);
+        return 2;
+    }
+
+    FILE *in = fopen(argv[1], "rb");
+    if (in == NULL)
+    {
+        perror(argv[1]);
+        return 1;
+    }
+    std::vector<uint8_t> data;
+    int c;
+    while ((c = fgetc(in)) != EOF)
+        data.push_back((uint8_t)c);
+    fclose(in);
+
+    std::vector<Record> records;
+    uint32_t written = 0;
+    if (!read_dump(data, &records, &written))
+    {
+        fprintf(stderr, "%s: invalid trace dump\n", argv[1]);
+        return 1;
+    }
+
+    FILE *out = (argc == 3) ? fopen(argv[2], "w") : stdout;
+    if (out == NULL)
+    {
+        perror(argv[2]);
+        return 1;
+    }
+
+    /* events */
+    fprintf(out, "{\"traceEvents\":[\n");
+    fprintf(out, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"main\"}},\n", TID_MAIN);
+    fprintf(out, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"isr\"}}", TID_ISR);
+
+    // the first record has no predecessor in the dump => timeline starts at 0
+    uint64_t time_us = 0;
+    std::vector<std::string> open_slices[TID_ISR + 1];
+    for (size_t i = 0; i < records.size(); i++)
+    {
+        const Record &record = records[i];
+        if (i > 0)
+            time_us += record.delta_us;
+        if (record.event == TRACE_EVENT_TIME)
+        {
+            if (i > 0)
+                time_us += (uint64_t)record.arg << 16;
+            continue;
+        }
+
+        std::string name = record_name(record);
+        int tid = (record.event == TRACE_EVENT_ISR_ENTER || record.event == TRACE_EVENT_ISR_EXIT) ? TID_ISR : TID_MAIN;
+        const char *phase;
+        switch (record.event)
+        {
+        case TRACE_EVENT_DRIVER_ENTER:
+        case TRACE_EVENT_ISR_ENTER:
+            phase = "B";
+            open_slices[tid].push_back(name);
+            break;
+        case TRACE_EVENT_DRIVER_EXIT:
+        case TRACE_EVENT_ISR_EXIT:
+            // begin of the slice was overwritten in the ring
+            if (open_slices[tid].empty())
+                continue;
+            phase = "E";
+            open_slices[tid].pop_back();
+            break;
+        default:
+            phase = "i";
+            break;
+        }
+        fprintf(out, ",\n{\"name\":\"%s\",\"ph\":\"%s\",\"ts\":%llu,\"pid\":1,\"tid\":%d%s,\"args\":{\"profile_id\":%u}}",
+                name.c_str(), phase, (unsigned long long)time_us, tid, phase[0] == 'i' ? ",\"s\":\"t\"" : "", record.profile_id);
+    }
+    fprintf(out, "\n]}\n");
+    if (out != stdout)
+        fclose(out);
+
+    /* summary */
+    fprintf(stderr, "%zu records (%u written, %u lost), %.3f ms\n", records.size(), written,
+            written - (uint32_t)records.size(), time_us / 1000.0);
+    for (int tid = TID_MAIN; tid <= TID_ISR; tid++)
+    {
+        for (size_t i = 0; i < open_slices[tid].size(); i++)
+            fprintf(stderr, "not finished at the end of the trace: %s\n", open_slices[tid][i].c_str());
+    }
+    return 0;
+}
+
+/*========================================================================*/
+/*                          PRIVATE FUNCTIONS                             */
+/*========================================================================*/
+
+bool read_dump(const std::vector<uint8_t> &data, std::vector<Record> *records, uint32_t *written)
+{
+    Reader reader = {data, 0};
+
+    while (reader.pos < data.size())
+    {
+        uint32_t version, chunk, num_chunks, num_records;
+        if (!reader.take(1, &version) || version != TRACE_DUMP_VERSION ||
+            !reader.take(3, &chunk) || !reader.take(3, &num_chunks) ||
+            !reader.take(1, &num_records) || !reader.take(5, written))
+            return false;
+
+        for (uint32_t i = 0; i < num_records; i++)
+        {
+            Record record;
+            uint32_t event, profile_id;
+            if (!reader.take(3, &record.delta_us) || !reader.take(1, &event) ||
+                !reader.take(2, &profile_id) || !reader.take(3, &record.arg))
+                return false;
+            record.event = (uint8_t)event;
+            record.profile_id = (uint8_t)profile_id;
+            records->push_back(record);
+        }
+    }
+    return true;
+}
+
+std::string record_name(const Record &record)
+{
+    static const char *const response_codes[] = {"DEBUG", "ERROR", "ACK", "DATA", "PROGRESS"};
+    char name[64];
+
+    switch (record.event)
+    {
+    case TRACE_EVENT_REQUEST:
+        if (record.arg == PERF_REQUEST_INVALID)
+            snprintf(name, sizeof(name), "request invalid");
+        else
+            snprintf(name, sizeof(name), "request %s driver %u",
+                     (record.arg & PERF_REQUEST_REGISTRATION) ? "registration" : "action",
+                     record.arg & ~PERF_REQUEST_REGISTRATION);
+        break;
+    case TRACE_EVENT_DRIVER_ENTER:
+    case TRACE_EVENT_DRIVER_EXIT:
+        snprintf(name, sizeof(name), "%s driver %u",
+                 (record.arg & 0xFF00) == TRACE_DRIVER_EVENT  ? "event"
+                 : (record.arg & 0xFF00) == TRACE_DRIVER_INIT ? "init"
+                                                              : "action",
+                 record.arg & 0xFF);
+        break;
+    case TRACE_EVENT_ISR_ENTER:
+    case TRACE_EVENT_ISR_EXIT:
+        snprintf(name, sizeof(name), "isr %u", record.arg);
+        break;
+    case TRACE_EVENT_RESPONSE:
+        snprintf(name, sizeof(name), "response %s", record.arg < 5 ? response_codes[record.arg] : "?");
+        break;
+    default:
+        snprintf(name, sizeof(name), "event %u", record.event);
+        break;
+    }
+    return name;
+}
@@ -0,0 +1,16 @@
+#!/bin/bash
+
+# build the virtual controller => start it on a pseudo-terminal => then run the gateway against it
+# arguments are passed to the virtual controller (e.g. --baud 115200 --latency 1000 --toggle 50)
+
+cd "$(dirname "$0")/../.." || exit 2
+LINK=/tmp/ttyUCTRL
+
+platformio run -e native_pty || exit 2
+.pio/build/native_pty/program --link $LINK --eeprom .pio/build/native_pty/eeprom.bin "$@" &
+CONTROLLER=$!
+trap "kill $CONTROLLER" EXIT
+
+# wait for the link of the pseudo-terminal
+while [ ! -e $LINK ]; do sleep 0.1; done
+python ./examples/simple_gateway.py $LINK
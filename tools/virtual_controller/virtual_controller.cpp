@@ -0,0 +1,437 @@
+/**************************************************************************/
+/*!
+    @file     virtual_controller.cpp
+
+    Virtual controller (env:native_pty): runs the native firmware in realtime
+    and exposes Serial on a pseudo-terminal, so the unchanged gateway
+    (examples/simple_gateway.py) can connect to it like to the Mega.
+
+    Simulated parts:
+        - serial link to the gateway: baudrate (max. byte rate) + latency of each direction
+        - uArm on Serial2/Serial3: answers every G-code line with "ok" after a delay
+        - ultrasonic sensor: echo of an object at a fixed distance on every pin
+        - TCS34725 color sensor: fixed raw color values
+        - step motor: timer4 ISR (simulated by the HAL)
+        - digital inputs: optionally toggled periodically (event storms)
+        - EEPROM: optionally loaded from/stored in a file (registrations survive a restart)
+        - watchdog: a reset restarts the program with the same pseudo-terminal + EEPROM
+
+    Usage: .pio/build/native_pty/program [options]
+        --link <path>        symlink to the pseudo-terminal (e.g. /tmp/ttyUCTRL)
+        --baud <baud>        simulated baudrate of the gateway link (default: Serial.begin(), 0 = unlimited)
+        --latency <us>       latency of each direction of the gateway link (default: 0)
+        --uarm-delay <ms>    response time of the uArm (default: 10)
+        --distance <cm>      distance measured by the ultrasonic sensor (default: 100)
+        --color <r,g,b>      raw values of the color sensor (default: 20000,12000,4000)
+        --toggle <ms>        toggle all digital inputs every <ms> (default: 0 = off)
+        --eeprom <file>      load/store the EEPROM content
+        (--restart <pty fd>,<eeprom fd>,<MCUSR>: used internally after a watchdog reset)
+*/
+/**************************************************************************/
+#include <hal.h>
+#include <EEPROM.h>
+
+#include <deque>
+#include <vector>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <termios.h>
+#include <unistd.h>
+
+/*========================================================================*/
+/*                          PRIVATE DEFINITIONS                           */
+/*========================================================================*/
+
+/* Defaults */
+#define DEFAULT_UARM_DELAY_MS 10
+#define DEFAULT_DISTANCE_CM 100
+// max. bytes waiting for the pseudo-terminal (older bytes are dropped without a gateway)
+#define MAX_TX_BACKLOG 65536
+// min. time between two EEPROM file updates [ms]
+#define EEPROM_SAVE_INTERVAL_MS 1000
+
+// echo time of the ultrasonic sensor per cm (sound travels the distance twice) [us]
+#define ULTRASONIC_US_PER_CM 58
+
+// byte on a simulated serial link: available at the receiver at due_us
+struct TimedByte
+{
+    uint64_t due_us;
+    uint8_t value;
+};
+
+// one direction of a simulated serial link
+struct Line
+{
+    std::deque<TimedByte> bytes;
+    // end of the last scheduled byte [us]
+    uint64_t busy_until;
+};
+
+// state kept over a watchdog reset (file descriptors are inherited by the restarted program)
+struct Restart
+{
+    int pty;
+    int eeprom;
+    unsigned mcusr;
+};
+
+struct Options
+{
+    const char *link;
+    long baud;
+    uint32_t latency_us;
+    uint32_t uarm_delay_ms;
+    uint32_t distance_cm;
+    uint16_t color[3];
+    uint32_t toggle_ms;
+    const char *eeprom;
+    Restart restart;
+};
+
+static Options options = {NULL, -1, 0, DEFAULT_UARM_DELAY_MS, DEFAULT_DISTANCE_CM, {20000, 12000, 4000}, 0, NULL, {-1, -1, 0}};
+static char **program_argv = NULL;
+
+static int pty = -1;
+static volatile sig_atomic_t stop = 0;
+
+/* Gateway link (Serial) */
+static Line gateway_rx; // pty => firmware
+static Line gateway_tx; // firmware => pty
+
+/* uArm links (Serial2, Serial3) */
+static Line uarm_rx[HAL_NUM_SERIAL];
+
+/* Digital inputs + EEPROM */
+static uint64_t last_toggle_us = 0;
+static uint32_t saved_eeprom_writes = 0;
+static uint64_t last_save_us = 0;
+
+/**
+    @brief  Schedules bytes on a line: not before earliest_us, one byte every 10 bit times
+*/
+void schedule(Line *line, const uint8_t *data, size_t length, uint64_t earliest_us, unsigned long baud);
+
+/**
+    @brief  Exchanges the bytes between the pseudo-terminal and the simulated devices (HAL poll function)
+*/
+void poll_devices(void);
+
+/**
+    @brief  Simulated uArm: answers each line with "ok"
+*/
+void uarm_responder(uint8_t port, uint8_t value);
+
+/**
+    @brief  Opens the pseudo-terminal in raw mode
+    @return false on failure
+*/
+bool open_pty(void);
+
+/**
+    @brief  Loads/stores the EEPROM file
+*/
+void load_eeprom(void);
+void save_eeprom(void);
+
+/**
+    @brief  Watchdog reset (HAL reset handler): restarts the program, keeps the pseudo-terminal + EEPROM
+*/
+void watchdog_reset(void);
+
+bool parse_options(int argc, char **argv);
+
+void on_signal(int signal)
+{
+    stop = 1;
+}
+
+/*========================================================================*/
+/*                          MAIN                                          */
+/*========================================================================*/
+
+int main(int argc, char **argv)
+{
+    program_argv = argv;
+    if (!parse_options(argc, argv))
+    {
+        fprintf(stderr, "Usage: %s [--link <path>] [--baud <baud>] [--latency <us>] [--uarm-delay <ms>] "
+                        "[--distance <cm>] [--color <r,g,b>] [--toggle <ms>] [--eeprom <file>]\n",
+                argv[0]);
+        return 2;
+    }
+    if (!open_pty())
+        return 1;
+
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+
+    /* simulated devices */
+    for (uint8_t pin = 0; pin < NUM_DIGITAL_PINS; pin++)
+        hal_set_pulse(pin, options.distance_cm * ULTRASONIC_US_PER_CM);
+    hal_set_color(true, options.color[0], options.color[1], options.color[2]);
+    hal_serial_set_responder(2, uarm_responder);
+    hal_serial_set_responder(3, uarm_responder);
+    load_eeprom();
+    MCUSR = (options.restart.pty >= 0) ? options.restart.mcusr : _BV(PORF);
+
+    hal_set_realtime(true);
+    hal_set_poll(poll_devices);
+    hal_set_reset_handler(watchdog_reset);
+
+    /* firmware */
+    setup();
+    while (!stop)
+        loop();
+
+    save_eeprom();
+    if (options.link != NULL)
+        unlink(options.link);
+    close(pty);
+    return 0;
+}
+
+/*========================================================================*/
+/*                          PRIVATE FUNCTIONS                             */
+/*========================================================================*/
+
+void schedule(Line *line, const uint8_t *data, size_t length, uint64_t earliest_us, unsigned long baud)
+{
+    // start bit + 8 data bits + stop bit
+    uint64_t byte_us = (baud > 0) ? 10000000ULL / baud : 0;
+
+    for (size_t i = 0; i < length; i++)
+    {
+        uint64_t start = (line->busy_until > earliest_us) ? line->busy_until : earliest_us;
+        line->busy_until = start + byte_us;
+        line->bytes.push_back({line->busy_until, data[i]});
+    }
+}
+
+void poll_devices(void)
+{
+    uint64_t now = hal_time_us();
+    unsigned long baud = (options.baud >= 0) ? (unsigned long)options.baud : hal_serial_stats(0).baud;
+    uint8_t buffer[256];
+    ssize_t length;
+
+    /* gateway => firmware */
+    while ((length = read(pty, buffer, sizeof(buffer))) > 0)
+        schedule(&gateway_rx, buffer, length, now + options.latency_us, baud);
+    while (!gateway_rx.bytes.empty() && gateway_rx.bytes.front().due_us <= now)
+    {
+        hal_serial_feed(0, &gateway_rx.bytes.front().value, 1);
+        gateway_rx.bytes.pop_front();
+    }
+
+    /* firmware => gateway */
+    while ((length = hal_serial_take(0, buffer, sizeof(buffer))) > 0)
+        schedule(&gateway_tx, buffer, length, now + options.latency_us, baud);
+    while (!gateway_tx.bytes.empty() && gateway_tx.bytes.front().due_us <= now)
+    {
+        // no gateway connected: keep the bytes until the pty accepts them again
+        if (write(pty, &gateway_tx.bytes.front().value, 1) != 1)
+            break;
+        gateway_tx.bytes.pop_front();
+    }
+    while (gateway_tx.bytes.size() > MAX_TX_BACKLOG)
+        gateway_tx.bytes.pop_front();
+
+    /* uArm => firmware */
+    for (uint8_t port = 2; port < HAL_NUM_SERIAL; port++)
+    {
+        hal_serial_take(port, buffer, sizeof(buffer)); // commands were handled by the responder
+        while (!uarm_rx[port].bytes.empty() && uarm_rx[port].bytes.front().due_us <= now)
+        {
+            hal_serial_feed(port, &uarm_rx[port].bytes.front().value, 1);
+            uarm_rx[port].bytes.pop_front();
+        }
+    }
+
+    /* toggle digital inputs */
+    if (options.toggle_ms > 0 && now - last_toggle_us >= options.toggle_ms * 1000ULL)
+    {
+        last_toggle_us = now;
+        for (uint8_t pin = 0; pin < NUM_DIGITAL_PINS; pin++)
+        {
+            if (hal_get_pin_mode(pin) != OUTPUT)
+                hal_set_pin(pin, !hal_get_pin(pin));
+        }
+    }
+
+    /* store changed EEPROM content */
+    if (hal_eeprom_writes() != saved_eeprom_writes && now - last_save_us >= EEPROM_SAVE_INTERVAL_MS * 1000ULL)
+    {
+        last_save_us = now;
+        save_eeprom();
+    }
+}
+
+void uarm_responder(uint8_t port, uint8_t value)
+{
+    static const uint8_t response[] = {'o', 'k', '\n'};
+
+    if (value == '\n')
+        schedule(&uarm_rx[port], response, sizeof(response),
+                 hal_time_us() + options.uarm_delay_ms * 1000ULL, hal_serial_stats(port).baud);
+}
+
+bool open_pty(void)
+{
+    struct termios tio;
+
+    // restarted after a watchdog reset: the gateway is still connected to the same pseudo-terminal
+    if (options.restart.pty >= 0)
+    {
+        pty = options.restart.pty;
+        printf("Virtual controller restarted (watchdog reset) on %s\n", ptsname(pty));
+        fflush(stdout);
+        return true;
+    }
+
+    pty = posix_openpt(O_RDWR | O_NOCTTY);
+    if (pty < 0 || grantpt(pty) != 0 || unlockpt(pty) != 0)
+    {
+        perror("Could not open pseudo-terminal");
+        return false;
+    }
+    fcntl(pty, F_SETFL, fcntl(pty, F_GETFL) | O_NONBLOCK);
+
+    // raw bytes: the protocol uses 0 as frame terminator
+    tcgetattr(pty, &tio);
+    cfmakeraw(&tio);
+    tcsetattr(pty, TCSANOW, &tio);
+
+    const char *name = ptsname(pty);
+    if (options.link != NULL)
+    {
+        unlink(options.link);
+        if (symlink(name, options.link) != 0)
+        {
+            perror("Could not create link");
+            return false;
+        }
+    }
+    printf("Virtual controller on %s%s%s\n", name, options.link != NULL ? " => " : "", options.link != NULL ? options.link : "");
+    fflush(stdout);
+    return true;
+}
+
+void load_eeprom(void)
+{
+    // EEPROM content before the watchdog reset
+    if (options.restart.eeprom >= 0)
+    {
+        if (pread(options.restart.eeprom, hal_eeprom(), EEPROM_SIZE, 0) != EEPROM_SIZE)
+            fprintf(stderr, "EEPROM content was lost during the restart\n");
+        close(options.restart.eeprom);
+        saved_eeprom_writes = hal_eeprom_writes();
+        return;
+    }
+    if (options.eeprom == NULL)
+        return;
+
+    FILE *file = fopen(options.eeprom, "rb");
+    if (file == NULL)
+        return; // first start: erased EEPROM
+    if (fread(hal_eeprom(), 1, EEPROM_SIZE, file) != EEPROM_SIZE)
+        fprintf(stderr, "EEPROM file %s is incomplete\n", options.eeprom);
+    fclose(file);
+}
+
+void save_eeprom(void)
+{
+    if (options.eeprom == NULL)
+        return;
+
+    FILE *file = fopen(options.eeprom, "wb");
+    if (file == NULL)
+    {
+        perror("Could not store EEPROM");
+        return;
+    }
+    fwrite(hal_eeprom(), 1, EEPROM_SIZE, file);
+    fclose(file);
+    saved_eeprom_writes = hal_eeprom_writes();
+}
+
+void watchdog_reset(void)
+{
+    char restart[64];
+    std::vector<char *> args;
+
+    save_eeprom();
+    // EEPROM content for the restarted program: unnamed temporary file
+    FILE *eeprom = tmpfile();
+    if (eeprom == NULL || fwrite(hal_eeprom(), 1, EEPROM_SIZE, eeprom) != EEPROM_SIZE || fflush(eeprom) != 0)
+    {
+        perror("Could not keep the EEPROM content");
+        exit(1);
+    }
+    snprintf(restart, sizeof(restart), "%d,%d,%u", pty, fileno(eeprom), (unsigned)MCUSR);
+
+    // same options, without the restart state of a previous reset
+    for (int i = 0; program_argv[i] != NULL; i++)
+    {
+        if (strcmp(program_argv[i], "--restart") == 0 && program_argv[i + 1] != NULL)
+        {
+            i++;
+            continue;
+        }
+        args.push_back(program_argv[i]);
+    }
+    args.push_back((char *)"--restart");
+    args.push_back(restart);
+    args.push_back(NULL);
+
+    printf("Watchdog reset: restarting the firmware\n");
+    fflush(stdout);
+    execv("/proc/self/exe", args.data());
+    perror("Could not restart");
+    exit(1);
+}
+
+bool parse_options(int argc, char **argv)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        const char *value = (i + 1 < argc) ? argv[i + 1] : NULL;
+        if (value == NULL)
+            return false;
+
+        if (strcmp(argv[i], "--link") == 0)
+            options.link = value;
+        else if (strcmp(argv[i], "--baud") == 0)
+            options.baud = atol(value);
+        else if (strcmp(argv[i], "--latency") == 0)
+            options.latency_us = (uint32_t)atol(value);
+        else if (strcmp(argv[i], "--uarm-delay") == 0)
+            options.uarm_delay_ms = (uint32_t)atol(value);
+        else if (strcmp(argv[i], "--distance") == 0)
+            options.distance_cm = (uint32_t)atol(value);
+        else if (strcmp(argv[i], "--toggle") == 0)
+            options.toggle_ms = (uint32_t)atol(value);
+        else if (strcmp(argv[i], "--eeprom") == 0)
+            options.eeprom = value;
+        else if (strcmp(argv[i], "--restart") == 0)
+        {
+            if (sscanf(value, "%d,%d,%u", &options.restart.pty, &options.restart.eeprom, &options.restart.mcusr) != 3)
+                return false;
+        }
+        else if (strcmp(argv[i], "--color") == 0)
+        {
+            unsigned r, g, b;
+            if (sscanf(value, "%u,%u,%u", &r, &g, &b) != 3)
+                return false;
+            options.color[0] = r;
+            options.color[1] = g;
+            options.color[2] = b;
+        }
+        else
+            return false;
+        i++;
+    }
+    return true;
+}